@@ -1,23 +1,87 @@
 #ifndef AES_DRIVER_H
 #define AES_DRIVER_H
 
+#include <linux/completion.h>
+#include <linux/debugfs.h>
 #include <linux/device.h>
+#include <linux/dma-mapping.h>
 #include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/idr.h>
 #include <linux/interrupt.h>
 #include <linux/io.h>
+#include <linux/jhash.h>
+#include <linux/kref.h>
+#include <linux/list.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/of.h>
 #include <linux/of_address.h>
 #include <linux/platform_device.h>
 #include <linux/printk.h>
 #include <linux/regmap.h>
+#include <linux/rwsem.h>
+#include <linux/scatterlist.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
 #include <linux/sysfs.h>
+#include <linux/uaccess.h>
+#include <linux/unaligned.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+#include <crypto/aes.h>
+#include <crypto/gcm.h>
+#include <crypto/internal/aead.h>
+#include <crypto/internal/hash.h>
+#include <crypto/internal/skcipher.h>
+#include <crypto/scatterwalk.h>
+#include <crypto/xts.h>
+
+#include "aes_ioctl.h"
 
 #define DRIVER_NAME "AES"
 
 #define SYSFS_BUFFER_LEN 10
 
+/* Request queue */
+#define AES_KEY_BATCH_MAX 8       // jobs run back to back on a resident key
+#define AES_POLL_TIMEOUT_US 1000  // per operation, the longest takes 7 cycles
+#define AES_KEY_SLOTS_MAX 64      // largest key table the gateware supports
+
+/* Descriptor ring */
+#define AES_RING_ENTRIES 64       // descriptors, a power of two up to 2^15
+
+/* Completion interrupt, defaults of the sysfs tunables */
+#define AES_CLK_MHZ 100                // S_AXI_ACLK, to convert IRQ_TIME
+#define AES_IRQ_COALESCE_COUNT 16      // ring completions per interrupt
+#define AES_IRQ_COALESCE_USECS 20      // longest wait after the first of them
+#define AES_IRQ_POLL_THRESHOLD 4       // batches of this many jobs poll HEAD
+
+/* Zero copy, default of the sysfs tunable */
+#define AES_ZERO_COPY_MIN 4096 // bytes from which the ring uses user pages
+#define AES_BUF_POOL_MAX (64 * 1024 * 1024) // DMA buffer pool bytes of all
+                                            // of an instance's handles
+
+/* Scheduling: default of the chunk_size sysfs tunable, and the relative
+ * deadline of each class under EDF */
+#define AES_CHUNK_SIZE (16 * 1024)      // bytes a long job runs at a time
+#define AES_DEADLINE_HIGH_US 1000       // AES_PRIO_HIGH
+#define AES_DEADLINE_NORMAL_US 100000   // AES_PRIO_NORMAL
+
+/* Device pool */
+#define AES_POOL_NAME "aes"             // /dev/aes dispatches across instances
+#define AES_AFFINITY_BUCKETS 64         // key hash buckets remembering a home
+#define AES_AFFINITY_SLACK_BLOCKS 32    // extra load a key's home may carry
+
+/* Crypto API */
+#define AES_CRA_PRIORITY 300 // above the generic and table-based software code
+#define AES_CRYPTO_MAX_LEN (64 * 1024) // larger requests use the fallback
+
 /* Macros for read-only and read-write attributes */
 #define DEVICE_ATTR_RW(_name)                                                  \
   struct device_attribute dev_attr_##_name = __ATTR_RW(_name)
@@ -54,19 +118,109 @@
 #define key_reg6_RST 0x0000
 #define key_reg7 0x0034
 #define key_reg7_RST 0x0000
+#define key_slot_reg 0x0038
+#define key_slot_reg_RST 0x0000
+#define key_slot_ctrl_reg 0x003C
+#define key_slots_reg 0x0040
+#define mode_reg 0x0044
+#define mode_reg_RST 0x0000
 #define done_reg 0x0048
 #define comp_state_reg 0x004C
 #define ciphertext_reg0 0x0050
 #define ciphertext_reg1 0x0054
 #define ciphertext_reg2 0x0058
 #define ciphertext_reg3 0x005C
+#define perf_ctrl_reg 0x0060
+#define caps_reg 0x0064
+#define banks_reg 0x0068
+#define aad_len_reg 0x006C
+#define text_len_reg 0x0070
+#define ks_ctrl_reg 0x0074
+#define ks_status_reg 0x0078
+#define byte_order_reg 0x007C
+#define perf_total_cycles_lo 0x0080
+#define perf_total_cycles_hi 0x0084
+#define perf_busy_cycles_lo 0x0088
+#define perf_busy_cycles_hi 0x008C
+#define perf_blocks_lo 0x0090
+#define perf_blocks_hi 0x0094
+#define perf_axi_wr_beats_lo 0x0098
+#define perf_axi_wr_beats_hi 0x009C
+#define perf_axi_rd_beats_lo 0x00A0
+#define perf_axi_rd_beats_hi 0x00A4
+#define perf_finished_wait_lo 0x00A8
+#define perf_finished_wait_hi 0x00AC
+#define iv_reg0 0x00B0
+#define iv_reg3 0x00BC
+#define tag_reg0 0x00C0
+#define tag_reg3 0x00CC
+#define ring_base_reg 0x00D0
+#define ring_size_reg 0x00D4
+#define ring_tail_reg 0x00D8
+#define ring_head_reg 0x00DC
+#define ring_ctrl_reg 0x00E0
+#define ring_status_reg 0x00E4
+#define irq_ctrl_reg 0x00E8
+#define irq_count_reg 0x00EC
+#define irq_time_reg 0x00F0
+#define irq_status_reg 0x00F4
+#define ctx_index_reg 0x00F8
+#define ctx_data_reg 0x00FC
+/* Data windows of the AXI4 burst slave (CAPS_WINDOW_BIT), byte offsets from
+ * the register base. Each moves its registers in one burst. */
+#define key_window 0x0100  // key_reg0-7
+#define iv_window 0x0120   // iv_reg0-3
+#define data_window 0x0130 // writes plaintext_reg0-3, reads ciphertext_reg0-3
+#define window_end 0x0140
 
 /* Bitfields */
 #define AES_ENABLE_BIT BIT(0)
+#define AES_ENABLE_AUTO_BIT BIT(1)
+#define AES_ENABLE_BANKS_BIT BIT(2)
 #define AES_KEY_CHOICE_MASK GENMASK(1, 0)
 #define AES_KEY_CHOICE_BIT_OFFSET 0
 #define DONE_BIT BIT(0)
 #define COMP_STATE_MASK GENMASK(1, 0)
 #define COMP_STATE_BIT_OFFSET 0
+#define COMP_STATE_IDLE 0
+#define COMP_STATE_BUSY 1
+#define COMP_STATE_FINISHED 2
+#define KEY_SLOT_MASK GENMASK(5, 0)
+#define KEY_SLOT_EN_BIT BIT(8)
+#define KEY_SLOT_STORE_BIT BIT(0)
+#define MODE_DECRYPT_BIT BIT(3)
+#define MODE_OP_BLOCK (0 << 4)
+#define MODE_OP_AAD (1 << 4)
+#define MODE_OP_INIT (2 << 4)
+#define MODE_OP_FINAL (3 << 4)
+#define MODE_BYTES_BIT_OFFSET 8
+#define CAPS_DECRYPT_BIT BIT(16)
+#define CAPS_DOORBELL_BIT BIT(17)
+#define CAPS_BANKS_BIT BIT(18)
+#define CAPS_RING_BIT BIT(19)
+#define CAPS_IRQ_BIT BIT(20)
+#define CAPS_WINDOW_BIT BIT(21)
+#define CAPS_KS_BIT BIT(22)
+#define CAPS_CTX_BIT BIT(23)
+#define CAPS_BYTE_ORDER_BIT BIT(24)
+#define BYTE_ORDER_LE_BIT BIT(0)
+#define RING_CTRL_RUN_BIT BIT(0)
+#define RING_STATUS_BUSY_BIT BIT(0)
+#define RING_STATUS_ERROR_BIT BIT(1)
+#define RING_DESC_MORE_BIT BIT(4)
+#define RING_DESC_KEY_PTR_BIT BIT(5)
+#define RING_DESC_KEY_CHOICE_OFFSET 6
+#define RING_DESC_KEY_SLOT_OFFSET 8
+#define RING_DESC_DONE_BIT BIT(31)
+#define RING_DESC_ERR_MASK GENMASK(7, 0)
+#define IRQ_CTRL_EN_BIT BIT(0)
+#define IRQ_COUNT_MAX 0xFFFF
+#define IRQ_STATUS_PENDING_BIT BIT(0)
+#define KS_CTRL_EN_BIT BIT(0)
+#define KS_CTRL_FLUSH_BIT BIT(1)
+#define KS_STATUS_FILL_MASK GENMASK(15, 0)
+#define CTX_WORDS 8
+#define PERF_SNAPSHOT_BIT BIT(0)
+#define PERF_CLEAR_BIT BIT(1)
 
 #endif // AES_DRIVER_H
@@ -0,0 +1,231 @@
+#ifndef AES_IOCTL_H
+#define AES_IOCTL_H
+
+/* Interface between the AES character device and user space. This header is
+ * shared by the driver and by the user library, so it only uses the exported
+ * kernel types. */
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define AES_BLOCK_LEN 16
+#define AES_JOB_MAX_LEN (16 * 1024 * 1024) // bytes per job
+
+/* Key choice values, as written to aes_key_choice_reg */
+#define AES_KEY_CHOICE_128 0
+#define AES_KEY_CHOICE_192 1
+#define AES_KEY_CHOICE_256 2
+
+/* Block cipher modes, as written to the MODE register */
+#define AES_MODE_ECB 0
+#define AES_MODE_CTR 1 // 128-bit big-endian counter, any length
+#define AES_MODE_GCM 2 // 96-bit IV, 128-bit tag, any length
+#define AES_MODE_XTS 3 // IEEE 1619 with a 128-bit tweak, whole blocks
+#define AES_MODE_CMAC 4 // RFC 4493 MAC over the input, any length
+
+/* aes_job flags */
+#define AES_JOB_DECRYPT (1u << 0)
+#define AES_JOB_MORE (1u << 1) // CMAC: the message continues in a later job
+#define AES_JOB_PRIO_HIGH (1u << 2) // any mode: queue in AES_PRIO_HIGH,
+                                    // whatever the handle's class
+
+#define AES_GCM_IV_LEN 12
+#define AES_GCM_TAG_LEN 16
+#define AES_CMAC_TAG_LEN 16
+
+/* One job. The driver loads the key (unless it is already resident),
+ * processes `len` bytes from `src` into `dst` and returns only when every
+ * block has been processed, so a job is never interleaved with another
+ * client's register writes. A GCM decryption whose tag does not match fails
+ * with EBADMSG and leaves `dst` untouched.
+ *
+ * An XTS job covers one or more data units (sectors) of `data_unit` bytes,
+ * or one unit of `len` bytes when `data_unit` is zero. `iv` is the tweak of
+ * the first unit as a 128-bit little-endian number and is incremented for
+ * each following unit, as dm-crypt's plain64 IVs are. ECB and XTS jobs may
+ * set AES_JOB_DECRYPT when the device has the inverse cipher.
+ *
+ * A CMAC job reads `len` bytes from `src`, writes nothing to `dst` and
+ * writes the MAC to `tag`. A long message is split over jobs: each job but
+ * the last sets AES_JOB_MORE, covers whole blocks and receives the chaining
+ * value in `tag`, which the next job passes in `iv` (zero for the first).
+ *
+ * Any job may set AES_JOB_PRIO_HIGH; see AES_IOC_SET_PRIO. */
+struct aes_job {
+  __u32 key_choice; // AES_KEY_CHOICE_*
+  __u32 len;        // bytes up to AES_JOB_MAX_LEN: ECB a non-zero multiple of
+                    // AES_BLOCK_LEN, CTR non-zero, GCM any, XTS a
+                    // non-zero multiple of data_unit and of AES_BLOCK_LEN,
+                    // CMAC any (a multiple of AES_BLOCK_LEN with MORE)
+  __u32 key[8];     // key register words, unused words zero
+  __u64 src;        // user pointer to the input
+  __u64 dst;        // user pointer to the output, may equal src
+  __u32 mode;       // AES_MODE_*
+  __u32 flags;      // AES_JOB_*
+  __u8 iv[16];      // CTR: initial counter block. GCM: AES_GCM_IV_LEN bytes.
+                    // XTS: tweak of the first data unit. CMAC: chaining
+                    // value, zero for a new message
+  __u64 aad;        // GCM: user pointer to the additional data
+  __u32 aad_len;    // GCM: bytes, up to AES_JOB_MAX_LEN
+  __u32 data_unit;  // XTS: bytes per data unit, a non-zero multiple of
+                    // AES_BLOCK_LEN, or zero. Other modes: zero
+  __u64 tag;        // GCM: user pointer to the tag, written on encryption
+                    // and checked on decryption. CMAC: user pointer to the
+                    // MAC, or the chaining value with AES_JOB_MORE
+  __u32 key2[8];    // XTS: tweak key register words, same key_choice
+};
+
+/*
+ * Asynchronous submission on a handle of one instance. AES_IOC_URING_SETUP
+ * creates a submission queue (SQ) and a completion queue (CQ) of `entries`
+ * each, which user space maps with mmap() at offset 0: struct aes_uring_hdr,
+ * then the SQ entries at sq_off and the CQ entries at cq_off.
+ *
+ * User space fills SQ entries and publishes them by advancing sq_tail;
+ * AES_IOC_URING_ENTER hands up to `to_submit` of them to the driver, which
+ * advances sq_head as it takes them, and then waits until `min_complete` CQ
+ * entries are ready. Completions are posted in the order jobs finish, one CQ
+ * entry per job, by advancing cq_tail; user space consumes them by advancing
+ * cq_head. The driver never takes more SQ entries than the CQ has room for.
+ *
+ * Each index has a single writer: store it with release semantics after the
+ * entries it covers, and load the other side's with acquire semantics.
+ * Indices run freely and wrap at 2^32; an entry lives at index % entries.
+ * Completions are moved to the CQ by AES_IOC_URING_ENTER, so a caller woken
+ * by poll() enters with to_submit zero to collect them. A job's buffers
+ * must stay valid until its completion has been posted.
+ */
+#define AES_URING_MAX_ENTRIES 4096
+
+struct aes_uring_params {
+  __u32 entries; // in: a power of two up to AES_URING_MAX_ENTRIES
+  __u32 flags;   // in: zero
+  __u32 sq_off;  // out: offset of the SQ entries in the mapping
+  __u32 cq_off;  // out: offset of the CQ entries in the mapping
+  __u32 size;    // out: bytes to map
+  __u32 pad;
+};
+
+/* Start of the mapping, each index on a cache line of its own */
+struct aes_uring_hdr {
+  __u32 sq_head; // written by the driver
+  __u32 pad0[15];
+  __u32 sq_tail; // written by user space
+  __u32 pad1[15];
+  __u32 cq_head; // written by user space
+  __u32 pad2[15];
+  __u32 cq_tail; // written by the driver
+  __u32 pad3[15];
+};
+
+struct aes_uring_sqe {
+  struct aes_job job;
+  __u64 user_data; // returned in the job's CQ entry
+};
+
+struct aes_uring_cqe {
+  __u64 user_data;
+  __s32 res; // 0, or a negative errno as AES_IOC_CRYPT would return
+  __u32 pad;
+};
+
+struct aes_uring_enter {
+  __u32 to_submit;    // SQ entries to take, at most those published
+  __u32 min_complete; // CQ entries to wait for, counting unconsumed ones
+};
+
+/*
+ * A batch of small independent messages in one call, on a handle of one
+ * instance. Each message names its key by index into the batch's key table
+ * and is ECB or CTR. The driver groups the messages by key, so each key is
+ * loaded once per batch, and runs consecutive ECB messages of a key, or CTR
+ * messages whose counters follow on from each other, as one job. Messages
+ * complete individually: `status` is written back for each, and a malformed
+ * message fails alone. The call itself fails only when the batch cannot be
+ * read or exceeds the limits below.
+ */
+#define AES_BATCH_MAX_MSGS 1024
+#define AES_BATCH_MAX_KEYS 256
+#define AES_BATCH_MAX_LEN (64 * 1024) // bytes, each message rounded up to
+                                      // whole blocks
+
+struct aes_key {
+  __u32 key_choice; // AES_KEY_CHOICE_*
+  __u32 key[8];     // key register words, unused words zero
+};
+
+struct aes_msg {
+  __u32 key;    // index into the batch's keys
+  __u32 mode;   // AES_MODE_ECB or AES_MODE_CTR
+  __u32 flags;  // ECB: AES_JOB_DECRYPT. CTR: zero
+  __u32 len;    // bytes: ECB a non-zero multiple of AES_BLOCK_LEN, CTR
+                // non-zero
+  __u8 iv[16];  // CTR: initial counter block
+  __u64 src;    // user pointer to the input
+  __u64 dst;    // user pointer to the output, may equal src
+  __s32 status; // out: 0, or a negative errno as AES_IOC_CRYPT would return
+  __u32 pad;
+};
+
+struct aes_batch {
+  __u64 keys;  // user pointer to nkeys struct aes_key
+  __u64 msgs;  // user pointer to count struct aes_msg
+  __u32 nkeys; // 1 to AES_BATCH_MAX_KEYS
+  __u32 count; // 1 to AES_BATCH_MAX_MSGS
+};
+
+/*
+ * Scheduling. A handle's jobs queue in its class, AES_PRIO_NORMAL unless set
+ * with AES_IOC_SET_PRIO, or in AES_PRIO_HIGH with AES_JOB_PRIO_HIGH. The
+ * driver takes jobs of the high class first, round robin over handles within
+ * a class. Jobs longer than the instance's chunk_size run in chunks of about
+ * that many bytes, and the driver looks for waiting jobs between chunks, so
+ * a small high-priority job waits for at most one chunk of a bulk one. XTS
+ * jobs chunk by data unit, and run whole without one. GCM and CMAC save the
+ * engine's state with the job between chunks, and run on the registers once
+ * split; GCM runs whole on gateware without the context window (CAPS bit
+ * 23).
+ *
+ * With the instance's sched_edf set the classes only set default deadlines:
+ * each job is due deadline_us after it was submitted, or the class default
+ * when that is zero, and the driver takes the job due first.
+ */
+#define AES_PRIO_HIGH 0
+#define AES_PRIO_NORMAL 1
+#define AES_PRIO_CLASSES 2
+
+struct aes_prio {
+  __u32 prio;        // AES_PRIO_*
+  __u32 deadline_us; // EDF: relative deadline of each job, 0 for the class
+                     // default
+};
+
+/*
+ * DMA buffer pool of a handle of one instance. AES_IOC_BUF_SETUP allocates
+ * `size` bytes that the engine reaches without pinning or mapping, coherent
+ * with the CPU, which user space maps once with mmap() at offset
+ * AES_BUF_MMAP_OFFSET. An ECB or CTR job whose src and dst both lie in that
+ * mapping runs on the ring straight from it, at any length and in a single
+ * descriptor; other jobs on it are copied as from any memory. The pool is
+ * freed with the handle.
+ */
+#define AES_BUF_MMAP_OFFSET 0x40000000       // page-aligned, fits a 32-bit off_t
+#define AES_BUF_MAX_SIZE (64 * 1024 * 1024) // bytes per handle
+
+struct aes_buf_params {
+  __u32 size;  // in: bytes, a non-zero multiple of the page size up to
+               // AES_BUF_MAX_SIZE
+  __u32 flags; // in: zero
+};
+
+#define AES_IOC_MAGIC 'a'
+#define AES_IOC_CRYPT _IOW(AES_IOC_MAGIC, 1, struct aes_job)
+#define AES_IOC_URING_SETUP _IOWR(AES_IOC_MAGIC, 2, struct aes_uring_params)
+/* Returns the number of SQ entries taken */
+#define AES_IOC_URING_ENTER _IOW(AES_IOC_MAGIC, 3, struct aes_uring_enter)
+#define AES_IOC_BATCH _IOW(AES_IOC_MAGIC, 4, struct aes_batch)
+/* Applies to jobs submitted afterwards */
+#define AES_IOC_SET_PRIO _IOW(AES_IOC_MAGIC, 5, struct aes_prio)
+#define AES_IOC_BUF_SETUP _IOW(AES_IOC_MAGIC, 6, struct aes_buf_params)
+
+#endif // AES_IOCTL_H
@@ -22,8 +22,219 @@ struct pixxel_AES_config {
   const struct regmap_config *reg_map_config;
 };
 
+/* One entry of the gateware key table, as last stored by the driver */
+struct AES_key_slot {
+  bool valid;
+  u32 key_choice;
+  u32 key[8];
+  u64 last_used;
+};
+
+/* Ring descriptor, as the gateware reads it: see AES_ring.v. Addresses are
+ * bus addresses, the key, IV and tag words as the registers hold them. */
+struct AES_ring_desc {
+  __le32 ctrl; // AES_MODE_*, MODE_DECRYPT_BIT and RING_DESC_*
+  __le32 key_addr;
+  __le32 aad_addr;
+  __le32 src;
+  __le32 dst;
+  __le32 aad_len;
+  __le32 len;
+  __le32 iv[4];
+  __le32 status; // written back: RING_DESC_DONE_BIT and an error code
+  __le32 tag[4]; // written back for GCM and CMAC
+};
+
 struct pixxel_AES_dev {
-  unsigned int dummy;
+  struct device *dev;
+  int id;                     // stable instance index, /dev/aes<id>
+  struct list_head pool_node; // on AES_pool
+  atomic_t load;              // blocks submitted and not yet returned
+  wait_queue_head_t idle_wq;  // woken when load drops to zero
+  /* probe()'s reference, dropped by remove(), and one per open handle: the
+   * last one frees the instance */
+  struct kref ref;
+  struct rw_semaphore remove_lock; // ioctls read; remove() sets dead
+  bool dead; // removed: open handles fail all but close
+  struct regmap *regmap;
+  struct dentry *debugfs_dir;
+  struct miscdevice misc;
+
+  /* Serialises every register access: queued jobs and sysfs attributes */
+  struct mutex hw_lock;
+  /* Key currently loaded in the key registers, valid under hw_lock */
+  bool key_valid;
+  u32 key_choice;
+  u32 key[8];
+  unsigned int key_batch; // jobs run on the resident key since it was loaded
+
+  /* Key slot table, under hw_lock. When the gateware has slots, the resident
+   * key above is the one in the selected slot. */
+  unsigned int num_key_slots; // 0 on gateware without a key table
+  bool key_slot_selected;     // core uses a slot rather than the key regs
+  u64 key_slot_clock;         // LRU timestamp source
+  struct AES_key_slot key_slots[AES_KEY_SLOTS_MAX];
+
+  u32 caps; // BIT(AES_MODE_*) for each mode the gateware implements, and
+            // feature bits from CAPS_DECRYPT_BIT
+  u32 mode; // last value written to the MODE register, under hw_lock
+  bool doorbell;    // gateware has the doorbell (CAPS_DOORBELL_BIT)
+  bool banks;       // gateware has data banks (CAPS_BANKS_BIT)
+  bool doorbell_on; // ENABLE_AUTO is set, under hw_lock
+  /* Key and data registers hold little-endian words (BYTE_ORDER set, on
+   * gateware with CAPS_BYTE_ORDER_BIT); else the original packing, in FIPS
+   * order from the top byte of the highest word in use */
+  bool le_words;
+  /* Register base when the gateware has the data windows (CAPS_WINDOW_BIT)
+   * and the mapping covers them, else NULL: the key, IV and data words then
+   * move with memcpy_toio() and memcpy_fromio(), a burst each */
+  void __iomem *window;
+
+  /* Descriptor ring (CAPS_RING_BIT), under hw_lock. Entry i of the coherent
+   * buffer holds the descriptor of ring_jobs[i] and the key it points at. */
+  bool ring;
+  struct AES_ring_desc *ring_desc;
+  __le32 (*ring_keys)[8];
+  dma_addr_t ring_dma;
+  u32 ring_head; // first descriptor not yet reaped
+  u32 ring_tail; // next descriptor to fill; HEAD and TAIL run free
+  u64 ring_key_clock; // key_slot_clock when the last batch ended: slots used
+                      // since are referenced by posted descriptors
+  struct AES_job *ring_jobs[AES_RING_ENTRIES];
+
+  /* Completion interrupt (CAPS_IRQ_BIT). A batch of at least
+   * irq_poll_threshold jobs polls HEAD with the interrupt off, like NAPI
+   * under load; smaller batches sleep until the coalesced interrupt. */
+  int irq;                   // 0 without one: the ring is always polled
+  wait_queue_head_t ring_wq; // woken from the interrupt handler
+  bool ring_irq;             // set by the handler, cleared before HEAD reads
+  bool ring_polling;         // IRQ_CTRL is off, under hw_lock
+  u32 irq_count;             // last value written to IRQ_COUNT, under hw_lock
+  unsigned int irq_coalesce_count; // sysfs tunables, under hw_lock
+  unsigned int irq_coalesce_usecs;
+  unsigned int irq_poll_threshold;
+
+  /* Request queue: per class, clients with pending jobs of that class,
+   * served round robin */
+  spinlock_t queue_lock;
+  struct list_head clients[AES_PRIO_CLASSES];
+  struct workqueue_struct *wq;
+  struct work_struct work;
+
+  /* Queue statistics, exported in debugfs */
+  u64 stat_jobs;
+  u64 stat_blocks;
+  u64 stat_key_loads;
+  u64 stat_key_slot_hits;
+  u64 stat_ring_jobs;
+  u64 stat_irqs;
+  u64 stat_poll_switches; // changes between polling and interrupts
+  u64 stat_zero_copy_jobs;
+  u64 stat_pool_jobs; // zero-copy jobs run from a handle's buffer pool
+  u64 stat_chunks; // chunks of long jobs run before their last
+
+  /* Requests of at least zero_copy_min bytes that the ring can run from the
+   * user's pages skip the bounce buffer; 0 copies all. A sysfs tunable. */
+  unsigned int zero_copy_min;
+  atomic_t buf_pool_bytes; // of the handles' pools, up to AES_BUF_POOL_MAX
+  /* Scheduling tunables in sysfs: bytes a long job runs before the queue is
+   * looked at again, 0 for whole jobs, and earliest deadline first */
+  unsigned int chunk_size;
+  bool sched_edf;
+};
+
+/* Submission and completion queues a handle shares with user space */
+struct AES_uring {
+  void *mem; // struct aes_uring_hdr, then the SQ and CQ entries
+  size_t size;
+  u32 entries;
+  struct aes_uring_hdr *hdr;
+  struct aes_uring_sqe *sqes;
+  struct aes_uring_cqe *cqes;
+  u32 sq_head, cq_tail; // the driver's own copies of its indices
+  struct mutex lock;    // serialises AES_IOC_URING_ENTER
+  unsigned int inflight; // jobs taken from the SQ and not yet posted
+  spinlock_t done_lock;
+  struct list_head done; // finished jobs for the CQ
+  unsigned int running;  // jobs on the instance's queue, under done_lock
+  wait_queue_head_t wq;
+};
+
+/* DMA buffer pool of a handle, mapped once into its address space */
+struct AES_bufpool {
+  void *cpu;
+  dma_addr_t dma;
+  size_t size;
+  unsigned long uaddr; // start of the user mapping, 0 until mmap()
+};
+
+/* One open file handle on the character device */
+struct AES_client {
+  struct pixxel_AES_dev *AES_dev;
+  struct list_head node[AES_PRIO_CLASSES]; // on AES_dev->clients[] while
+                                           // jobs of the class are queued
+  struct list_head jobs[AES_PRIO_CLASSES];
+  u32 prio;                // AES_PRIO_* of jobs without AES_JOB_PRIO_HIGH
+  u32 deadline_us;         // EDF: relative deadline, 0 for the class's
+  struct AES_uring *uring; // set once by AES_IOC_URING_SETUP
+  struct AES_bufpool *bufs; // set once by AES_IOC_BUF_SETUP
+};
+
+struct AES_job {
+  struct list_head node;
+  struct AES_client *client;
+  u32 key_choice;
+  u32 key[8];
+  u32 key2[8]; // XTS: tweak key
+  u32 mode;  // AES_MODE_*
+  u32 flags; // AES_JOB_*
+  u8 iv[16];
+  u32 data_unit; // XTS: bytes per tweak, 0 for the whole job
+  u32 aad_len;
+  u32 len;
+  u8 *buf; // aad_len bytes of additional data, then len bytes processed in
+           // place; NULL for a zero-copy job
+  u32 prio;     // AES_PRIO_*, set on submission
+  u64 deadline; // EDF: ktime_get_ns() when due
+  u32 offset;   // bytes of text run by earlier chunks
+  u8 ctx[4 * CTX_WORDS]; // GCM: engine context between chunks
+  dma_addr_t dma; // buf, while its descriptors are on the ring
+  /* Zero copy (ECB and CTR on the ring): the user's pages, pinned and mapped
+   * for the engine. dst_sgt is src_sgt for an in-place request. */
+  struct sg_table *src_sgt;
+  struct sg_table *dst_sgt;
+  struct scatterlist *src_sg, *dst_sg; // where the next chunk starts
+  u32 src_off, dst_off;
+  unsigned int ring_descs; // descriptors on the ring and not yet reaped
+  bool ring_posted;        // all of the job's descriptors have been posted
+  bool pooled;             // zero copy from the handle's buffer pool
+  u8 tag[AES_GCM_TAG_LEN]; // GCM: tag computed by the hardware. CMAC: MAC,
+                           // or chaining value with AES_JOB_MORE
+  int status;
+  /* Called from the queue worker when set, otherwise done is completed */
+  void (*complete)(struct AES_job *job);
+  struct completion done;
+};
+
+/* User memory pinned and mapped for a zero-copy job, or a stretch of the
+ * handle's buffer pool in the single entry sg */
+struct AES_user_buf {
+  struct sg_table sgt;
+  struct scatterlist sg;
+  struct page **pages; // NULL for the buffer pool
+  int npages;
+  enum dma_data_direction dir;
+};
+
+/* A request from user space, through AES_IOC_CRYPT or the submission queue */
+struct AES_user_job {
+  struct AES_job job;
+  struct aes_job req;
+  struct AES_user_buf src, dst; // zero copy: the user's pages
+  u8 tag[AES_GCM_TAG_LEN];       // GCM decryption: the expected tag
+  u64 user_data;                 // submission queue: returned with the result
+  unsigned int blocks;           // submission queue: load on the instance
+  struct list_head node;         // submission queue: on the done list
 };
 
 static const struct regmap_range AES_wr_range[] = {
@@ -41,6 +252,15 @@ static const struct regmap_range AES_wr_range[] = {
     {.range_min = key_reg5, .range_max = key_reg5},
     {.range_min = key_reg6, .range_max = key_reg6},
     {.range_min = key_reg7, .range_max = key_reg7},
+    {.range_min = key_slot_reg, .range_max = key_slot_ctrl_reg},
+    {.range_min = mode_reg, .range_max = mode_reg},
+    {.range_min = perf_ctrl_reg, .range_max = perf_ctrl_reg},
+    {.range_min = aad_len_reg, .range_max = ks_ctrl_reg},
+    {.range_min = byte_order_reg, .range_max = byte_order_reg},
+    {.range_min = iv_reg0, .range_max = iv_reg3},
+    {.range_min = ring_base_reg, .range_max = ring_tail_reg},
+    {.range_min = ring_ctrl_reg, .range_max = ring_ctrl_reg},
+    {.range_min = irq_ctrl_reg, .range_max = ctx_data_reg},
 
 };
 
@@ -60,12 +280,22 @@ static const struct regmap_range AES_rd_range[] = {
     {.range_min = key_reg5, .range_max = key_reg5},
     {.range_min = key_reg6, .range_max = key_reg6},
     {.range_min = key_reg7, .range_max = key_reg7},
+    {.range_min = key_slot_reg, .range_max = key_slot_reg},
+    {.range_min = key_slots_reg, .range_max = mode_reg},
     {.range_min = done_reg, .range_max = done_reg},
     {.range_min = comp_state_reg, .range_max = comp_state_reg},
     {.range_min = ciphertext_reg0, .range_max = ciphertext_reg0},
     {.range_min = ciphertext_reg1, .range_max = ciphertext_reg1},
     {.range_min = ciphertext_reg2, .range_max = ciphertext_reg2},
     {.range_min = ciphertext_reg3, .range_max = ciphertext_reg3},
+    {.range_min = caps_reg, .range_max = banks_reg},
+    {.range_min = aad_len_reg, .range_max = byte_order_reg},
+    {.range_min = perf_total_cycles_lo, .range_max = ctx_data_reg},
+};
+
+/* Reading CTX_DATA moves CTX_INDEX on: keep register dumps off it */
+static const struct regmap_range AES_precious_range[] = {
+    {.range_min = ctx_data_reg, .range_max = ctx_data_reg},
 };
 
 static const struct regmap_access_table AES_wr_table = {
@@ -78,6 +308,11 @@ static const struct regmap_access_table AES_rd_table = {
     .n_yes_ranges = ARRAY_SIZE(AES_rd_range),
 };
 
+static const struct regmap_access_table AES_precious_table = {
+    .yes_ranges = AES_precious_range,
+    .n_yes_ranges = ARRAY_SIZE(AES_precious_range),
+};
+
 static const struct regmap_config AES_regmap_config = {
     .reg_bits = 32,
     .val_bits = 32,
@@ -85,6 +320,7 @@ static const struct regmap_config AES_regmap_config = {
     .cache_type = REGCACHE_NONE,
     .wr_table = &AES_wr_table,
     .rd_table = &AES_rd_table,
+    .precious_table = &AES_precious_table,
 };
 
 static const struct pixxel_AES_config AES_config = {
@@ -102,12 +338,28 @@ static struct of_device_id AES_of_match_ids[] = {
 
 MODULE_DEVICE_TABLE(of, AES_of_match_ids);
 
+static int AES_deselect_key_slot(struct pixxel_AES_dev *AES_dev);
+static int AES_set_mode(struct pixxel_AES_dev *AES_dev, u32 mode);
+static int AES_set_doorbell(struct pixxel_AES_dev *AES_dev, bool on);
+static unsigned int AES_job_blocks(u32 aad_len, u32 len);
+static void AES_uring_free(struct AES_client *client);
+static void AES_bufpool_free(struct AES_client *client);
+
+/* All probed instances. /dev/aes and the crypto API submit each job to one of
+ * them; the lock is taken from softirq context by crypto requests. */
+static LIST_HEAD(AES_pool);
+static DEFINE_SPINLOCK(AES_pool_lock);
+static DEFINE_IDA(AES_ida);
+/* Instance a key hash was last sent to, or -1; under AES_pool_lock */
+static int AES_affinity[AES_AFFINITY_BUCKETS];
+
 /*--------------------------------------------------------- SYSFS ATTRIBUTES
  * ---------------------------------------------------------*/
 
 static ssize_t aes_enable_show(struct device *dev,
                                struct device_attribute *attr, char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -116,7 +368,9 @@ static ssize_t aes_enable_show(struct device *dev,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, enable_reg, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read enable_reg.\n");
     return ret;
@@ -129,6 +383,7 @@ static ssize_t aes_enable_store(struct device *dev,
                                 struct device_attribute *attr, const char *buf,
                                 size_t count) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int data;
   int ret;
 
@@ -142,8 +397,18 @@ static ssize_t aes_enable_store(struct device *dev,
     return -EIO;
   }
 
-  ret = regmap_update_bits(AES_regmap, enable_reg, AES_ENABLE_BIT,
-                           data ? AES_ENABLE_BIT : 0);
+  mutex_lock(&AES_dev->hw_lock);
+  /* A block started from sysfs is an ECB block on the key registers, run
+   * with explicit enable writes */
+  ret = AES_set_doorbell(AES_dev, false);
+  if (!ret && data)
+    ret = AES_deselect_key_slot(AES_dev);
+  if (!ret && data)
+    ret = AES_set_mode(AES_dev, AES_MODE_ECB);
+  if (!ret)
+    ret = regmap_update_bits(AES_regmap, enable_reg, AES_ENABLE_BIT,
+                             data ? AES_ENABLE_BIT : 0);
+  mutex_unlock(&AES_dev->hw_lock);
 
   if (ret) {
     dev_err(dev, "AES: Failed to write to aes_enable.\n");
@@ -157,6 +422,7 @@ static ssize_t aes_enable_store(struct device *dev,
 static ssize_t aes_key_choice_show(struct device *dev,
                                    struct device_attribute *attr, char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -165,7 +431,9 @@ static ssize_t aes_key_choice_show(struct device *dev,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, aes_key_choice_reg, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read aes_key_choice_reg.\n");
     return ret;
@@ -179,6 +447,7 @@ static ssize_t aes_key_choice_store(struct device *dev,
                                     struct device_attribute *attr,
                                     const char *buf, size_t count) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int data;
   int ret;
 
@@ -194,8 +463,11 @@ static ssize_t aes_key_choice_store(struct device *dev,
 
   data = (data >> AES_KEY_CHOICE_BIT_OFFSET);
   data &= AES_KEY_CHOICE_MASK;
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_update_bits(AES_regmap, aes_key_choice_reg, AES_KEY_CHOICE_MASK,
                            data);
+  AES_dev->key_valid = false;
+  mutex_unlock(&AES_dev->hw_lock);
 
   if (ret) {
     dev_err(dev, "AES: Failed to write to aes_key_choice.\n");
@@ -209,6 +481,7 @@ static ssize_t aes_key_choice_store(struct device *dev,
 static ssize_t plain_text0_show(struct device *dev,
                                 struct device_attribute *attr, char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -217,7 +490,9 @@ static ssize_t plain_text0_show(struct device *dev,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, plaintext_reg0, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read plaintext_reg0.\n");
     return ret;
@@ -230,6 +505,7 @@ static ssize_t plain_text0_store(struct device *dev,
                                  struct device_attribute *attr, const char *buf,
                                  size_t count) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int data;
   int ret;
 
@@ -243,7 +519,9 @@ static ssize_t plain_text0_store(struct device *dev,
     return -EIO;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_write(AES_regmap, plaintext_reg0, data);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to write to plain_text0.\n");
     return ret;
@@ -256,6 +534,7 @@ static ssize_t plain_text0_store(struct device *dev,
 static ssize_t plain_text1_show(struct device *dev,
                                 struct device_attribute *attr, char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -264,7 +543,9 @@ static ssize_t plain_text1_show(struct device *dev,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, plaintext_reg1, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read plaintext_reg1.\n");
     return ret;
@@ -277,6 +558,7 @@ static ssize_t plain_text1_store(struct device *dev,
                                  struct device_attribute *attr, const char *buf,
                                  size_t count) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int data;
   int ret;
 
@@ -290,7 +572,9 @@ static ssize_t plain_text1_store(struct device *dev,
     return -EIO;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_write(AES_regmap, plaintext_reg1, data);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to write to plain_text1.\n");
     return ret;
@@ -303,6 +587,7 @@ static ssize_t plain_text1_store(struct device *dev,
 static ssize_t plain_text2_show(struct device *dev,
                                 struct device_attribute *attr, char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -311,7 +596,9 @@ static ssize_t plain_text2_show(struct device *dev,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, plaintext_reg2, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read plaintext_reg2.\n");
     return ret;
@@ -324,6 +611,7 @@ static ssize_t plain_text2_store(struct device *dev,
                                  struct device_attribute *attr, const char *buf,
                                  size_t count) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int data;
   int ret;
 
@@ -337,7 +625,9 @@ static ssize_t plain_text2_store(struct device *dev,
     return -EIO;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_write(AES_regmap, plaintext_reg2, data);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to write to plain_text2.\n");
     return ret;
@@ -350,6 +640,7 @@ static ssize_t plain_text2_store(struct device *dev,
 static ssize_t plain_text3_show(struct device *dev,
                                 struct device_attribute *attr, char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -358,7 +649,9 @@ static ssize_t plain_text3_show(struct device *dev,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, plaintext_reg3, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read plaintext_reg3.\n");
     return ret;
@@ -371,6 +664,7 @@ static ssize_t plain_text3_store(struct device *dev,
                                  struct device_attribute *attr, const char *buf,
                                  size_t count) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int data;
   int ret;
 
@@ -384,7 +678,12 @@ static ssize_t plain_text3_store(struct device *dev,
     return -EIO;
   }
 
-  ret = regmap_write(AES_regmap, plaintext_reg3, data);
+  mutex_lock(&AES_dev->hw_lock);
+  /* Not a doorbell: sysfs blocks are started through aes_enable */
+  ret = AES_set_doorbell(AES_dev, false);
+  if (!ret)
+    ret = regmap_write(AES_regmap, plaintext_reg3, data);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to write to plain_text3.\n");
     return ret;
@@ -397,6 +696,7 @@ static ssize_t plain_text3_store(struct device *dev,
 static ssize_t key0_show(struct device *dev, struct device_attribute *attr,
                          char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -405,7 +705,9 @@ static ssize_t key0_show(struct device *dev, struct device_attribute *attr,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, key_reg0, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read key_reg0.\n");
     return ret;
@@ -417,6 +719,7 @@ static ssize_t key0_show(struct device *dev, struct device_attribute *attr,
 static ssize_t key0_store(struct device *dev, struct device_attribute *attr,
                           const char *buf, size_t count) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int data;
   int ret;
 
@@ -430,7 +733,10 @@ static ssize_t key0_store(struct device *dev, struct device_attribute *attr,
     return -EIO;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_write(AES_regmap, key_reg0, data);
+  AES_dev->key_valid = false;
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to write to key0.\n");
     return ret;
@@ -443,6 +749,7 @@ static ssize_t key0_store(struct device *dev, struct device_attribute *attr,
 static ssize_t key1_show(struct device *dev, struct device_attribute *attr,
                          char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -451,7 +758,9 @@ static ssize_t key1_show(struct device *dev, struct device_attribute *attr,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, key_reg1, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read key_reg1.\n");
     return ret;
@@ -463,6 +772,7 @@ static ssize_t key1_show(struct device *dev, struct device_attribute *attr,
 static ssize_t key1_store(struct device *dev, struct device_attribute *attr,
                           const char *buf, size_t count) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int data;
   int ret;
 
@@ -476,7 +786,10 @@ static ssize_t key1_store(struct device *dev, struct device_attribute *attr,
     return -EIO;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_write(AES_regmap, key_reg1, data);
+  AES_dev->key_valid = false;
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to write to key1.\n");
     return ret;
@@ -489,6 +802,7 @@ static ssize_t key1_store(struct device *dev, struct device_attribute *attr,
 static ssize_t key2_show(struct device *dev, struct device_attribute *attr,
                          char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -497,7 +811,9 @@ static ssize_t key2_show(struct device *dev, struct device_attribute *attr,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, key_reg2, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read key_reg2.\n");
     return ret;
@@ -509,6 +825,7 @@ static ssize_t key2_show(struct device *dev, struct device_attribute *attr,
 static ssize_t key2_store(struct device *dev, struct device_attribute *attr,
                           const char *buf, size_t count) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int data;
   int ret;
 
@@ -522,7 +839,10 @@ static ssize_t key2_store(struct device *dev, struct device_attribute *attr,
     return -EIO;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_write(AES_regmap, key_reg2, data);
+  AES_dev->key_valid = false;
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to write to key2.\n");
     return ret;
@@ -535,6 +855,7 @@ static ssize_t key2_store(struct device *dev, struct device_attribute *attr,
 static ssize_t key3_show(struct device *dev, struct device_attribute *attr,
                          char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -543,7 +864,9 @@ static ssize_t key3_show(struct device *dev, struct device_attribute *attr,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, key_reg3, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read key_reg3.\n");
     return ret;
@@ -555,6 +878,7 @@ static ssize_t key3_show(struct device *dev, struct device_attribute *attr,
 static ssize_t key3_store(struct device *dev, struct device_attribute *attr,
                           const char *buf, size_t count) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int data;
   int ret;
 
@@ -568,7 +892,10 @@ static ssize_t key3_store(struct device *dev, struct device_attribute *attr,
     return -EIO;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_write(AES_regmap, key_reg3, data);
+  AES_dev->key_valid = false;
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to write to key3.\n");
     return ret;
@@ -581,6 +908,7 @@ static ssize_t key3_store(struct device *dev, struct device_attribute *attr,
 static ssize_t key4_show(struct device *dev, struct device_attribute *attr,
                          char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -589,7 +917,9 @@ static ssize_t key4_show(struct device *dev, struct device_attribute *attr,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, key_reg4, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read key_reg4.\n");
     return ret;
@@ -601,6 +931,7 @@ static ssize_t key4_show(struct device *dev, struct device_attribute *attr,
 static ssize_t key4_store(struct device *dev, struct device_attribute *attr,
                           const char *buf, size_t count) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int data;
   int ret;
 
@@ -614,7 +945,10 @@ static ssize_t key4_store(struct device *dev, struct device_attribute *attr,
     return -EIO;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_write(AES_regmap, key_reg4, data);
+  AES_dev->key_valid = false;
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to write to key4.\n");
     return ret;
@@ -627,6 +961,7 @@ static ssize_t key4_store(struct device *dev, struct device_attribute *attr,
 static ssize_t key5_show(struct device *dev, struct device_attribute *attr,
                          char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -635,7 +970,9 @@ static ssize_t key5_show(struct device *dev, struct device_attribute *attr,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, key_reg5, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read key_reg5.\n");
     return ret;
@@ -647,6 +984,7 @@ static ssize_t key5_show(struct device *dev, struct device_attribute *attr,
 static ssize_t key5_store(struct device *dev, struct device_attribute *attr,
                           const char *buf, size_t count) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int data;
   int ret;
 
@@ -660,7 +998,10 @@ static ssize_t key5_store(struct device *dev, struct device_attribute *attr,
     return -EIO;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_write(AES_regmap, key_reg5, data);
+  AES_dev->key_valid = false;
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to write to key5.\n");
     return ret;
@@ -673,6 +1014,7 @@ static ssize_t key5_store(struct device *dev, struct device_attribute *attr,
 static ssize_t key6_show(struct device *dev, struct device_attribute *attr,
                          char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -681,7 +1023,9 @@ static ssize_t key6_show(struct device *dev, struct device_attribute *attr,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, key_reg6, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read key_reg6.\n");
     return ret;
@@ -693,6 +1037,7 @@ static ssize_t key6_show(struct device *dev, struct device_attribute *attr,
 static ssize_t key6_store(struct device *dev, struct device_attribute *attr,
                           const char *buf, size_t count) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int data;
   int ret;
 
@@ -706,7 +1051,10 @@ static ssize_t key6_store(struct device *dev, struct device_attribute *attr,
     return -EIO;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_write(AES_regmap, key_reg6, data);
+  AES_dev->key_valid = false;
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to write to key6.\n");
     return ret;
@@ -719,6 +1067,7 @@ static ssize_t key6_store(struct device *dev, struct device_attribute *attr,
 static ssize_t key7_show(struct device *dev, struct device_attribute *attr,
                          char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -727,7 +1076,9 @@ static ssize_t key7_show(struct device *dev, struct device_attribute *attr,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, key_reg7, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read key_reg7.\n");
     return ret;
@@ -739,6 +1090,7 @@ static ssize_t key7_show(struct device *dev, struct device_attribute *attr,
 static ssize_t key7_store(struct device *dev, struct device_attribute *attr,
                           const char *buf, size_t count) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int data;
   int ret;
 
@@ -752,7 +1104,10 @@ static ssize_t key7_store(struct device *dev, struct device_attribute *attr,
     return -EIO;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_write(AES_regmap, key_reg7, data);
+  AES_dev->key_valid = false;
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to write to key7.\n");
     return ret;
@@ -765,6 +1120,7 @@ static ssize_t key7_store(struct device *dev, struct device_attribute *attr,
 static ssize_t done_show(struct device *dev, struct device_attribute *attr,
                          char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -773,7 +1129,9 @@ static ssize_t done_show(struct device *dev, struct device_attribute *attr,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, done_reg, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read done_reg.\n");
     return ret;
@@ -785,6 +1143,7 @@ static ssize_t done_show(struct device *dev, struct device_attribute *attr,
 static ssize_t comp_state_show(struct device *dev,
                                struct device_attribute *attr, char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -793,7 +1152,9 @@ static ssize_t comp_state_show(struct device *dev,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, comp_state_reg, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read comp_state_reg.\n");
     return ret;
@@ -806,6 +1167,7 @@ static ssize_t comp_state_show(struct device *dev,
 static ssize_t cipher_text0_show(struct device *dev,
                                  struct device_attribute *attr, char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -814,7 +1176,9 @@ static ssize_t cipher_text0_show(struct device *dev,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, ciphertext_reg0, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read ciphertext_reg0.\n");
     return ret;
@@ -826,6 +1190,7 @@ static ssize_t cipher_text0_show(struct device *dev,
 static ssize_t cipher_text1_show(struct device *dev,
                                  struct device_attribute *attr, char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -834,7 +1199,9 @@ static ssize_t cipher_text1_show(struct device *dev,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, ciphertext_reg1, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read ciphertext_reg1.\n");
     return ret;
@@ -846,6 +1213,7 @@ static ssize_t cipher_text1_show(struct device *dev,
 static ssize_t cipher_text2_show(struct device *dev,
                                  struct device_attribute *attr, char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -854,7 +1222,9 @@ static ssize_t cipher_text2_show(struct device *dev,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, ciphertext_reg2, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read ciphertext_reg2.\n");
     return ret;
@@ -866,6 +1236,7 @@ static ssize_t cipher_text2_show(struct device *dev,
 static ssize_t cipher_text3_show(struct device *dev,
                                  struct device_attribute *attr, char *buf) {
   struct regmap *AES_regmap = dev_get_regmap(dev, NULL);
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
   unsigned int val;
   int ret;
 
@@ -874,7 +1245,9 @@ static ssize_t cipher_text3_show(struct device *dev,
     return -ENODEV;
   }
 
+  mutex_lock(&AES_dev->hw_lock);
   ret = regmap_read(AES_regmap, ciphertext_reg3, &val);
+  mutex_unlock(&AES_dev->hw_lock);
   if (ret) {
     dev_err(dev, "AES: Failed to read ciphertext_reg3.\n");
     return ret;
@@ -883,6 +1256,167 @@ static ssize_t cipher_text3_show(struct device *dev,
   return scnprintf(buf, PAGE_SIZE, "%u\n", val);
 }
 
+/* Interrupt coalescing tunables. Batches of at least irq_poll_threshold
+ * jobs are polled; 0 polls every batch. Without an interrupt line the ring
+ * is always polled and only the values are kept. */
+static ssize_t irq_coalesce_count_show(struct device *dev,
+                                       struct device_attribute *attr,
+                                       char *buf) {
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
+
+  return scnprintf(buf, PAGE_SIZE, "%u\n",
+                   READ_ONCE(AES_dev->irq_coalesce_count));
+}
+
+static ssize_t irq_coalesce_count_store(struct device *dev,
+                                        struct device_attribute *attr,
+                                        const char *buf, size_t count) {
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
+  unsigned int data;
+
+  if (kstrtouint(buf, SYSFS_BUFFER_LEN, &data) || !data ||
+      data > IRQ_COUNT_MAX) {
+    dev_err(dev, "AES: irq_coalesce_count must be 1 to %u.\n",
+            IRQ_COUNT_MAX);
+    return -EINVAL;
+  }
+
+  /* IRQ_COUNT follows at the next wait */
+  mutex_lock(&AES_dev->hw_lock);
+  AES_dev->irq_coalesce_count = data;
+  mutex_unlock(&AES_dev->hw_lock);
+  return count;
+}
+
+static ssize_t irq_coalesce_usecs_show(struct device *dev,
+                                       struct device_attribute *attr,
+                                       char *buf) {
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
+
+  return scnprintf(buf, PAGE_SIZE, "%u\n",
+                   READ_ONCE(AES_dev->irq_coalesce_usecs));
+}
+
+static ssize_t irq_coalesce_usecs_store(struct device *dev,
+                                        struct device_attribute *attr,
+                                        const char *buf, size_t count) {
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
+  unsigned int data;
+  int ret = 0;
+
+  if (kstrtouint(buf, SYSFS_BUFFER_LEN, &data) ||
+      data > U32_MAX / AES_CLK_MHZ) {
+    dev_err(dev, "AES: Unable to store irq_coalesce_usecs data.\n");
+    return -EINVAL;
+  }
+
+  mutex_lock(&AES_dev->hw_lock);
+  if (AES_dev->irq)
+    ret = regmap_write(AES_dev->regmap, irq_time_reg, data * AES_CLK_MHZ);
+  if (!ret)
+    AES_dev->irq_coalesce_usecs = data;
+  mutex_unlock(&AES_dev->hw_lock);
+  if (ret) {
+    dev_err(dev, "AES: Failed to write to irq_time_reg.\n");
+    return ret;
+  }
+  return count;
+}
+
+static ssize_t irq_poll_threshold_show(struct device *dev,
+                                       struct device_attribute *attr,
+                                       char *buf) {
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
+
+  return scnprintf(buf, PAGE_SIZE, "%u\n",
+                   READ_ONCE(AES_dev->irq_poll_threshold));
+}
+
+static ssize_t irq_poll_threshold_store(struct device *dev,
+                                        struct device_attribute *attr,
+                                        const char *buf, size_t count) {
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
+  unsigned int data;
+
+  if (kstrtouint(buf, SYSFS_BUFFER_LEN, &data)) {
+    dev_err(dev, "AES: Unable to store irq_poll_threshold data.\n");
+    return -EINVAL;
+  }
+
+  mutex_lock(&AES_dev->hw_lock);
+  AES_dev->irq_poll_threshold = data;
+  mutex_unlock(&AES_dev->hw_lock);
+  return count;
+}
+
+static ssize_t zero_copy_min_show(struct device *dev,
+                                  struct device_attribute *attr, char *buf) {
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
+
+  return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(AES_dev->zero_copy_min));
+}
+
+static ssize_t zero_copy_min_store(struct device *dev,
+                                   struct device_attribute *attr,
+                                   const char *buf, size_t count) {
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
+  unsigned int data;
+
+  if (kstrtouint(buf, SYSFS_BUFFER_LEN, &data)) {
+    dev_err(dev, "AES: Unable to store zero_copy_min data.\n");
+    return -EINVAL;
+  }
+
+  WRITE_ONCE(AES_dev->zero_copy_min, data);
+  return count;
+}
+
+/* Scheduling tunables, taken up by the next job the worker picks */
+static ssize_t chunk_size_show(struct device *dev,
+                               struct device_attribute *attr, char *buf) {
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
+
+  return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(AES_dev->chunk_size));
+}
+
+static ssize_t chunk_size_store(struct device *dev,
+                                struct device_attribute *attr,
+                                const char *buf, size_t count) {
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
+  unsigned int data;
+
+  if (kstrtouint(buf, SYSFS_BUFFER_LEN, &data) || data % AES_BLOCK_LEN) {
+    dev_err(dev, "AES: chunk_size must be a multiple of %u.\n",
+            AES_BLOCK_LEN);
+    return -EINVAL;
+  }
+
+  WRITE_ONCE(AES_dev->chunk_size, data);
+  return count;
+}
+
+static ssize_t sched_edf_show(struct device *dev,
+                              struct device_attribute *attr, char *buf) {
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
+
+  return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(AES_dev->sched_edf));
+}
+
+static ssize_t sched_edf_store(struct device *dev,
+                               struct device_attribute *attr,
+                               const char *buf, size_t count) {
+  struct pixxel_AES_dev *AES_dev = dev_get_drvdata(dev);
+  bool data;
+
+  if (kstrtobool(buf, &data)) {
+    dev_err(dev, "AES: Unable to store sched_edf data.\n");
+    return -EINVAL;
+  }
+
+  WRITE_ONCE(AES_dev->sched_edf, data);
+  return count;
+}
+
 DEVICE_ATTR_RW(aes_enable);
 DEVICE_ATTR_RW(aes_key_choice);
 DEVICE_ATTR_RW(plain_text0);
@@ -903,6 +1437,12 @@ DEVICE_ATTR_R(cipher_text0);
 DEVICE_ATTR_R(cipher_text1);
 DEVICE_ATTR_R(cipher_text2);
 DEVICE_ATTR_R(cipher_text3);
+DEVICE_ATTR_RW(irq_coalesce_count);
+DEVICE_ATTR_RW(irq_coalesce_usecs);
+DEVICE_ATTR_RW(irq_poll_threshold);
+DEVICE_ATTR_RW(zero_copy_min);
+DEVICE_ATTR_RW(chunk_size);
+DEVICE_ATTR_RW(sched_edf);
 
 static struct attribute *AES_attrs[] = {&dev_attr_aes_enable.attr,
                                         &dev_attr_aes_key_choice.attr,
@@ -924,83 +1464,3297 @@ static struct attribute *AES_attrs[] = {&dev_attr_aes_enable.attr,
                                         &dev_attr_cipher_text1.attr,
                                         &dev_attr_cipher_text2.attr,
                                         &dev_attr_cipher_text3.attr,
+                                        &dev_attr_irq_coalesce_count.attr,
+                                        &dev_attr_irq_coalesce_usecs.attr,
+                                        &dev_attr_irq_poll_threshold.attr,
+                                        &dev_attr_zero_copy_min.attr,
+                                        &dev_attr_chunk_size.attr,
+                                        &dev_attr_sched_edf.attr,
                                         NULL};
 
 ATTRIBUTE_GROUPS(AES);
 
-/*--------------------------------------------------------- PROBE AND REMOVE
+/*--------------------------------------------------------- REQUEST QUEUE
  * ---------------------------------------------------------*/
 
-static int AES_probe(struct platform_device *pdev) {
-  struct resource *r_mem; /* IO mem resources */
-  void __iomem *base_addr;
-  //struct device_node *node = pdev->dev.of_node; //unused variable
-  const struct of_device_id *match;
-  struct pixxel_AES_config *AES_config;
-  struct regmap *AES_regmap;
-  struct pixxel_AES_dev *AES_dev;
-  dev_info(&pdev->dev, "Probing Device Tree\n");
+static bool AES_key_resident(struct pixxel_AES_dev *AES_dev, u32 key_choice,
+                             const u32 *key) {
+  return AES_dev->key_valid && AES_dev->key_choice == key_choice &&
+         !memcmp(AES_dev->key, key, sizeof(AES_dev->key));
+}
 
-  /* Get the memory resource */
-  r_mem = platform_get_resource(pdev, IORESOURCE_MEM, 0);
-  if (!r_mem) {
-    dev_err(&pdev->dev, "Failed to get memory resource. Invalid address.\n");
-    return -ENODEV;
+static bool AES_job_key_resident(struct pixxel_AES_dev *AES_dev,
+                                 const struct AES_job *job) {
+  return AES_key_resident(AES_dev, job->key_choice, job->key);
+}
+
+/* EDF: the client whose first job of some class is due first, ties going to
+ * the earlier one in round robin order */
+static struct AES_client *AES_pick_edf(struct pixxel_AES_dev *AES_dev,
+                                       u32 *prio) {
+  struct AES_client *client, *pick = NULL;
+  struct AES_job *job;
+  u64 due = U64_MAX;
+  u32 p;
+
+  for (p = 0; p < AES_PRIO_CLASSES; p++) {
+    list_for_each_entry(client, &AES_dev->clients[p], node[p]) {
+      job = list_first_entry(&client->jobs[p], struct AES_job, node);
+      if (job->deadline < due) {
+        pick = client;
+        due = job->deadline;
+        *prio = p;
+      }
+    }
   }
+  return pick;
+}
 
-  /* Map physical memory region to virtual address */
-  base_addr = devm_ioremap_resource(&pdev->dev, r_mem);
-  if (IS_ERR(base_addr)) {
-    dev_err(&pdev->dev, "Failed to map memory region\n");
-    return PTR_ERR(base_addr);
+/*
+ * Pick the next job: from the high class while it has any, or the job due
+ * first under EDF. Within a class clients are served round robin so one file
+ * handle cannot starve the others; within that order a job whose key is
+ * already loaded is preferred, for at most AES_KEY_BATCH_MAX jobs in a row.
+ */
+static struct AES_job *AES_dequeue_job(struct pixxel_AES_dev *AES_dev) {
+  struct AES_client *client, *pick = NULL;
+  struct list_head *clients = NULL;
+  struct AES_job *job;
+  u32 prio;
+
+  lockdep_assert_held(&AES_dev->hw_lock);
+
+  spin_lock_bh(&AES_dev->queue_lock);
+  if (READ_ONCE(AES_dev->sched_edf)) {
+    pick = AES_pick_edf(AES_dev, &prio);
+    if (pick)
+      clients = &AES_dev->clients[prio];
+  } else {
+    for (prio = 0; prio < AES_PRIO_CLASSES; prio++) {
+      if (!list_empty(&AES_dev->clients[prio])) {
+        clients = &AES_dev->clients[prio];
+        break;
+      }
+    }
+  }
+  if (clients && !pick && AES_dev->key_batch < AES_KEY_BATCH_MAX) {
+    list_for_each_entry(client, clients, node[prio]) {
+      job = list_first_entry(&client->jobs[prio], struct AES_job, node);
+      if (AES_job_key_resident(AES_dev, job)) {
+        pick = client;
+        break;
+      }
+    }
+  }
+  if (clients && !pick) {
+    /* Strict round robin, then start a new batch window */
+    pick = list_first_entry(clients, struct AES_client, node[prio]);
+    AES_dev->key_batch = 0;
+  }
+  if (!pick) {
+    spin_unlock_bh(&AES_dev->queue_lock);
+    return NULL;
   }
 
-  /* Setup regmap */
-  match = of_match_node(AES_of_match_ids, pdev->dev.of_node);
-  if (!match) {
-    dev_err(&pdev->dev, "Could not find a matching OF ID\n");
-    return -ENODEV;
+  job = list_first_entry(&pick->jobs[prio], struct AES_job, node);
+  list_del(&job->node);
+  if (list_empty(&pick->jobs[prio]))
+    list_del_init(&pick->node[prio]);
+  else
+    list_move_tail(&pick->node[prio], clients);
+  spin_unlock_bh(&AES_dev->queue_lock);
+  return job;
+}
+
+/* A job with chunks left goes back to the head of its client's queue, and
+ * the client to the back of the round robin if it had left it */
+static void AES_requeue_job(struct pixxel_AES_dev *AES_dev,
+                            struct AES_job *job) {
+  struct AES_client *client = job->client;
+
+  spin_lock_bh(&AES_dev->queue_lock);
+  if (list_empty(&client->jobs[job->prio]))
+    list_add_tail(&client->node[job->prio], &AES_dev->clients[job->prio]);
+  list_add(&job->node, &client->jobs[job->prio]);
+  spin_unlock_bh(&AES_dev->queue_lock);
+}
+
+/*
+ * Bytes of a job to run before the queue is looked at again: all that is
+ * left, or chunk_size of it. XTS chunks are whole data units. A GCM or CMAC
+ * chunk leaves its state in the engine, saved with the job for the next
+ * chunk to restore: the chaining value of CMAC through TAG and IV, GCM's
+ * hash and counter through the context window, without which GCM runs whole.
+ */
+static u32 AES_job_chunk(struct pixxel_AES_dev *AES_dev,
+                         const struct AES_job *job) {
+  u32 left = job->len - job->offset, chunk = READ_ONCE(AES_dev->chunk_size);
+
+  if (!chunk || left <= chunk ||
+      (job->mode == AES_MODE_GCM && !(AES_dev->caps & CAPS_CTX_BIT)) ||
+      (job->mode == AES_MODE_XTS && !job->data_unit))
+    return left;
+  if (job->mode == AES_MODE_XTS)
+    chunk = max(rounddown(chunk, job->data_unit), job->data_unit);
+  return min(chunk, left);
+}
+
+static int AES_deselect_key_slot(struct pixxel_AES_dev *AES_dev) {
+  lockdep_assert_held(&AES_dev->hw_lock);
+
+  if (!AES_dev->key_slot_selected)
+    return 0;
+  AES_dev->key_slot_selected = false;
+  AES_dev->key_valid = false;
+  return regmap_write(AES_dev->regmap, key_slot_reg, 0);
+}
+
+/*
+ * Find the slot holding the job's key, or the least recently used slot to
+ * store it in. Returns the slot index; *hit tells which case it was.
+ */
+static unsigned int AES_key_slot_lookup(struct pixxel_AES_dev *AES_dev,
+                                        u32 key_choice, const u32 *key,
+                                        bool *hit) {
+  struct AES_key_slot *slot;
+  unsigned int i, victim = 0;
+  bool free_found = false;
+
+  for (i = 0; i < AES_dev->num_key_slots; i++) {
+    slot = &AES_dev->key_slots[i];
+    if (!slot->valid) {
+      if (!free_found)
+        victim = i;
+      free_found = true;
+      continue;
+    }
+    if (slot->key_choice == key_choice &&
+        !memcmp(slot->key, key, sizeof(slot->key))) {
+      *hit = true;
+      return i;
+    }
+    if (!free_found &&
+        slot->last_used < AES_dev->key_slots[victim].last_used)
+      victim = i;
   }
-  if (!match->data) {
-    dev_err(&pdev->dev, "Device %s has no data\n", match->name);
-    return -ENODATA;
+  *hit = false;
+  return victim;
+}
+
+/* Key register i for a key held as little-endian words. The original packing
+ * puts the nk key words in registers nk-1 down to 0, each big-endian. */
+static u32 AES_key_reg_word(struct pixxel_AES_dev *AES_dev, u32 key_choice,
+                            const u32 *key, int i) {
+  int nk = 4 + 2 * key_choice;
+
+  if (AES_dev->le_words)
+    return key[i];
+  return i < nk ? swab32(key[nk - 1 - i]) : 0;
+}
+
+static int AES_write_key_regs(struct pixxel_AES_dev *AES_dev, u32 key_choice,
+                              const u32 *key) {
+  __le32 words[ARRAY_SIZE(AES_dev->key)];
+  int i, ret;
+
+  if (AES_dev->window) {
+    for (i = 0; i < ARRAY_SIZE(words); i++)
+      words[i] = cpu_to_le32(key[i]);
+    memcpy_toio(AES_dev->window + key_window, words, sizeof(words));
+    goto out_choice;
   }
-  AES_config = (struct pixxel_AES_config *)match->data;
-  AES_regmap =
-      devm_regmap_init_mmio(&pdev->dev, base_addr, AES_config->reg_map_config);
-  if (IS_ERR(AES_regmap)) {
-    dev_err(&pdev->dev, "Could not initialize regmap");
-    return PTR_ERR(AES_regmap);
+  for (i = 0; i < ARRAY_SIZE(AES_dev->key); i++) {
+    ret = regmap_write(AES_dev->regmap, key_reg0 + 4 * i,
+                       AES_key_reg_word(AES_dev, key_choice, key, i));
+    if (ret)
+      return ret;
   }
+out_choice:
+  return regmap_update_bits(AES_dev->regmap, aes_key_choice_reg,
+                            AES_KEY_CHOICE_MASK, key_choice);
+}
 
-  /* Set device data */
-  AES_dev = devm_kzalloc(&pdev->dev, sizeof(*AES_dev), GFP_KERNEL);
-  platform_set_drvdata(pdev, AES_dev);
+/*
+ * Make a key the one the core uses. With a key table a key already in a
+ * slot costs one register write; otherwise the key is written to the key
+ * registers and, when there are slots, stored over the LRU slot.
+ */
+static int AES_load_key(struct pixxel_AES_dev *AES_dev, u32 key_choice,
+                        const u32 *key) {
+  struct AES_key_slot *slot;
+  unsigned int idx;
+  bool hit;
+  int ret;
 
-  dev_info(&pdev->dev,
-           "AES at physical addr: 0x%llx mapped to virtual address: %p \n",
-           (unsigned long long)r_mem->start, base_addr);
+  if (AES_key_resident(AES_dev, key_choice, key)) {
+    AES_dev->key_batch++;
+    return 0;
+  }
+
+  AES_dev->key_valid = false;
+  if (!AES_dev->num_key_slots) {
+    ret = AES_write_key_regs(AES_dev, key_choice, key);
+    if (ret)
+      return ret;
+    AES_dev->stat_key_loads++;
+    goto out_resident;
+  }
+
+  idx = AES_key_slot_lookup(AES_dev, key_choice, key, &hit);
+  slot = &AES_dev->key_slots[idx];
+  if (!hit) {
+    slot->valid = false;
+    ret = AES_write_key_regs(AES_dev, key_choice, key);
+    if (ret)
+      return ret;
+  }
+  /* Select the slot first: a store writes the selected slot */
+  ret = regmap_write(AES_dev->regmap, key_slot_reg, idx | KEY_SLOT_EN_BIT);
+  if (ret)
+    return ret;
+  AES_dev->key_slot_selected = true;
+  if (!hit) {
+    ret = regmap_write(AES_dev->regmap, key_slot_ctrl_reg, KEY_SLOT_STORE_BIT);
+    if (ret)
+      return ret;
+    slot->key_choice = key_choice;
+    memcpy(slot->key, key, sizeof(slot->key));
+    slot->valid = true;
+    AES_dev->stat_key_loads++;
+  } else {
+    AES_dev->stat_key_slot_hits++;
+  }
+  slot->last_used = ++AES_dev->key_slot_clock;
+
+out_resident:
+  memcpy(AES_dev->key, key, sizeof(AES_dev->key));
+  AES_dev->key_choice = key_choice;
+  AES_dev->key_valid = true;
+  AES_dev->key_batch = 1;
   return 0;
 }
 
-static void AES_remove(struct platform_device *pdev) {
-  dev_set_drvdata(&pdev->dev, NULL);
-  return;
+/* MODE selects the cipher mode and operation of the next enable. It is only
+ * written when it changes, so a run of full blocks costs no extra write. */
+static int AES_set_mode(struct pixxel_AES_dev *AES_dev, u32 mode) {
+  int ret;
+
+  lockdep_assert_held(&AES_dev->hw_lock);
+
+  if (AES_dev->mode == mode)
+    return 0;
+  ret = regmap_write(AES_dev->regmap, mode_reg, mode);
+  if (!ret)
+    AES_dev->mode = mode;
+  return ret;
 }
 
-static struct platform_driver AES_driver = {
-    .driver =
-        {
-            .name = DRIVER_NAME,
-            .owner = THIS_MODULE,
-            .of_match_table = AES_of_match_ids,
-            .dev_groups = AES_groups,
-        },
-    .probe = AES_probe,
-    .remove = AES_remove,
-};
+/* Doorbell mode, with the data banks when the gateware has them, is left on
+ * between jobs and only turned off for the sysfs register interface, whose
+ * users start blocks through aes_enable, and for the descriptor ring. Turning
+ * it off empties the banks. */
+static int AES_set_doorbell(struct pixxel_AES_dev *AES_dev, bool on) {
+  u32 val = AES_ENABLE_AUTO_BIT | (AES_dev->banks ? AES_ENABLE_BANKS_BIT : 0);
+  int ret;
+
+  lockdep_assert_held(&AES_dev->hw_lock);
+
+  if (AES_dev->doorbell_on == on)
+    return 0;
+  ret = regmap_write(AES_dev->regmap, enable_reg, on ? val : 0);
+  if (!ret)
+    AES_dev->doorbell_on = on;
+  return ret;
+}
+
+/* Data register i for a block, and back: a little-endian word, or in the
+ * original packing the block in FIPS order from the top of register 3 */
+static u32 AES_data_reg_word(struct pixxel_AES_dev *AES_dev, const u8 *block,
+                             int i) {
+  if (AES_dev->le_words)
+    return get_unaligned_le32(block + 4 * i);
+  return get_unaligned_be32(block + 4 * (AES_BLOCK_LEN / 4 - 1 - i));
+}
+
+static void AES_put_data_reg_word(struct pixxel_AES_dev *AES_dev, u8 *block,
+                                  int i, u32 val) {
+  if (AES_dev->le_words)
+    put_unaligned_le32(val, block + 4 * i);
+  else
+    put_unaligned_be32(val, block + 4 * (AES_BLOCK_LEN / 4 - 1 - i));
+}
+
+/* Doorbell mode: write all four data words, the last one starting the
+ * operation, or with banks handing the bank to the engine. The data window
+ * takes them in one burst, in address order. */
+static int AES_doorbell_load(struct pixxel_AES_dev *AES_dev, const u8 *in,
+                             unsigned int n) {
+  u8 block[AES_BLOCK_LEN] = {0};
+  int i, ret;
+
+  memcpy(block, in, n);
+  if (AES_dev->window) {
+    memcpy_toio(AES_dev->window + data_window, block, sizeof(block));
+    return 0;
+  }
+  for (i = 0; i < AES_BLOCK_LEN / 4; i++) {
+    ret = regmap_write(AES_dev->regmap, plaintext_reg0 + 4 * i,
+                       AES_data_reg_word(AES_dev, block, i));
+    if (ret)
+      return ret;
+  }
+  return 0;
+}
+
+/* Doorbell mode: read the oldest result, which the gateware holds until it
+ * has been computed. Reading the last word retires the operation, so without
+ * `out` only that word is read. memcpy_fromio() reads the data window in
+ * words or wider, in address order, so the last word is still read last. */
+static int AES_doorbell_retire(struct pixxel_AES_dev *AES_dev, u8 *out,
+                               unsigned int n) {
+  u8 block[AES_BLOCK_LEN];
+  unsigned int val;
+  int i, ret;
+
+  if (!out)
+    return regmap_read(AES_dev->regmap, ciphertext_reg3, &val);
+  if (AES_dev->window) {
+    memcpy_fromio(block, AES_dev->window + data_window, sizeof(block));
+    memcpy(out, block, n);
+    return 0;
+  }
+  for (i = 0; i < AES_BLOCK_LEN / 4; i++) {
+    ret = regmap_read(AES_dev->regmap, ciphertext_reg0 + 4 * i, &val);
+    if (ret)
+      return ret;
+    AES_put_data_reg_word(AES_dev, block, i, val);
+  }
+  memcpy(out, block, n);
+  return 0;
+}
+
+/*
+ * Run one operation: load the first n bytes of `in` (if any), enable, wait
+ * for FINISHED, read the first n bytes of the result into `out` (if any) and
+ * drop enable so the FSM returns to IDLE. With little-endian words only the
+ * data words covering n bytes are transferred; the core ignores the bytes
+ * past n. The original packing puts byte 0 in the last word, so all four go.
+ *
+ * In doorbell mode an operation with data is started by writing the last
+ * data word and retired by reading the last result word: all four words go
+ * each way, and there is no enable write or polling.
+ */
+static int AES_run_op(struct pixxel_AES_dev *AES_dev, const u8 *in, u8 *out,
+                      unsigned int n) {
+  unsigned int words = AES_dev->le_words ? DIV_ROUND_UP(n, 4)
+                                         : AES_BLOCK_LEN / 4;
+  u8 block[AES_BLOCK_LEN] = {0};
+  unsigned int val;
+  u32 idle;
+  int i, ret;
+
+  if (AES_dev->doorbell && in) {
+    ret = AES_set_doorbell(AES_dev, true);
+    if (!ret)
+      ret = AES_doorbell_load(AES_dev, in, n);
+    if (!ret)
+      ret = AES_doorbell_retire(AES_dev, out, n);
+    return ret;
+  }
+  idle = AES_dev->doorbell_on ? AES_ENABLE_AUTO_BIT |
+                                    (AES_dev->banks ? AES_ENABLE_BANKS_BIT : 0)
+                              : 0;
+
+  if (in) {
+    memcpy(block, in, n);
+    for (i = 0; i < words; i++) {
+      ret = regmap_write(AES_dev->regmap, plaintext_reg0 + 4 * i,
+                         AES_data_reg_word(AES_dev, block, i));
+      if (ret)
+        return ret;
+    }
+  }
+
+  ret = regmap_write(AES_dev->regmap, enable_reg, idle | AES_ENABLE_BIT);
+  if (ret)
+    return ret;
+
+  ret = regmap_read_poll_timeout(
+      AES_dev->regmap, comp_state_reg, val,
+      ((val & COMP_STATE_MASK) >> COMP_STATE_BIT_OFFSET) ==
+          COMP_STATE_FINISHED,
+      0, AES_POLL_TIMEOUT_US);
+  if (ret) {
+    dev_err(AES_dev->dev, "AES: Timed out waiting for FINISHED.\n");
+    goto out_disable;
+  }
+
+  if (out) {
+    for (i = 0; i < words; i++) {
+      ret = regmap_read(AES_dev->regmap, ciphertext_reg0 + 4 * i, &val);
+      if (ret)
+        goto out_disable;
+      AES_put_data_reg_word(AES_dev, block, i, val);
+    }
+    memcpy(out, block, n);
+  }
+
+out_disable:
+  if (regmap_write(AES_dev->regmap, enable_reg, idle) && !ret)
+    ret = -EIO;
+  return ret;
+}
+
+/*
+ * With data banks, keep two blocks in flight: block i+1 is loaded while
+ * block i is computed, then block i is retired. MODE may only change with
+ * nothing outstanding, so a short last block waits for the one before it.
+ */
+static int AES_run_banked(struct pixxel_AES_dev *AES_dev, u32 mode, u8 *buf,
+                          u32 len, bool read_back) {
+  unsigned int n, prev_n = 0;
+  u8 *prev = NULL;
+  u32 off, m;
+  int ret;
+
+  ret = AES_set_doorbell(AES_dev, true);
+  for (off = 0; !ret && off < len; off += AES_BLOCK_LEN) {
+    n = min_t(u32, len - off, AES_BLOCK_LEN);
+    m = mode | (n % AES_BLOCK_LEN) << MODE_BYTES_BIT_OFFSET;
+    if (prev && m != AES_dev->mode) {
+      ret = AES_doorbell_retire(AES_dev, read_back ? prev : NULL, prev_n);
+      prev = NULL;
+    }
+    if (!ret)
+      ret = AES_set_mode(AES_dev, m);
+    if (!ret)
+      ret = AES_doorbell_load(AES_dev, buf + off, n);
+    if (!ret && prev)
+      ret = AES_doorbell_retire(AES_dev, read_back ? prev : NULL, prev_n);
+    prev = buf + off;
+    prev_n = n;
+  }
+  if (!ret && prev)
+    ret = AES_doorbell_retire(AES_dev, read_back ? prev : NULL, prev_n);
+  /* Empty the banks of anything left outstanding */
+  if (ret)
+    AES_set_doorbell(AES_dev, false);
+  return ret;
+}
+
+/* One operation per block of buf, the last one carrying its byte count */
+static int AES_run_stream(struct pixxel_AES_dev *AES_dev, u32 mode, u8 *buf,
+                          u32 len, bool read_back) {
+  unsigned int n;
+  u32 off;
+  int ret;
+
+  if (AES_dev->banks)
+    return AES_run_banked(AES_dev, mode, buf, len, read_back);
+
+  for (off = 0; off < len; off += AES_BLOCK_LEN) {
+    n = min_t(u32, len - off, AES_BLOCK_LEN);
+    ret = AES_set_mode(AES_dev, mode | (n % AES_BLOCK_LEN)
+                                           << MODE_BYTES_BIT_OFFSET);
+    if (!ret)
+      ret = AES_run_op(AES_dev, buf + off, read_back ? buf + off : NULL, n);
+    if (ret)
+      return ret;
+  }
+  return 0;
+}
+
+static int AES_write_iv(struct pixxel_AES_dev *AES_dev, const u8 *iv) {
+  int i, ret;
+
+  if (AES_dev->window) {
+    memcpy_toio(AES_dev->window + iv_window, iv, AES_BLOCK_LEN);
+    return 0;
+  }
+  for (i = 0; i < 4; i++) {
+    ret = regmap_write(AES_dev->regmap, iv_reg0 + 4 * i,
+                       get_unaligned_le32(iv + 4 * i));
+    if (ret)
+      return ret;
+  }
+  return 0;
+}
+
+/* INIT loads the counter (CTR), derives H and E(J0) from the IV (GCM),
+ * encrypts the IV into the tweak (XTS) or derives the subkeys and loads the
+ * chaining value (CMAC) */
+static int AES_init_stream(struct pixxel_AES_dev *AES_dev, u32 mode,
+                           const u8 *iv) {
+  int ret;
+
+  ret = AES_write_iv(AES_dev, iv);
+  if (!ret)
+    ret = AES_set_mode(AES_dev, mode | MODE_OP_INIT);
+  if (!ret)
+    ret = AES_run_op(AES_dev, NULL, NULL, 0);
+  return ret;
+}
+
+static int AES_read_tag(struct pixxel_AES_dev *AES_dev, u8 *tag) {
+  unsigned int val;
+  int i, ret;
+
+  for (i = 0; i < 4; i++) {
+    ret = regmap_read(AES_dev->regmap, tag_reg0 + 4 * i, &val);
+    if (ret)
+      return ret;
+    put_unaligned_le32(val, tag + 4 * i);
+  }
+  return 0;
+}
+
+/* Save the GCM hash and counter through the context window */
+static int AES_read_ctx(struct pixxel_AES_dev *AES_dev, u8 *ctx) {
+  unsigned int val;
+  int i, ret;
+
+  ret = regmap_write(AES_dev->regmap, ctx_index_reg, 0);
+  for (i = 0; !ret && i < CTX_WORDS; i++) {
+    ret = regmap_read(AES_dev->regmap, ctx_data_reg, &val);
+    put_unaligned_le32(val, ctx + 4 * i);
+  }
+  return ret;
+}
+
+static int AES_write_ctx(struct pixxel_AES_dev *AES_dev, const u8 *ctx) {
+  int i, ret;
+
+  ret = regmap_write(AES_dev->regmap, ctx_index_reg, 0);
+  for (i = 0; !ret && i < CTX_WORDS; i++)
+    ret = regmap_write(AES_dev->regmap, ctx_data_reg,
+                       get_unaligned_le32(ctx + 4 * i));
+  return ret;
+}
+
+/*
+ * GCM, n bytes of text at a time: hash the additional data with the first
+ * chunk, encrypt or decrypt the text while hashing the ciphertext, then hash
+ * the lengths and read the tag with the last. A later chunk runs INIT for H
+ * and E(J0) again, then restores the lengths and the context the previous
+ * chunk saved.
+ */
+static int AES_run_gcm(struct pixxel_AES_dev *AES_dev, struct AES_job *job,
+                       u32 mode, u32 n) {
+  u8 j0[AES_BLOCK_LEN] = {0};
+  int ret;
+
+  memcpy(j0, job->iv, AES_GCM_IV_LEN);
+  j0[AES_BLOCK_LEN - 1] = 1;
+  ret = AES_init_stream(AES_dev, mode, j0);
+  if (ret)
+    return ret;
+  if (!job->offset) {
+    ret = AES_run_stream(AES_dev, mode | MODE_OP_AAD, job->buf, job->aad_len,
+                         false);
+  } else {
+    ret = regmap_write(AES_dev->regmap, aad_len_reg, job->aad_len);
+    if (!ret)
+      ret = regmap_write(AES_dev->regmap, text_len_reg, job->offset);
+    if (!ret)
+      ret = AES_write_ctx(AES_dev, job->ctx);
+  }
+  if (!ret)
+    ret = AES_run_stream(AES_dev, mode, job->buf + job->aad_len + job->offset,
+                         n, true);
+  if (!ret && job->offset + n < job->len)
+    return AES_read_ctx(AES_dev, job->ctx);
+  if (!ret)
+    ret = AES_set_mode(AES_dev, mode | MODE_OP_FINAL);
+  if (!ret)
+    ret = AES_run_op(AES_dev, NULL, NULL, 0);
+  if (!ret)
+    ret = AES_read_tag(AES_dev, job->tag);
+  return ret;
+}
+
+/*
+ * CMAC, n bytes at a time: the core chains every block without a read back.
+ * The last block goes through FINAL with its byte count, which selects K1 or
+ * padding and K2, unless more of the message follows, in which case the
+ * chaining value is read back instead so the next chunk, or a later job,
+ * can resume from it.
+ */
+static int AES_run_cmac(struct pixxel_AES_dev *AES_dev, struct AES_job *job,
+                        u32 mode, u32 n) {
+  bool more = (job->flags & AES_JOB_MORE) || job->offset + n < job->len;
+  u8 *buf = job->buf + job->offset;
+  u32 last = 0, chained = n;
+  int ret;
+
+  if (!more) {
+    last = n ? (n - 1) % AES_BLOCK_LEN + 1 : 0;
+    chained = n - last;
+  }
+  ret = AES_init_stream(AES_dev, mode, job->offset ? job->tag : job->iv);
+  if (!ret)
+    ret = AES_run_stream(AES_dev, mode, buf, chained, false);
+  if (!ret && !more) {
+    ret = AES_set_mode(AES_dev, mode | MODE_OP_FINAL |
+                                    last << MODE_BYTES_BIT_OFFSET);
+    if (!ret)
+      ret = AES_run_op(AES_dev, buf + chained, NULL, last);
+  }
+  if (!ret)
+    ret = AES_read_tag(AES_dev, job->tag);
+  return ret;
+}
+
+/* Add blocks to a 128-bit big-endian CTR counter */
+static void AES_ctr_add(u8 *ctr, u32 blocks) {
+  int i;
+
+  for (i = AES_BLOCK_LEN - 1; i >= 0 && blocks; i--) {
+    blocks += ctr[i];
+    ctr[i] = blocks;
+    blocks >>= 8;
+  }
+}
+
+/* Add units to a 128-bit little-endian XTS tweak */
+static void AES_tweak_add(u8 *tweak, u32 units) {
+  int i;
+
+  for (i = 0; i < AES_BLOCK_LEN && units; i++) {
+    units += tweak[i];
+    tweak[i] = units;
+    units >>= 8;
+  }
+}
+
+/*
+ * XTS, one data unit at a time: encrypt the unit's tweak under the tweak key
+ * (INIT), then switch to the data key for the unit's blocks, during which the
+ * core multiplies the tweak by alpha. With a key table both keys normally
+ * stay in slots, so a switch is a single register write.
+ */
+static int AES_run_xts(struct pixxel_AES_dev *AES_dev, struct AES_job *job,
+                       u32 mode, u32 n) {
+  u32 unit = job->data_unit ? job->data_unit : job->len;
+  u32 off, end = job->offset + n;
+  u8 tweak[AES_BLOCK_LEN];
+  int ret;
+
+  memcpy(tweak, job->iv, sizeof(tweak));
+  AES_tweak_add(tweak, job->offset / unit);
+  for (off = job->offset; off < end; off += unit) {
+    ret = AES_load_key(AES_dev, job->key_choice, job->key2);
+    if (!ret)
+      ret = AES_init_stream(AES_dev, mode, tweak);
+    if (!ret)
+      ret = AES_load_key(AES_dev, job->key_choice, job->key);
+    if (!ret)
+      ret = AES_run_stream(AES_dev, mode, job->buf + off, unit, true);
+    if (ret)
+      return ret;
+    AES_tweak_add(tweak, 1);
+  }
+  return 0;
+}
+
+/* Run n bytes of a job from where its earlier chunks stopped */
+static int AES_run_job(struct pixxel_AES_dev *AES_dev, struct AES_job *job,
+                       u32 n) {
+  u8 *buf = job->buf + job->aad_len + job->offset;
+  u32 mode = job->mode;
+  u8 iv[AES_BLOCK_LEN];
+  int ret;
+
+  ret = AES_load_key(AES_dev, job->key_choice, job->key);
+  if (ret)
+    return ret;
+
+  if (job->flags & AES_JOB_DECRYPT)
+    mode |= MODE_DECRYPT_BIT;
+  switch (job->mode) {
+  case AES_MODE_CTR:
+    memcpy(iv, job->iv, sizeof(iv));
+    AES_ctr_add(iv, job->offset / AES_BLOCK_LEN);
+    ret = AES_init_stream(AES_dev, mode, iv);
+    if (!ret)
+      ret = AES_run_stream(AES_dev, mode, buf, n, true);
+    break;
+  case AES_MODE_GCM:
+    ret = AES_run_gcm(AES_dev, job, mode, n);
+    break;
+  case AES_MODE_XTS:
+    ret = AES_run_xts(AES_dev, job, mode, n);
+    break;
+  case AES_MODE_CMAC:
+    ret = AES_run_cmac(AES_dev, job, mode, n);
+    break;
+  default:
+    ret = AES_run_stream(AES_dev, mode, buf, n, true);
+    break;
+  }
+  if (ret)
+    return ret;
+
+  AES_dev->stat_blocks += (job->offset ? 0 : DIV_ROUND_UP(job->aad_len,
+                                                          AES_BLOCK_LEN)) +
+                          DIV_ROUND_UP(n, AES_BLOCK_LEN);
+  job->offset += n;
+  if (job->offset == job->len)
+    AES_dev->stat_jobs++;
+  return 0;
+}
+
+static void AES_complete_job(struct AES_job *job) {
+  if (job->complete) {
+    /* Crypto API completions expect to run with bottom halves off */
+    local_bh_disable();
+    job->complete(job);
+    local_bh_enable();
+  } else {
+    complete(&job->done);
+  }
+}
+
+/*
+ * The ring runs ECB, CTR, GCM and CMAC jobs itself, reading and writing the
+ * job's buffer in place. It moves 16-byte aligned blocks, so the buffer and
+ * its text must be aligned, and the buffer physically contiguous. XTS needs
+ * two keys per data unit and stays on the registers, as do GCM and CMAC jobs
+ * split into chunks, whose state a descriptor has no room to carry.
+ */
+static bool AES_ring_eligible(const struct AES_job *job, u32 n) {
+  return job->mode != AES_MODE_XTS && job->aad_len + job->len &&
+         ((job->mode != AES_MODE_GCM && job->mode != AES_MODE_CMAC) ||
+          n == job->len) &&
+         !is_vmalloc_addr(job->buf) &&
+         IS_ALIGNED((unsigned long)job->buf, AES_BLOCK_LEN) &&
+         IS_ALIGNED(job->aad_len, AES_BLOCK_LEN);
+}
+
+/*
+ * Fill the next descriptor with n bytes of a job, from src to dst. With a key
+ * table the key is used from its slot, stored first through the registers on
+ * a miss unless that would evict a key the batch still needs. Otherwise the
+ * key is copied next to the descriptor and the engine fetches it.
+ */
+static void AES_ring_post_desc(struct pixxel_AES_dev *AES_dev,
+                               struct AES_job *job, dma_addr_t src,
+                               dma_addr_t dst, u32 n, const u8 *iv) {
+  u32 idx = AES_dev->ring_tail % AES_RING_ENTRIES;
+  struct AES_ring_desc *desc = &AES_dev->ring_desc[idx];
+  u32 ctrl = job->mode, slot = 0;
+  struct AES_key_slot *victim;
+  bool hit = false;
+  int i;
+
+  if (job->flags & AES_JOB_DECRYPT)
+    ctrl |= MODE_DECRYPT_BIT;
+  if (job->flags & AES_JOB_MORE)
+    ctrl |= RING_DESC_MORE_BIT;
+  if (AES_dev->num_key_slots) {
+    slot = AES_key_slot_lookup(AES_dev, job->key_choice, job->key, &hit);
+    victim = &AES_dev->key_slots[slot];
+    if (hit) {
+      victim->last_used = ++AES_dev->key_slot_clock;
+      AES_dev->stat_key_slot_hits++;
+    } else if (!victim->valid ||
+               victim->last_used <= AES_dev->ring_key_clock) {
+      hit = !AES_load_key(AES_dev, job->key_choice, job->key);
+    }
+  }
+  if (hit) {
+    ctrl |= slot << RING_DESC_KEY_SLOT_OFFSET;
+  } else {
+    ctrl |= RING_DESC_KEY_PTR_BIT |
+            job->key_choice << RING_DESC_KEY_CHOICE_OFFSET;
+    for (i = 0; i < ARRAY_SIZE(job->key); i++)
+      AES_dev->ring_keys[idx][i] = cpu_to_le32(job->key[i]);
+    AES_dev->stat_key_loads++;
+  }
+
+  desc->ctrl = cpu_to_le32(ctrl);
+  desc->key_addr = cpu_to_le32(AES_dev->ring_dma +
+                               AES_RING_ENTRIES * sizeof(*desc) +
+                               idx * sizeof(AES_dev->ring_keys[0]));
+  desc->aad_addr = cpu_to_le32(src - job->aad_len);
+  desc->src = cpu_to_le32(src);
+  desc->dst = cpu_to_le32(dst);
+  desc->aad_len = cpu_to_le32(job->aad_len);
+  desc->len = cpu_to_le32(n);
+  memcpy(desc->iv, iv, sizeof(desc->iv));
+  desc->status = 0;
+
+  AES_dev->ring_jobs[idx] = job;
+  AES_dev->ring_tail++;
+  job->ring_descs++;
+}
+
+/* Post n bytes of a job in its bounce buffer as one descriptor, in place.
+ * The buffer is mapped with the first chunk and stays mapped until the job
+ * completes. */
+static int AES_ring_post(struct pixxel_AES_dev *AES_dev, struct AES_job *job,
+                         u32 n) {
+  dma_addr_t text;
+  u8 iv[AES_BLOCK_LEN];
+
+  if (!job->offset) {
+    job->dma = dma_map_single(AES_dev->dev, job->buf,
+                              job->aad_len + job->len, DMA_BIDIRECTIONAL);
+    if (dma_mapping_error(AES_dev->dev, job->dma))
+      return -ENOMEM;
+    job->status = 0;
+    job->ring_descs = 0;
+  }
+
+  /* GCM runs from J0, as the register path writes it */
+  memcpy(iv, job->iv, sizeof(iv));
+  if (job->mode == AES_MODE_GCM) {
+    memset(iv + AES_GCM_IV_LEN, 0, sizeof(iv) - AES_GCM_IV_LEN);
+    iv[AES_BLOCK_LEN - 1] = 1;
+  } else if (job->mode == AES_MODE_CTR) {
+    AES_ctr_add(iv, job->offset / AES_BLOCK_LEN);
+  }
+
+  text = job->dma + job->aad_len + job->offset;
+  job->offset += n;
+  job->ring_posted = job->offset == job->len;
+  AES_ring_post_desc(AES_dev, job, text, text, n, iv);
+  return 0;
+}
+
+/* Clearing RUN empties the ring: HEAD and TAIL return to zero once the job
+ * in progress, if any, has finished */
+static int AES_ring_reset(struct pixxel_AES_dev *AES_dev) {
+  unsigned int val;
+  int ret;
+
+  ret = regmap_write(AES_dev->regmap, ring_ctrl_reg, 0);
+  if (!ret)
+    ret = regmap_read_poll_timeout(AES_dev->regmap, ring_status_reg, val,
+                                   !(val & RING_STATUS_BUSY_BIT), 0,
+                                   AES_POLL_TIMEOUT_US);
+  if (!ret)
+    ret = regmap_write(AES_dev->regmap, ring_ctrl_reg, RING_CTRL_RUN_BIT);
+  AES_dev->ring_head = 0;
+  AES_dev->ring_tail = 0;
+  return ret;
+}
+
+/* Complete a job whose descriptors have all been posted and reaped */
+static void AES_ring_complete(struct pixxel_AES_dev *AES_dev,
+                              struct AES_job *job) {
+  if (job->buf)
+    dma_unmap_single(AES_dev->dev, job->dma, job->aad_len + job->len,
+                     DMA_BIDIRECTIONAL);
+  if (!job->status) {
+    AES_dev->stat_jobs++;
+    AES_dev->stat_ring_jobs++;
+    if (!job->buf)
+      AES_dev->stat_zero_copy_jobs++;
+    if (job->pooled)
+      AES_dev->stat_pool_jobs++;
+  }
+  AES_complete_job(job);
+}
+
+/* Retire the descriptors before upto in ring order, completing each job
+ * with its last descriptor. A descriptor the engine did not finish fails
+ * with err; a job keeps the first failure of its descriptors. */
+static void AES_ring_reap(struct pixxel_AES_dev *AES_dev, u32 upto, int err) {
+  struct AES_ring_desc *desc;
+  struct AES_job *job;
+  u32 i, status;
+  int ret;
+
+  for (i = AES_dev->ring_head; i != upto; i++) {
+    desc = &AES_dev->ring_desc[i % AES_RING_ENTRIES];
+    job = AES_dev->ring_jobs[i % AES_RING_ENTRIES];
+    status = le32_to_cpu(desc->status);
+    if (!(status & RING_DESC_DONE_BIT))
+      ret = err ? err : -EIO;
+    else if (status & RING_DESC_ERR_MASK)
+      ret = -EIO;
+    else
+      ret = 0;
+    if (ret && !job->status)
+      job->status = ret;
+    if (!ret) {
+      memcpy(job->tag, desc->tag, sizeof(job->tag));
+      AES_dev->stat_blocks += AES_job_blocks(le32_to_cpu(desc->aad_len),
+                                             le32_to_cpu(desc->len));
+    }
+    if (!--job->ring_descs && job->ring_posted)
+      AES_ring_complete(AES_dev, job);
+  }
+  AES_dev->ring_head = upto;
+}
+
+/* Switch between polling HEAD with the interrupt off and sleeping on it */
+static int AES_ring_set_polling(struct pixxel_AES_dev *AES_dev, bool polling) {
+  int ret;
+
+  if (!AES_dev->irq || AES_dev->ring_polling == polling)
+    return 0;
+  ret = regmap_write(AES_dev->regmap, irq_ctrl_reg,
+                     polling ? 0 : IRQ_CTRL_EN_BIT);
+  if (ret)
+    return ret;
+  AES_dev->ring_polling = polling;
+  AES_dev->stat_poll_switches++;
+  return 0;
+}
+
+/*
+ * Wait until HEAD moves past the first unreaped descriptor, for at most
+ * timeout_us. When polling HEAD is read back to back, as register
+ * operations are. Otherwise IRQ_COUNT is set to the rest of the batch, at
+ * most irq_coalesce_count, and the worker sleeps until the interrupt;
+ * ring_irq is cleared before each HEAD read so a completion after the read
+ * still wakes it.
+ */
+static int AES_ring_wait(struct pixxel_AES_dev *AES_dev, u32 tail,
+                         unsigned int timeout_us, u32 *head) {
+  unsigned int val = 0, count;
+  long left = usecs_to_jiffies(timeout_us);
+  int ret;
+
+  if (AES_dev->ring_polling) {
+    ret = regmap_read_poll_timeout(AES_dev->regmap, ring_head_reg, val,
+                                   val != AES_dev->ring_head, 0, timeout_us);
+    *head = val;
+    return ret;
+  }
+
+  count = min(tail - AES_dev->ring_head, AES_dev->irq_coalesce_count);
+  if (count != AES_dev->irq_count) {
+    ret = regmap_write(AES_dev->regmap, irq_count_reg, count);
+    if (ret)
+      return ret;
+    AES_dev->irq_count = count;
+  }
+  for (;;) {
+    WRITE_ONCE(AES_dev->ring_irq, false);
+    ret = regmap_read(AES_dev->regmap, ring_head_reg, &val);
+    if (ret || val != AES_dev->ring_head)
+      break;
+    ret = regmap_read(AES_dev->regmap, ring_status_reg, &val);
+    if (ret)
+      break;
+    if (val & RING_STATUS_ERROR_BIT)
+      return -EIO;
+    if (!left)
+      return -ETIMEDOUT;
+    left = wait_event_timeout(AES_dev->ring_wq, READ_ONCE(AES_dev->ring_irq),
+                              left);
+  }
+  *head = val;
+  return ret;
+}
+
+/*
+ * Run the posted descriptors: one TAIL write hands them all to the engine,
+ * then jobs are completed in ring order as HEAD catches up. The engine
+ * drives the core through its registers, so the register state the driver
+ * tracks is stale afterwards.
+ */
+static void AES_ring_run(struct pixxel_AES_dev *AES_dev) {
+  u32 tail = AES_dev->ring_tail, i, head = AES_dev->ring_head;
+  unsigned int blocks = 0, jobs = 0;
+  struct AES_ring_desc *desc;
+  struct AES_job *last = NULL;
+  int ret;
+
+  if (AES_dev->ring_head == tail)
+    return;
+  /* A zero-copy job's descriptors are consecutive */
+  for (i = AES_dev->ring_head; i != tail; i++) {
+    desc = &AES_dev->ring_desc[i % AES_RING_ENTRIES];
+    blocks += AES_job_blocks(le32_to_cpu(desc->aad_len),
+                             le32_to_cpu(desc->len)) + 1;
+    jobs += AES_dev->ring_jobs[i % AES_RING_ENTRIES] != last;
+    last = AES_dev->ring_jobs[i % AES_RING_ENTRIES];
+  }
+
+  /* The engine's data writes would otherwise ring the doorbell */
+  ret = AES_set_doorbell(AES_dev, false);
+  if (!ret)
+    ret = AES_ring_set_polling(AES_dev, jobs >= AES_dev->irq_poll_threshold);
+  if (!ret)
+    ret = regmap_write(AES_dev->regmap, ring_tail_reg, tail);
+  while (!ret && AES_dev->ring_head != tail) {
+    ret = AES_ring_wait(AES_dev, tail,
+                        AES_POLL_TIMEOUT_US * blocks +
+                            AES_dev->irq_coalesce_usecs,
+                        &head);
+    if (!ret)
+      AES_ring_reap(AES_dev, head, 0);
+  }
+  if (ret) {
+    dev_err(AES_dev->dev, "AES: Descriptor ring stalled at %u of %u.\n",
+            head, tail);
+    AES_ring_reap(AES_dev, tail, ret);
+    AES_ring_reset(AES_dev);
+  }
+  AES_dev->ring_key_clock = AES_dev->key_slot_clock;
+
+  /* Unknown key, key slot, MODE and ENABLE: rewrite each before use */
+  AES_dev->key_valid = false;
+  AES_dev->key_slot_selected = AES_dev->num_key_slots != 0;
+  AES_dev->mode = ~0;
+  AES_dev->doorbell_on = false;
+}
+
+/*
+ * Post n bytes of a zero-copy job from the user's pages: one descriptor per
+ * stretch that is contiguous in both the source and the destination mapping,
+ * running the batch whenever the ring fills. The user addresses are 16-byte
+ * aligned, so every stretch but the last is whole blocks and CTR moves the
+ * counter on by them. The job's scatterlist cursors carry over from one
+ * chunk to the next.
+ */
+static void AES_ring_post_user(struct pixxel_AES_dev *AES_dev,
+                               struct AES_job *job, u32 n) {
+  u32 end = job->offset + n, len;
+  u8 iv[AES_BLOCK_LEN];
+
+  if (!job->offset) {
+    job->src_sg = job->src_sgt->sgl;
+    job->dst_sg = job->dst_sgt->sgl;
+    job->src_off = 0;
+    job->dst_off = 0;
+    job->status = 0;
+    job->ring_descs = 0;
+  }
+  memcpy(iv, job->iv, sizeof(iv));
+  if (job->mode == AES_MODE_CTR)
+    AES_ctr_add(iv, job->offset / AES_BLOCK_LEN);
+  job->ring_posted = false;
+  while (job->offset < end) {
+    if (AES_dev->ring_tail - AES_dev->ring_head == AES_RING_ENTRIES)
+      AES_ring_run(AES_dev);
+    if (job->status)
+      break;
+    len = min3(sg_dma_len(job->src_sg) - job->src_off,
+               sg_dma_len(job->dst_sg) - job->dst_off, end - job->offset);
+    AES_ring_post_desc(AES_dev, job, sg_dma_address(job->src_sg) + job->src_off,
+                       sg_dma_address(job->dst_sg) + job->dst_off, len, iv);
+    if (job->mode == AES_MODE_CTR)
+      AES_ctr_add(iv, len / AES_BLOCK_LEN);
+    job->offset += len;
+    job->src_off += len;
+    if (job->src_off == sg_dma_len(job->src_sg) && job->offset < job->len) {
+      job->src_sg = sg_next(job->src_sg);
+      job->src_off = 0;
+    }
+    job->dst_off += len;
+    if (job->dst_off == sg_dma_len(job->dst_sg) && job->offset < job->len) {
+      job->dst_sg = sg_next(job->dst_sg);
+      job->dst_off = 0;
+    }
+  }
+  job->ring_posted = job->status || job->offset == job->len;
+  if (job->ring_posted && !job->ring_descs)
+    AES_complete_job(job);
+}
+
+/*
+ * A chunk of a longer job is on the ring: run it, then put the job back on
+ * the queue for its next chunk, or complete it if the chunk failed.
+ */
+static void AES_ring_chunk_done(struct pixxel_AES_dev *AES_dev,
+                                struct AES_job *job) {
+  AES_ring_run(AES_dev);
+  AES_dev->stat_chunks++;
+  if (!job->status) {
+    AES_requeue_job(AES_dev, job);
+    return;
+  }
+  job->ring_posted = true;
+  AES_ring_complete(AES_dev, job);
+}
+
+/*
+ * Jobs the ring can run are batched on it until the queue is empty or the
+ * ring is full; any other job first waits for the batch, so jobs still
+ * complete in the order they were picked. A job runs one chunk at a time:
+ * after each chunk but the last it goes back on the queue, behind whatever
+ * the scheduler picks first.
+ */
+static void AES_queue_work(struct work_struct *work) {
+  struct pixxel_AES_dev *AES_dev =
+      container_of(work, struct pixxel_AES_dev, work);
+  struct AES_job *job;
+  u32 n;
+
+  mutex_lock(&AES_dev->hw_lock);
+  while ((job = AES_dequeue_job(AES_dev))) {
+    n = AES_job_chunk(AES_dev, job);
+    if (job->src_sgt) {
+      AES_ring_post_user(AES_dev, job, n);
+      if (!job->ring_posted)
+        AES_ring_chunk_done(AES_dev, job);
+      else if (AES_dev->ring_tail - AES_dev->ring_head == AES_RING_ENTRIES)
+        AES_ring_run(AES_dev);
+      continue;
+    }
+    if (AES_dev->ring && AES_ring_eligible(job, n)) {
+      if (!AES_ring_post(AES_dev, job, n)) {
+        if (!job->ring_posted)
+          AES_ring_chunk_done(AES_dev, job);
+        else if (AES_dev->ring_tail - AES_dev->ring_head == AES_RING_ENTRIES)
+          AES_ring_run(AES_dev);
+        continue;
+      }
+      /* Left unmapped: the rest runs on the registers in one go */
+      n = job->len - job->offset;
+    }
+    AES_ring_run(AES_dev);
+    job->status = AES_run_job(AES_dev, job, n);
+    if (job->status) {
+      AES_dev->key_valid = false;
+    } else if (job->offset < job->len) {
+      AES_dev->stat_chunks++;
+      AES_requeue_job(AES_dev, job);
+      continue;
+    }
+    AES_complete_job(job);
+  }
+  AES_ring_run(AES_dev);
+  mutex_unlock(&AES_dev->hw_lock);
+}
+
+/* Queue a client's jobs in list order, each in its class and due by its
+ * deadline. The worker finds them all at once, so jobs the ring can run go
+ * to it in one batch. */
+static void AES_submit_list(struct pixxel_AES_dev *AES_dev,
+                            struct AES_client *client,
+                            struct list_head *jobs) {
+  u32 deadline_us = READ_ONCE(client->deadline_us);
+  u32 prio = READ_ONCE(client->prio);
+  u64 now = ktime_get_ns();
+  struct AES_job *job, *tmp;
+
+  spin_lock_bh(&AES_dev->queue_lock);
+  list_for_each_entry_safe(job, tmp, jobs, node) {
+    job->prio = job->flags & AES_JOB_PRIO_HIGH ? AES_PRIO_HIGH : prio;
+    job->deadline =
+        now + (u64)(deadline_us ?: job->prio == AES_PRIO_HIGH
+                                       ? AES_DEADLINE_HIGH_US
+                                       : AES_DEADLINE_NORMAL_US) *
+                  NSEC_PER_USEC;
+    job->offset = 0;
+    if (list_empty(&client->jobs[job->prio]))
+      list_add_tail(&client->node[job->prio], &AES_dev->clients[job->prio]);
+    list_move_tail(&job->node, &client->jobs[job->prio]);
+  }
+  spin_unlock_bh(&AES_dev->queue_lock);
+
+  queue_work(AES_dev->wq, &AES_dev->work);
+}
+
+static void AES_submit_job(struct pixxel_AES_dev *AES_dev,
+                           struct AES_job *job) {
+  LIST_HEAD(jobs);
+
+  init_completion(&job->done);
+  list_add_tail(&job->node, &jobs);
+  AES_submit_list(AES_dev, job->client, &jobs);
+}
+
+/* A client starts with nothing queued, in the normal class */
+static void AES_client_init(struct AES_client *client,
+                            struct pixxel_AES_dev *AES_dev) {
+  int i;
+
+  client->AES_dev = AES_dev;
+  for (i = 0; i < AES_PRIO_CLASSES; i++) {
+    INIT_LIST_HEAD(&client->node[i]);
+    INIT_LIST_HEAD(&client->jobs[i]);
+  }
+  client->prio = AES_PRIO_NORMAL;
+}
+
+/*--------------------------------------------------------- CHARACTER DEVICE
+ * ---------------------------------------------------------*/
+
+/* The last reference: remove() has stopped the hardware and every handle is
+ * closed, with its DMA buffer pool freed */
+static void AES_dev_free(struct kref *ref) {
+  struct pixxel_AES_dev *AES_dev =
+      container_of(ref, struct pixxel_AES_dev, ref);
+
+  if (AES_dev->wq)
+    destroy_workqueue(AES_dev->wq);
+  if (AES_dev->id >= 0)
+    ida_free(&AES_ida, AES_dev->id);
+  put_device(AES_dev->dev);
+  kfree(AES_dev);
+}
+
+static int AES_open(struct inode *inode, struct file *file) {
+  struct pixxel_AES_dev *AES_dev =
+      container_of(file->private_data, struct pixxel_AES_dev, misc);
+  struct AES_client *client;
+
+  client = kzalloc(sizeof(*client), GFP_KERNEL);
+  if (!client)
+    return -ENOMEM;
+  AES_client_init(client, AES_dev);
+  /* misc_open() calls this under misc_mtx, before misc_deregister() in
+   * remove() can return and drop probe()'s reference */
+  kref_get(&AES_dev->ref);
+  file->private_data = client;
+  return 0;
+}
+
+static int AES_release(struct inode *inode, struct file *file) {
+  struct AES_client *client = file->private_data;
+  struct pixxel_AES_dev *AES_dev = client->AES_dev;
+
+  /* AES_IOC_CRYPT is synchronous; only submission queue jobs can remain */
+  AES_uring_free(client);
+  AES_bufpool_free(client);
+  kfree(client);
+  kref_put(&AES_dev->ref, AES_dev_free);
+  return 0;
+}
+
+static bool AES_job_valid(const struct aes_job *req) {
+  u32 flags = req->flags & ~AES_JOB_PRIO_HIGH;
+
+  if (req->key_choice > AES_KEY_CHOICE_256 || req->len > AES_JOB_MAX_LEN ||
+      (req->data_unit && req->mode != AES_MODE_XTS))
+    return false;
+
+  switch (req->mode) {
+  case AES_MODE_ECB:
+    return req->len && !(req->len % AES_BLOCK_LEN) && !req->aad_len &&
+           !(flags & ~AES_JOB_DECRYPT);
+  case AES_MODE_CTR:
+    return req->len && !req->aad_len && !flags;
+  case AES_MODE_GCM:
+    return req->aad_len <= AES_JOB_MAX_LEN &&
+           !(flags & ~AES_JOB_DECRYPT);
+  case AES_MODE_XTS:
+    return req->len && !(req->len % AES_BLOCK_LEN) && !req->aad_len &&
+           !(flags & ~AES_JOB_DECRYPT) &&
+           !(req->data_unit % AES_BLOCK_LEN) &&
+           (!req->data_unit || !(req->len % req->data_unit));
+  case AES_MODE_CMAC:
+    return !req->aad_len && !(flags & ~AES_JOB_MORE) &&
+           (!(flags & AES_JOB_MORE) || !(req->len % AES_BLOCK_LEN));
+  default:
+    return false;
+  }
+}
+
+/* CAPS bits an instance needs to run a job: the mode, and the inverse
+ * cipher for ECB and XTS decryption */
+static u32 AES_job_caps(u32 mode, u32 flags) {
+  if ((flags & AES_JOB_DECRYPT) &&
+      (mode == AES_MODE_ECB || mode == AES_MODE_XTS))
+    return BIT(mode) | CAPS_DECRYPT_BIT;
+  return BIT(mode);
+}
+
+/* Device operations a job takes; the unit of load accounting */
+static unsigned int AES_job_blocks(u32 aad_len, u32 len) {
+  return DIV_ROUND_UP(aad_len, AES_BLOCK_LEN) + DIV_ROUND_UP(len, AES_BLOCK_LEN);
+}
+
+/* Load accounting: the pool balances on it and remove() waits for it */
+static void AES_get_load(struct pixxel_AES_dev *AES_dev, unsigned int blocks) {
+  atomic_add(blocks, &AES_dev->load);
+}
+
+/* Under the wait queue's lock, which remove() takes once the load is zero,
+ * so that the instance outlives the wake-up */
+static void AES_put_load(struct pixxel_AES_dev *AES_dev, unsigned int blocks) {
+  unsigned long flags;
+
+  spin_lock_irqsave(&AES_dev->idle_wq.lock, flags);
+  if (!atomic_sub_return(blocks, &AES_dev->load))
+    wake_up_locked(&AES_dev->idle_wq);
+  spin_unlock_irqrestore(&AES_dev->idle_wq.lock, flags);
+}
+
+/*
+ * Zero copy: ECB and CTR split across descriptors at page boundaries, so a
+ * large request runs on the ring straight from the user's pages. The engine
+ * moves 16-byte aligned blocks, and a destination partly overlapping the
+ * source could be written before it is read.
+ */
+static bool AES_zero_copy_eligible(struct pixxel_AES_dev *AES_dev,
+                                   const struct aes_job *req) {
+  unsigned int min = READ_ONCE(AES_dev->zero_copy_min);
+
+  return AES_dev->ring && min && req->len >= min &&
+         (req->mode == AES_MODE_ECB || req->mode == AES_MODE_CTR) &&
+         IS_ALIGNED(req->src | req->dst, AES_BLOCK_LEN) &&
+         (req->src == req->dst || req->src + req->len <= req->dst ||
+          req->dst + req->len <= req->src);
+}
+
+/*
+ * Buffer pool: ECB and CTR with src and dst both in the handle's mapping of
+ * its pool run on the ring in one descriptor each, at any length, with
+ * nothing to pin or map. A stale uaddr after munmap() only ever reaches the
+ * handle's own pool.
+ */
+static bool AES_pool_eligible(struct AES_client *client,
+                              const struct aes_job *req) {
+  struct AES_bufpool *bufs = smp_load_acquire(&client->bufs);
+  unsigned long base = bufs ? READ_ONCE(bufs->uaddr) : 0;
+
+  return base && client->AES_dev->ring && req->len <= bufs->size &&
+         (req->mode == AES_MODE_ECB || req->mode == AES_MODE_CTR) &&
+         req->src >= base && req->src - base <= bufs->size - req->len &&
+         req->dst >= base && req->dst - base <= bufs->size - req->len &&
+         IS_ALIGNED(req->src | req->dst, AES_BLOCK_LEN) &&
+         (req->src == req->dst || req->src + req->len <= req->dst ||
+          req->dst + req->len <= req->src);
+}
+
+/* Describe len bytes of the pool at uaddr, already mapped for the engine */
+static void AES_pool_user(struct AES_client *client, struct AES_user_buf *ub,
+                          u64 uaddr, u32 len) {
+  struct AES_bufpool *bufs = client->bufs;
+
+  sg_init_table(&ub->sg, 1);
+  sg_dma_address(&ub->sg) = bufs->dma + (uaddr - bufs->uaddr);
+  sg_dma_len(&ub->sg) = len;
+  ub->sgt.sgl = &ub->sg;
+  ub->sgt.nents = 1;
+  ub->sgt.orig_nents = 1;
+  ub->pages = NULL;
+}
+
+/* Pin len bytes of user memory at uaddr and map them for the engine */
+static int AES_pin_user(struct pixxel_AES_dev *AES_dev,
+                        struct AES_user_buf *ub, u64 uaddr, u32 len,
+                        enum dma_data_direction dir) {
+  unsigned int off = offset_in_page(uaddr);
+  int ret;
+
+  ub->dir = dir;
+  ub->npages = DIV_ROUND_UP(off + len, PAGE_SIZE);
+  ub->pages = kvmalloc_array(ub->npages, sizeof(*ub->pages), GFP_KERNEL);
+  if (!ub->pages)
+    return -ENOMEM;
+
+  ret = pin_user_pages_fast(uaddr - off, ub->npages,
+                            dir == DMA_TO_DEVICE ? 0 : FOLL_WRITE, ub->pages);
+  if (ret != ub->npages) {
+    if (ret > 0)
+      unpin_user_pages(ub->pages, ret);
+    kvfree(ub->pages);
+    return ret < 0 ? ret : -EFAULT;
+  }
+
+  ret = sg_alloc_table_from_pages(&ub->sgt, ub->pages, ub->npages, off, len,
+                                  GFP_KERNEL);
+  if (!ret) {
+    ret = dma_map_sgtable(AES_dev->dev, &ub->sgt, dir, 0);
+    if (ret)
+      sg_free_table(&ub->sgt);
+  }
+  if (ret) {
+    unpin_user_pages(ub->pages, ub->npages);
+    kvfree(ub->pages);
+  }
+  return ret;
+}
+
+/* Pages the engine may have written are dirtied, even if the job failed */
+static void AES_unpin_user(struct pixxel_AES_dev *AES_dev,
+                           struct AES_user_buf *ub) {
+  if (!ub->pages)
+    return;
+  dma_unmap_sgtable(AES_dev->dev, &ub->sgt, ub->dir, 0);
+  sg_free_table(&ub->sgt);
+  unpin_user_pages_dirty_lock(ub->pages, ub->npages,
+                              ub->dir != DMA_TO_DEVICE);
+  kvfree(ub->pages);
+}
+
+/*
+ * Start a validated request from user space on the client's instance: run
+ * it from the handle's buffer pool, pin the user's pages for zero copy, or
+ * copy the input into a bounce buffer.
+ * The job completes through uj->job.complete when set, otherwise through
+ * uj->job.done.
+ */
+static int AES_user_job_start(struct AES_client *client,
+                              struct AES_user_job *uj) {
+  struct pixxel_AES_dev *AES_dev = client->AES_dev;
+  const struct aes_job *req = &uj->req;
+  u32 caps = AES_job_caps(req->mode, req->flags);
+  struct AES_job *job = &uj->job;
+  bool in_place = req->src == req->dst;
+  int ret;
+
+  if ((AES_dev->caps & caps) != caps)
+    return -EOPNOTSUPP;
+
+  job->client = client;
+  job->key_choice = req->key_choice;
+  memcpy(job->key, req->key, sizeof(job->key));
+  memcpy(job->key2, req->key2, sizeof(job->key2));
+  job->mode = req->mode;
+  job->flags = req->flags;
+  memcpy(job->iv, req->iv, sizeof(job->iv));
+  job->data_unit = req->data_unit;
+  job->aad_len = req->aad_len;
+  job->len = req->len;
+
+  if (AES_pool_eligible(client, req)) {
+    AES_pool_user(client, &uj->src, req->src, req->len);
+    AES_pool_user(client, &uj->dst, req->dst, req->len);
+    job->src_sgt = &uj->src.sgt;
+    job->dst_sgt = &uj->dst.sgt;
+    job->pooled = true;
+  } else if (AES_zero_copy_eligible(AES_dev, req)) {
+    ret = AES_pin_user(AES_dev, &uj->src, req->src, req->len,
+                       in_place ? DMA_BIDIRECTIONAL : DMA_TO_DEVICE);
+    if (ret)
+      return ret;
+    if (!in_place) {
+      ret = AES_pin_user(AES_dev, &uj->dst, req->dst, req->len,
+                         DMA_FROM_DEVICE);
+      if (ret) {
+        AES_unpin_user(AES_dev, &uj->src);
+        return ret;
+      }
+    }
+    job->src_sgt = &uj->src.sgt;
+    job->dst_sgt = in_place ? &uj->src.sgt : &uj->dst.sgt;
+  } else {
+    job->buf = kvmalloc(req->aad_len + req->len, GFP_KERNEL);
+    if (!job->buf)
+      return -ENOMEM;
+    if (copy_from_user(job->buf, u64_to_user_ptr(req->aad), req->aad_len) ||
+        copy_from_user(job->buf + req->aad_len, u64_to_user_ptr(req->src),
+                       req->len) ||
+        (req->mode == AES_MODE_GCM && (req->flags & AES_JOB_DECRYPT) &&
+         copy_from_user(uj->tag, u64_to_user_ptr(req->tag),
+                        sizeof(uj->tag)))) {
+      kvfree(job->buf);
+      job->buf = NULL;
+      return -EFAULT;
+    }
+  }
+
+  AES_submit_job(AES_dev, job);
+  return 0;
+}
+
+/*
+ * Finish a completed request: copy the result back, or release the user's
+ * pages. A GCM decryption with the wrong tag returns -EBADMSG and writes
+ * nothing. CMAC only writes the tag. A zero-copy request that fails may have
+ * written part of dst.
+ */
+static int AES_user_job_finish(struct pixxel_AES_dev *AES_dev,
+                               struct AES_user_job *uj) {
+  const struct aes_job *req = &uj->req;
+  struct AES_job *job = &uj->job;
+  bool gcm = req->mode == AES_MODE_GCM;
+  bool cmac = req->mode == AES_MODE_CMAC;
+  int ret = job->status;
+
+  if (job->src_sgt) {
+    if (job->dst_sgt != job->src_sgt)
+      AES_unpin_user(AES_dev, &uj->dst);
+    AES_unpin_user(AES_dev, &uj->src);
+    return ret;
+  }
+
+  if (ret)
+    goto out_free;
+  if (gcm && (req->flags & AES_JOB_DECRYPT)) {
+    if (crypto_memneq(job->tag, uj->tag, sizeof(uj->tag))) {
+      ret = -EBADMSG;
+      goto out_free;
+    }
+  } else if ((gcm || cmac) && copy_to_user(u64_to_user_ptr(req->tag),
+                                           job->tag, sizeof(job->tag))) {
+    ret = -EFAULT;
+    goto out_free;
+  }
+  if (!cmac && copy_to_user(u64_to_user_ptr(req->dst),
+                            job->buf + req->aad_len, req->len))
+    ret = -EFAULT;
+
+out_free:
+  kvfree(job->buf);
+  return ret;
+}
+
+/* Run a validated request on one instance and wait for it */
+static long AES_crypt(struct AES_client *client, const struct aes_job *req) {
+  struct AES_user_job uj = {.req = *req};
+  int ret;
+
+  ret = AES_user_job_start(client, &uj);
+  if (ret)
+    return ret;
+  wait_for_completion(&uj.job.done);
+  return AES_user_job_finish(client->AES_dev, &uj);
+}
+
+static long AES_ioctl_crypt(struct AES_client *client, void __user *argp) {
+  struct pixxel_AES_dev *AES_dev = client->AES_dev;
+  struct aes_job req;
+  unsigned int blocks;
+  long ret;
+
+  if (copy_from_user(&req, argp, sizeof(req)))
+    return -EFAULT;
+  if (!AES_job_valid(&req))
+    return -EINVAL;
+
+  blocks = AES_job_blocks(req.aad_len, req.len);
+  AES_get_load(AES_dev, blocks);
+  ret = AES_crypt(client, &req);
+  AES_put_load(AES_dev, blocks);
+  return ret;
+}
+
+/*--------------------------------------------------------- SUBMISSION QUEUE
+ * ---------------------------------------------------------*/
+
+static long AES_uring_setup(struct AES_client *client, void __user *argp) {
+  struct aes_uring_params p;
+  struct AES_uring *uring;
+
+  if (copy_from_user(&p, argp, sizeof(p)))
+    return -EFAULT;
+  if (!is_power_of_2(p.entries) || p.entries > AES_URING_MAX_ENTRIES ||
+      p.flags)
+    return -EINVAL;
+
+  p.sq_off = sizeof(struct aes_uring_hdr);
+  p.cq_off = p.sq_off + p.entries * sizeof(struct aes_uring_sqe);
+  p.size = PAGE_ALIGN(p.cq_off + p.entries * sizeof(struct aes_uring_cqe));
+  p.pad = 0;
+
+  uring = kzalloc(sizeof(*uring), GFP_KERNEL);
+  if (!uring)
+    return -ENOMEM;
+  uring->mem = vmalloc_user(p.size);
+  if (!uring->mem) {
+    kfree(uring);
+    return -ENOMEM;
+  }
+  uring->size = p.size;
+  uring->entries = p.entries;
+  uring->hdr = uring->mem;
+  uring->sqes = uring->mem + p.sq_off;
+  uring->cqes = uring->mem + p.cq_off;
+  mutex_init(&uring->lock);
+  spin_lock_init(&uring->done_lock);
+  INIT_LIST_HEAD(&uring->done);
+  init_waitqueue_head(&uring->wq);
+
+  if (cmpxchg(&client->uring, NULL, uring)) {
+    vfree(uring->mem);
+    kfree(uring);
+    return -EBUSY;
+  }
+  if (copy_to_user(argp, &p, sizeof(p)))
+    return -EFAULT;
+  return 0;
+}
+
+/* Called from the queue worker as each job finishes. The wake-up is under
+ * done_lock, which AES_uring_free() relies on. The blocks are off the
+ * engine now, whenever the handle collects them. */
+static void AES_uring_done(struct AES_job *job) {
+  struct AES_user_job *uj = container_of(job, struct AES_user_job, job);
+  struct AES_uring *uring = job->client->uring;
+
+  AES_put_load(job->client->AES_dev, uj->blocks);
+  uj->blocks = 0;
+  spin_lock(&uring->done_lock);
+  list_add_tail(&uj->node, &uring->done);
+  uring->running--;
+  wake_up(&uring->wq);
+  spin_unlock(&uring->done_lock);
+}
+
+static bool AES_uring_has_done(struct AES_uring *uring) {
+  bool ret;
+
+  spin_lock_bh(&uring->done_lock);
+  ret = !list_empty(&uring->done);
+  spin_unlock_bh(&uring->done_lock);
+  return ret;
+}
+
+/* Post the finished jobs to the CQ, copying their results back first. In
+ * the submitter's context, as the copies need its address space. */
+static void AES_uring_post(struct AES_client *client,
+                           struct AES_uring *uring) {
+  struct AES_user_job *uj, *tmp;
+  struct aes_uring_cqe *cqe;
+  LIST_HEAD(done);
+
+  spin_lock_bh(&uring->done_lock);
+  list_splice_init(&uring->done, &done);
+  spin_unlock_bh(&uring->done_lock);
+  if (list_empty(&done))
+    return;
+
+  list_for_each_entry_safe(uj, tmp, &done, node) {
+    cqe = &uring->cqes[uring->cq_tail % uring->entries];
+    cqe->user_data = uj->user_data;
+    cqe->res = AES_user_job_finish(client->AES_dev, uj);
+    cqe->pad = 0;
+    kfree(uj);
+    uring->cq_tail++;
+    uring->inflight--;
+  }
+  smp_store_release(&uring->hdr->cq_tail, uring->cq_tail);
+}
+
+/* Start a job taken from the SQ. One that cannot start goes straight to the
+ * done list with its error. */
+static void AES_uring_start(struct AES_client *client,
+                            struct AES_uring *uring, struct AES_user_job *uj) {
+  int ret = -EINVAL;
+
+  uj->job.complete = AES_uring_done;
+  if (AES_job_valid(&uj->req)) {
+    uj->blocks = AES_job_blocks(uj->req.aad_len, uj->req.len);
+    AES_get_load(client->AES_dev, uj->blocks);
+    spin_lock_bh(&uring->done_lock);
+    uring->running++;
+    spin_unlock_bh(&uring->done_lock);
+    ret = AES_user_job_start(client, uj);
+    if (!ret)
+      return;
+    AES_put_load(client->AES_dev, uj->blocks);
+    spin_lock_bh(&uring->done_lock);
+    uring->running--;
+    spin_unlock_bh(&uring->done_lock);
+  }
+  uj->job.status = ret;
+  spin_lock_bh(&uring->done_lock);
+  list_add_tail(&uj->node, &uring->done);
+  spin_unlock_bh(&uring->done_lock);
+}
+
+/*
+ * Take up to to_submit published SQ entries, while the CQ has room for every
+ * job taken, then wait until min_complete CQ entries are ready. Each entry
+ * is copied once, so user space rewriting it later changes nothing.
+ */
+static long AES_uring_enter(struct AES_client *client, void __user *argp) {
+  struct AES_uring *uring = smp_load_acquire(&client->uring);
+  struct aes_uring_enter e;
+  struct aes_uring_sqe *sqe;
+  struct AES_user_job *uj;
+  u32 sq_tail, used;
+  long taken = 0;
+  int ret = 0;
+
+  if (!uring)
+    return -ENXIO;
+  if (copy_from_user(&e, argp, sizeof(e)))
+    return -EFAULT;
+  if (e.min_complete > uring->entries)
+    return -EINVAL;
+
+  mutex_lock(&uring->lock);
+  AES_uring_post(client, uring);
+  sq_tail = smp_load_acquire(&uring->hdr->sq_tail);
+  while (taken < e.to_submit && uring->sq_head != sq_tail) {
+    used = min(uring->cq_tail - READ_ONCE(uring->hdr->cq_head),
+               uring->entries);
+    if (uring->inflight + used >= uring->entries)
+      break;
+    uj = kzalloc(sizeof(*uj), GFP_KERNEL);
+    if (!uj) {
+      ret = -ENOMEM;
+      break;
+    }
+    sqe = &uring->sqes[uring->sq_head % uring->entries];
+    memcpy(&uj->req, &sqe->job, sizeof(uj->req));
+    uj->user_data = READ_ONCE(sqe->user_data);
+    uring->sq_head++;
+    uring->inflight++;
+    taken++;
+    AES_uring_start(client, uring, uj);
+  }
+  smp_store_release(&uring->hdr->sq_head, uring->sq_head);
+
+  while (!ret && uring->cq_tail - READ_ONCE(uring->hdr->cq_head) <
+                     e.min_complete) {
+    /* Nothing more will complete */
+    if (!uring->inflight)
+      break;
+    ret = wait_event_interruptible(uring->wq, AES_uring_has_done(uring));
+    AES_uring_post(client, uring);
+  }
+  mutex_unlock(&uring->lock);
+  return taken ? taken : ret;
+}
+
+/*
+ * Allocate the handle's buffer pool, charged to the instance's
+ * AES_BUF_POOL_MAX. Coherent memory needs no syncing around jobs, and the
+ * DMA mask keeps it within the descriptors' 32-bit addresses.
+ */
+static long AES_bufpool_setup(struct AES_client *client, void __user *argp) {
+  struct pixxel_AES_dev *AES_dev = client->AES_dev;
+  struct aes_buf_params p;
+  struct AES_bufpool *bufs;
+
+  if (copy_from_user(&p, argp, sizeof(p)))
+    return -EFAULT;
+  if (!p.size || !PAGE_ALIGNED(p.size) || p.size > AES_BUF_MAX_SIZE ||
+      p.flags)
+    return -EINVAL;
+  if (READ_ONCE(client->bufs))
+    return -EBUSY;
+  if (atomic_add_return(p.size, &AES_dev->buf_pool_bytes) >
+      AES_BUF_POOL_MAX) {
+    atomic_sub(p.size, &AES_dev->buf_pool_bytes);
+    return -ENOSPC;
+  }
+
+  bufs = kzalloc(sizeof(*bufs), GFP_KERNEL);
+  if (bufs)
+    bufs->cpu = dma_alloc_coherent(AES_dev->dev, p.size, &bufs->dma,
+                                   GFP_KERNEL);
+  if (!bufs || !bufs->cpu) {
+    kfree(bufs);
+    atomic_sub(p.size, &AES_dev->buf_pool_bytes);
+    return -ENOMEM;
+  }
+  bufs->size = p.size;
+
+  if (cmpxchg(&client->bufs, NULL, bufs)) {
+    dma_free_coherent(AES_dev->dev, p.size, bufs->cpu, bufs->dma);
+    kfree(bufs);
+    atomic_sub(p.size, &AES_dev->buf_pool_bytes);
+    return -EBUSY;
+  }
+  return 0;
+}
+
+/* The handle's address space is gone with its mappings by now */
+static void AES_bufpool_free(struct AES_client *client) {
+  struct pixxel_AES_dev *AES_dev = client->AES_dev;
+  struct AES_bufpool *bufs = client->bufs;
+
+  if (!bufs)
+    return;
+  dma_free_coherent(AES_dev->dev, bufs->size, bufs->cpu, bufs->dma);
+  atomic_sub(bufs->size, &AES_dev->buf_pool_bytes);
+  kfree(bufs);
+}
+
+/* The whole pool, once: jobs find it by the address of that mapping */
+static int AES_bufpool_mmap(struct AES_client *client,
+                            struct vm_area_struct *vma) {
+  struct AES_bufpool *bufs = smp_load_acquire(&client->bufs);
+  int ret;
+
+  if (!bufs)
+    return -ENXIO;
+  if (vma->vm_end - vma->vm_start != bufs->size)
+    return -EINVAL;
+  if (cmpxchg(&bufs->uaddr, 0, vma->vm_start))
+    return -EBUSY;
+  vma->vm_pgoff = 0;
+  ret = dma_mmap_coherent(client->AES_dev->dev, vma, bufs->cpu, bufs->dma,
+                          bufs->size);
+  if (ret)
+    WRITE_ONCE(bufs->uaddr, 0);
+  return ret;
+}
+
+static int AES_mmap(struct file *file, struct vm_area_struct *vma) {
+  struct AES_client *client = file->private_data;
+  struct AES_uring *uring = smp_load_acquire(&client->uring);
+
+  if (READ_ONCE(client->AES_dev->dead))
+    return -ENODEV;
+  if (vma->vm_pgoff == AES_BUF_MMAP_OFFSET >> PAGE_SHIFT)
+    return AES_bufpool_mmap(client, vma);
+  if (!uring)
+    return -ENXIO;
+  if (vma->vm_pgoff || vma_pages(vma) > uring->size >> PAGE_SHIFT)
+    return -EINVAL;
+  return remap_vmalloc_range(vma, uring->mem, 0);
+}
+
+/* Readable when there are completions to collect or to consume; an error
+ * once the instance is being removed, which wakes pollers on idle_wq */
+static __poll_t AES_poll(struct file *file, poll_table *wait) {
+  struct AES_client *client = file->private_data;
+  struct AES_uring *uring = smp_load_acquire(&client->uring);
+
+  if (!uring)
+    return EPOLLERR;
+  poll_wait(file, &uring->wq, wait);
+  poll_wait(file, &client->AES_dev->idle_wq, wait);
+  if (READ_ONCE(client->AES_dev->dead))
+    return EPOLLERR | EPOLLHUP;
+  if (AES_uring_has_done(uring) ||
+      READ_ONCE(uring->cq_tail) != READ_ONCE(uring->hdr->cq_head))
+    return EPOLLIN | EPOLLRDNORM;
+  return 0;
+}
+
+/* Wait for the jobs still on the queue and drop every result: the handle is
+ * closing, and its address space may already be gone */
+static void AES_uring_free(struct AES_client *client) {
+  struct AES_uring *uring = client->uring;
+  struct AES_user_job *uj, *tmp;
+
+  if (!uring)
+    return;
+  wait_event(uring->wq, !READ_ONCE(uring->running));
+  /* Once the lock is free the last callback is done with the ring */
+  spin_lock_bh(&uring->done_lock);
+  spin_unlock_bh(&uring->done_lock);
+
+  list_for_each_entry_safe(uj, tmp, &uring->done, node) {
+    if (uj->job.src_sgt) {
+      if (uj->job.dst_sgt != uj->job.src_sgt)
+        AES_unpin_user(client->AES_dev, &uj->dst);
+      AES_unpin_user(client->AES_dev, &uj->src);
+    }
+    kvfree(uj->job.buf);
+    kfree(uj);
+  }
+  vfree(uring->mem);
+  kfree(uring);
+}
+
+/*--------------------------------------------------------- MESSAGE BATCH
+ * ---------------------------------------------------------*/
+
+/* Messages of a batch run as one job: ECB messages with one key, or CTR
+ * messages each starting at the counter the one before it ends on. Their
+ * text lies back to back in the batch buffer. */
+struct AES_batch_run {
+  struct AES_job job;
+  u32 first; // position of the first message in the sorted order
+  u32 count;
+};
+
+static int AES_batch_msg_check(struct pixxel_AES_dev *AES_dev,
+                               const struct aes_key *keys, u32 nkeys,
+                               const struct aes_msg *msg) {
+  u32 caps;
+
+  if (msg->key >= nkeys || keys[msg->key].key_choice > AES_KEY_CHOICE_256 ||
+      !msg->len || msg->len > AES_BATCH_MAX_LEN)
+    return -EINVAL;
+  switch (msg->mode) {
+  case AES_MODE_ECB:
+    if (msg->len % AES_BLOCK_LEN || (msg->flags & ~AES_JOB_DECRYPT))
+      return -EINVAL;
+    break;
+  case AES_MODE_CTR:
+    if (msg->flags)
+      return -EINVAL;
+    break;
+  default:
+    return -EINVAL;
+  }
+  caps = AES_job_caps(msg->mode, msg->flags);
+  return (AES_dev->caps & caps) == caps ? 0 : -EOPNOTSUPP;
+}
+
+/* Sort order: key, then mode and flags, then position in the batch */
+static u64 AES_batch_order(const struct aes_msg *msg, u32 i) {
+  return (u64)msg->key << 40 | (u64)msg->mode << 36 | (u64)msg->flags << 32 |
+         i;
+}
+
+static int AES_batch_cmp(const void *a, const void *b) {
+  u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* Whether msg can extend the run that prev ends */
+static bool AES_batch_joins(const struct aes_msg *prev,
+                            const struct aes_msg *msg) {
+  u8 iv[AES_BLOCK_LEN];
+
+  if (msg->key != prev->key || msg->mode != prev->mode ||
+      msg->flags != prev->flags)
+    return false;
+  if (msg->mode == AES_MODE_ECB)
+    return true;
+  if (prev->len % AES_BLOCK_LEN)
+    return false;
+  memcpy(iv, prev->iv, sizeof(iv));
+  AES_ctr_add(iv, prev->len / AES_BLOCK_LEN);
+  return !memcmp(iv, msg->iv, sizeof(iv));
+}
+
+/*
+ * Run a batch: copy the valid messages into one buffer in key order, each
+ * at a block boundary, queue one job per run and wait for them all, then
+ * copy the results back and write every message's status. The runs queue
+ * together from one client, so a key is loaded for its first run only and
+ * on the ring each run is one descriptor.
+ */
+static long AES_ioctl_batch(struct AES_client *client, void __user *argp) {
+  struct pixxel_AES_dev *AES_dev = client->AES_dev;
+  struct AES_batch_run *runs = NULL, *run = NULL;
+  struct aes_msg __user *umsgs;
+  u32 i, r, n = 0, nruns = 0, off, len = 0;
+  struct aes_msg *msgs, *msg;
+  struct AES_job *job;
+  struct aes_key *keys;
+  struct aes_batch b;
+  LIST_HEAD(jobs);
+  u64 *order = NULL;
+  u8 *buf = NULL;
+  long ret = 0;
+
+  if (copy_from_user(&b, argp, sizeof(b)))
+    return -EFAULT;
+  if (!b.nkeys || b.nkeys > AES_BATCH_MAX_KEYS || !b.count ||
+      b.count > AES_BATCH_MAX_MSGS)
+    return -EINVAL;
+  keys = memdup_array_user(u64_to_user_ptr(b.keys), b.nkeys, sizeof(*keys));
+  if (IS_ERR(keys))
+    return PTR_ERR(keys);
+  umsgs = u64_to_user_ptr(b.msgs);
+  msgs = vmemdup_array_user(umsgs, b.count, sizeof(*msgs));
+  if (IS_ERR(msgs)) {
+    kfree(keys);
+    return PTR_ERR(msgs);
+  }
+
+  order = kvmalloc_array(b.count, sizeof(*order), GFP_KERNEL);
+  if (!order) {
+    ret = -ENOMEM;
+    goto out_free;
+  }
+  for (i = 0; i < b.count; i++) {
+    msg = &msgs[i];
+    msg->status = AES_batch_msg_check(AES_dev, keys, b.nkeys, msg);
+    if (msg->status)
+      continue;
+    len += ALIGN(msg->len, AES_BLOCK_LEN);
+    order[n++] = AES_batch_order(msg, i);
+  }
+  if (len > AES_BATCH_MAX_LEN) {
+    ret = -EINVAL;
+    goto out_free;
+  }
+  if (!n)
+    goto out_status;
+  sort(order, n, sizeof(*order), AES_batch_cmp, NULL);
+
+  buf = kmalloc(len, GFP_KERNEL);
+  runs = kvcalloc(n, sizeof(*runs), GFP_KERNEL);
+  if (!buf || !runs) {
+    ret = -ENOMEM;
+    goto out_free;
+  }
+  for (i = 0, off = 0; i < n; off += ALIGN(msg->len, AES_BLOCK_LEN), i++) {
+    msg = &msgs[(u32)order[i]];
+    if (copy_from_user(buf + off, u64_to_user_ptr(msg->src), msg->len)) {
+      msg->status = -EFAULT;
+      run = NULL;
+      continue;
+    }
+    if (run && AES_batch_joins(&msgs[(u32)order[i - 1]], msg)) {
+      run->count++;
+      run->job.len += msg->len;
+      continue;
+    }
+    run = &runs[nruns++];
+    run->first = i;
+    run->count = 1;
+    job = &run->job;
+    job->client = client;
+    job->key_choice = keys[msg->key].key_choice;
+    memcpy(job->key, keys[msg->key].key, sizeof(job->key));
+    job->mode = msg->mode;
+    job->flags = msg->flags;
+    memcpy(job->iv, msg->iv, sizeof(job->iv));
+    job->len = msg->len;
+    job->buf = buf + off;
+  }
+
+  AES_get_load(AES_dev, len / AES_BLOCK_LEN);
+  for (r = 0; r < nruns; r++) {
+    init_completion(&runs[r].job.done);
+    list_add_tail(&runs[r].job.node, &jobs);
+  }
+  AES_submit_list(AES_dev, client, &jobs);
+  for (r = 0; r < nruns; r++)
+    wait_for_completion(&runs[r].job.done);
+  AES_put_load(AES_dev, len / AES_BLOCK_LEN);
+
+  for (r = 0; r < nruns; r++) {
+    run = &runs[r];
+    off = run->job.buf - buf;
+    for (i = run->first; i < run->first + run->count; i++) {
+      msg = &msgs[(u32)order[i]];
+      msg->status = run->job.status;
+      if (!msg->status && copy_to_user(u64_to_user_ptr(msg->dst), buf + off,
+                                       msg->len))
+        msg->status = -EFAULT;
+      off += ALIGN(msg->len, AES_BLOCK_LEN);
+    }
+  }
+
+out_status:
+  for (i = 0; i < b.count; i++) {
+    if (put_user(msgs[i].status, &umsgs[i].status)) {
+      ret = -EFAULT;
+      break;
+    }
+  }
+out_free:
+  kvfree(runs);
+  kfree(buf);
+  kvfree(order);
+  kvfree(msgs);
+  kfree(keys);
+  return ret;
+}
+
+static long AES_ioctl_set_prio(struct AES_client *client, void __user *argp) {
+  struct aes_prio p;
+
+  if (copy_from_user(&p, argp, sizeof(p)))
+    return -EFAULT;
+  if (p.prio >= AES_PRIO_CLASSES)
+    return -EINVAL;
+  WRITE_ONCE(client->prio, p.prio);
+  WRITE_ONCE(client->deadline_us, p.deadline_us);
+  return 0;
+}
+
+static long AES_ioctl_cmd(struct AES_client *client, unsigned int cmd,
+                          unsigned long arg) {
+  switch (cmd) {
+  case AES_IOC_CRYPT:
+    return AES_ioctl_crypt(client, (void __user *)arg);
+  case AES_IOC_URING_SETUP:
+    return AES_uring_setup(client, (void __user *)arg);
+  case AES_IOC_URING_ENTER:
+    return AES_uring_enter(client, (void __user *)arg);
+  case AES_IOC_BATCH:
+    return AES_ioctl_batch(client, (void __user *)arg);
+  case AES_IOC_SET_PRIO:
+    return AES_ioctl_set_prio(client, (void __user *)arg);
+  case AES_IOC_BUF_SETUP:
+    return AES_bufpool_setup(client, (void __user *)arg);
+  default:
+    return -ENOTTY;
+  }
+}
+
+/* Every command may reach the hardware, so none runs once remove() has
+ * marked the instance dead */
+static long AES_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+  struct AES_client *client = file->private_data;
+  struct pixxel_AES_dev *AES_dev = client->AES_dev;
+  long ret = -ENODEV;
+
+  down_read(&AES_dev->remove_lock);
+  if (!AES_dev->dead)
+    ret = AES_ioctl_cmd(client, cmd, arg);
+  up_read(&AES_dev->remove_lock);
+  return ret;
+}
+
+static const struct file_operations AES_fops = {
+    .owner = THIS_MODULE,
+    .open = AES_open,
+    .release = AES_release,
+    .unlocked_ioctl = AES_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .mmap = AES_mmap,
+    .poll = AES_poll,
+};
+
+/*--------------------------------------------------------- DEVICE POOL
+ * ---------------------------------------------------------*/
+
+/*
+ * Choose an instance for a job: the least loaded one with the CAPS bits the
+ * job needs, unless the key's home instance (where it was last sent, so most
+ * likely still resident) is within AES_AFFINITY_SLACK_BLOCKS of it. The load
+ * is taken before the pool lock is dropped, which also keeps the instance
+ * from being removed under the job.
+ */
+static struct pixxel_AES_dev *AES_pool_get(u32 key_choice, const u32 *key,
+                                           u32 caps, unsigned int blocks) {
+  u32 bucket = jhash(key, 8 * sizeof(u32), key_choice) % AES_AFFINITY_BUCKETS;
+  struct pixxel_AES_dev *AES_dev, *least = NULL, *home = NULL;
+  int load, least_load = INT_MAX;
+
+  spin_lock_bh(&AES_pool_lock);
+  list_for_each_entry(AES_dev, &AES_pool, pool_node) {
+    if ((AES_dev->caps & caps) != caps)
+      continue;
+    load = atomic_read(&AES_dev->load);
+    if (load < least_load) {
+      least = AES_dev;
+      least_load = load;
+    }
+    if (AES_dev->id == AES_affinity[bucket])
+      home = AES_dev;
+  }
+  if (home &&
+      atomic_read(&home->load) <= least_load + AES_AFFINITY_SLACK_BLOCKS)
+    least = home;
+  if (least) {
+    AES_affinity[bucket] = least->id;
+    AES_get_load(least, blocks);
+  }
+  spin_unlock_bh(&AES_pool_lock);
+  return least;
+}
+
+static long AES_pool_ioctl_crypt(void __user *argp) {
+  struct pixxel_AES_dev *AES_dev;
+  struct AES_client client;
+  struct aes_job req;
+  unsigned int blocks;
+  long ret;
+
+  if (copy_from_user(&req, argp, sizeof(req)))
+    return -EFAULT;
+  if (!AES_job_valid(&req))
+    return -EINVAL;
+
+  blocks = AES_job_blocks(req.aad_len, req.len);
+  AES_dev = AES_pool_get(req.key_choice, req.key,
+                         AES_job_caps(req.mode, req.flags), blocks);
+  if (!AES_dev)
+    return -ENODEV;
+
+  /* Each pooled job queues as its own client of the chosen instance */
+  AES_client_init(&client, AES_dev);
+  ret = AES_crypt(&client, &req);
+  AES_put_load(AES_dev, blocks);
+  return ret;
+}
+
+static long AES_pool_ioctl(struct file *file, unsigned int cmd,
+                           unsigned long arg) {
+  switch (cmd) {
+  case AES_IOC_CRYPT:
+    return AES_pool_ioctl_crypt((void __user *)arg);
+  default:
+    return -ENOTTY;
+  }
+}
+
+static const struct file_operations AES_pool_fops = {
+    .owner = THIS_MODULE,
+    .unlocked_ioctl = AES_pool_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+};
+
+static struct miscdevice AES_pool_misc = {
+    .minor = MISC_DYNAMIC_MINOR,
+    .name = AES_POOL_NAME,
+    .fops = &AES_pool_fops,
+};
+
+/* Instance ids come from the "aes" aliases in the device tree when present,
+ * otherwise the lowest free index, so /dev/aes<id> is stable across boots */
+static int AES_alloc_id(struct device *dev) {
+  int id = of_alias_get_id(dev->of_node, AES_POOL_NAME);
+
+  if (id >= 0)
+    return ida_alloc_range(&AES_ida, id, id, GFP_KERNEL);
+  return ida_alloc(&AES_ida, GFP_KERNEL);
+}
+
+/*--------------------------------------------------------- CRYPTO API
+ * ---------------------------------------------------------*/
+
+struct AES_gcm_ctx {
+  u32 key_choice;
+  u32 key[8];                   // key register words
+  struct crypto_aead *fallback; // requests the hardware cannot take
+};
+
+struct AES_gcm_reqctx {
+  struct aead_request *req;
+  struct pixxel_AES_dev *AES_dev;
+  struct AES_client client;
+  struct AES_job job;
+  u8 tag[AES_GCM_TAG_LEN]; // expected tag on decryption
+  struct aead_request fallback_req; // last, sized by the fallback
+};
+
+struct AES_xts_ctx {
+  u32 key_choice;
+  u32 key[8];                       // data key register words
+  u32 key2[8];                      // tweak key register words
+  struct crypto_skcipher *fallback; // requests the hardware cannot take
+};
+
+struct AES_xts_reqctx {
+  struct skcipher_request *req;
+  struct pixxel_AES_dev *AES_dev;
+  struct AES_client client;
+  struct AES_job job;
+  struct skcipher_request fallback_req; // last, sized by the fallback
+};
+
+struct AES_cmac_ctx {
+  u32 key_choice;
+  u32 key[8];                 // key register words
+  struct crypto_aes_ctx aes;  // software path when no instance is free
+};
+
+/* Partial hash state, as exported: the chaining value and the bytes not yet
+ * chained. The last block is always held back for FINAL. */
+struct AES_cmac_state {
+  u8 mac[AES_BLOCK_SIZE];
+  u8 buf[AES_BLOCK_SIZE];
+  unsigned int buflen;
+};
+
+struct AES_cmac_reqctx {
+  struct AES_cmac_state state;
+  bool final;
+  struct ahash_request *req;
+  struct pixxel_AES_dev *AES_dev;
+  struct AES_client client;
+  struct AES_job job;
+};
+
+/* Registered while at least one instance is probed, under AES_alg_lock */
+static DEFINE_MUTEX(AES_alg_lock);
+static unsigned int AES_alg_users;
+
+/* Split an AES key into key register words and its key choice */
+static int AES_key_words(const u8 *key, unsigned int keylen, u32 *key_choice,
+                         u32 *words) {
+  int i;
+
+  switch (keylen) {
+  case AES_KEYSIZE_128:
+    *key_choice = AES_KEY_CHOICE_128;
+    break;
+  case AES_KEYSIZE_192:
+    *key_choice = AES_KEY_CHOICE_192;
+    break;
+  case AES_KEYSIZE_256:
+    *key_choice = AES_KEY_CHOICE_256;
+    break;
+  default:
+    return -EINVAL;
+  }
+  memset(words, 0, 8 * sizeof(u32));
+  for (i = 0; i < keylen / 4; i++)
+    words[i] = get_unaligned_le32(key + 4 * i);
+  return 0;
+}
+
+static int AES_gcm_setkey(struct crypto_aead *tfm, const u8 *key,
+                          unsigned int keylen) {
+  struct AES_gcm_ctx *ctx = crypto_aead_ctx(tfm);
+  int ret;
+
+  ret = AES_key_words(key, keylen, &ctx->key_choice, ctx->key);
+  if (ret)
+    return ret;
+
+  crypto_aead_clear_flags(ctx->fallback, CRYPTO_TFM_REQ_MASK);
+  crypto_aead_set_flags(ctx->fallback,
+                        crypto_aead_get_flags(tfm) & CRYPTO_TFM_REQ_MASK);
+  return crypto_aead_setkey(ctx->fallback, key, keylen);
+}
+
+static int AES_gcm_setauthsize(struct crypto_aead *tfm,
+                               unsigned int authsize) {
+  struct AES_gcm_ctx *ctx = crypto_aead_ctx(tfm);
+  int ret;
+
+  ret = crypto_gcm_check_authsize(authsize);
+  if (ret)
+    return ret;
+  return crypto_aead_setauthsize(ctx->fallback, authsize);
+}
+
+static int AES_gcm_fallback(struct aead_request *req, bool decrypt) {
+  struct AES_gcm_ctx *ctx = crypto_aead_ctx(crypto_aead_reqtfm(req));
+  struct AES_gcm_reqctx *rctx = aead_request_ctx(req);
+
+  aead_request_set_tfm(&rctx->fallback_req, ctx->fallback);
+  aead_request_set_callback(&rctx->fallback_req, req->base.flags,
+                            req->base.complete, req->base.data);
+  aead_request_set_crypt(&rctx->fallback_req, req->src, req->dst,
+                         req->cryptlen, req->iv);
+  aead_request_set_ad(&rctx->fallback_req, req->assoclen);
+  return decrypt ? crypto_aead_decrypt(&rctx->fallback_req)
+                 : crypto_aead_encrypt(&rctx->fallback_req);
+}
+
+/* Runs in the queue worker once the hardware has finished the request */
+static void AES_gcm_done(struct AES_job *job) {
+  struct AES_gcm_reqctx *rctx = container_of(job, struct AES_gcm_reqctx, job);
+  struct aead_request *req = rctx->req;
+  unsigned int authsize = crypto_aead_authsize(crypto_aead_reqtfm(req));
+  unsigned int total = job->aad_len + job->len;
+  int ret = job->status;
+
+  if (!ret && (job->flags & AES_JOB_DECRYPT) &&
+      crypto_memneq(job->tag, rctx->tag, authsize))
+    ret = -EBADMSG;
+  if (!ret) {
+    /* The additional data is passed through for out-of-place requests */
+    scatterwalk_map_and_copy(job->buf, req->dst, 0, total, 1);
+    if (!(job->flags & AES_JOB_DECRYPT))
+      scatterwalk_map_and_copy(job->tag, req->dst, total, authsize, 1);
+  }
+
+  kfree_sensitive(job->buf);
+  AES_put_load(rctx->AES_dev, AES_job_blocks(job->aad_len, job->len));
+  aead_request_complete(req, ret);
+}
+
+static int AES_gcm_crypt(struct aead_request *req, bool decrypt) {
+  struct crypto_aead *tfm = crypto_aead_reqtfm(req);
+  struct AES_gcm_ctx *ctx = crypto_aead_ctx(tfm);
+  struct AES_gcm_reqctx *rctx = aead_request_ctx(req);
+  unsigned int authsize = crypto_aead_authsize(tfm);
+  gfp_t gfp = req->base.flags & CRYPTO_TFM_REQ_MAY_SLEEP ? GFP_KERNEL
+                                                         : GFP_ATOMIC;
+  struct AES_job *job = &rctx->job;
+  unsigned int textlen, blocks;
+
+  if (decrypt && req->cryptlen < authsize)
+    return -EINVAL;
+  textlen = req->cryptlen - (decrypt ? authsize : 0);
+  if (req->assoclen > AES_CRYPTO_MAX_LEN || textlen > AES_CRYPTO_MAX_LEN)
+    return AES_gcm_fallback(req, decrypt);
+
+  blocks = AES_job_blocks(req->assoclen, textlen);
+  rctx->AES_dev = AES_pool_get(ctx->key_choice, ctx->key, BIT(AES_MODE_GCM),
+                               blocks);
+  if (!rctx->AES_dev)
+    return AES_gcm_fallback(req, decrypt);
+
+  memset(job, 0, sizeof(*job));
+  job->buf = kmalloc(req->assoclen + textlen, gfp);
+  if (!job->buf) {
+    AES_put_load(rctx->AES_dev, blocks);
+    return -ENOMEM;
+  }
+  scatterwalk_map_and_copy(job->buf, req->src, 0, req->assoclen + textlen, 0);
+  if (decrypt)
+    scatterwalk_map_and_copy(rctx->tag, req->src, req->assoclen + textlen,
+                             authsize, 0);
+
+  job->key_choice = ctx->key_choice;
+  memcpy(job->key, ctx->key, sizeof(job->key));
+  job->mode = AES_MODE_GCM;
+  job->flags = decrypt ? AES_JOB_DECRYPT : 0;
+  memcpy(job->iv, req->iv, GCM_AES_IV_SIZE);
+  job->aad_len = req->assoclen;
+  job->len = textlen;
+  job->complete = AES_gcm_done;
+
+  /* Each request queues as its own client, like a pooled ioctl */
+  rctx->req = req;
+  AES_client_init(&rctx->client, rctx->AES_dev);
+  job->client = &rctx->client;
+  AES_submit_job(rctx->AES_dev, job);
+  return -EINPROGRESS;
+}
+
+static int AES_gcm_encrypt(struct aead_request *req) {
+  return AES_gcm_crypt(req, false);
+}
+
+static int AES_gcm_decrypt(struct aead_request *req) {
+  return AES_gcm_crypt(req, true);
+}
+
+static int AES_gcm_init_tfm(struct crypto_aead *tfm) {
+  struct AES_gcm_ctx *ctx = crypto_aead_ctx(tfm);
+
+  ctx->fallback = crypto_alloc_aead(crypto_tfm_alg_name(crypto_aead_tfm(tfm)),
+                                    0, CRYPTO_ALG_NEED_FALLBACK);
+  if (IS_ERR(ctx->fallback))
+    return PTR_ERR(ctx->fallback);
+  crypto_aead_set_reqsize(tfm, sizeof(struct AES_gcm_reqctx) +
+                                   crypto_aead_reqsize(ctx->fallback));
+  return 0;
+}
+
+static void AES_gcm_exit_tfm(struct crypto_aead *tfm) {
+  struct AES_gcm_ctx *ctx = crypto_aead_ctx(tfm);
+
+  crypto_free_aead(ctx->fallback);
+}
+
+static int AES_xts_setkey(struct crypto_skcipher *tfm, const u8 *key,
+                          unsigned int keylen) {
+  struct AES_xts_ctx *ctx = crypto_skcipher_ctx(tfm);
+  u32 key_choice;
+  int ret;
+
+  ret = xts_verify_key(tfm, key, keylen);
+  if (ret)
+    return ret;
+  /* The data key comes first, then the tweak key of the same size */
+  ret = AES_key_words(key, keylen / 2, &ctx->key_choice, ctx->key);
+  if (!ret)
+    ret = AES_key_words(key + keylen / 2, keylen / 2, &key_choice, ctx->key2);
+  if (ret)
+    return ret;
+
+  crypto_skcipher_clear_flags(ctx->fallback, CRYPTO_TFM_REQ_MASK);
+  crypto_skcipher_set_flags(ctx->fallback, crypto_skcipher_get_flags(tfm) &
+                                               CRYPTO_TFM_REQ_MASK);
+  return crypto_skcipher_setkey(ctx->fallback, key, keylen);
+}
+
+static int AES_xts_fallback(struct skcipher_request *req, bool decrypt) {
+  struct AES_xts_ctx *ctx = crypto_skcipher_ctx(crypto_skcipher_reqtfm(req));
+  struct AES_xts_reqctx *rctx = skcipher_request_ctx(req);
+
+  skcipher_request_set_tfm(&rctx->fallback_req, ctx->fallback);
+  skcipher_request_set_callback(&rctx->fallback_req, req->base.flags,
+                                req->base.complete, req->base.data);
+  skcipher_request_set_crypt(&rctx->fallback_req, req->src, req->dst,
+                             req->cryptlen, req->iv);
+  return decrypt ? crypto_skcipher_decrypt(&rctx->fallback_req)
+                 : crypto_skcipher_encrypt(&rctx->fallback_req);
+}
+
+/* Runs in the queue worker once the hardware has finished the request */
+static void AES_xts_done(struct AES_job *job) {
+  struct AES_xts_reqctx *rctx = container_of(job, struct AES_xts_reqctx, job);
+  struct skcipher_request *req = rctx->req;
+
+  if (!job->status)
+    scatterwalk_map_and_copy(job->buf, req->dst, 0, job->len, 1);
+  kfree_sensitive(job->buf);
+  AES_put_load(rctx->AES_dev, AES_job_blocks(0, job->len));
+  skcipher_request_complete(req, job->status);
+}
+
+/* Requests are one data unit (dm-crypt sends a sector each). Ciphertext
+ * stealing, for lengths that are not whole blocks, is left to the fallback. */
+static int AES_xts_crypt(struct skcipher_request *req, bool decrypt) {
+  struct AES_xts_ctx *ctx = crypto_skcipher_ctx(crypto_skcipher_reqtfm(req));
+  struct AES_xts_reqctx *rctx = skcipher_request_ctx(req);
+  gfp_t gfp = req->base.flags & CRYPTO_TFM_REQ_MAY_SLEEP ? GFP_KERNEL
+                                                         : GFP_ATOMIC;
+  struct AES_job *job = &rctx->job;
+  unsigned int blocks;
+
+  if (req->cryptlen < AES_BLOCK_SIZE)
+    return -EINVAL;
+  if (req->cryptlen % AES_BLOCK_SIZE || req->cryptlen > AES_CRYPTO_MAX_LEN)
+    return AES_xts_fallback(req, decrypt);
+
+  blocks = AES_job_blocks(0, req->cryptlen);
+  rctx->AES_dev = AES_pool_get(
+      ctx->key_choice, ctx->key,
+      AES_job_caps(AES_MODE_XTS, decrypt ? AES_JOB_DECRYPT : 0), blocks);
+  if (!rctx->AES_dev)
+    return AES_xts_fallback(req, decrypt);
+
+  memset(job, 0, sizeof(*job));
+  job->buf = kmalloc(req->cryptlen, gfp);
+  if (!job->buf) {
+    AES_put_load(rctx->AES_dev, blocks);
+    return -ENOMEM;
+  }
+  scatterwalk_map_and_copy(job->buf, req->src, 0, req->cryptlen, 0);
+
+  job->key_choice = ctx->key_choice;
+  memcpy(job->key, ctx->key, sizeof(job->key));
+  memcpy(job->key2, ctx->key2, sizeof(job->key2));
+  job->mode = AES_MODE_XTS;
+  job->flags = decrypt ? AES_JOB_DECRYPT : 0;
+  memcpy(job->iv, req->iv, AES_BLOCK_SIZE);
+  job->len = req->cryptlen;
+  job->complete = AES_xts_done;
+
+  rctx->req = req;
+  AES_client_init(&rctx->client, rctx->AES_dev);
+  job->client = &rctx->client;
+  AES_submit_job(rctx->AES_dev, job);
+  return -EINPROGRESS;
+}
+
+static int AES_xts_encrypt(struct skcipher_request *req) {
+  return AES_xts_crypt(req, false);
+}
+
+static int AES_xts_decrypt(struct skcipher_request *req) {
+  return AES_xts_crypt(req, true);
+}
+
+static int AES_xts_init_tfm(struct crypto_skcipher *tfm) {
+  struct AES_xts_ctx *ctx = crypto_skcipher_ctx(tfm);
+
+  ctx->fallback =
+      crypto_alloc_skcipher(crypto_tfm_alg_name(crypto_skcipher_tfm(tfm)), 0,
+                            CRYPTO_ALG_NEED_FALLBACK);
+  if (IS_ERR(ctx->fallback))
+    return PTR_ERR(ctx->fallback);
+  crypto_skcipher_set_reqsize(tfm, sizeof(struct AES_xts_reqctx) +
+                                       crypto_skcipher_reqsize(ctx->fallback));
+  return 0;
+}
+
+static void AES_xts_exit_tfm(struct crypto_skcipher *tfm) {
+  struct AES_xts_ctx *ctx = crypto_skcipher_ctx(tfm);
+
+  crypto_free_skcipher(ctx->fallback);
+}
+
+static int AES_cmac_setkey(struct crypto_ahash *tfm, const u8 *key,
+                           unsigned int keylen) {
+  struct AES_cmac_ctx *ctx = crypto_ahash_ctx(tfm);
+  int ret;
+
+  ret = AES_key_words(key, keylen, &ctx->key_choice, ctx->key);
+  if (ret)
+    return ret;
+  return aes_expandkey(&ctx->aes, key, keylen);
+}
+
+/* Double in GF(2^128), big endian, for the subkeys */
+static void AES_cmac_dbl(u8 *x) {
+  u8 carry = x[0] >> 7;
+  int i;
+
+  for (i = 0; i < AES_BLOCK_SIZE - 1; i++)
+    x[i] = (x[i] << 1) | (x[i + 1] >> 7);
+  x[AES_BLOCK_SIZE - 1] = (x[AES_BLOCK_SIZE - 1] << 1) ^ (carry ? 0x87 : 0);
+}
+
+/* Software CMAC with the same state as the hardware: chain `len` bytes into
+ * mac, or with `final` chain all but the last block and finish with it */
+static void AES_cmac_soft(const struct AES_cmac_ctx *ctx, u8 *mac,
+                          const u8 *data, unsigned int len, bool final) {
+  unsigned int last = 0, off;
+  u8 k[AES_BLOCK_SIZE] = {0};
+
+  if (final)
+    last = len ? (len - 1) % AES_BLOCK_SIZE + 1 : 0;
+  for (off = 0; off < len - last; off += AES_BLOCK_SIZE) {
+    crypto_xor(mac, data + off, AES_BLOCK_SIZE);
+    aes_encrypt(&ctx->aes, mac, mac);
+  }
+  if (!final)
+    return;
+
+  aes_encrypt(&ctx->aes, k, k);
+  AES_cmac_dbl(k);
+  crypto_xor(mac, data + off, last);
+  if (last < AES_BLOCK_SIZE) {
+    mac[last] ^= 0x80;
+    AES_cmac_dbl(k);
+  }
+  crypto_xor(mac, k, AES_BLOCK_SIZE);
+  aes_encrypt(&ctx->aes, mac, mac);
+  memzero_explicit(k, sizeof(k));
+}
+
+/* Runs in the queue worker once the hardware has finished the request */
+static void AES_cmac_done(struct AES_job *job) {
+  struct AES_cmac_reqctx *rctx =
+      container_of(job, struct AES_cmac_reqctx, job);
+  struct ahash_request *req = rctx->req;
+
+  if (!job->status)
+    memcpy(rctx->final ? req->result : rctx->state.mac, job->tag,
+           AES_BLOCK_SIZE);
+  kfree_sensitive(job->buf);
+  AES_put_load(rctx->AES_dev, AES_job_blocks(0, job->len));
+  ahash_request_complete(req, job->status);
+}
+
+/*
+ * Chain the buffered bytes and `nbytes` more from req->src. Without `final`
+ * the last block is held back, so only whole blocks reach the hardware and
+ * the chaining value comes back (AES_JOB_MORE); with it the whole remainder
+ * goes in one job ending in FINAL. Work too large for one job, or with no
+ * instance free, is done in software from the same state.
+ */
+static int AES_cmac_process(struct ahash_request *req, unsigned int nbytes,
+                            bool final) {
+  struct AES_cmac_ctx *ctx = crypto_ahash_ctx(crypto_ahash_reqtfm(req));
+  struct AES_cmac_reqctx *rctx = ahash_request_ctx(req);
+  struct AES_cmac_state *st = &rctx->state;
+  gfp_t gfp = req->base.flags & CRYPTO_TFM_REQ_MAY_SLEEP ? GFP_KERNEL
+                                                         : GFP_ATOMIC;
+  unsigned int total = st->buflen + nbytes, len, keep = 0;
+  struct AES_job *job = &rctx->job;
+  u8 *buf;
+
+  if (!final && total <= AES_BLOCK_SIZE) {
+    scatterwalk_map_and_copy(st->buf + st->buflen, req->src, 0, nbytes, 0);
+    st->buflen = total;
+    return 0;
+  }
+  if (!final)
+    keep = (total - 1) % AES_BLOCK_SIZE + 1;
+  len = total - keep;
+
+  buf = kmalloc(len, gfp);
+  if (!buf)
+    return -ENOMEM;
+  memcpy(buf, st->buf, st->buflen);
+  scatterwalk_map_and_copy(buf + st->buflen, req->src, 0, len - st->buflen, 0);
+  scatterwalk_map_and_copy(st->buf, req->src, len - st->buflen, keep, 0);
+  st->buflen = keep;
+
+  rctx->AES_dev = NULL;
+  if (len <= AES_CRYPTO_MAX_LEN)
+    rctx->AES_dev = AES_pool_get(ctx->key_choice, ctx->key,
+                                 BIT(AES_MODE_CMAC), AES_job_blocks(0, len));
+  if (!rctx->AES_dev) {
+    AES_cmac_soft(ctx, st->mac, buf, len, final);
+    if (final)
+      memcpy(req->result, st->mac, AES_BLOCK_SIZE);
+    kfree_sensitive(buf);
+    return 0;
+  }
+
+  memset(job, 0, sizeof(*job));
+  job->buf = buf;
+  job->key_choice = ctx->key_choice;
+  memcpy(job->key, ctx->key, sizeof(job->key));
+  job->mode = AES_MODE_CMAC;
+  job->flags = final ? 0 : AES_JOB_MORE;
+  memcpy(job->iv, st->mac, AES_BLOCK_SIZE);
+  job->len = len;
+  job->complete = AES_cmac_done;
+
+  rctx->final = final;
+  rctx->req = req;
+  AES_client_init(&rctx->client, rctx->AES_dev);
+  job->client = &rctx->client;
+  AES_submit_job(rctx->AES_dev, job);
+  return -EINPROGRESS;
+}
+
+static int AES_cmac_init(struct ahash_request *req) {
+  struct AES_cmac_reqctx *rctx = ahash_request_ctx(req);
+
+  memset(&rctx->state, 0, sizeof(rctx->state));
+  return 0;
+}
+
+static int AES_cmac_update(struct ahash_request *req) {
+  return AES_cmac_process(req, req->nbytes, false);
+}
+
+static int AES_cmac_final(struct ahash_request *req) {
+  return AES_cmac_process(req, 0, true);
+}
+
+static int AES_cmac_finup(struct ahash_request *req) {
+  return AES_cmac_process(req, req->nbytes, true);
+}
+
+static int AES_cmac_digest(struct ahash_request *req) {
+  AES_cmac_init(req);
+  return AES_cmac_finup(req);
+}
+
+static int AES_cmac_export(struct ahash_request *req, void *out) {
+  struct AES_cmac_reqctx *rctx = ahash_request_ctx(req);
+
+  memcpy(out, &rctx->state, sizeof(rctx->state));
+  return 0;
+}
+
+static int AES_cmac_import(struct ahash_request *req, const void *in) {
+  struct AES_cmac_reqctx *rctx = ahash_request_ctx(req);
+
+  memcpy(&rctx->state, in, sizeof(rctx->state));
+  return 0;
+}
+
+static int AES_cmac_init_tfm(struct crypto_ahash *tfm) {
+  crypto_ahash_set_reqsize(tfm, sizeof(struct AES_cmac_reqctx));
+  return 0;
+}
+
+static struct aead_alg AES_aead_algs[] = {
+    {
+        .setkey = AES_gcm_setkey,
+        .setauthsize = AES_gcm_setauthsize,
+        .encrypt = AES_gcm_encrypt,
+        .decrypt = AES_gcm_decrypt,
+        .init = AES_gcm_init_tfm,
+        .exit = AES_gcm_exit_tfm,
+        .ivsize = GCM_AES_IV_SIZE,
+        .maxauthsize = AES_GCM_TAG_LEN,
+        .base =
+            {
+                .cra_name = "gcm(aes)",
+                .cra_driver_name = "gcm-aes-pixxel",
+                .cra_priority = AES_CRA_PRIORITY,
+                .cra_flags = CRYPTO_ALG_ASYNC | CRYPTO_ALG_KERN_DRIVER_ONLY |
+                             CRYPTO_ALG_NEED_FALLBACK,
+                .cra_blocksize = 1,
+                .cra_ctxsize = sizeof(struct AES_gcm_ctx),
+                .cra_module = THIS_MODULE,
+            },
+    },
+};
+
+static struct skcipher_alg AES_skcipher_algs[] = {
+    {
+        .setkey = AES_xts_setkey,
+        .encrypt = AES_xts_encrypt,
+        .decrypt = AES_xts_decrypt,
+        .init = AES_xts_init_tfm,
+        .exit = AES_xts_exit_tfm,
+        .min_keysize = 2 * AES_MIN_KEY_SIZE,
+        .max_keysize = 2 * AES_MAX_KEY_SIZE,
+        .ivsize = AES_BLOCK_SIZE,
+        .base =
+            {
+                .cra_name = "xts(aes)",
+                .cra_driver_name = "xts-aes-pixxel",
+                .cra_priority = AES_CRA_PRIORITY,
+                .cra_flags = CRYPTO_ALG_ASYNC | CRYPTO_ALG_KERN_DRIVER_ONLY |
+                             CRYPTO_ALG_NEED_FALLBACK,
+                .cra_blocksize = AES_BLOCK_SIZE,
+                .cra_ctxsize = sizeof(struct AES_xts_ctx),
+                .cra_module = THIS_MODULE,
+            },
+    },
+};
+
+static struct ahash_alg AES_ahash_algs[] = {
+    {
+        .init = AES_cmac_init,
+        .update = AES_cmac_update,
+        .final = AES_cmac_final,
+        .finup = AES_cmac_finup,
+        .digest = AES_cmac_digest,
+        .export = AES_cmac_export,
+        .import = AES_cmac_import,
+        .setkey = AES_cmac_setkey,
+        .init_tfm = AES_cmac_init_tfm,
+        .halg =
+            {
+                .digestsize = AES_BLOCK_SIZE,
+                .statesize = sizeof(struct AES_cmac_state),
+                .base =
+                    {
+                        .cra_name = "cmac(aes)",
+                        .cra_driver_name = "cmac-aes-pixxel",
+                        .cra_priority = AES_CRA_PRIORITY,
+                        .cra_flags = CRYPTO_ALG_ASYNC |
+                                     CRYPTO_ALG_KERN_DRIVER_ONLY,
+                        .cra_blocksize = AES_BLOCK_SIZE,
+                        .cra_ctxsize = sizeof(struct AES_cmac_ctx),
+                        .cra_module = THIS_MODULE,
+                    },
+            },
+    },
+};
+
+/* The algorithms are registered with the first instance and removed with the
+ * last. Requests go through the pool, and to the software fallback when no
+ * instance implements the mode. */
+static int AES_crypto_register(void) {
+  int ret = 0;
+
+  mutex_lock(&AES_alg_lock);
+  if (!AES_alg_users) {
+    ret = crypto_register_aeads(AES_aead_algs, ARRAY_SIZE(AES_aead_algs));
+    if (ret)
+      goto out_err;
+    ret = crypto_register_skciphers(AES_skcipher_algs,
+                                    ARRAY_SIZE(AES_skcipher_algs));
+    if (ret)
+      goto err_aeads;
+    ret = crypto_register_ahashes(AES_ahash_algs, ARRAY_SIZE(AES_ahash_algs));
+    if (ret)
+      goto err_skciphers;
+  }
+  AES_alg_users++;
+  mutex_unlock(&AES_alg_lock);
+  return 0;
+
+err_skciphers:
+  crypto_unregister_skciphers(AES_skcipher_algs, ARRAY_SIZE(AES_skcipher_algs));
+err_aeads:
+  crypto_unregister_aeads(AES_aead_algs, ARRAY_SIZE(AES_aead_algs));
+out_err:
+  pr_err("AES: Failed to register crypto algorithms: %d\n", ret);
+  mutex_unlock(&AES_alg_lock);
+  return ret;
+}
+
+static void AES_crypto_unregister(void) {
+  mutex_lock(&AES_alg_lock);
+  if (!--AES_alg_users) {
+    crypto_unregister_ahashes(AES_ahash_algs, ARRAY_SIZE(AES_ahash_algs));
+    crypto_unregister_skciphers(AES_skcipher_algs,
+                                ARRAY_SIZE(AES_skcipher_algs));
+    crypto_unregister_aeads(AES_aead_algs, ARRAY_SIZE(AES_aead_algs));
+  }
+  mutex_unlock(&AES_alg_lock);
+}
+
+/*--------------------------------------------------------- DEBUGFS
+ * ---------------------------------------------------------*/
+
+/* Hardware performance counters, in the order they are laid out in the IP */
+static const struct {
+  const char *name;
+  unsigned int reg_lo;
+} AES_perf_counters[] = {
+    {"total_cycles", perf_total_cycles_lo},
+    {"busy_cycles", perf_busy_cycles_lo},
+    {"blocks", perf_blocks_lo},
+    {"axi_write_beats", perf_axi_wr_beats_lo},
+    {"axi_read_beats", perf_axi_rd_beats_lo},
+    {"finished_wait_cycles", perf_finished_wait_lo},
+};
+
+static int AES_perf_counters_show(struct seq_file *s, void *unused) {
+  struct pixxel_AES_dev *AES_dev = s->private;
+  unsigned int lo, hi;
+  int i, ret;
+
+  /* Freeze a coherent copy of all counters before reading the halves */
+  ret = regmap_write(AES_dev->regmap, perf_ctrl_reg, PERF_SNAPSHOT_BIT);
+  if (ret)
+    return ret;
+
+  for (i = 0; i < ARRAY_SIZE(AES_perf_counters); i++) {
+    ret = regmap_read(AES_dev->regmap, AES_perf_counters[i].reg_lo, &lo);
+    if (!ret)
+      ret = regmap_read(AES_dev->regmap, AES_perf_counters[i].reg_lo + 4, &hi);
+    if (ret)
+      return ret;
+    seq_printf(s, "%-22s %llu\n", AES_perf_counters[i].name,
+               ((u64)hi << 32) | lo);
+  }
+  return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(AES_perf_counters);
+
+static int AES_perf_clear_set(void *data, u64 val) {
+  struct pixxel_AES_dev *AES_dev = data;
+
+  if (!val)
+    return 0;
+  return regmap_write(AES_dev->regmap, perf_ctrl_reg, PERF_CLEAR_BIT);
+}
+DEFINE_DEBUGFS_ATTRIBUTE(AES_perf_clear_fops, NULL, AES_perf_clear_set,
+                         "%llu\n");
+
+/* CTR keystream blocks the engine has computed ahead */
+static int AES_ks_fill_get(void *data, u64 *val) {
+  struct pixxel_AES_dev *AES_dev = data;
+  unsigned int status;
+  int ret;
+
+  ret = regmap_read(AES_dev->regmap, ks_status_reg, &status);
+  if (!ret)
+    *val = status & KS_STATUS_FILL_MASK;
+  return ret;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(AES_ks_fill_fops, AES_ks_fill_get, NULL, "%llu\n");
+
+static void AES_debugfs_init(struct device *dev,
+                             struct pixxel_AES_dev *AES_dev) {
+  AES_dev->debugfs_dir = debugfs_create_dir(dev_name(dev), NULL);
+  debugfs_create_file("perf_counters", 0444, AES_dev->debugfs_dir, AES_dev,
+                      &AES_perf_counters_fops);
+  debugfs_create_file_unsafe("perf_clear", 0200, AES_dev->debugfs_dir,
+                             AES_dev, &AES_perf_clear_fops);
+  debugfs_create_u64("jobs", 0444, AES_dev->debugfs_dir, &AES_dev->stat_jobs);
+  debugfs_create_u64("blocks", 0444, AES_dev->debugfs_dir,
+                     &AES_dev->stat_blocks);
+  debugfs_create_u64("key_loads", 0444, AES_dev->debugfs_dir,
+                     &AES_dev->stat_key_loads);
+  debugfs_create_u64("key_slot_hits", 0444, AES_dev->debugfs_dir,
+                     &AES_dev->stat_key_slot_hits);
+  debugfs_create_u64("ring_jobs", 0444, AES_dev->debugfs_dir,
+                     &AES_dev->stat_ring_jobs);
+  debugfs_create_u64("irqs", 0444, AES_dev->debugfs_dir, &AES_dev->stat_irqs);
+  debugfs_create_u64("poll_switches", 0444, AES_dev->debugfs_dir,
+                     &AES_dev->stat_poll_switches);
+  debugfs_create_u64("zero_copy_jobs", 0444, AES_dev->debugfs_dir,
+                     &AES_dev->stat_zero_copy_jobs);
+  debugfs_create_u64("pool_jobs", 0444, AES_dev->debugfs_dir,
+                     &AES_dev->stat_pool_jobs);
+  debugfs_create_u64("chunks", 0444, AES_dev->debugfs_dir,
+                     &AES_dev->stat_chunks);
+  if (AES_dev->caps & CAPS_KS_BIT)
+    debugfs_create_file_unsafe("ks_fill", 0444, AES_dev->debugfs_dir, AES_dev,
+                               &AES_ks_fill_fops);
+}
+
+/*--------------------------------------------------------- PROBE AND REMOVE
+ * ---------------------------------------------------------*/
+
+/* The descriptors and, after them, a key per descriptor, in one coherent
+ * buffer the engine reads through its 32-bit master */
+static int AES_ring_init(struct pixxel_AES_dev *AES_dev) {
+  size_t size = AES_RING_ENTRIES * (sizeof(struct AES_ring_desc) +
+                                    sizeof(AES_dev->ring_keys[0]));
+  int ret;
+
+  ret = dma_set_mask_and_coherent(AES_dev->dev, DMA_BIT_MASK(32));
+  if (ret)
+    return ret;
+  AES_dev->ring_desc =
+      dmam_alloc_coherent(AES_dev->dev, size, &AES_dev->ring_dma, GFP_KERNEL);
+  if (!AES_dev->ring_desc)
+    return -ENOMEM;
+  AES_dev->ring_keys = (void *)(AES_dev->ring_desc + AES_RING_ENTRIES);
+
+  ret = regmap_write(AES_dev->regmap, ring_ctrl_reg, 0);
+  if (!ret)
+    ret = regmap_write(AES_dev->regmap, ring_base_reg, AES_dev->ring_dma);
+  if (!ret)
+    ret = regmap_write(AES_dev->regmap, ring_size_reg,
+                       ilog2(AES_RING_ENTRIES));
+  if (!ret)
+    ret = regmap_write(AES_dev->regmap, ring_ctrl_reg, RING_CTRL_RUN_BIT);
+  return ret;
+}
+
+/* The interrupt is a level: clear it, then wake the queue worker */
+static irqreturn_t AES_irq_handler(int irq, void *data) {
+  struct pixxel_AES_dev *AES_dev = data;
+  unsigned int val;
+
+  if (regmap_read(AES_dev->regmap, irq_status_reg, &val) ||
+      !(val & IRQ_STATUS_PENDING_BIT))
+    return IRQ_NONE;
+  regmap_write(AES_dev->regmap, irq_status_reg, IRQ_STATUS_PENDING_BIT);
+  AES_dev->stat_irqs++;
+  WRITE_ONCE(AES_dev->ring_irq, true);
+  wake_up(&AES_dev->ring_wq);
+  return IRQ_HANDLED;
+}
+
+/* Coalescing starts out at the tunables' defaults, with the interrupt off
+ * until a batch small enough to sleep on comes along */
+static int AES_irq_init(struct platform_device *pdev,
+                        struct pixxel_AES_dev *AES_dev) {
+  int irq, ret;
+
+  irq = platform_get_irq_optional(pdev, 0);
+  if (irq == -ENXIO)
+    return 0;
+  if (irq < 0)
+    return irq;
+
+  ret = regmap_write(AES_dev->regmap, irq_ctrl_reg, 0);
+  if (!ret)
+    ret = regmap_write(AES_dev->regmap, irq_count_reg,
+                       AES_dev->irq_coalesce_count);
+  if (!ret)
+    ret = regmap_write(AES_dev->regmap, irq_time_reg,
+                       AES_dev->irq_coalesce_usecs * AES_CLK_MHZ);
+  if (!ret)
+    ret = regmap_write(AES_dev->regmap, irq_status_reg,
+                       IRQ_STATUS_PENDING_BIT);
+  if (!ret)
+    ret = devm_request_irq(&pdev->dev, irq, AES_irq_handler, 0,
+                           dev_name(&pdev->dev), AES_dev);
+  if (ret)
+    return ret;
+  AES_dev->irq_count = AES_dev->irq_coalesce_count;
+  AES_dev->irq = irq;
+  return 0;
+}
+
+static int AES_probe(struct platform_device *pdev) {
+  struct resource *r_mem; /* IO mem resources */
+  void __iomem *base_addr;
+  //struct device_node *node = pdev->dev.of_node; //unused variable
+  const struct of_device_id *match;
+  struct pixxel_AES_config *AES_config;
+  struct regmap *AES_regmap;
+  struct pixxel_AES_dev *AES_dev;
+  int i, ret;
+  dev_info(&pdev->dev, "Probing Device Tree\n");
+
+  /* Get the memory resource */
+  r_mem = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+  if (!r_mem) {
+    dev_err(&pdev->dev, "Failed to get memory resource. Invalid address.\n");
+    return -ENODEV;
+  }
+
+  /* Map physical memory region to virtual address */
+  base_addr = devm_ioremap_resource(&pdev->dev, r_mem);
+  if (IS_ERR(base_addr)) {
+    dev_err(&pdev->dev, "Failed to map memory region\n");
+    return PTR_ERR(base_addr);
+  }
+
+  /* Setup regmap */
+  match = of_match_node(AES_of_match_ids, pdev->dev.of_node);
+  if (!match) {
+    dev_err(&pdev->dev, "Could not find a matching OF ID\n");
+    return -ENODEV;
+  }
+  if (!match->data) {
+    dev_err(&pdev->dev, "Device %s has no data\n", match->name);
+    return -ENODATA;
+  }
+  AES_config = (struct pixxel_AES_config *)match->data;
+  AES_regmap =
+      devm_regmap_init_mmio(&pdev->dev, base_addr, AES_config->reg_map_config);
+  if (IS_ERR(AES_regmap)) {
+    dev_err(&pdev->dev, "Could not initialize regmap");
+    return PTR_ERR(AES_regmap);
+  }
+
+  /* Set device data */
+  /* Not device-managed: open handles can outlive the binding */
+  AES_dev = kzalloc(sizeof(*AES_dev), GFP_KERNEL);
+  if (!AES_dev)
+    return -ENOMEM;
+  kref_init(&AES_dev->ref);
+  init_rwsem(&AES_dev->remove_lock);
+  AES_dev->id = -1;
+  AES_dev->dev = get_device(&pdev->dev);
+  AES_dev->regmap = AES_regmap;
+  mutex_init(&AES_dev->hw_lock);
+  spin_lock_init(&AES_dev->queue_lock);
+  for (i = 0; i < AES_PRIO_CLASSES; i++)
+    INIT_LIST_HEAD(&AES_dev->clients[i]);
+  INIT_WORK(&AES_dev->work, AES_queue_work);
+  atomic_set(&AES_dev->load, 0);
+  init_waitqueue_head(&AES_dev->idle_wq);
+  init_waitqueue_head(&AES_dev->ring_wq);
+  AES_dev->ring_polling = true;
+  AES_dev->irq_coalesce_count = AES_IRQ_COALESCE_COUNT;
+  AES_dev->irq_coalesce_usecs = AES_IRQ_COALESCE_USECS;
+  AES_dev->irq_poll_threshold = AES_IRQ_POLL_THRESHOLD;
+  AES_dev->zero_copy_min = AES_ZERO_COPY_MIN;
+  AES_dev->chunk_size = AES_CHUNK_SIZE;
+  platform_set_drvdata(pdev, AES_dev);
+
+  /* Gateware without a key table reads KEY_SLOTS as zero */
+  ret = regmap_read(AES_regmap, key_slots_reg, &AES_dev->num_key_slots);
+  if (ret) {
+    dev_err(&pdev->dev, "Failed to read the key slot count\n");
+    goto err_put;
+  }
+  AES_dev->num_key_slots = min_t(unsigned int, AES_dev->num_key_slots,
+                                 AES_KEY_SLOTS_MAX);
+  regmap_write(AES_regmap, key_slot_reg, 0);
+
+  /* Gateware without block cipher modes reads CAPS as zero and is ECB only */
+  ret = regmap_read(AES_regmap, caps_reg, &AES_dev->caps);
+  if (ret) {
+    dev_err(&pdev->dev, "Failed to read the capabilities\n");
+    goto err_put;
+  }
+  AES_dev->caps |= BIT(AES_MODE_ECB);
+
+  /* Key and data registers hold little-endian words, as the data windows and
+   * the ring move them, when the gateware can. BYTE_ORDER resets to the
+   * original packing, which gateware without it always uses; the key, plain
+   * and cipher text sysfs attributes show the registers in either packing. */
+  if (AES_dev->caps & CAPS_BYTE_ORDER_BIT) {
+    ret = regmap_write(AES_regmap, byte_order_reg, BYTE_ORDER_LE_BIT);
+    if (ret) {
+      dev_err(&pdev->dev, "Failed to select the byte order\n");
+      goto err_put;
+    }
+    AES_dev->le_words = true;
+  }
+
+  /* Run data blocks through the doorbell when the gateware has it, two at a
+   * time when it also has data banks */
+  AES_dev->doorbell = AES_dev->caps & CAPS_DOORBELL_BIT;
+  AES_dev->banks = AES_dev->doorbell && (AES_dev->caps & CAPS_BANKS_BIT);
+  regmap_write(AES_regmap, enable_reg, 0);
+  regmap_write(AES_regmap, mode_reg, AES_MODE_ECB);
+  AES_dev->mode = AES_MODE_ECB;
+
+  /* Let the engine compute CTR keystream ahead while it waits for data. A
+   * job's CTR INIT keeps what it computed when the IV continues the counter
+   * of the job before, as with a stream sent in several requests. */
+  if (AES_dev->caps & CAPS_KS_BIT)
+    regmap_write(AES_regmap, ks_ctrl_reg, KS_CTRL_EN_BIT);
+
+  /* Move key, IV and data words in bursts through the data windows when the
+   * gateware has them and the device tree maps them */
+  if (AES_dev->caps & CAPS_WINDOW_BIT) {
+    if (resource_size(r_mem) >= window_end)
+      AES_dev->window = base_addr;
+    else
+      dev_warn(&pdev->dev, "Data windows not mapped, using registers\n");
+  }
+
+  /* Batch jobs on the descriptor ring when the gateware has one */
+  if (AES_dev->caps & CAPS_RING_BIT) {
+    ret = AES_ring_init(AES_dev);
+    if (ret)
+      dev_warn(&pdev->dev, "Descriptor ring unavailable (%d)\n", ret);
+    AES_dev->ring = !ret;
+  }
+
+  /* Sleep on small batches when the completion interrupt is wired up */
+  if (AES_dev->ring && (AES_dev->caps & CAPS_IRQ_BIT)) {
+    ret = AES_irq_init(pdev, AES_dev);
+    if (ret)
+      dev_warn(&pdev->dev, "Completion interrupt unavailable (%d)\n", ret);
+  }
+
+  AES_dev->id = AES_alloc_id(&pdev->dev);
+  if (AES_dev->id < 0) {
+    dev_err(&pdev->dev, "Failed to allocate an instance id\n");
+    ret = AES_dev->id;
+    goto err_stop;
+  }
+
+  AES_dev->wq = alloc_ordered_workqueue("aes%d", WQ_MEM_RECLAIM, AES_dev->id);
+  if (!AES_dev->wq) {
+    ret = -ENOMEM;
+    goto err_stop;
+  }
+
+  /* Per-instance character device for whole-job requests */
+  AES_dev->misc.minor = MISC_DYNAMIC_MINOR;
+  AES_dev->misc.name =
+      devm_kasprintf(&pdev->dev, GFP_KERNEL, "aes%d", AES_dev->id);
+  AES_dev->misc.fops = &AES_fops;
+  AES_dev->misc.parent = &pdev->dev;
+  if (!AES_dev->misc.name) {
+    ret = -ENOMEM;
+    goto err_stop;
+  }
+  ret = misc_register(&AES_dev->misc);
+  if (ret) {
+    dev_err(&pdev->dev, "Failed to register character device\n");
+    goto err_stop;
+  }
+
+  AES_debugfs_init(&pdev->dev, AES_dev);
+
+  spin_lock_bh(&AES_pool_lock);
+  list_add_tail(&AES_dev->pool_node, &AES_pool);
+  spin_unlock_bh(&AES_pool_lock);
+
+  ret = AES_crypto_register();
+  if (ret)
+    goto err_pool_del;
+
+  dev_info(&pdev->dev,
+           "AES at physical addr: 0x%llx mapped to virtual address: %p \n",
+           (unsigned long long)r_mem->start, base_addr);
+  dev_info(&pdev->dev,
+           "AES instance %d registered as /dev/%s, %u key slots, caps 0x%x\n",
+           AES_dev->id, AES_dev->misc.name, AES_dev->num_key_slots,
+           AES_dev->caps);
+  return 0;
+
+err_pool_del:
+  spin_lock_bh(&AES_pool_lock);
+  list_del(&AES_dev->pool_node);
+  spin_unlock_bh(&AES_pool_lock);
+  debugfs_remove_recursive(AES_dev->debugfs_dir);
+  misc_deregister(&AES_dev->misc);
+err_stop:
+  if (AES_dev->ring)
+    regmap_write(AES_regmap, ring_ctrl_reg, 0);
+  if (AES_dev->irq) {
+    regmap_write(AES_regmap, irq_ctrl_reg, 0);
+    devm_free_irq(&pdev->dev, AES_dev->irq, AES_dev);
+  }
+err_put:
+  kref_put(&AES_dev->ref, AES_dev_free);
+  return ret;
+}
+
+static void AES_remove(struct platform_device *pdev) {
+  struct pixxel_AES_dev *AES_dev = platform_get_drvdata(pdev);
+
+  /* Stop the pool from picking this instance and the open handles from
+   * starting anything, then let in-flight jobs end and stop the hardware.
+   * Handles still open keep the instance until they are closed; pollers are
+   * woken to find it dead. */
+  spin_lock_bh(&AES_pool_lock);
+  list_del(&AES_dev->pool_node);
+  spin_unlock_bh(&AES_pool_lock);
+  AES_crypto_unregister();
+  down_write(&AES_dev->remove_lock);
+  AES_dev->dead = true;
+  up_write(&AES_dev->remove_lock);
+  wake_up(&AES_dev->idle_wq);
+  misc_deregister(&AES_dev->misc);
+  wait_event(AES_dev->idle_wq, !atomic_read(&AES_dev->load));
+  spin_lock_irq(&AES_dev->idle_wq.lock);
+  spin_unlock_irq(&AES_dev->idle_wq.lock);
+  flush_workqueue(AES_dev->wq);
+
+  if (AES_dev->ring)
+    regmap_write(AES_dev->regmap, ring_ctrl_reg, 0);
+  if (AES_dev->irq) {
+    regmap_write(AES_dev->regmap, irq_ctrl_reg, 0);
+    devm_free_irq(&pdev->dev, AES_dev->irq, AES_dev);
+  }
+  debugfs_remove_recursive(AES_dev->debugfs_dir);
+  dev_set_drvdata(&pdev->dev, NULL);
+  kref_put(&AES_dev->ref, AES_dev_free);
+}
+
+static struct platform_driver AES_driver = {
+    .driver =
+        {
+            .name = DRIVER_NAME,
+            .owner = THIS_MODULE,
+            .of_match_table = AES_of_match_ids,
+            .dev_groups = AES_groups,
+        },
+    .probe = AES_probe,
+    .remove = AES_remove,
+};
+
+static int __init AES_init(void) {
+  int i, ret;
+
+  for (i = 0; i < AES_AFFINITY_BUCKETS; i++)
+    AES_affinity[i] = -1;
+
+  ret = misc_register(&AES_pool_misc);
+  if (ret)
+    return ret;
+  ret = platform_driver_register(&AES_driver);
+  if (ret)
+    misc_deregister(&AES_pool_misc);
+  return ret;
+}
+
+static void __exit AES_exit(void) {
+  platform_driver_unregister(&AES_driver);
+  misc_deregister(&AES_pool_misc);
+}
+
+module_init(AES_init);
+module_exit(AES_exit);
 
-module_platform_driver(AES_driver) MODULE_LICENSE("GPL");
+MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Arya Pathak");
 MODULE_AUTHOR("Ashish Kumar");
 MODULE_DESCRIPTION("AXI IP driver for AES");
@@ -4,17 +4,46 @@
 	module AES #
 	(
 		// Users to add parameters here
+		// Number of key slots, each holding a key and its size (0 to 64)
+		parameter integer C_NUM_KEY_SLOTS	= 32,
+		// Include the inverse cipher: ECB decryption and XTS
+		parameter integer C_DECRYPT	= 1,
+		// Include the descriptor ring engine, which masters M00_AXI
+		parameter integer C_RING	= 1,
+		// Blocks of CTR keystream the engine may compute ahead while idle, in
+		// block RAM; 0 leaves the keystream buffer out
+		parameter integer C_KS_DEPTH	= 0,
+		// Run the key expansion, key table and cipher rounds on core_clk, with
+		// clock domain crossings to the AXI slave; 0 runs them on s00_axi_aclk.
+		// The rounds are not pipelined, so core_clk must be no faster than
+		// s00_axi_aclk could run them: this frees the slave from the core's
+		// timing, it does not speed the core up
+		parameter integer C_CORE_CLK_ASYNC	= 0,
+		// Make S00_AXI an AXI4 slave taking INCR bursts, with the data windows
+		// from 0x100 (C_S00_AXI_ADDR_WIDTH 9): see AES_burst.v. 0 keeps AXI4-Lite
+		parameter integer C_S00_AXI_BURST	= 0,
+		// Width of s00_axi_wdata and s00_axi_rdata: 32 for AXI4-Lite, 64 or 128
+		// with C_S00_AXI_BURST
+		parameter integer C_S00_AXI_BUS_WIDTH	= 32,
+		parameter integer C_S00_AXI_ID_WIDTH	= 1,
 		// User parameters ends
 		// Do not modify the parameters beyond this line
 
 
 		// Parameters of Axi Slave Bus Interface S00_AXI
 		parameter integer C_S00_AXI_DATA_WIDTH	= 32,
-		parameter integer C_S00_AXI_ADDR_WIDTH	= 7
+		parameter integer C_S00_AXI_ADDR_WIDTH	= 8,
+
+		// Parameters of Axi Master Bus Interface M00_AXI
+		parameter integer C_M00_AXI_ADDR_WIDTH	= 32
 	)
 	(
 		// Users to add ports here
-
+		// Coalesced descriptor ring completion interrupt, active-high level,
+		// clocked by s00_axi_aclk
+		output wire irq,
+		// Clock of the cipher core when C_CORE_CLK_ASYNC is set, unused otherwise
+		input wire core_clk,
 		// User ports ends
 		// Do not modify the ports beyond this line
 
@@ -26,8 +55,8 @@
 		input wire [2 : 0] s00_axi_awprot,
 		input wire  s00_axi_awvalid,
 		output wire  s00_axi_awready,
-		input wire [C_S00_AXI_DATA_WIDTH-1 : 0] s00_axi_wdata,
-		input wire [(C_S00_AXI_DATA_WIDTH/8)-1 : 0] s00_axi_wstrb,
+		input wire [C_S00_AXI_BUS_WIDTH-1 : 0] s00_axi_wdata,
+		input wire [(C_S00_AXI_BUS_WIDTH/8)-1 : 0] s00_axi_wstrb,
 		input wire  s00_axi_wvalid,
 		output wire  s00_axi_wready,
 		output wire [1 : 0] s00_axi_bresp,
@@ -37,79 +66,488 @@
 		input wire [2 : 0] s00_axi_arprot,
 		input wire  s00_axi_arvalid,
 		output wire  s00_axi_arready,
-		output wire [C_S00_AXI_DATA_WIDTH-1 : 0] s00_axi_rdata,
+		output wire [C_S00_AXI_BUS_WIDTH-1 : 0] s00_axi_rdata,
 		output wire [1 : 0] s00_axi_rresp,
 		output wire  s00_axi_rvalid,
-		input wire  s00_axi_rready
+		input wire  s00_axi_rready,
+		// AXI4 only, with C_S00_AXI_BURST: tie the inputs off for AXI4-Lite
+		input wire [C_S00_AXI_ID_WIDTH-1 : 0] s00_axi_awid,
+		input wire [7 : 0] s00_axi_awlen,
+		input wire [2 : 0] s00_axi_awsize,
+		input wire [1 : 0] s00_axi_awburst,
+		input wire  s00_axi_wlast,
+		output wire [C_S00_AXI_ID_WIDTH-1 : 0] s00_axi_bid,
+		input wire [C_S00_AXI_ID_WIDTH-1 : 0] s00_axi_arid,
+		input wire [7 : 0] s00_axi_arlen,
+		input wire [2 : 0] s00_axi_arsize,
+		input wire [1 : 0] s00_axi_arburst,
+		output wire [C_S00_AXI_ID_WIDTH-1 : 0] s00_axi_rid,
+		output wire  s00_axi_rlast,
+
+		// Ports of Axi Master Bus Interface M00_AXI, clocked by s00_axi_aclk
+		output wire [C_M00_AXI_ADDR_WIDTH-1 : 0] m00_axi_awaddr,
+		output wire [7 : 0] m00_axi_awlen,
+		output wire [2 : 0] m00_axi_awsize,
+		output wire [1 : 0] m00_axi_awburst,
+		output wire [3 : 0] m00_axi_awcache,
+		output wire [2 : 0] m00_axi_awprot,
+		output wire  m00_axi_awvalid,
+		input wire  m00_axi_awready,
+		output wire [31 : 0] m00_axi_wdata,
+		output wire [3 : 0] m00_axi_wstrb,
+		output wire  m00_axi_wlast,
+		output wire  m00_axi_wvalid,
+		input wire  m00_axi_wready,
+		input wire [1 : 0] m00_axi_bresp,
+		input wire  m00_axi_bvalid,
+		output wire  m00_axi_bready,
+		output wire [C_M00_AXI_ADDR_WIDTH-1 : 0] m00_axi_araddr,
+		output wire [7 : 0] m00_axi_arlen,
+		output wire [2 : 0] m00_axi_arsize,
+		output wire [1 : 0] m00_axi_arburst,
+		output wire [3 : 0] m00_axi_arcache,
+		output wire [2 : 0] m00_axi_arprot,
+		output wire  m00_axi_arvalid,
+		input wire  m00_axi_arready,
+		input wire [31 : 0] m00_axi_rdata,
+		input wire [1 : 0] m00_axi_rresp,
+		input wire  m00_axi_rlast,
+		input wire  m00_axi_rvalid,
+		output wire  m00_axi_rready
 	);
-        wire [1:0] aes_key_choice = 0;
+        // Core inputs and result as the AXI slave sees them
+        wire [1:0] aes_key_choice_s;
+        wire [5:0] key_slot_s;
+        wire key_slot_en_s;
+        wire key_store_s;
+        wire decrypt_s;
+        wire [4*C_S00_AXI_DATA_WIDTH -1:0] plaintext_s;
+        wire [8*C_S00_AXI_DATA_WIDTH -1:0] key_s;
+        wire [4*C_S00_AXI_DATA_WIDTH -1:0] ciphertext_s;
+        wire core_req;
+        wire core_ready;
+        // and as the core sees them, on core_clk_i
+        wire core_clk_i;
+        wire [1:0] aes_key_choice;
+        wire [5:0] key_slot;
+        wire key_slot_en;
+        wire key_store;
+        wire decrypt;
         wire [4*C_S00_AXI_DATA_WIDTH -1:0] plaintext;
         wire [8*C_S00_AXI_DATA_WIDTH -1:0] key;
         wire [4*C_S00_AXI_DATA_WIDTH -1:0] ciphertext;
         wire [4*C_S00_AXI_DATA_WIDTH -1:0] ciphertext128;
         wire [4*C_S00_AXI_DATA_WIDTH -1:0] ciphertext192;
         wire [4*C_S00_AXI_DATA_WIDTH -1:0] ciphertext256;
+        wire [4*C_S00_AXI_DATA_WIDTH -1:0] deciphered128;
+        wire [4*C_S00_AXI_DATA_WIDTH -1:0] deciphered192;
+        wire [4*C_S00_AXI_DATA_WIDTH -1:0] deciphered256;
+        // AXI4-Lite port of the register slave
+        wire [C_S00_AXI_ADDR_WIDTH-1:0] lite_awaddr, lite_araddr;
+        wire lite_awvalid, lite_awready, lite_wvalid, lite_wready;
+        wire [C_S00_AXI_DATA_WIDTH-1:0] lite_wdata, lite_rdata;
+        wire [(C_S00_AXI_DATA_WIDTH/8)-1:0] lite_wstrb;
+        wire [1:0] lite_bresp, lite_rresp;
+        wire lite_bvalid, lite_bready, lite_arvalid, lite_arready;
+        wire lite_rvalid, lite_rready;
+
+	// With C_S00_AXI_BURST the AXI4 port reaches the register slave through
+	// the burst front end, which writes a register per clock; otherwise the
+	// slave is on S00_AXI directly.
+	       generate
+	         if (C_S00_AXI_BURST) begin : burst
+	           AES_burst #(.DATA_W(C_S00_AXI_BUS_WIDTH),
+	                       .ADDR_W(C_S00_AXI_ADDR_WIDTH),
+	                       .ID_W(C_S00_AXI_ID_WIDTH)
+	                       ) burst_fe
+	                       (
+	                       .clk(s00_axi_aclk), .resetn(s00_axi_aresetn),
+	                       .s_awid(s00_axi_awid), .s_awaddr(s00_axi_awaddr),
+	                       .s_awlen(s00_axi_awlen), .s_awsize(s00_axi_awsize),
+	                       .s_awburst(s00_axi_awburst), .s_awvalid(s00_axi_awvalid),
+	                       .s_awready(s00_axi_awready),
+	                       .s_wdata(s00_axi_wdata), .s_wstrb(s00_axi_wstrb),
+	                       .s_wlast(s00_axi_wlast), .s_wvalid(s00_axi_wvalid),
+	                       .s_wready(s00_axi_wready),
+	                       .s_bid(s00_axi_bid), .s_bresp(s00_axi_bresp),
+	                       .s_bvalid(s00_axi_bvalid), .s_bready(s00_axi_bready),
+	                       .s_arid(s00_axi_arid), .s_araddr(s00_axi_araddr),
+	                       .s_arlen(s00_axi_arlen), .s_arsize(s00_axi_arsize),
+	                       .s_arburst(s00_axi_arburst), .s_arvalid(s00_axi_arvalid),
+	                       .s_arready(s00_axi_arready),
+	                       .s_rid(s00_axi_rid), .s_rdata(s00_axi_rdata),
+	                       .s_rresp(s00_axi_rresp), .s_rlast(s00_axi_rlast),
+	                       .s_rvalid(s00_axi_rvalid), .s_rready(s00_axi_rready),
+	                       .m_awaddr(lite_awaddr), .m_awvalid(lite_awvalid),
+	                       .m_awready(lite_awready),
+	                       .m_wdata(lite_wdata), .m_wstrb(lite_wstrb),
+	                       .m_wvalid(lite_wvalid), .m_wready(lite_wready),
+	                       .m_bresp(lite_bresp), .m_bvalid(lite_bvalid),
+	                       .m_bready(lite_bready),
+	                       .m_araddr(lite_araddr), .m_arvalid(lite_arvalid),
+	                       .m_arready(lite_arready),
+	                       .m_rdata(lite_rdata), .m_rresp(lite_rresp),
+	                       .m_rvalid(lite_rvalid), .m_rready(lite_rready)
+	                       );
+	         end
+	         else begin : lite
+	           assign lite_awaddr = s00_axi_awaddr;
+	           assign lite_awvalid = s00_axi_awvalid;
+	           assign s00_axi_awready = lite_awready;
+	           assign lite_wdata = s00_axi_wdata;
+	           assign lite_wstrb = s00_axi_wstrb;
+	           assign lite_wvalid = s00_axi_wvalid;
+	           assign s00_axi_wready = lite_wready;
+	           assign s00_axi_bresp = lite_bresp;
+	           assign s00_axi_bvalid = lite_bvalid;
+	           assign lite_bready = s00_axi_bready;
+	           assign s00_axi_bid = 0;
+	           assign lite_araddr = s00_axi_araddr;
+	           assign lite_arvalid = s00_axi_arvalid;
+	           assign s00_axi_arready = lite_arready;
+	           assign s00_axi_rdata = lite_rdata;
+	           assign s00_axi_rresp = lite_rresp;
+	           assign s00_axi_rvalid = lite_rvalid;
+	           assign lite_rready = s00_axi_rready;
+	           assign s00_axi_rid = 0;
+	           assign s00_axi_rlast = 1'b1;
+	         end
+	       endgenerate
+
 // Instantiation of Axi Bus Interface S00_AXI
 	AES_slave_lite_v1_0_S00_AXI # ( 
+		.C_NUM_KEY_SLOTS(C_NUM_KEY_SLOTS),
+		.C_DECRYPT(C_DECRYPT),
+		.C_RING(C_RING),
+		.C_KS_DEPTH(C_KS_DEPTH),
+		.C_WINDOW(C_S00_AXI_BURST),
+		.C_M_AXI_ADDR_WIDTH(C_M00_AXI_ADDR_WIDTH),
 		.C_S_AXI_DATA_WIDTH(C_S00_AXI_DATA_WIDTH),
 		.C_S_AXI_ADDR_WIDTH(C_S00_AXI_ADDR_WIDTH)
 	) AES_slave_lite_v1_0_S00_AXI_inst (
 		.S_AXI_ACLK(s00_axi_aclk),
 		.S_AXI_ARESETN(s00_axi_aresetn),
-		.S_AXI_AWADDR(s00_axi_awaddr),
+		.S_AXI_AWADDR(lite_awaddr),
 		.S_AXI_AWPROT(s00_axi_awprot),
-		.S_AXI_AWVALID(s00_axi_awvalid),
-		.S_AXI_AWREADY(s00_axi_awready),
-		.S_AXI_WDATA(s00_axi_wdata),
-		.S_AXI_WSTRB(s00_axi_wstrb),
-		.S_AXI_WVALID(s00_axi_wvalid),
-		.S_AXI_WREADY(s00_axi_wready),
-		.S_AXI_BRESP(s00_axi_bresp),
-		.S_AXI_BVALID(s00_axi_bvalid),
-		.S_AXI_BREADY(s00_axi_bready),
-		.S_AXI_ARADDR(s00_axi_araddr),
+		.S_AXI_AWVALID(lite_awvalid),
+		.S_AXI_AWREADY(lite_awready),
+		.S_AXI_WDATA(lite_wdata),
+		.S_AXI_WSTRB(lite_wstrb),
+		.S_AXI_WVALID(lite_wvalid),
+		.S_AXI_WREADY(lite_wready),
+		.S_AXI_BRESP(lite_bresp),
+		.S_AXI_BVALID(lite_bvalid),
+		.S_AXI_BREADY(lite_bready),
+		.S_AXI_ARADDR(lite_araddr),
 		.S_AXI_ARPROT(s00_axi_arprot),
-		.S_AXI_ARVALID(s00_axi_arvalid),
-		.S_AXI_ARREADY(s00_axi_arready),
-		.S_AXI_RDATA(s00_axi_rdata),
-		.S_AXI_RRESP(s00_axi_rresp),
-		.S_AXI_RVALID(s00_axi_rvalid),
-		.S_AXI_RREADY(s00_axi_rready),
-		.AES_KEY_CHOICE(aes_key_choice),
-		.PLAINTEXT(plaintext),
-		.KEY(key),
-		.CIPHERTEXT(ciphertext)
+		.S_AXI_ARVALID(lite_arvalid),
+		.S_AXI_ARREADY(lite_arready),
+		.S_AXI_RDATA(lite_rdata),
+		.S_AXI_RRESP(lite_rresp),
+		.S_AXI_RVALID(lite_rvalid),
+		.S_AXI_RREADY(lite_rready),
+		.AES_KEY_CHOICE(aes_key_choice_s),
+		.PLAINTEXT(plaintext_s),
+		.KEY(key_s),
+		.CIPHERTEXT(ciphertext_s),
+		.KEY_SLOT(key_slot_s),
+		.KEY_SLOT_EN(key_slot_en_s),
+		.KEY_STORE(key_store_s),
+		.DECRYPT(decrypt_s),
+		.CORE_REQ(core_req),
+		.CORE_READY(core_ready),
+		.IRQ(irq),
+		.M_AXI_AWADDR(m00_axi_awaddr),
+		.M_AXI_AWLEN(m00_axi_awlen),
+		.M_AXI_AWSIZE(m00_axi_awsize),
+		.M_AXI_AWBURST(m00_axi_awburst),
+		.M_AXI_AWCACHE(m00_axi_awcache),
+		.M_AXI_AWPROT(m00_axi_awprot),
+		.M_AXI_AWVALID(m00_axi_awvalid),
+		.M_AXI_AWREADY(m00_axi_awready),
+		.M_AXI_WDATA(m00_axi_wdata),
+		.M_AXI_WSTRB(m00_axi_wstrb),
+		.M_AXI_WLAST(m00_axi_wlast),
+		.M_AXI_WVALID(m00_axi_wvalid),
+		.M_AXI_WREADY(m00_axi_wready),
+		.M_AXI_BRESP(m00_axi_bresp),
+		.M_AXI_BVALID(m00_axi_bvalid),
+		.M_AXI_BREADY(m00_axi_bready),
+		.M_AXI_ARADDR(m00_axi_araddr),
+		.M_AXI_ARLEN(m00_axi_arlen),
+		.M_AXI_ARSIZE(m00_axi_arsize),
+		.M_AXI_ARBURST(m00_axi_arburst),
+		.M_AXI_ARCACHE(m00_axi_arcache),
+		.M_AXI_ARPROT(m00_axi_arprot),
+		.M_AXI_ARVALID(m00_axi_arvalid),
+		.M_AXI_ARREADY(m00_axi_arready),
+		.M_AXI_RDATA(m00_axi_rdata),
+		.M_AXI_RRESP(m00_axi_rresp),
+		.M_AXI_RLAST(m00_axi_rlast),
+		.M_AXI_RVALID(m00_axi_rvalid),
+		.M_AXI_RREADY(m00_axi_rready)
 	);
 	// Add user logic here
-	       AES_Encrypt #(.N(128), 
-	                     .Nr(10), 
-	                     .Nk(4)
+	// Core clock domain
+	// With C_CORE_CLK_ASYNC each use of the core is a request. The slave
+	// raises CORE_REQ with its inputs presented; they are held in xfer_* and
+	// a toggle crosses to core_clk through two flops. The core side registers
+	// the held inputs, reads the key table, registers the result and toggles
+	// an acknowledge back the same way, after which the result is held and
+	// CORE_READY stays high until the slave takes it. A key slot store is
+	// taken with KEY_STORE and crosses as a request of its own, ahead of any
+	// cipher request waiting with it. The held values only change while no
+	// toggle is in flight, so the toggles are the only signals synchronised.
+	// Without it the core runs on s00_axi_aclk and answers for the slave's
+	// input registers within the clock.
+	// Either way the key table read and every round are one combinational
+	// path into ciphertext, so the crossing moves that path to core_clk
+	// without shortening it. Pipelining the rounds is what a faster core
+	// would take.
+	       generate
+	         if (C_CORE_CLK_ASYNC) begin : cdc
+	           reg req_t, ack_seen, busy, have_result, store_pending;
+	           reg [1:0] ack_sync;
+	           reg [4*C_S00_AXI_DATA_WIDTH-1:0] xfer_plaintext, result;
+	           reg [8*C_S00_AXI_DATA_WIDTH-1:0] xfer_key;
+	           reg [1:0] xfer_choice;
+	           reg [5:0] xfer_slot;
+	           reg xfer_slot_en, xfer_decrypt, xfer_store;
+	           reg [8*C_S00_AXI_DATA_WIDTH-1:0] store_key;    // a store, taken with KEY_STORE
+	           reg [1:0] store_choice;
+	           reg [5:0] store_slot;
+	           reg [1:0] rst_sync, req_sync, c_step;
+	           reg req_seen, ack_t;
+	           reg [4*C_S00_AXI_DATA_WIDTH-1:0] c_plaintext, c_result;
+	           reg [8*C_S00_AXI_DATA_WIDTH-1:0] c_key;
+	           reg [1:0] c_choice;
+	           reg [5:0] c_slot;
+	           reg c_slot_en, c_decrypt, c_store;
+	           wire c_resetn = rst_sync[1];
+	           wire issue = !busy && (store_pending || (core_req && !have_result));
+
+	           always @(posedge s00_axi_aclk)
+	           begin
+	             if (s00_axi_aresetn == 1'b0)
+	             begin
+	               req_t <= 1'b0;
+	               ack_sync <= 2'b00;
+	               ack_seen <= 1'b0;
+	               busy <= 1'b0;
+	               have_result <= 1'b0;
+	               store_pending <= 1'b0;
+	             end
+	             else
+	             begin
+	               ack_sync <= {ack_sync[0], ack_t};
+	               if (core_req && core_ready)
+	                 have_result <= 1'b0;
+	               if (busy && ack_sync[1] != ack_seen)
+	               begin
+	                 ack_seen <= ack_sync[1];
+	                 busy <= 1'b0;
+	                 if (!xfer_store)
+	                 begin
+	                   result <= c_result;
+	                   have_result <= 1'b1;
+	                 end
+	               end
+	               if (issue)
+	               begin
+	                 xfer_plaintext <= plaintext_s;
+	                 xfer_key <= store_pending ? store_key : key_s;
+	                 xfer_choice <= store_pending ? store_choice : aes_key_choice_s;
+	                 xfer_slot <= store_pending ? store_slot : key_slot_s;
+	                 xfer_slot_en <= key_slot_en_s;
+	                 xfer_decrypt <= decrypt_s;
+	                 xfer_store <= store_pending;
+	                 req_t <= ~req_t;
+	                 busy <= 1'b1;
+	                 store_pending <= 1'b0;
+	               end
+	               if (key_store_s)
+	               begin
+	                 store_key <= key_s;
+	                 store_choice <= aes_key_choice_s;
+	                 store_slot <= key_slot_s;
+	                 store_pending <= 1'b1;
+	               end
+	             end
+	           end
+
+	           // Reset is asserted at once and released on core_clk
+	           always @(posedge core_clk or negedge s00_axi_aresetn)
+	           begin
+	             if (s00_axi_aresetn == 1'b0)
+	               rst_sync <= 2'b00;
+	             else
+	               rst_sync <= {rst_sync[0], 1'b1};
+	           end
+
+	           // Steps of a request: take the inputs, read or write the key
+	           // table, take the result
+	           always @(posedge core_clk)
+	           begin
+	             if (c_resetn == 1'b0)
+	             begin
+	               req_sync <= 2'b00;
+	               req_seen <= 1'b0;
+	               ack_t <= 1'b0;
+	               c_step <= 2'd0;
+	             end
+	             else
+	             begin
+	               req_sync <= {req_sync[0], req_t};
+	               case (c_step)
+	                 2'd0:
+	                   if (req_sync[1] != req_seen)
+	                   begin
+	                     req_seen <= req_sync[1];
+	                     c_plaintext <= xfer_plaintext;
+	                     c_key <= xfer_key;
+	                     c_choice <= xfer_choice;
+	                     c_slot <= xfer_slot;
+	                     c_slot_en <= xfer_slot_en;
+	                     c_decrypt <= xfer_decrypt;
+	                     c_store <= xfer_store;
+	                     c_step <= 2'd1;
+	                   end
+	                 2'd1:
+	                   c_step <= 2'd2;
+	                 default:
+	                 begin
+	                   c_result <= ciphertext;
+	                   ack_t <= ~ack_t;
+	                   c_step <= 2'd0;
+	                 end
+	               endcase
+	             end
+	           end
+
+	           assign core_clk_i = core_clk;
+	           assign plaintext = c_plaintext;
+	           assign key = c_key;
+	           assign aes_key_choice = c_choice;
+	           assign key_slot = c_slot;
+	           assign key_slot_en = c_slot_en;
+	           assign decrypt = c_decrypt;
+	           assign key_store = c_store && (c_step == 2'd1);
+	           assign ciphertext_s = result;
+	           assign core_ready = have_result;
+	         end
+	         else begin : no_cdc
+	           assign core_clk_i = s00_axi_aclk;
+	           assign plaintext = plaintext_s;
+	           assign key = key_s;
+	           assign aes_key_choice = aes_key_choice_s;
+	           assign key_slot = key_slot_s;
+	           assign key_slot_en = key_slot_en_s;
+	           assign decrypt = decrypt_s;
+	           assign key_store = key_store_s;
+	           assign ciphertext_s = ciphertext;
+	           assign core_ready = 1'b1;
+	         end
+	       endgenerate
+
+	// Round keys are expanded from the key registers, or from the key read
+	// from the key slot table when KEY_SLOT_EN is set. A key slot store writes
+	// the key as the slave presents it, in the original packing whatever
+	// BYTE_ORDER says, and the current key size; the table holds 258 bits a
+	// slot rather than a 1922-bit schedule. The expansion was already in
+	// series with the rounds for the key registers, so a slot adds the table
+	// read in front of it and no longer path.
+	       wire [1407:0] rk128_expanded;
+	       wire [1663:0] rk192_expanded;
+	       wire [1919:0] rk256_expanded;
+	       wire [255:0] slot_key;
+	       wire [1:0] slot_key_choice;
+	       wire use_slot = key_slot_en && (C_NUM_KEY_SLOTS > 0);
+	       wire [255:0] core_key = use_slot ? slot_key : key;
+	       wire [1:0] core_key_choice = use_slot ? slot_key_choice : aes_key_choice;
+
+	       keyExpansion #(4,10) ke128 (core_key[127:0], rk128_expanded);
+	       keyExpansion #(6,12) ke192 (core_key[191:0], rk192_expanded);
+	       keyExpansion #(8,14) ke256 (core_key, rk256_expanded);
+
+	       generate
+	         if (C_NUM_KEY_SLOTS > 0) begin : slots
+	           keyTable #(.SLOTS(C_NUM_KEY_SLOTS),
+	                      .W(256)
+	                      ) key_table
+	                      (
+	                      core_clk_i,
+	                      key_store,
+	                      key_slot,
+	                      key,
+	                      aes_key_choice,
+	                      key_slot,
+	                      slot_key,
+	                      slot_key_choice
+	                      );
+	         end
+	         else begin : no_slots
+	           assign slot_key = 0;
+	           assign slot_key_choice = 0;
+	         end
+	       endgenerate
+
+	       AES_EncryptRounds #(.Nr(10)
 	                     ) aes128
 	                     ( 
 	                     plaintext, 
-	                     key, 
+	                     rk128_expanded, 
 	                     ciphertext128
 	                     );
-	       AES_Encrypt #(.N(192), 
-	                     .Nr(12), 
-	                     .Nk(6)
+	       AES_EncryptRounds #(.Nr(12)
 	                     ) aes192
 	                     ( 
 	                     plaintext, 
-	                     key, 
+	                     rk192_expanded, 
 	                     ciphertext192
 	                     );
 	       
-	       AES_Encrypt #(.N(256), 
-	                     .Nr(14), 
-	                     .Nk(8)
+	       AES_EncryptRounds #(.Nr(14)
 	                     ) aes256
 	                     ( 
 	                     plaintext, 
-	                     key, 
+	                     rk256_expanded, 
 	                     ciphertext256
 	                     );
-assign ciphertext = (aes_key_choice==0) ? ciphertext128 : (aes_key_choice==1) ? ciphertext192 : (aes_key_choice==2) ? ciphertext256 : 0; 
+	// Inverse cipher on the same round keys, selected by DECRYPT
+	       generate
+	         if (C_DECRYPT) begin : inverse
+	           AES_DecryptRounds #(.Nr(10)
+	                         ) aes128_inv
+	                         ( 
+	                         plaintext, 
+	                         rk128_expanded, 
+	                         deciphered128
+	                         );
+	           AES_DecryptRounds #(.Nr(12)
+	                         ) aes192_inv
+	                         ( 
+	                         plaintext, 
+	                         rk192_expanded, 
+	                         deciphered192
+	                         );
+	           AES_DecryptRounds #(.Nr(14)
+	                         ) aes256_inv
+	                         ( 
+	                         plaintext, 
+	                         rk256_expanded, 
+	                         deciphered256
+	                         );
+	         end
+	         else begin : no_inverse
+	           assign deciphered128 = 0;
+	           assign deciphered192 = 0;
+	           assign deciphered256 = 0;
+	         end
+	       endgenerate
+
+assign ciphertext = decrypt ?
+                    ((core_key_choice==0) ? deciphered128 : (core_key_choice==1) ? deciphered192 : (core_key_choice==2) ? deciphered256 : 0) :
+                    ((core_key_choice==0) ? ciphertext128 : (core_key_choice==1) ? ciphertext192 : (core_key_choice==2) ? ciphertext256 : 0); 
 	// User logic ends
 
 	endmodule
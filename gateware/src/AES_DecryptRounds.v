@@ -0,0 +1,26 @@
+module AES_DecryptRounds#(parameter Nr=10)(in,fullkeys,out);
+// The inverse cipher, taking the same expanded round keys as
+// AES_EncryptRounds and applying them from the last round to the first.
+input [127:0] in;
+input [(128*(Nr+1))-1:0] fullkeys;
+output [127:0] out;
+wire [127:0] states [Nr+1:0] ;
+wire [127:0] afterShiftRows;
+wire [127:0] afterSubBytes;
+
+addRoundKey addrk1 (in,states[0],fullkeys[127:0]);
+
+genvar i;
+generate
+	
+	for(i=1; i<Nr ;i=i+1)begin : loop
+		decryptRound dr(states[i-1],fullkeys[128*i+:128],states[i]);
+		
+		end
+		invShiftRows sr(states[Nr-1],afterShiftRows);
+		invSubBytes sb(afterShiftRows,afterSubBytes);
+		addRoundKey addrk2(afterSubBytes,states[Nr],fullkeys[((128*(Nr+1))-1)-:128]);
+			assign out=states[Nr];
+
+endgenerate
+endmodule
@@ -0,0 +1,26 @@
+module AES_EncryptRounds#(parameter Nr=10)(in,fullkeys,out);
+// The cipher rounds of AES_Encrypt, taking the expanded round keys as an input
+// so that they can come from keyExpansion or from a stored key slot.
+input [127:0] in;
+input [(128*(Nr+1))-1:0] fullkeys;
+output [127:0] out;
+wire [127:0] states [Nr+1:0] ;
+wire [127:0] afterSubBytes;
+wire [127:0] afterShiftRows;
+
+addRoundKey addrk1 (in,states[0],fullkeys[((128*(Nr+1))-1)-:128]);
+
+genvar i;
+generate
+	
+	for(i=1; i<Nr ;i=i+1)begin : loop
+		encryptRound er(states[i-1],fullkeys[(((128*(Nr+1))-1)-128*i)-:128],states[i]);
+		
+		end
+		subBytes sb(states[Nr-1],afterSubBytes);
+		shiftRows sr(afterSubBytes,afterShiftRows);
+		addRoundKey addrk2(afterShiftRows,states[Nr],fullkeys[127:0]);
+			assign out=states[Nr];
+
+endgenerate
+endmodule
@@ -0,0 +1,311 @@
+module AES_burst #(parameter DATA_W=128, parameter ADDR_W=9, parameter ID_W=1)(clk, resetn,
+	s_awid, s_awaddr, s_awlen, s_awsize, s_awburst, s_awvalid, s_awready,
+	s_wdata, s_wstrb, s_wlast, s_wvalid, s_wready,
+	s_bid, s_bresp, s_bvalid, s_bready,
+	s_arid, s_araddr, s_arlen, s_arsize, s_arburst, s_arvalid, s_arready,
+	s_rid, s_rdata, s_rresp, s_rlast, s_rvalid, s_rready,
+	m_awaddr, m_awvalid, m_awready, m_wdata, m_wstrb, m_wvalid, m_wready,
+	m_bresp, m_bvalid, m_bready,
+	m_araddr, m_arvalid, m_arready, m_rdata, m_rresp, m_rvalid, m_rready);
+// AXI4 burst front end of the register slave. Takes INCR (and FIXED) bursts
+// of DATA_W-bit beats, 64 or 128, and turns each beat into 32-bit AXI4-Lite
+// accesses of the words it covers, in address order: a write per clock for
+// the words whose strobes are set, and a read at a time, so the slave's
+// doorbell and retire rules apply to burst accesses word by word. WRAP
+// bursts are taken as INCR. A burst's write response follows the responses
+// to all of its words, SLVERR if any of them failed. A read burst is only
+// taken with no write burst in progress or offered, so a read that follows a
+// write to DATA finds its doorbell rung.
+//
+// Byte addresses below 0x100 reach the registers as mapped on AXI4-Lite.
+// From 0x100 the data windows give the registers a burst moves together
+// consecutive addresses, repeating every 64 bytes up to 0x1FF:
+//   0x100-0x11F KEY     key_reg0-7
+//   0x120-0x12F IV      iv_reg0-3
+//   0x130-0x13F DATA    plaintext_reg0-3 when written, ciphertext_reg0-3
+//                       when read
+// so one 64-byte burst loads a key, an IV and a block, and in doorbell mode a
+// 16-byte burst to DATA starts a block and one from DATA retires it.
+input clk;
+input resetn;
+input [ID_W-1:0] s_awid;
+input [ADDR_W-1:0] s_awaddr;
+input [7:0] s_awlen;
+input [2:0] s_awsize;
+input [1:0] s_awburst;
+input s_awvalid;
+output s_awready;
+input [DATA_W-1:0] s_wdata;
+input [DATA_W/8-1:0] s_wstrb;
+input s_wlast;
+input s_wvalid;
+output s_wready;
+output reg [ID_W-1:0] s_bid;
+output [1:0] s_bresp;
+output s_bvalid;
+input s_bready;
+input [ID_W-1:0] s_arid;
+input [ADDR_W-1:0] s_araddr;
+input [7:0] s_arlen;
+input [2:0] s_arsize;
+input [1:0] s_arburst;
+input s_arvalid;
+output s_arready;
+output reg [ID_W-1:0] s_rid;
+output reg [DATA_W-1:0] s_rdata;
+output [1:0] s_rresp;
+output s_rlast;
+output s_rvalid;
+input s_rready;
+output [ADDR_W-1:0] m_awaddr;   // register slave, 32-bit AXI4-Lite
+output m_awvalid;
+input m_awready;
+output [31:0] m_wdata;
+output [3:0] m_wstrb;
+output m_wvalid;
+input m_wready;
+input [1:0] m_bresp;
+input m_bvalid;
+output m_bready;
+output [ADDR_W-1:0] m_araddr;
+output m_arvalid;
+input m_arready;
+input [31:0] m_rdata;
+input [1:0] m_rresp;
+input m_rvalid;
+output m_rready;
+
+localparam NL = DATA_W / 32;    // 32-bit words per beat
+localparam BURST_FIXED = 2'b00;
+
+localparam W_IDLE = 2'd0;
+localparam W_BEAT = 2'd1;       // wait for the next beat
+localparam W_WORD = 2'd2;       // write its words
+localparam W_RESP = 2'd3;       // wait for the words' responses, then B
+
+localparam R_IDLE = 2'd0;
+localparam R_ADDR = 2'd1;       // read a word of the beat
+localparam R_DATA = 2'd2;
+localparam R_BEAT = 2'd3;       // present the beat
+
+// Register byte address of a word of the burst address space
+function [ADDR_W-1:0] reg_addr;
+	input [ADDR_W-1:0] a;
+	input rd;
+	reg [5:0] word;
+	begin
+		if (a[8]) begin
+			if (a[5:2] < 8)
+				word = 6'h06 + a[5:2];                  // KEY
+			else if (a[5:2] < 12)
+				word = 6'h2C + (a[5:2] - 8);            // IV
+			else
+				word = (rd ? 6'h14 : 6'h02) + (a[5:2] - 12);    // DATA
+		end
+		else
+			word = a[7:2];
+		reg_addr = {word, 2'b00};
+	end
+endfunction
+
+// Lowest word set in a mask of the words of a beat
+function integer first_word;
+	input [NL-1:0] mask;
+	integer i;
+	begin
+		first_word = 0;
+		for (i = NL - 1; i >= 0; i = i - 1)
+			if (mask[i])
+				first_word = i;
+	end
+endfunction
+
+// Words of the beat at a covering its bytes for a transfer size
+function [NL-1:0] beat_words;
+	input [ADDR_W-1:0] a;
+	input [2:0] size;
+	integer i, lo, hi;
+	begin
+		lo = (a % (DATA_W / 8)) / 4;
+		hi = ((a % (DATA_W / 8)) / (1 << size) * (1 << size) + (1 << size) - 1) / 4;
+		for (i = 0; i < NL; i = i + 1)
+			beat_words[i] = i >= lo && i <= hi;
+	end
+endfunction
+
+// Address of the beat after the one at a
+function [ADDR_W-1:0] next_addr;
+	input [ADDR_W-1:0] a;
+	input [2:0] size;
+	input [1:0] burst;
+	begin
+		if (burst == BURST_FIXED)
+			next_addr = a;
+		else
+			next_addr = (a >> size << size) + (1 << size);
+	end
+endfunction
+
+// Write side
+reg [1:0] w_state;
+reg [ADDR_W-1:0] w_addr;
+reg [2:0] w_size;
+reg [1:0] w_burst;
+reg [DATA_W-1:0] w_data;
+reg [DATA_W/8-1:0] w_strb;
+reg [NL-1:0] w_words;           // words of the beat still to write
+reg w_last;
+reg w_err;
+reg aw_done, wd_done;           // halves of the current word's handshake
+reg [3:0] b_pend;               // word writes awaiting their response
+
+wire [NL-1:0] w_strb_words;
+genvar g;
+generate
+	for (g = 0; g < NL; g = g + 1) begin : strb_words
+		assign w_strb_words[g] = |s_wstrb[4*g +: 4];
+	end
+endgenerate
+
+wire [31:0] w_word = first_word(w_words);
+wire [ADDR_W-1:0] w_base = w_addr / (DATA_W / 8) * (DATA_W / 8);
+wire w_fire = (aw_done || m_awready) && (wd_done || m_wready);
+wire [NL-1:0] w_words_left = w_words & ~(w_fire ? {{(NL-1){1'b0}}, 1'b1} << w_word : {NL{1'b0}});
+
+assign s_awready = w_state == W_IDLE;
+assign s_wready = w_state == W_BEAT;
+assign s_bvalid = w_state == W_RESP && b_pend == 0;
+assign s_bresp = w_err ? 2'b10 : 2'b00;
+assign m_awaddr = reg_addr(w_base + 4 * w_word, 1'b0);
+assign m_awvalid = w_state == W_WORD && w_words != 0 && !aw_done;
+assign m_wdata = w_data[32*w_word +: 32];
+assign m_wstrb = w_strb[4*w_word +: 4];
+assign m_wvalid = w_state == W_WORD && w_words != 0 && !wd_done;
+assign m_bready = 1'b1;
+
+always @(posedge clk) begin
+	if (resetn == 1'b0) begin
+		w_state <= W_IDLE;
+		w_words <= 0;
+		w_err <= 1'b0;
+		aw_done <= 1'b0;
+		wd_done <= 1'b0;
+		b_pend <= 0;
+		s_bid <= 0;
+	end
+	else begin
+		b_pend <= b_pend + (w_state == W_WORD && w_words != 0 && w_fire) - m_bvalid;
+		if (m_bvalid && m_bresp != 2'b00)
+			w_err <= 1'b1;
+		case (w_state)
+		W_IDLE:
+			if (s_awvalid) begin
+				s_bid <= s_awid;
+				w_addr <= s_awaddr;
+				w_size <= s_awsize;
+				w_burst <= s_awburst;
+				w_err <= 1'b0;
+				w_state <= W_BEAT;
+			end
+		W_BEAT:
+			if (s_wvalid) begin
+				w_data <= s_wdata;
+				w_strb <= s_wstrb;
+				w_words <= w_strb_words;
+				w_last <= s_wlast;
+				w_state <= W_WORD;
+			end
+		W_WORD: begin
+			if (w_words != 0 && !w_fire) begin
+				aw_done <= aw_done || m_awready;
+				wd_done <= wd_done || m_wready;
+			end
+			else begin
+				aw_done <= 1'b0;
+				wd_done <= 1'b0;
+			end
+			w_words <= w_words_left;
+			if (w_words_left == 0) begin
+				w_addr <= next_addr(w_addr, w_size, w_burst);
+				w_state <= w_last ? W_RESP : W_BEAT;
+			end
+		end
+		W_RESP:
+			if (s_bvalid && s_bready)
+				w_state <= W_IDLE;
+		endcase
+	end
+end
+
+// Read side
+reg [1:0] r_state;
+reg [ADDR_W-1:0] r_addr;
+reg [7:0] r_len;                // beats left after this one
+reg [2:0] r_size;
+reg [1:0] r_burst;
+reg [NL-1:0] r_words;           // words of the beat still to read
+reg r_err;
+
+wire [31:0] r_word = first_word(r_words);
+wire [ADDR_W-1:0] r_base = r_addr / (DATA_W / 8) * (DATA_W / 8);
+wire [ADDR_W-1:0] r_next = next_addr(r_addr, r_size, r_burst);
+
+assign s_arready = r_state == R_IDLE && w_state == W_IDLE && !s_awvalid;
+assign s_rvalid = r_state == R_BEAT;
+assign s_rresp = r_err ? 2'b10 : 2'b00;
+assign s_rlast = r_len == 0;
+assign m_araddr = reg_addr(r_base + 4 * r_word, 1'b1);
+assign m_arvalid = r_state == R_ADDR;
+assign m_rready = r_state == R_DATA;
+
+always @(posedge clk) begin
+	if (resetn == 1'b0) begin
+		r_state <= R_IDLE;
+		r_len <= 0;
+		r_err <= 1'b0;
+		s_rid <= 0;
+		s_rdata <= 0;
+	end
+	else begin
+		case (r_state)
+		R_IDLE:
+			if (s_arvalid && s_arready) begin
+				s_rid <= s_arid;
+				r_addr <= s_araddr;
+				r_len <= s_arlen;
+				r_size <= s_arsize;
+				r_burst <= s_arburst;
+				r_words <= beat_words(s_araddr, s_arsize);
+				r_err <= 1'b0;
+				s_rdata <= 0;
+				r_state <= R_ADDR;
+			end
+		R_ADDR:
+			if (m_arready)
+				r_state <= R_DATA;
+		R_DATA:
+			if (m_rvalid) begin
+				s_rdata[32*r_word +: 32] <= m_rdata;
+				if (m_rresp != 2'b00)
+					r_err <= 1'b1;
+				r_words[r_word] <= 1'b0;
+				r_state <= r_words == ({{(NL-1){1'b0}}, 1'b1} << r_word) ? R_BEAT : R_ADDR;
+			end
+		R_BEAT:
+			if (s_rready) begin
+				if (r_len == 0)
+					r_state <= R_IDLE;
+				else begin
+					r_addr <= r_next;
+					r_len <= r_len - 1;
+					r_words <= beat_words(r_next, r_size);
+					r_err <= 1'b0;
+					s_rdata <= 0;
+					r_state <= R_ADDR;
+				end
+			end
+		endcase
+	end
+end
+
+endmodule
@@ -0,0 +1,431 @@
+module AES_ring #(parameter ADDR_W=32)(clk, resetn, run, base, size_log2, tail, head, busy, error,
+	reg_wr, reg_index, reg_data, core_idle, core_finished, result, tag,
+	m_araddr, m_arlen, m_arvalid, m_arready, m_rdata, m_rresp, m_rlast, m_rvalid, m_rready,
+	m_awaddr, m_awlen, m_awvalid, m_awready, m_wdata, m_wstrb, m_wlast, m_wvalid, m_wready,
+	m_bresp, m_bvalid, m_bready);
+// Descriptor ring engine. Fetches job descriptors through an AXI4 master from
+// a ring of 2^size_log2 entries at base, for ring indices head up to tail, and
+// runs each job on the core through the same register writes software would
+// make: key, IV, MODE, data words, enable. Results go to the job's
+// destination, and the tag and a completion status back into the descriptor;
+// head then advances. The register interface and descriptor layout are
+// described with the ring registers in AES_slave_lite_v1_0_S00_AXI.v.
+//
+// Data moves in bursts of up to four 32-bit beats, one block at a time, so
+// data buffers must be 16-byte aligned; a partial last block reads and writes
+// only the words it covers, the writes byte-masked. A bus error stops the
+// engine with error set until run is cleared.
+input clk;
+input resetn;
+input run;
+input [ADDR_W-1:0] base;
+input [3:0] size_log2;
+input [31:0] tail;
+output reg [31:0] head;
+output busy;            // a job is in progress and owns the core registers
+output reg error;
+output reg reg_wr;      // register write port, one write per clock
+output reg [5:0] reg_index;
+output reg [31:0] reg_data;
+input core_idle;
+input core_finished;
+input [127:0] result;   // result registers, word 0 in bits 31:0
+input [127:0] tag;
+output reg [ADDR_W-1:0] m_araddr;
+output reg [7:0] m_arlen;
+output reg m_arvalid;
+input m_arready;
+input [31:0] m_rdata;
+input [1:0] m_rresp;
+input m_rlast;
+input m_rvalid;
+output m_rready;
+output reg [ADDR_W-1:0] m_awaddr;
+output reg [7:0] m_awlen;
+output reg m_awvalid;
+input m_awready;
+output [31:0] m_wdata;
+output [3:0] m_wstrb;
+output m_wlast;
+output reg m_wvalid;
+input m_wready;
+input [1:0] m_bresp;
+input m_bvalid;
+output m_bready;
+
+// Descriptor: 16 words, 64 bytes
+//   0 CTRL      [2:0] mode, [3] decrypt, [4] more (CMAC: no FINAL),
+//               [5] key from KEY_ADDR, [7:6] its key choice, [13:8] key slot
+//   1 KEY_ADDR  eight key words, as written to the key registers
+//   2 AAD_ADDR  GCM additional data
+//   3 SRC       data in
+//   4 DST       data out, in place when equal to SRC
+//   5 AAD_LEN   bytes of additional data
+//   6 LEN       bytes of data
+//   7-10 IV     as written to the IV registers (GCM: J0)
+//   11 STATUS   written back: bit 31 done, [7:0] RING_ERR_*
+//   12-15 TAG   written back for GCM and CMAC: the tag registers
+localparam DESC_WORDS  = 11;    // words fetched, up to STATUS
+localparam DESC_STATUS = 11;
+localparam DESC_TAG    = 12;
+localparam CTRL_MORE    = 4;
+localparam CTRL_KEY_PTR = 5;
+localparam RING_ERR_DESC = 8'd1;    // mode or alignment the ring cannot run
+
+localparam MODE_ECB  = 3'd0;
+localparam MODE_CTR  = 3'd1;
+localparam MODE_GCM  = 3'd2;
+localparam MODE_CMAC = 3'd4;
+localparam OP_BLOCK = 2'd0;
+localparam OP_AAD   = 2'd1;
+localparam OP_INIT  = 2'd2;
+localparam OP_FINAL = 2'd3;
+
+// Register indices the engine writes
+localparam REG_ENABLE     = 6'h00;
+localparam REG_KEY_CHOICE = 6'h01;
+localparam REG_PLAINTEXT0 = 6'h02;
+localparam REG_KEY0       = 6'h06;
+localparam REG_KEY_SLOT   = 6'h0E;
+localparam REG_MODE       = 6'h11;
+localparam REG_IV0        = 6'h2C;
+localparam KEY_SLOT_EN    = 32'h100;
+
+localparam S_IDLE   = 4'd0;
+localparam S_DESC   = 4'd1;     // fetch the descriptor
+localparam S_KEY    = 4'd2;     // fetch the key into the key registers
+localparam S_SELECT = 4'd3;     // key choice and key slot
+localparam S_IV     = 4'd4;
+localparam S_NEXT   = 4'd5;     // pick the next operation of the job
+localparam S_LOAD   = 4'd6;     // fetch a block into the data registers
+localparam S_MODE   = 4'd7;
+localparam S_GO     = 4'd8;
+localparam S_WAIT   = 4'd9;     // for FINISHED
+localparam S_STOP   = 4'd10;    // drop enable, wait for IDLE
+localparam S_STORE  = 4'd11;    // write the result block
+localparam S_TAG    = 4'd12;
+localparam S_STATUS = 4'd13;
+localparam S_HALT   = 4'd14;    // bus error
+
+localparam P_INIT  = 3'd0;
+localparam P_AAD   = 3'd1;
+localparam P_TEXT  = 3'd2;
+localparam P_FINAL = 3'd3;
+localparam P_TAG   = 3'd4;
+localparam P_DONE  = 3'd5;
+
+reg [3:0] state;
+reg [2:0] phase;
+reg [3:0] beat;
+reg [ADDR_W-1:0] desc_addr;
+reg [31:0] d_ctrl, d_key_addr, d_aad_addr, d_src, d_dst, d_aad_len, d_len;
+reg [127:0] d_iv;
+reg [7:0] status;
+
+// The operation in progress
+reg [1:0] op;
+reg [4:0] op_bytes;             // MODE [12:8]
+reg [4:0] n;                    // bytes of data it reads and writes
+reg store;
+reg [ADDR_W-1:0] in_addr, out_addr;
+reg [127:0] wbuf;
+reg [3:0] wbeats;               // beats of the current write burst
+
+wire [2:0] mode = d_ctrl[2:0];
+wire more = d_ctrl[CTRL_MORE];
+wire [ADDR_W-1:0] mask = (1 << size_log2) - 1;
+wire [1:0] words_m1 = (n - 5'd1) >> 2;    // beats covering n bytes, less one
+wire [15:0] byte_en = (n >= 16) ? 16'hFFFF : ((16'h1 << n) - 16'h1);
+
+assign busy = (state != S_IDLE) && (state != S_HALT);
+assign m_rready = (state == S_DESC) || (state == S_KEY) || (state == S_LOAD);
+assign m_bready = 1'b1;
+assign m_wdata = wbuf[32*beat +: 32];
+assign m_wstrb = (state == S_STORE) ? byte_en[4*beat +: 4] : 4'hF;
+assign m_wlast = (beat == wbeats);
+
+wire r_beat = m_rvalid && m_rready;
+wire w_beat = m_wvalid && m_wready;
+wire b_done = m_bvalid && m_bready;
+wire bus_err = (r_beat && m_rresp[1]) || (b_done && m_bresp[1]);
+
+// Descriptors the ring cannot run: XTS needs two keys per data unit, data
+// must be 16-byte aligned and a key 32-byte aligned, so no burst crosses a
+// 4 KiB boundary
+wire desc_ok = (mode == MODE_ECB || mode == MODE_CTR || mode == MODE_GCM || mode == MODE_CMAC) &&
+               (d_src[3:0] == 0) && (d_dst[3:0] == 0) && (d_aad_addr[3:0] == 0) &&
+               (!d_ctrl[CTRL_KEY_PTR] || d_key_addr[4:0] == 0);
+
+task read_burst;
+	input [ADDR_W-1:0] addr;
+	input [7:0] len;
+	begin
+		m_araddr <= addr;
+		m_arlen <= len;
+		m_arvalid <= 1'b1;
+		beat <= 0;
+	end
+endtask
+
+task write_burst;
+	input [ADDR_W-1:0] addr;
+	input [3:0] len;
+	input [127:0] data;
+	begin
+		m_awaddr <= addr;
+		m_awlen <= len;
+		m_awvalid <= 1'b1;
+		m_wvalid <= 1'b1;
+		wbuf <= data;
+		wbeats <= len;
+		beat <= 0;
+	end
+endtask
+
+task write_reg;
+	input [5:0] index;
+	input [31:0] data;
+	begin
+		reg_wr <= 1'b1;
+		reg_index <= index;
+		reg_data <= data;
+	end
+endtask
+
+// Start an operation: remember what it reads and writes, then fetch its data
+// or go straight to MODE
+task start_op;
+	input [1:0] o;
+	input [4:0] bytes;
+	input [4:0] len;
+	input rd;
+	input wr;
+	begin
+		op <= o;
+		op_bytes <= bytes;
+		n <= len;
+		store <= wr;
+		if (rd) begin
+			read_burst(in_addr, (len - 5'd1) >> 2);
+			state <= S_LOAD;
+		end
+		else
+			state <= S_MODE;
+	end
+endtask
+
+always @(posedge clk) begin
+	if (resetn == 1'b0) begin
+		state <= S_IDLE;
+		head <= 32'h0;
+		error <= 1'b0;
+		reg_wr <= 1'b0;
+		reg_index <= 6'h0;
+		reg_data <= 32'h0;
+		m_arvalid <= 1'b0;
+		m_awvalid <= 1'b0;
+		m_wvalid <= 1'b0;
+		beat <= 0;
+	end
+	else begin
+		reg_wr <= 1'b0;
+		if (m_arvalid && m_arready)
+			m_arvalid <= 1'b0;
+		if (m_awvalid && m_awready)
+			m_awvalid <= 1'b0;
+
+		if (bus_err) begin
+			error <= 1'b1;
+			m_arvalid <= 1'b0;
+			m_awvalid <= 1'b0;
+			m_wvalid <= 1'b0;
+			state <= S_HALT;
+		end
+		else case (state)
+			S_IDLE: begin
+				// Clearing run empties the ring
+				if (!run)
+					head <= 32'h0;
+				else if (head != tail) begin
+					desc_addr <= base + ((head & mask) << 6);
+					read_burst(base + ((head & mask) << 6), DESC_WORDS - 1);
+					state <= S_DESC;
+				end
+			end
+
+			S_DESC: if (r_beat) begin
+				case (beat)
+					0: d_ctrl <= m_rdata;
+					1: d_key_addr <= m_rdata;
+					2: d_aad_addr <= m_rdata;
+					3: d_src <= m_rdata;
+					4: d_dst <= m_rdata;
+					5: d_aad_len <= m_rdata;
+					6: d_len <= m_rdata;
+					default: d_iv[32*(beat-7) +: 32] <= m_rdata;
+				endcase
+				beat <= beat + 1;
+				if (m_rlast)
+					state <= S_SELECT;
+			end
+
+			S_SELECT: begin
+				status <= 8'h0;
+				phase <= P_INIT;
+				in_addr <= d_aad_addr;
+				beat <= 0;
+				if (!desc_ok) begin
+					status <= RING_ERR_DESC;
+					phase <= P_DONE;
+					state <= S_NEXT;
+				end
+				else if (d_ctrl[CTRL_KEY_PTR]) begin
+					// The key registers, then the key size, with no slot
+					write_reg(REG_KEY_SLOT, 32'h0);
+					read_burst(d_key_addr, 8'd7);
+					state <= S_KEY;
+				end
+				else begin
+					write_reg(REG_KEY_SLOT, KEY_SLOT_EN | d_ctrl[13:8]);
+					state <= (mode == MODE_ECB) ? S_NEXT : S_IV;
+				end
+			end
+
+			S_KEY: if (r_beat) begin
+				write_reg(REG_KEY0 + beat, m_rdata);
+				beat <= beat + 1;
+				if (m_rlast)
+					state <= S_IV;
+			end
+
+			// After a key fetch, the key choice first
+			S_IV: begin
+				if (beat == 8) begin
+					write_reg(REG_KEY_CHOICE, d_ctrl[7:6]);
+					beat <= 0;
+					if (mode == MODE_ECB)
+						state <= S_NEXT;
+				end
+				else begin
+					write_reg(REG_IV0 + beat, d_iv[32*beat +: 32]);
+					beat <= beat + 1;
+					if (beat == 3)
+						state <= S_NEXT;
+				end
+			end
+
+			S_NEXT: case (phase)
+				P_INIT: begin
+					phase <= P_AAD;
+					if (mode != MODE_ECB)
+						start_op(OP_INIT, 5'd0, 5'd0, 1'b0, 1'b0);
+				end
+				P_AAD: begin
+					if (mode == MODE_GCM && d_aad_len != 0) begin
+						start_op(OP_AAD, d_aad_len[3:0], (d_aad_len >= 16) ? 5'd16 : d_aad_len[4:0], 1'b1, 1'b0);
+						d_aad_len <= (d_aad_len >= 16) ? d_aad_len - 16 : 32'h0;
+					end
+					else begin
+						phase <= P_TEXT;
+						in_addr <= d_src;
+						out_addr <= d_dst;
+					end
+				end
+				P_TEXT: begin
+					// CMAC keeps its last block for FINAL
+					if (d_len == 0 || (mode == MODE_CMAC && !more && d_len <= 16))
+						phase <= P_FINAL;
+					else begin
+						start_op(OP_BLOCK, d_len[3:0], (d_len >= 16) ? 5'd16 : d_len[4:0], 1'b1, mode != MODE_CMAC);
+						d_len <= (d_len >= 16) ? d_len - 16 : 32'h0;
+					end
+				end
+				P_FINAL: begin
+					// GCM and CMAC then write back the tag, or with more the
+					// CMAC chaining value
+					phase <= (mode == MODE_GCM || mode == MODE_CMAC) ? P_TAG : P_DONE;
+					if (mode == MODE_GCM)
+						start_op(OP_FINAL, 5'd0, 5'd0, 1'b0, 1'b0);
+					else if (mode == MODE_CMAC && !more) begin
+						start_op(OP_FINAL, d_len[4:0], d_len[4:0], d_len != 0, 1'b0);
+						d_len <= 32'h0;
+					end
+				end
+				P_TAG: begin
+					write_burst(desc_addr + 4*DESC_TAG, 4'd3, tag);
+					phase <= P_DONE;
+					state <= S_TAG;
+				end
+				default: begin
+					write_burst(desc_addr + 4*DESC_STATUS, 4'd0, {96'h0, 1'b1, 23'h0, status});
+					state <= S_STATUS;
+				end
+			endcase
+
+			S_LOAD: if (r_beat) begin
+				write_reg(REG_PLAINTEXT0 + beat, m_rdata);
+				beat <= beat + 1;
+				if (m_rlast) begin
+					in_addr <= in_addr + 16;
+					state <= S_MODE;
+				end
+			end
+
+			S_MODE: begin
+				write_reg(REG_MODE, {19'h0, op_bytes, 2'b00, op, d_ctrl[3:0]});
+				state <= S_GO;
+			end
+
+			S_GO: begin
+				write_reg(REG_ENABLE, 32'h1);
+				state <= S_WAIT;
+			end
+
+			S_WAIT: if (core_finished) begin
+				wbuf <= result;
+				write_reg(REG_ENABLE, 32'h0);
+				state <= S_STOP;
+			end
+
+			S_STOP: if (core_idle && !reg_wr) begin
+				if (store) begin
+					write_burst(out_addr, words_m1, wbuf);
+					out_addr <= out_addr + 16;
+					state <= S_STORE;
+				end
+				else
+					state <= S_NEXT;
+			end
+
+			S_STORE, S_TAG, S_STATUS: begin
+				if (w_beat) begin
+					beat <= beat + 1;
+					if (m_wlast)
+						m_wvalid <= 1'b0;
+				end
+				if (b_done) begin
+					if (state == S_STATUS) begin
+						head <= head + 1;
+						state <= S_IDLE;
+					end
+					else
+						state <= S_NEXT;
+				end
+			end
+
+			S_HALT: begin
+				// Held until software clears run
+				if (!run) begin
+					error <= 1'b0;
+					head <= 32'h0;
+					state <= S_IDLE;
+				end
+			end
+
+			default:
+				state <= S_IDLE;
+		endcase
+	end
+end
+
+endmodule
@@ -4,14 +4,25 @@
 	module AES_slave_lite_v1_0_S00_AXI #
 	(
 		// Users to add parameters here
-
+		// Number of key slots in the key table, read back from KEY_SLOTS
+		parameter integer C_NUM_KEY_SLOTS	= 32,
+		// The core includes the inverse cipher, advertised in CAPS
+		parameter integer C_DECRYPT	= 1,
+		// Include the descriptor ring engine and its AXI4 master, advertised in CAPS
+		parameter integer C_RING	= 1,
+		// Blocks in the CTR keystream buffer, advertised in CAPS; 0 leaves it out
+		parameter integer C_KS_DEPTH	= 0,
+		// S_AXI is driven by the AXI4 burst front end (AES_burst.v), advertised in CAPS
+		parameter integer C_WINDOW	= 0,
+		// Width of M_AXI address bus
+		parameter integer C_M_AXI_ADDR_WIDTH	= 32,
 		// User parameters ends
 		// Do not modify the parameters beyond this line
 
 		// Width of S_AXI data bus
 		parameter integer C_S_AXI_DATA_WIDTH	= 32,
 		// Width of S_AXI address bus
-		parameter integer C_S_AXI_ADDR_WIDTH	= 7
+		parameter integer C_S_AXI_ADDR_WIDTH	= 8
 	)
 	(
 		// Users to add ports here
@@ -19,6 +30,44 @@
         output wire [4*C_S_AXI_DATA_WIDTH -1:0] PLAINTEXT,
         output wire [8*C_S_AXI_DATA_WIDTH -1:0] KEY,
         input wire [4*C_S_AXI_DATA_WIDTH -1:0] CIPHERTEXT,
+        output wire [5:0] KEY_SLOT,
+        output wire KEY_SLOT_EN,
+        output wire KEY_STORE,
+        output wire DECRYPT,    // CIPHERTEXT is the inverse cipher of PLAINTEXT
+        output wire IRQ,        // coalesced ring completion interrupt, level
+        output wire CORE_REQ,   // an operation needs CIPHERTEXT for the inputs presented
+        input wire CORE_READY,  // CIPHERTEXT answers them; tied high for a single clock
+        // AXI4 master of the descriptor ring engine, on S_AXI_ACLK: 32-bit
+        // INCR bursts, one outstanding transaction at a time
+        output wire [C_M_AXI_ADDR_WIDTH-1:0] M_AXI_AWADDR,
+        output wire [7:0] M_AXI_AWLEN,
+        output wire [2:0] M_AXI_AWSIZE,
+        output wire [1:0] M_AXI_AWBURST,
+        output wire [3:0] M_AXI_AWCACHE,
+        output wire [2:0] M_AXI_AWPROT,
+        output wire M_AXI_AWVALID,
+        input wire M_AXI_AWREADY,
+        output wire [31:0] M_AXI_WDATA,
+        output wire [3:0] M_AXI_WSTRB,
+        output wire M_AXI_WLAST,
+        output wire M_AXI_WVALID,
+        input wire M_AXI_WREADY,
+        input wire [1:0] M_AXI_BRESP,
+        input wire M_AXI_BVALID,
+        output wire M_AXI_BREADY,
+        output wire [C_M_AXI_ADDR_WIDTH-1:0] M_AXI_ARADDR,
+        output wire [7:0] M_AXI_ARLEN,
+        output wire [2:0] M_AXI_ARSIZE,
+        output wire [1:0] M_AXI_ARBURST,
+        output wire [3:0] M_AXI_ARCACHE,
+        output wire [2:0] M_AXI_ARPROT,
+        output wire M_AXI_ARVALID,
+        input wire M_AXI_ARREADY,
+        input wire [31:0] M_AXI_RDATA,
+        input wire [1:0] M_AXI_RRESP,
+        input wire M_AXI_RLAST,
+        input wire M_AXI_RVALID,
+        output wire M_AXI_RREADY,
 		// User ports ends
 		// Do not modify the ports beyond this line
 
@@ -85,7 +134,6 @@
 	);
 
 	// AXI4LITE signals
-	reg [C_S_AXI_ADDR_WIDTH-1 : 0] 	axi_awaddr;
 	reg  	axi_awready;
 	reg  	axi_wready;
 	reg [1 : 0] 	axi_bresp;
@@ -94,6 +142,7 @@
 	reg  	axi_arready;
 	reg [1 : 0] 	axi_rresp;
 	reg  	axi_rvalid;
+	reg [C_S_AXI_DATA_WIDTH-1 : 0] 	axi_rdata;
 
 	// Example-specific design signals
 	// local parameter for addressing 32 bit / 64 bit C_S_AXI_DATA_WIDTH
@@ -101,17 +150,53 @@
 	// ADDR_LSB = 2 for 32 bits (n downto 2)
 	// ADDR_LSB = 3 for 64 bits (n downto 3)
 	localparam integer ADDR_LSB = (C_S_AXI_DATA_WIDTH/32) + 1;
-	localparam integer OPT_MEM_ADDR_BITS = 4;
+	localparam integer OPT_MEM_ADDR_BITS = 5;
+	localparam integer NUM_REGS = 1 << (OPT_MEM_ADDR_BITS+1);
+	localparam integer DW = C_S_AXI_DATA_WIDTH;
+	// Write responses that may be outstanding before the slave stops taking writes
+	localparam integer B_DEPTH = 4;
+	// Block cipher modes and operations, see the MODE register below
+	localparam MODE_ECB = 3'd0;
+	localparam MODE_CTR = 3'd1;
+	localparam MODE_GCM = 3'd2;
+	localparam MODE_XTS = 3'd3;
+	localparam MODE_CMAC = 3'd4;
+	localparam OP_BLOCK = 2'd0;
+	localparam OP_AAD   = 2'd1;
+	localparam OP_INIT  = 2'd2;
+	localparam OP_FINAL = 2'd3;
+	// CAPS (0x19): bit n set when mode n is implemented; feature bits from 16
+	localparam CAPS_DECRYPT = 16;   // inverse cipher: ECB decryption
+	localparam CAPS_DOORBELL = 17;  // ENABLE_AUTO doorbell mode
+	localparam CAPS_BANKS = 18;     // ENABLE_BANKS double-buffered data registers
+	localparam CAPS_RING = 19;      // descriptor ring engine (RING_*)
+	localparam CAPS_IRQ = 20;       // coalesced completion interrupt (IRQ_*)
+	localparam CAPS_WINDOW = 21;    // AXI4 bursts and the data windows from 0x100
+	localparam CAPS_KS = 22;        // CTR keystream buffer (KS_*)
+	localparam CAPS_CTX = 23;       // context save and restore (CTX_*)
+localparam CAPS_BYTE_ORDER = 24; // BYTE_ORDER selects little-endian key and data words
+	localparam [31:0] CAPS = (1 << MODE_ECB) | (1 << MODE_CTR) | (1 << MODE_GCM) | (1 << MODE_CMAC) |
+	                         (1 << CAPS_DOORBELL) | (1 << CAPS_BANKS) | (1 << CAPS_CTX) |
+                         (1 << CAPS_BYTE_ORDER) |
+	                         (C_DECRYPT ? ((1 << MODE_XTS) | (1 << CAPS_DECRYPT)) : 0) |
+	                         (C_RING ? ((1 << CAPS_RING) | (1 << CAPS_IRQ)) : 0) |
+	                         (C_WINDOW ? (1 << CAPS_WINDOW) : 0) |
+	                         ((C_KS_DEPTH > 0) ? (1 << CAPS_KS) : 0);
+	localparam [15:0] KS_DEPTH = C_KS_DEPTH;
 	//----------------------------------------------
 	//-- Signals for user logic register space example
 	//------------------------------------------------
-	//-- Number of Slave Registers 24
+	//-- Number of Slave Registers 47
 	reg [C_S_AXI_DATA_WIDTH-1:0]	enable_reg;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	aes_key_choice_reg;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	plaintext_reg0;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	plaintext_reg1;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	plaintext_reg2;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	plaintext_reg3;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	plaintext1_reg0;    // second data bank
+	reg [C_S_AXI_DATA_WIDTH-1:0]	plaintext1_reg1;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	plaintext1_reg2;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	plaintext1_reg3;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	key_reg0;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	key_reg1;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	key_reg2;
@@ -120,13 +205,122 @@
 	reg [C_S_AXI_DATA_WIDTH-1:0]	key_reg5;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	key_reg6;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	key_reg7;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	key_slot_reg;
+	reg 	key_store;    // one-clock pulse storing the key registers into a slot
+	reg [C_S_AXI_DATA_WIDTH-1:0]	mode_reg;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	aad_len_reg;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	text_len_reg;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	iv_reg0;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	iv_reg1;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	iv_reg2;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	iv_reg3;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	tag_reg0;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	tag_reg1;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	tag_reg2;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	tag_reg3;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	done_reg;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	comp_state_reg;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	ciphertext_reg0;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	ciphertext_reg1;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	ciphertext_reg2;
 	reg [C_S_AXI_DATA_WIDTH-1:0]	ciphertext_reg3;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	ciphertext1_reg0;    // second result bank
+	reg [C_S_AXI_DATA_WIDTH-1:0]	ciphertext1_reg1;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	ciphertext1_reg2;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	ciphertext1_reg3;
+	// Bank ownership: full/valid flags, and which bank software writes and
+	// reads next (in_wr, out_rd) and the engine takes and fills next (in_rd, out_wr)
+	reg [1:0]	in_full;
+	reg [1:0]	out_valid;
+	reg 	in_wr, in_rd, out_wr, out_rd;
+	// Descriptor ring registers
+	reg [C_S_AXI_DATA_WIDTH-1:0]	ring_base_reg;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	ring_size_reg;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	ring_tail_reg;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	ring_ctrl_reg;
+	// Interrupt coalescing registers and state
+	reg [C_S_AXI_DATA_WIDTH-1:0]	irq_ctrl_reg;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	irq_count_reg;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	irq_time_reg;
+	reg 	irq_pending;
+	reg [15:0]	irq_events;    // completions counted towards the next interrupt
+	reg [31:0]	irq_timer;     // cycles since the first of them
+	reg [31:0]	ring_head_q;
+	reg 	ring_error_q;
+	// CTR keystream buffer control
+	reg [C_S_AXI_DATA_WIDTH-1:0]	ks_ctrl_reg;
+	reg [15:0]	ks_count;
+	// Word order of the key and data registers
+	reg [C_S_AXI_DATA_WIDTH-1:0]	byte_order_reg;
+	// Context window: the word CTX_DATA accesses next, and that word
+	reg [2:0]	ctx_index;
+	wire [C_S_AXI_DATA_WIDTH-1:0]	ctx_data;
+	// Free-running performance counters and the snapshot copies software reads
+	reg [63:0]	perf_total_cycles;
+	reg [63:0]	perf_busy_cycles;
+	reg [63:0]	perf_blocks;
+	reg [63:0]	perf_axi_wr_beats;
+	reg [63:0]	perf_axi_rd_beats;
+	reg [63:0]	perf_finished_wait;
+	reg [63:0]	perf_total_cycles_snap;
+	reg [63:0]	perf_busy_cycles_snap;
+	reg [63:0]	perf_blocks_snap;
+	reg [63:0]	perf_axi_wr_beats_snap;
+	reg [63:0]	perf_axi_rd_beats_snap;
+	reg [63:0]	perf_finished_wait_snap;
+	reg [NUM_REGS*DW-1:0]	rd_words;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	reg_data_out;
 	integer	 byte_index;
+	integer	 rd_i;
+	// Write channel holding registers, for an address or data beat that
+	// arrives before its partner, and the write responses not yet accepted
+	reg 	aw_held;
+	reg 	w_held;
+	reg [OPT_MEM_ADDR_BITS:0]	aw_index_q;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	w_data_q;
+	reg [(C_S_AXI_DATA_WIDTH/8)-1:0]	w_strb_q;
+	reg [2:0]	b_count;
+	// The register write stage: a write issued on the bus lands here a clock
+	// later, and only this stage is decoded by the register logic
+	reg 	wr_en;
+	reg [OPT_MEM_ADDR_BITS:0]	wr_index;
+	reg [C_S_AXI_DATA_WIDTH-1:0]	wr_data;
+	reg [(C_S_AXI_DATA_WIDTH/8)-1:0]	wr_strb;
+	wire aw_take = S_AXI_AWVALID && axi_awready;
+	wire w_take = S_AXI_WVALID && axi_wready;
+	wire wr_issue = (aw_held || aw_take) && (w_held || w_take);
+	wire [OPT_MEM_ADDR_BITS:0] issue_index = aw_held ? aw_index_q : S_AXI_AWADDR[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB];
+	wire aw_held_next = (aw_held || aw_take) && !wr_issue;
+	wire w_held_next = (w_held || w_take) && !wr_issue;
+	wire [2:0] b_count_next = b_count + wr_issue - (axi_bvalid && S_AXI_BREADY);
+	// Register index of an address being accepted, and of the current read,
+	// which is also held one-hot in rd_sel for the read mux
+	wire [OPT_MEM_ADDR_BITS:0] ar_index = S_AXI_ARADDR[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB];
+	wire [OPT_MEM_ADDR_BITS:0] rd_index = axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB];
+	reg [NUM_REGS-1:0]	rd_sel;
+	// Doorbell mode, described with the user logic
+	localparam ENABLE_AUTO = 1;
+	localparam ENABLE_BANKS = 2;
+	wire auto_mode = enable_reg[ENABLE_AUTO];
+	wire banks = auto_mode && enable_reg[ENABLE_BANKS];
+	wire auto_start = auto_mode && wr_en && (wr_index == 6'h05);
+	wire auto_issue = auto_mode && wr_issue && (issue_index == 6'h05);    // on its way to auto_start
+	wire auto_retire = auto_mode && S_AXI_RVALID && S_AXI_RREADY && (rd_index == 6'h17);
+	wire rd_wait_ar;    // the read being accepted must wait for the result
+	wire rd_wait;       // the read in Rwait must keep waiting
+	wire bank_busy;     // the engine is running an operation from a bank
+	// Descriptor ring, described with the user logic. While the ring engine
+	// runs a job it makes the register writes instead of AXI-Lite.
+	wire ring_busy;
+	wire ring_error;
+	wire [31:0] ring_head;
+	wire ring_reg_wr;
+	wire [OPT_MEM_ADDR_BITS:0] ring_reg_index;
+	wire [C_S_AXI_DATA_WIDTH-1:0] ring_reg_data;
+	wire reg_wvalid = ring_busy ? ring_reg_wr : wr_en;
+	wire [OPT_MEM_ADDR_BITS:0] reg_windex = ring_busy ? ring_reg_index : wr_index;
+	wire [C_S_AXI_DATA_WIDTH-1:0] reg_wdata = ring_busy ? ring_reg_data : wr_data;
+	wire [(C_S_AXI_DATA_WIDTH/8)-1:0] reg_wstrb = ring_busy ? {(C_S_AXI_DATA_WIDTH/8){1'b1}} : wr_strb;
 
 	// I/O Connections assignments
 
@@ -137,86 +331,60 @@
 	assign S_AXI_ARREADY	= axi_arready;
 	assign S_AXI_RRESP	= axi_rresp;
 	assign S_AXI_RVALID	= axi_rvalid;
+	assign S_AXI_RDATA	= axi_rdata;
 	 //state machine varibles 
-	 reg [1:0] state_write;
 	 reg [1:0] state_read;
 	 //State machine local parameters
-	 localparam Idle = 2'b00,Raddr = 2'b10,Rdata = 2'b11 ,Waddr = 2'b10,Wdata = 2'b11;
-	// Implement Write state machine
-	// Outstanding write transactions are not supported by the slave i.e., master should assert bready to receive response on or before it starts sending the new transaction
-	always @(posedge S_AXI_ACLK)                                 
-	  begin                                 
-	     if (S_AXI_ARESETN == 1'b0)                                 
-	       begin                                 
-	         axi_awready <= 0;                                 
-	         axi_wready <= 0;                                 
-	         axi_bvalid <= 0;                                 
-	         axi_bresp <= 0;                                 
-	         axi_awaddr <= 0;                                 
-	         state_write <= Idle;                                 
-	       end                                 
-	     else                                  
-	       begin                                 
-	         case(state_write)                                 
-	           Idle:                                      
-	             begin                                 
-	               if(S_AXI_ARESETN == 1'b1)                                  
-	                 begin                                 
-	                   axi_awready <= 1'b1;                                 
-	                   axi_wready <= 1'b1;                                 
-	                   state_write <= Waddr;                                 
-	                 end                                 
-	               else state_write <= state_write;                                 
-	             end                                 
-	           Waddr:        //At this state, slave is ready to receive address along with corresponding control signals and first data packet. Response valid is also handled at this state                                 
-	             begin                                 
-	               if (S_AXI_AWVALID && S_AXI_AWREADY)                                 
-	                  begin                                 
-	                    axi_awaddr <= S_AXI_AWADDR;                                 
-	                    if(S_AXI_WVALID)                                  
-	                      begin                                   
-	                        axi_awready <= 1'b1;                                 
-	                        state_write <= Waddr;                                 
-	                        axi_bvalid <= 1'b1;                                 
-	                      end                                 
-	                    else                                  
-	                      begin                                 
-	                        axi_awready <= 1'b0;                                 
-	                        state_write <= Wdata;                                 
-	                        if (S_AXI_BREADY && axi_bvalid) axi_bvalid <= 1'b0;                                 
-	                      end                                 
-	                  end                                 
-	               else                                  
-	                  begin                                 
-	                    state_write <= state_write;                                 
-	                    if (S_AXI_BREADY && axi_bvalid) axi_bvalid <= 1'b0;                                 
-	                   end                                 
-	             end                                 
-	          Wdata:        //At this state, slave is ready to receive the data packets until the number of transfers is equal to burst length                                 
-	             begin                                 
-	               if (S_AXI_WVALID)                                 
-	                 begin                                 
-	                   state_write <= Waddr;                                 
-	                   axi_bvalid <= 1'b1;                                 
-	                   axi_awready <= 1'b1;                                 
-	                 end                                 
-	                else                                  
-	                 begin                                 
-	                   state_write <= state_write;                                 
-	                   if (S_AXI_BREADY && axi_bvalid) axi_bvalid <= 1'b0;                                 
-	                 end                                              
-	             end                                 
-	          endcase                                 
-	        end                                 
-	      end                                 
+	 localparam Raddr = 2'b00,Rwait = 2'b01,Rload = 2'b10,Rdata = 2'b11;
+	// Implement write channels
+	// The slave takes one write per clock. AWREADY and WREADY are registered
+	// and stay high while fewer than B_DEPTH write responses are outstanding,
+	// so a master that presents both channels together and keeps BREADY high
+	// writes back to back. An address or data beat that arrives alone is held
+	// until its partner arrives, and its channel's ready drops meanwhile. A
+	// write issues on the clock both halves are present and is applied to the
+	// registers from wr_en on the next clock, the same clock its response is
+	// presented, so a read that follows the response sees it.
+	always @(posedge S_AXI_ACLK)
+	  begin
+	    if (S_AXI_ARESETN == 1'b0)
+	      begin
+	        axi_awready <= 1'b0;
+	        axi_wready <= 1'b0;
+	        axi_bvalid <= 1'b0;
+	        axi_bresp <= 2'b0;
+	        aw_held <= 1'b0;
+	        w_held <= 1'b0;
+	        b_count <= 3'd0;
+	        wr_en <= 1'b0;
+	      end
+	    else
+	      begin
+	        axi_awready <= !aw_held_next && (b_count_next < B_DEPTH);
+	        axi_wready <= !w_held_next && (b_count_next < B_DEPTH);
+	        aw_held <= aw_held_next;
+	        w_held <= w_held_next;
+	        if (aw_take)
+	          aw_index_q <= S_AXI_AWADDR[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB];
+	        if (w_take)
+	          begin
+	            w_data_q <= S_AXI_WDATA;
+	            w_strb_q <= S_AXI_WSTRB;
+	          end
+	        b_count <= b_count_next;
+	        axi_bvalid <= (b_count_next != 0);
+	        wr_en <= wr_issue;
+	        wr_index <= issue_index;
+	        wr_data <= w_held ? w_data_q : S_AXI_WDATA;
+	        wr_strb <= w_held ? w_strb_q : S_AXI_WSTRB;
+	      end
+	  end
 
 	// Implement memory mapped register select and write logic generation
-	// The write data is accepted and written to memory mapped registers when
-	// axi_awready, S_AXI_WVALID, axi_wready and S_AXI_WVALID are asserted. Write strobes are used to
-	// select byte enables of slave registers while writing.
+	// The write data is written to memory mapped registers from the register
+	// write stage, or from the ring engine while it runs a job. Write strobes
+	// are used to select byte enables of slave registers while writing.
 	// These registers are cleared when reset (active low) is applied.
-	// Slave register write enable is asserted when valid address and data are available
-	// and the slave is ready to accept the write address and write data.
 	 
 
 	always @( posedge S_AXI_ACLK )
@@ -229,6 +397,10 @@
 	      plaintext_reg1 <= 0;
 	      plaintext_reg2 <= 0;
 	      plaintext_reg3 <= 0;
+	      plaintext1_reg0 <= 0;
+	      plaintext1_reg1 <= 0;
+	      plaintext1_reg2 <= 0;
+	      plaintext1_reg3 <= 0;
 	      key_reg0 <= 0;
 	      key_reg1 <= 0;
 	      key_reg2 <= 0;
@@ -237,108 +409,174 @@
 	      key_reg5 <= 0;
 	      key_reg6 <= 0;
 	      key_reg7 <= 0;
+	      key_slot_reg <= 0;
+	      mode_reg <= 0;
+	      iv_reg0 <= 0;
+	      iv_reg1 <= 0;
+	      iv_reg2 <= 0;
+	      iv_reg3 <= 0;
 	    end 
 	  else begin
-	    if (S_AXI_WVALID)
+	    if (reg_wvalid)
 	      begin
-	        case ( (S_AXI_AWVALID) ? S_AXI_AWADDR[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] : axi_awaddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] )
-	          5'h00:
+	        case ( reg_windex )
+	          6'h00:
 	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
-	              if ( S_AXI_WSTRB[byte_index] == 1 ) begin
+	              if ( reg_wstrb[byte_index] == 1 ) begin
 	                // Respective byte enables are asserted as per write strobes 
 	                // Slave register 0
-	                enable_reg[(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
+	                enable_reg[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
 	              end  
-	          5'h01:
+	          6'h01:
 	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
-	              if ( S_AXI_WSTRB[byte_index] == 1 ) begin
+	              if ( reg_wstrb[byte_index] == 1 ) begin
 	                // Respective byte enables are asserted as per write strobes 
 	                // Slave register 1
-	                aes_key_choice_reg[(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
+	                aes_key_choice_reg[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
 	              end  
-	          5'h02:
+	          6'h02:
 	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
-	              if ( S_AXI_WSTRB[byte_index] == 1 ) begin
+	              if ( reg_wstrb[byte_index] == 1 ) begin
 	                // Respective byte enables are asserted as per write strobes 
 	                // Slave register 2
-	                plaintext_reg0[(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
+	                if ( in_wr )
+	                  plaintext1_reg0[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
+	                else
+	                  plaintext_reg0[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
 	              end  
-	          5'h03:
+	          6'h03:
 	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
-	              if ( S_AXI_WSTRB[byte_index] == 1 ) begin
+	              if ( reg_wstrb[byte_index] == 1 ) begin
 	                // Respective byte enables are asserted as per write strobes 
 	                // Slave register 3
-	                plaintext_reg1[(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
+	                if ( in_wr )
+	                  plaintext1_reg1[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
+	                else
+	                  plaintext_reg1[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
 	              end  
-	          5'h04:
+	          6'h04:
 	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
-	              if ( S_AXI_WSTRB[byte_index] == 1 ) begin
+	              if ( reg_wstrb[byte_index] == 1 ) begin
 	                // Respective byte enables are asserted as per write strobes 
 	                // Slave register 4
-	                plaintext_reg2[(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
+	                if ( in_wr )
+	                  plaintext1_reg2[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
+	                else
+	                  plaintext_reg2[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
 	              end  
-	          5'h05:
+	          6'h05:
+	            begin
+	              for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
+	                if ( reg_wstrb[byte_index] == 1 ) begin
+	                  // Respective byte enables are asserted as per write strobes 
+	                  // Slave register 5
+	                  if ( in_wr )
+	                    plaintext1_reg3[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
+	                  else
+	                    plaintext_reg3[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
+	                end  
+	              // The doorbell: the last plaintext word starts the operation,
+	              // or with banks hands the bank to the engine
+	              if ( auto_start && !banks )
+	                enable_reg[0] <= 1'b1;
+	            end
+	          6'h06:
 	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
-	              if ( S_AXI_WSTRB[byte_index] == 1 ) begin
-	                // Respective byte enables are asserted as per write strobes 
-	                // Slave register 5
-	                plaintext_reg3[(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
-	              end  
-	          5'h06:
-	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
-	              if ( S_AXI_WSTRB[byte_index] == 1 ) begin
+	              if ( reg_wstrb[byte_index] == 1 ) begin
 	                // Respective byte enables are asserted as per write strobes 
 	                // Slave register 6
-	                key_reg0[(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
+	                key_reg0[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
 	              end  
-	          5'h07:
+	          6'h07:
 	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
-	              if ( S_AXI_WSTRB[byte_index] == 1 ) begin
+	              if ( reg_wstrb[byte_index] == 1 ) begin
 	                // Respective byte enables are asserted as per write strobes 
 	                // Slave register 7
-	                key_reg1[(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
+	                key_reg1[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
 	              end  
-	          5'h08:
+	          6'h08:
 	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
-	              if ( S_AXI_WSTRB[byte_index] == 1 ) begin
+	              if ( reg_wstrb[byte_index] == 1 ) begin
 	                // Respective byte enables are asserted as per write strobes 
 	                // Slave register 8
-	                key_reg2[(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
+	                key_reg2[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
 	              end  
-	          5'h09:
+	          6'h09:
 	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
-	              if ( S_AXI_WSTRB[byte_index] == 1 ) begin
+	              if ( reg_wstrb[byte_index] == 1 ) begin
 	                // Respective byte enables are asserted as per write strobes 
 	                // Slave register 9
-	                key_reg3[(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
+	                key_reg3[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
 	              end  
-	          5'h0A:
+	          6'h0A:
 	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
-	              if ( S_AXI_WSTRB[byte_index] == 1 ) begin
+	              if ( reg_wstrb[byte_index] == 1 ) begin
 	                // Respective byte enables are asserted as per write strobes 
 	                // Slave register 10
-	                key_reg4[(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
+	                key_reg4[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
 	              end  
-	          5'h0B:
+	          6'h0B:
 	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
-	              if ( S_AXI_WSTRB[byte_index] == 1 ) begin
+	              if ( reg_wstrb[byte_index] == 1 ) begin
 	                // Respective byte enables are asserted as per write strobes 
 	                // Slave register 11
-	                key_reg5[(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
+	                key_reg5[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
 	              end  
-	          5'h0C:
+	          6'h0C:
 	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
-	              if ( S_AXI_WSTRB[byte_index] == 1 ) begin
+	              if ( reg_wstrb[byte_index] == 1 ) begin
 	                // Respective byte enables are asserted as per write strobes 
 	                // Slave register 12
-	                key_reg6[(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
+	                key_reg6[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
 	              end  
-	          5'h0D:
+	          6'h0D:
 	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
-	              if ( S_AXI_WSTRB[byte_index] == 1 ) begin
+	              if ( reg_wstrb[byte_index] == 1 ) begin
 	                // Respective byte enables are asserted as per write strobes 
 	                // Slave register 13
-	                key_reg7[(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
+	                key_reg7[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
+	              end
+	          6'h0E:
+	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
+	              if ( reg_wstrb[byte_index] == 1 ) begin
+	                // Respective byte enables are asserted as per write strobes 
+	                // Slave register 14
+	                key_slot_reg[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
+	              end
+	          6'h11:
+	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
+	              if ( reg_wstrb[byte_index] == 1 ) begin
+	                // Respective byte enables are asserted as per write strobes 
+	                // Slave register 17
+	                mode_reg[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
+	              end
+	          6'h2C:
+	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
+	              if ( reg_wstrb[byte_index] == 1 ) begin
+	                // Respective byte enables are asserted as per write strobes 
+	                // Slave register 44
+	                iv_reg0[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
+	              end
+	          6'h2D:
+	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
+	              if ( reg_wstrb[byte_index] == 1 ) begin
+	                // Respective byte enables are asserted as per write strobes 
+	                // Slave register 45
+	                iv_reg1[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
+	              end
+	          6'h2E:
+	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
+	              if ( reg_wstrb[byte_index] == 1 ) begin
+	                // Respective byte enables are asserted as per write strobes 
+	                // Slave register 46
+	                iv_reg2[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
+	              end
+	          6'h2F:
+	            for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
+	              if ( reg_wstrb[byte_index] == 1 ) begin
+	                // Respective byte enables are asserted as per write strobes 
+	                // Slave register 47
+	                iv_reg3[(byte_index*8) +: 8] <= reg_wdata[(byte_index*8) +: 8];
 	              end
 	          default : begin
 	                      enable_reg <= enable_reg;
@@ -347,6 +585,10 @@
 	                      plaintext_reg1 <= plaintext_reg1;
 	                      plaintext_reg2 <= plaintext_reg2;
 	                      plaintext_reg3 <= plaintext_reg3;
+	                      plaintext1_reg0 <= plaintext1_reg0;
+	                      plaintext1_reg1 <= plaintext1_reg1;
+	                      plaintext1_reg2 <= plaintext1_reg2;
+	                      plaintext1_reg3 <= plaintext1_reg3;
 	                      key_reg0 <= key_reg0;
 	                      key_reg1 <= key_reg1;
 	                      key_reg2 <= key_reg2;
@@ -355,13 +597,26 @@
 	                      key_reg5 <= key_reg5;
 	                      key_reg6 <= key_reg6;
 	                      key_reg7 <= key_reg7;
+	                      key_slot_reg <= key_slot_reg;
+	                      mode_reg <= mode_reg;
+	                      iv_reg0 <= iv_reg0;
+	                      iv_reg1 <= iv_reg1;
+	                      iv_reg2 <= iv_reg2;
+	                      iv_reg3 <= iv_reg3;
 	                    end
 	        endcase
 	      end
+	    // Reading the last result word retires the operation
+	    if (auto_retire && !banks)
+	      enable_reg[0] <= 1'b0;
 	  end
 	end    
 
 	// Implement read state machine
+	// The accepted address is decoded one-hot into rd_sel. The next clock
+	// (Rload) registers the selected word into RDATA and raises RVALID, so the
+	// read mux is an AND-OR of registers between two flops. A result read in
+	// doorbell mode waits in Rwait first.
 	  always @(posedge S_AXI_ACLK)                                       
 	    begin                                       
 	      if (S_AXI_ARESETN == 1'b0)                                       
@@ -370,31 +625,33 @@
 	         axi_arready <= 1'b0;                                       
 	         axi_rvalid <= 1'b0;                                       
 	         axi_rresp <= 1'b0;                                       
-	         state_read <= Idle;                                       
+	         state_read <= Raddr;                                       
 	        end                                       
 	      else                                       
 	        begin                                       
 	          case(state_read)                                       
-	            Idle:     //Initial state inidicating reset is done and ready to receive read/write transactions                                       
-	              begin                                                
-	                if (S_AXI_ARESETN == 1'b1)                                        
-	                  begin                                       
-	                    state_read <= Raddr;                                       
-	                    axi_arready <= 1'b1;                                       
-	                  end                                       
-	                else state_read <= state_read;                                       
-	              end                                       
 	            Raddr:        //At this state, slave is ready to receive address along with corresponding control signals                                       
 	              begin                                       
 	                if (S_AXI_ARVALID && S_AXI_ARREADY)                                       
 	                  begin                                       
-	                    state_read <= Rdata;                                       
+	                    state_read <= rd_wait_ar ? Rwait : Rload;                                       
 	                    axi_araddr <= S_AXI_ARADDR;                                       
-	                    axi_rvalid <= 1'b1;                                       
+	                    rd_sel <= {{(NUM_REGS-1){1'b0}}, 1'b1} << ar_index;
 	                    axi_arready <= 1'b0;                                       
 	                  end                                       
-	                else state_read <= state_read;                                       
+	                else axi_arready <= 1'b1;    // also leaves reset
 	              end                                       
+	            Rwait:        //Doorbell mode: a result read is held until the operation finishes
+	              begin
+	                if (!rd_wait)
+	                  state_read <= Rload;
+	              end
+	            Rload:        //Register the selected word
+	              begin
+	                axi_rdata <= reg_data_out;
+	                axi_rvalid <= 1'b1;
+	                state_read <= Rdata;
+	              end
 	            Rdata:        //At this state, slave is ready to send the data packets until the number of transfers is equal to burst length                                       
 	              begin                                           
 	                if (S_AXI_RVALID && S_AXI_RREADY)                                       
@@ -403,41 +660,590 @@
 	                    axi_arready <= 1'b1;                                       
 	                    state_read <= Raddr;                                       
 	                  end                                       
-	                else state_read <= state_read;                                       
 	              end                                       
 	           endcase                                       
 	          end                                       
 	        end                                         
 	// Implement memory mapped register select and read logic generation
-	  assign S_AXI_RDATA = (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h0) ? enable_reg : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h1) ? aes_key_choice_reg : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h2) ? plaintext_reg0 : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h3) ? plaintext_reg1 : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h4) ? plaintext_reg2 : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h5) ? plaintext_reg3 : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h6) ? key_reg0 : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h7) ? key_reg1 : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h8) ? key_reg2 : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h9) ? key_reg3 : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'hA) ? key_reg4 : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'hB) ? key_reg5 : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'hC) ? key_reg6 : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'hD) ? key_reg7 : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h12) ? done_reg : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h13) ? comp_state_reg : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h14) ? ciphertext_reg0 : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h15) ? ciphertext_reg1 : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h16) ? ciphertext_reg2 : (axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] == 5'h17) ? ciphertext_reg3 : 0; 
+	// Every readable register has its slot in rd_words, the rest read as zero
+	  always @(*)
+	  begin
+	    rd_words = 0;
+	    rd_words[DW*6'h00 +: DW] = enable_reg;
+	    rd_words[DW*6'h01 +: DW] = aes_key_choice_reg;
+	    rd_words[DW*6'h02 +: DW] = in_wr ? plaintext1_reg0 : plaintext_reg0;
+	    rd_words[DW*6'h03 +: DW] = in_wr ? plaintext1_reg1 : plaintext_reg1;
+	    rd_words[DW*6'h04 +: DW] = in_wr ? plaintext1_reg2 : plaintext_reg2;
+	    rd_words[DW*6'h05 +: DW] = in_wr ? plaintext1_reg3 : plaintext_reg3;
+	    rd_words[DW*6'h06 +: DW] = key_reg0;
+	    rd_words[DW*6'h07 +: DW] = key_reg1;
+	    rd_words[DW*6'h08 +: DW] = key_reg2;
+	    rd_words[DW*6'h09 +: DW] = key_reg3;
+	    rd_words[DW*6'h0A +: DW] = key_reg4;
+	    rd_words[DW*6'h0B +: DW] = key_reg5;
+	    rd_words[DW*6'h0C +: DW] = key_reg6;
+	    rd_words[DW*6'h0D +: DW] = key_reg7;
+	    rd_words[DW*6'h0E +: DW] = key_slot_reg;
+	    rd_words[DW*6'h10 +: DW] = C_NUM_KEY_SLOTS;
+	    rd_words[DW*6'h11 +: DW] = mode_reg;
+	    rd_words[DW*6'h12 +: DW] = done_reg;
+	    rd_words[DW*6'h13 +: DW] = comp_state_reg;
+	    rd_words[DW*6'h14 +: DW] = out_rd ? ciphertext1_reg0 : ciphertext_reg0;
+	    rd_words[DW*6'h15 +: DW] = out_rd ? ciphertext1_reg1 : ciphertext_reg1;
+	    rd_words[DW*6'h16 +: DW] = out_rd ? ciphertext1_reg2 : ciphertext_reg2;
+	    rd_words[DW*6'h17 +: DW] = out_rd ? ciphertext1_reg3 : ciphertext_reg3;
+	    rd_words[DW*6'h19 +: DW] = CAPS;
+	    rd_words[DW*6'h1A +: DW] = {24'h0, out_rd, out_wr, in_rd, in_wr, out_valid, in_full};
+	    rd_words[DW*6'h1B +: DW] = aad_len_reg;
+	    rd_words[DW*6'h1C +: DW] = text_len_reg;
+	    rd_words[DW*6'h1D +: DW] = ks_ctrl_reg;
+	    rd_words[DW*6'h1E +: DW] = {KS_DEPTH, ks_count};
+    rd_words[DW*6'h1F +: DW] = byte_order_reg;
+	    // Performance counter snapshots, low word first
+	    rd_words[DW*6'h20 +: DW] = perf_total_cycles_snap[31:0];
+	    rd_words[DW*6'h21 +: DW] = perf_total_cycles_snap[63:32];
+	    rd_words[DW*6'h22 +: DW] = perf_busy_cycles_snap[31:0];
+	    rd_words[DW*6'h23 +: DW] = perf_busy_cycles_snap[63:32];
+	    rd_words[DW*6'h24 +: DW] = perf_blocks_snap[31:0];
+	    rd_words[DW*6'h25 +: DW] = perf_blocks_snap[63:32];
+	    rd_words[DW*6'h26 +: DW] = perf_axi_wr_beats_snap[31:0];
+	    rd_words[DW*6'h27 +: DW] = perf_axi_wr_beats_snap[63:32];
+	    rd_words[DW*6'h28 +: DW] = perf_axi_rd_beats_snap[31:0];
+	    rd_words[DW*6'h29 +: DW] = perf_axi_rd_beats_snap[63:32];
+	    rd_words[DW*6'h2A +: DW] = perf_finished_wait_snap[31:0];
+	    rd_words[DW*6'h2B +: DW] = perf_finished_wait_snap[63:32];
+	    rd_words[DW*6'h2C +: DW] = iv_reg0;
+	    rd_words[DW*6'h2D +: DW] = iv_reg1;
+	    rd_words[DW*6'h2E +: DW] = iv_reg2;
+	    rd_words[DW*6'h2F +: DW] = iv_reg3;
+	    rd_words[DW*6'h30 +: DW] = tag_reg0;
+	    rd_words[DW*6'h31 +: DW] = tag_reg1;
+	    rd_words[DW*6'h32 +: DW] = tag_reg2;
+	    rd_words[DW*6'h33 +: DW] = tag_reg3;
+	    rd_words[DW*6'h34 +: DW] = ring_base_reg;
+	    rd_words[DW*6'h35 +: DW] = ring_size_reg;
+	    rd_words[DW*6'h36 +: DW] = ring_tail_reg;
+	    rd_words[DW*6'h37 +: DW] = ring_head;
+	    rd_words[DW*6'h38 +: DW] = ring_ctrl_reg;
+	    rd_words[DW*6'h39 +: DW] = {30'h0, ring_error, ring_busy};
+	    rd_words[DW*6'h3A +: DW] = irq_ctrl_reg;
+	    rd_words[DW*6'h3B +: DW] = irq_count_reg;
+	    rd_words[DW*6'h3C +: DW] = irq_time_reg;
+	    rd_words[DW*6'h3D +: DW] = {31'h0, irq_pending};
+	    rd_words[DW*6'h3E +: DW] = {29'h0, ctx_index};
+	    rd_words[DW*6'h3F +: DW] = ctx_data;
+
+	    reg_data_out = 0;
+	    for ( rd_i = 0; rd_i < NUM_REGS; rd_i = rd_i+1 )
+	      reg_data_out = reg_data_out | ({DW{rd_sel[rd_i]}} & rd_words[DW*rd_i +: DW]);
+	  end
 	
 	// Add user logic here
 	
     assign ENABLE         = enable_reg[0];
-    assign AES_KEY_CHOICE = ENABLE?aes_key_choice_reg[1:0]:0;
-    
-    assign PLAINTEXT[0*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH] = ENABLE?plaintext_reg0:0;
-    assign PLAINTEXT[1*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH] = ENABLE?plaintext_reg1:0;
-    assign PLAINTEXT[2*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH] = ENABLE?plaintext_reg2:0;
-    assign PLAINTEXT[3*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH] = ENABLE?plaintext_reg3:0;
-    
-    assign KEY[0*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH] = ENABLE?key_reg0:0;
-    assign KEY[1*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH] = ENABLE?key_reg1:0;
-    assign KEY[2*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH] = ENABLE?key_reg2:0;
-    assign KEY[3*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH] = ENABLE?key_reg3:0; 
-    assign KEY[4*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH] = ENABLE?key_reg4:0;
-    assign KEY[5*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH] = ENABLE?key_reg5:0;
-    assign KEY[6*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH] = ENABLE?key_reg6:0;
-    assign KEY[7*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH] = ENABLE?key_reg7:0;
-    
-    
+
+    // Datapath inputs
+    // The key, key size, cipher input and direction reach the core through
+    // registers loaded every clock, so no register-interface logic sits in
+    // front of the key expansion and rounds. The core therefore answers for
+    // the inputs presented a clock earlier: an operation is started from
+    // IDLE with its input already presented, and an input that changes
+    // within an operation is only seen a clock later. A core on its own
+    // clock answers later still, which CORE_READY reports. Key registers
+    // must be written before KEY_SLOT_CTRL, which stores them a clock after
+    // its own write, from these registers.
+    reg  [1:0]   key_choice_q;
+    reg  [8*C_S_AXI_DATA_WIDTH-1:0] key_q;
+    reg  [4*C_S_AXI_DATA_WIDTH-1:0] plaintext_q;
+    reg          decrypt_q;
+
+    assign AES_KEY_CHOICE = key_choice_q;
+    assign KEY = key_q;
+    assign PLAINTEXT = plaintext_q;
+    assign DECRYPT = decrypt_q;
+
+    // Key slots
+    // KEY_SLOT (0x0E) bits [5:0] select a slot and bit 8 makes the core use that
+    // slot's round keys instead of the key registers. Writing KEY_SLOT_CTRL
+    // (0x0F) with bit 0 set stores the expansion of the key registers, for the
+    // key size in aes_key_choice_reg, into the selected slot on the next clock.
+    // KEY_SLOT_CTRL reads back as zero and KEY_SLOTS (0x10) as the slot count.
+    localparam KEY_SLOT_CTRL_STORE = 0;
+    localparam KEY_SLOT_EN_BIT     = 8;
+
+    always @( posedge S_AXI_ACLK )
+    begin
+      if ( S_AXI_ARESETN == 1'b0 )
+        key_store <= 1'b0;
+      else
+        key_store <= wr_en && (wr_index == 6'h0F) && wr_data[KEY_SLOT_CTRL_STORE];
+    end
+
+    assign KEY_SLOT    = key_slot_reg[5:0];
+    assign KEY_SLOT_EN = key_slot_reg[KEY_SLOT_EN_BIT];
+    assign KEY_STORE   = key_store;
+
+    // Block cipher modes
+    // MODE (0x11): [2:0] mode, [3] decrypt, [5:4] operation, [12:8] valid bytes
+    // of this block (0 means 16). Each operation is started by enable_reg and
+    // completes through BUSY and FINISHED like a single ECB block:
+    //   BLOCK  encrypt/decrypt the plaintext registers into the result registers
+    //   AAD    GCM: hash the plaintext registers as additional data
+    //   INIT   CTR: load the counter from IV. GCM: H = E(0), E(J0) for the tag,
+    //          counter = inc32(J0) with J0 taken from IV, clear hash and lengths
+    //   FINAL  GCM: hash the length block and write the tag registers
+    // XTS uses INIT to encrypt IV into the tweak with the key selected at the
+    // time, normally the tweak key; software then selects the data key. Each
+    // BLOCK is E(P ^ T) ^ T, or D(C ^ T) ^ T with decrypt set, and multiplies
+    // the tweak by alpha. XTS blocks are always full.
+    // CMAC (RFC 4493) chains blocks internally and only the tag is read back.
+    // INIT derives the subkey K1 from E(0) and loads the chaining value from
+    // IV: zero for a new message, or a value read from TAG to resume one.
+    // BLOCK chains a full block and leaves the chaining value in TAG, which is
+    // the CBC-MAC once a message of whole blocks has been chained. FINAL takes
+    // the last block, masked with K1 when complete or padded and masked with
+    // K2, and writes the tag. FINAL reads [12:8] literally: 16 for a complete
+    // block, 0 to 15 for a partial or empty one. CMAC writes no result.
+    // AAD_LEN (0x1B) and TEXT_LEN (0x1C) count the bytes hashed since INIT.
+    //
+    // Context save and restore
+    // A GCM message keeps its running hash and counter in the engine between
+    // operations. CTX_INDEX (0x3E) [2:0] selects a word of the context and
+    // CTX_DATA (0x3F) reads or writes it, each access moving on to the next
+    // word: words 0-3 the running hash (GCM Y, or the CMAC chaining value) as
+    // TAG lays out a tag, words 4-7 the counter block (or the XTS tweak) as
+    // IV lays out an IV. Writes take effect while the engine is not BUSY, and
+    // disarm the keystream buffer. To checkpoint a message between blocks,
+    // software reads the eight words and AAD_LEN and TEXT_LEN. To resume it,
+    // on this engine or another, it loads the key, runs INIT with the
+    // message's own IV, which derives H and E(J0) again (CMAC: K1), then
+    // writes the lengths and the eight words back. CMAC can also resume from
+    // the chaining value through IV alone, as above.
+    //
+    // Byte order
+    // BYTE_ORDER (0x1F) bit 0 clear, the reset value, keeps the original
+    // packing: the key, data and result registers hold the key and block in
+    // FIPS-197 order, byte 0 in the top byte of plaintext_reg3 and of
+    // key_reg3, key_reg5 or key_reg7 for a 128-, 192- or 256-bit key. With
+    // the bit set they hold little-endian words, byte 0 in bits 7:0 of
+    // key_reg0 and plaintext_reg0, as a key or block copied from memory lands
+    // through the data windows and the ring, which therefore need the bit
+    // set. IV, TAG and CTX_DATA always hold little-endian words. The cipher
+    // and GHASH work on blocks in FIPS-197 order, byte 0 in bits 127:120, so
+    // little-endian data is byte-reversed on the way in and out.
+    localparam BYTE_ORDER_LE = 0;
+    wire byte_order_le = byte_order_reg[BYTE_ORDER_LE];
+
+    always @( posedge S_AXI_ACLK )
+    begin
+      if ( S_AXI_ARESETN == 1'b0 )
+        byte_order_reg <= 32'h0;
+      else if (wr_en && wr_index == 6'h1F)
+        byte_order_reg <= {31'h0, wr_data[BYTE_ORDER_LE]};
+    end
+
+    function [127:0] byte_reverse;
+      input [127:0] in;
+      integer i;
+      begin
+        for (i = 0; i < 16; i = i + 1)
+          byte_reverse[127-8*i -: 8] = in[8*i +: 8];
+      end
+    endfunction
+
+    // A data or result block between the registers and FIPS order
+    function [127:0] data_order;
+      input [127:0] in;
+      begin
+        data_order = byte_order_le ? byte_reverse(in) : in;
+      end
+    endfunction
+
+    // The key registers in the core's packing, the original one: an nbytes
+    // key in FIPS order in the low nbytes bytes
+    function [255:0] key_order;
+      input [255:0] k;
+      input integer nbytes;
+      integer i;
+      begin
+        key_order = 0;
+        for (i = 0; i < 32; i = i + 1)
+          if (i < nbytes)
+            key_order[8*(nbytes-1-i) +: 8] = k[8*i +: 8];
+      end
+    endfunction
+
+    wire [255:0] key_words = {key_reg7, key_reg6, key_reg5, key_reg4, key_reg3, key_reg2, key_reg1, key_reg0};
+    wire [255:0] key_core  = !byte_order_le ? key_words :
+                             (aes_key_choice_reg[1:0] == 0) ? key_order(key_words, 16) :
+                             (aes_key_choice_reg[1:0] == 1) ? key_order(key_words, 24) :
+                                                              key_order(key_words, 32);
+
+    wire [2:0] mode       = mode_reg[2:0];
+    wire       decrypt    = mode_reg[3];
+    wire [1:0] op         = mode_reg[5:4];
+    wire [4:0] nbytes     = (mode_reg[12:8] == 0 || mode_reg[12:8] > 16) ? 5'd16 : mode_reg[12:8];
+    // Leading nbytes bytes of a block in FIPS order
+    wire [127:0] byte_mask = ~({128{1'b1}} >> (8*nbytes));
+
+    // The engine's data bank; bank 0 unless ENABLE_BANKS is set
+    wire [127:0] data_words = in_rd ? {plaintext1_reg3, plaintext1_reg2, plaintext1_reg1, plaintext1_reg0} :
+                                      {plaintext_reg3, plaintext_reg2, plaintext_reg1, plaintext_reg0};
+    wire [127:0] data_block = data_order(data_words) & byte_mask;
+    wire [127:0] iv_block   = byte_reverse({iv_reg3, iv_reg2, iv_reg1, iv_reg0});
+
+    // Multiply an XTS tweak by alpha (x) in GF(2^128). IEEE 1619 treats the
+    // tweak as a little-endian number, i.e. the byte-reversed FIPS-order value.
+    function [127:0] xts_mul_alpha;
+      input [127:0] t;
+      reg [127:0] le;
+      begin
+        le = byte_reverse(t);
+        xts_mul_alpha = byte_reverse({le[126:0], 1'b0} ^ (le[127] ? 128'h87 : 128'h0));
+      end
+    endfunction
+
+    // Double in GF(2^128) in the CMAC bit order (RFC 4493 subkeys)
+    function [127:0] cmac_dbl;
+      input [127:0] x;
+      begin
+        cmac_dbl = {x[126:0], 1'b0} ^ (x[127] ? 128'h87 : 128'h0);
+      end
+    endfunction
+
+    // CMAC last block: the leading mac_bytes bytes, then 10* padding unless
+    // the block is complete
+    wire [4:0]   mac_bytes = (mode_reg[12:8] > 16) ? 5'd16 : mode_reg[12:8];
+    wire [127:0] mac_mask  = ~({128{1'b1}} >> (8*mac_bytes));
+    wire [127:0] mac_data  = data_order(data_words) & mac_mask;
+
+    reg  [127:0] ctr_block;    // next counter block, or the XTS tweak
+    reg  [127:0] ghash_h;      // hash subkey E(0)
+    reg  [127:0] ghash_y;      // running hash, or the CMAC chaining value
+    reg  [127:0] cmac_k1;      // CMAC subkey K1; K2 is its double
+    reg  [127:0] ek_j0;        // E(J0), masks the tag
+    reg  [1:0]   op_step;      // progress through a multi-cycle operation
+    reg  [127:0] ks_ctr;       // CTR: counter of the next keystream block to buffer
+    reg          ks_armed;     // ks_ctr follows the counter loaded by CTR INIT
+    reg  [127:0] cipher_in;
+
+    // Only ECB and XTS data blocks go through the inverse cipher; keystream
+    // modes and the XTS tweak always encrypt
+    wire inverse = (C_DECRYPT != 0) && decrypt && (op == OP_BLOCK) &&
+                   (mode == MODE_ECB || mode == MODE_XTS);
+
+    always @( posedge S_AXI_ACLK )
+    begin
+      key_choice_q <= aes_key_choice_reg[1:0];
+      key_q <= key_core;
+      plaintext_q <= cipher_in;
+      decrypt_q <= inverse;
+    end
+
+    // Keystream modes XOR the data with the encrypted counter, which a CTR
+    // block takes from the keystream buffer while that holds any
+    wire [127:0] cipher_out = CIPHERTEXT;
+    wire [127:0] ks_head;      // oldest buffered keystream block
+    wire         ks_hit     = (ks_count != 0) && (mode == MODE_CTR) && (op == OP_BLOCK);
+    wire [127:0] keystream  = ks_hit ? ks_head : cipher_out;
+    wire [127:0] ctr_out    = (data_block ^ keystream) & byte_mask;
+
+    wire [127:0] mac_last = (mac_bytes == 16) ? (mac_data ^ cmac_k1) :
+                            (mac_data ^ (128'h1 << (127 - 8*mac_bytes)) ^ cmac_dbl(cmac_k1));
+
+    // GHASH multiplier: Y = (Y ^ X) * H
+    wire         mul_start;
+    reg  [127:0] mul_x;
+    wire         mul_done;
+    wire [127:0] mul_z;
+
+    gf128_mul #(.DIGIT(32)) ghash_mul (
+      .clk(S_AXI_ACLK),
+      .resetn(S_AXI_ARESETN),
+      .start(mul_start),
+      .x(mul_x),
+      .h(ghash_h),
+      .busy(),
+      .done(mul_done),
+      .z(mul_z)
+    );
+
+    always @(*)
+    begin
+      case (mode)
+        MODE_ECB: cipher_in = data_block;
+        MODE_GCM: cipher_in = (op == OP_INIT) ? ((op_step == 0) ? 128'h0 : iv_block) : ctr_block;
+        MODE_XTS: cipher_in = (op == OP_INIT) ? iv_block : (data_block ^ ctr_block);
+        MODE_CMAC: cipher_in = (op == OP_INIT) ? 128'h0 :
+                               (op == OP_FINAL) ? (ghash_y ^ mac_last) : (ghash_y ^ data_block);
+        default:  cipher_in = ks_armed ? ks_ctr : ctr_block;
+      endcase
+      case (op)
+        OP_AAD:   mul_x = ghash_y ^ data_block;
+        OP_FINAL: mul_x = ghash_y ^ {29'h0, aad_len_reg, 3'h0, 29'h0, text_len_reg, 3'h0};
+        default:  mul_x = ghash_y ^ (decrypt ? data_block : ctr_out);
+      endcase
+    end
+
+    // Context window
+    wire [255:0] ctx_words = {byte_reverse(ctr_block), byte_reverse(ghash_y)};
+    wire ctx_wr = wr_en && (wr_index == 6'h3F);
+    wire ctx_rd = S_AXI_RVALID && S_AXI_RREADY && (rd_index == 6'h3F);
+    reg  [255:0] ctx_next;    // the context with a CTX_DATA write applied
+    assign ctx_data = ctx_words[32*ctx_index +: 32];
+
+    always @(*)
+    begin
+      ctx_next = ctx_words;
+      ctx_next[32*ctx_index +: 32] = wr_data;
+    end
+
+    always @( posedge S_AXI_ACLK )
+    begin
+      if ( S_AXI_ARESETN == 1'b0 )
+        ctx_index <= 3'd0;
+      else if (wr_en && wr_index == 6'h3E)
+        ctx_index <= wr_data[2:0];
+      else if (ctx_wr || ctx_rd)
+        ctx_index <= ctx_index + 3'd1;
+    end
+
     // IP states
     localparam IDLE = 2'b00;
     localparam BUSY = 2'b01;
     localparam FINISHED = 2'b10;
+    localparam FILL = 2'b11;    // computing a keystream block, reported as IDLE
     
     // State register
     reg [1:0] comp_state;
+
+    // Doorbell mode
+    // With ENABLE_AUTO (enable_reg bit 1) set, writing plaintext_reg3 also sets
+    // enable, so the last data word starts the operation. A read of a result
+    // register (0x14-0x17) is held until the operation has finished, and
+    // reading ciphertext_reg3 drops enable again, so a block costs exactly
+    // four writes and four reads with no polling. Operations without a result
+    // retire the same way by reading ciphertext_reg3 alone. Writing enable_reg
+    // directly still works, and must keep bit 1 to stay in doorbell mode.
+    //
+    // Data banks
+    // ENABLE_BANKS (enable_reg bit 2, with bit 1) doubles the plaintext and
+    // ciphertext registers so software loads the next block while the engine
+    // works on the previous one. The doorbell then hands the bank software
+    // has just filled to the engine and software continues in the other one;
+    // the engine takes full banks in order whenever a result bank is free and
+    // returns to IDLE without waiting in FINISHED. Result reads come from the
+    // oldest unread result bank, are held while that result is still being
+    // computed, and reading ciphertext_reg3 frees the bank. At most two
+    // operations may be outstanding, counting those whose result is unread,
+    // and MODE may only change with none outstanding. BANKS (0x1A) reads
+    // back {out_rd, out_wr, in_rd, in_wr, out_valid[1:0], in_full[1:0]}.
+    // Clearing the bit empties both banks.
+    reg  bank_op;    // the operation in progress came from a data bank
+    wire bank_ready = banks && in_full[in_rd] && !out_valid[out_wr];
+    wire bank_pending = (in_full != 2'b00);
+    assign bank_busy = bank_op && (comp_state == BUSY);
+
+    wire rd_result = (rd_index >= 6'h14) && (rd_index <= 6'h17);
+    wire ar_result = (ar_index >= 6'h14) && (ar_index <= 6'h17);
+    wire auto_busy = banks ? (!out_valid[out_rd] && bank_pending) :
+                             (ENABLE && (comp_state != FINISHED));
+    // A doorbell write issued or being applied has not reached enable_reg or
+    // the bank flags yet
+    assign rd_wait = auto_mode && rd_result && (auto_busy || auto_start);
+    assign rd_wait_ar = auto_mode && ar_result && (auto_busy || auto_start || auto_issue);
+
+    // Results go to the engine's result bank
+    task write_result;
+      input [127:0] r;
+      begin
+        if (out_wr)
+          {ciphertext1_reg3, ciphertext1_reg2, ciphertext1_reg1, ciphertext1_reg0} <= r;
+        else
+          {ciphertext_reg3, ciphertext_reg2, ciphertext_reg1, ciphertext_reg0} <= r;
+      end
+    endtask
+
+    wire gcm_hash_op = (mode == MODE_GCM) && (op != OP_INIT);
+
+    // BUSY cycles that use the core's result: the first of each operation
+    // unless the keystream buffer answers it, and the third of GCM INIT.
+    // With the core on its own clock they wait for it, doing nothing until
+    // CORE_READY, and so does FILL.
+    wire core_step = (op_step == 0) || (mode == MODE_GCM && op == OP_INIT && op_step == 2);
+    assign CORE_REQ = ((comp_state == BUSY) && core_step && !ks_hit) || (comp_state == FILL);
+    wire core_wait = CORE_REQ && !CORE_READY;
+
+    // GCM hashing operations start the multiplier on their first BUSY cycle
+    assign mul_start = (comp_state == BUSY) && (op_step == 0) && gcm_hash_op && !core_wait;
+
+    // Last BUSY cycle of the current operation. GCM INIT presents J0 on its
+    // second cycle and takes E(J0) on its third.
+    wire op_last = core_wait ? 1'b0 : gcm_hash_op ? mul_done :
+                   (mode == MODE_GCM && op == OP_INIT) ? (op_step == 2) : 1'b1;
+
+    // CTR keystream buffer
+    // With C_KS_DEPTH > 0 the engine precomputes CTR keystream while it would
+    // otherwise sit in IDLE. Once CTR INIT has loaded the counter and KS_CTRL
+    // (0x1D) bit 0 is set, an idle engine with MODE still in CTR and room in
+    // the buffer spends a FILL cycle encrypting ks_ctr, the counter after the
+    // last block buffered, into the buffer: one block every two clocks, or
+    // per round trip of a core on its own clock. A CTR BLOCK then XORs the
+    // oldest buffered block in its first BUSY cycle without using the core.
+    // A CTR INIT whose IV is the counter the next block would use keeps the
+    // buffer, so a stream sent as several messages stays ahead; any other
+    // INIT empties it. So does a change of what the keystream depends on: a
+    // write that changes the key size, key or key slot registers (0x01,
+    // 0x06-0x0E), a key slot store, a write of MODE for another mode, and
+    // KS_CTRL bit 1 or clearing bit 0. A block being computed then is
+    // dropped, and filling waits three clocks for the new key to reach the
+    // core and the key table. KS_CTRL reads back bit 0, KS_STATUS (0x1E)
+    // reads [15:0] the fill level, [31:16] C_KS_DEPTH.
+    localparam KS_CTRL_EN    = 0;
+    localparam KS_CTRL_FLUSH = 1;
+
+    reg  [15:0]  ks_rd;       // oldest buffered block
+    reg  [15:0]  ks_wr;       // entry the next block goes to
+    reg  [1:0]   ks_quiet;    // clocks until filling may resume
+    reg          ks_stale;    // the block in FILL was flushed
+
+    function [15:0] ks_next;
+      input [15:0] i;
+      begin
+        ks_next = (i == KS_DEPTH - 1) ? 16'h0 : i + 16'h1;
+      end
+    endfunction
+
+    wire ks_on = (C_KS_DEPTH > 0) && ks_ctrl_reg[KS_CTRL_EN];
+    wire ks_ctrl_wr = wr_en && (wr_index == 6'h1D);
+    wire ks_disarm = (ks_ctrl_wr && !wr_data[KS_CTRL_EN]) || ctx_wr ||
+                     (reg_wvalid && reg_windex == 6'h11 && reg_wdata[2:0] != MODE_CTR);
+    // Rewriting a key register with the value it holds changes nothing, as
+    // when the ring loads the same key slot for each descriptor. BYTE_ORDER
+    // changes how the key registers are read.
+    wire ks_key_wr = reg_wvalid &&
+                     ((reg_windex == 6'h01 || (reg_windex >= 6'h06 && reg_windex <= 6'h0E) ||
+                       reg_windex == 6'h1F) ?
+                      (rd_words[DW*reg_windex +: DW] != reg_wdata) :
+                      (reg_windex == 6'h0F) && reg_wdata[KEY_SLOT_CTRL_STORE]);
+    wire ks_flush = ks_disarm || (ks_ctrl_wr && wr_data[KS_CTRL_FLUSH]) || ks_key_wr;
+    wire ks_fill = ks_on && ks_armed && (mode == MODE_CTR) && (ks_count < KS_DEPTH) &&
+                   (ks_quiet == 0) && !ks_flush;
+    // The first BUSY cycle of a CTR operation
+    wire ks_op = (comp_state == BUSY) && !core_wait && (op_step == 0) && (mode == MODE_CTR);
+    wire ks_init = ks_op && (op == OP_INIT);
+    wire ks_keep = ks_armed && (iv_block == ctr_block);
+    wire ks_step = ks_op && (op == OP_BLOCK);    // ctr_block moves on
+    wire ks_pop = ks_step && ks_hit;
+    wire ks_push = (comp_state == FILL) && CORE_READY && !ks_stale && !ks_flush;
+    wire [15:0] ks_rd_next = ks_pop ? ks_next(ks_rd) : ks_rd;
+
+    always @( posedge S_AXI_ACLK )
+    begin
+      if ( S_AXI_ARESETN == 1'b0 )
+      begin
+        ks_ctrl_reg <= 32'h0;
+        ks_count <= 16'h0;
+        ks_rd <= 16'h0;
+        ks_wr <= 16'h0;
+        ks_ctr <= 128'h0;
+        ks_armed <= 1'b0;
+        ks_quiet <= 2'd0;
+        ks_stale <= 1'b0;
+      end
+      else
+      begin
+        if (ks_ctrl_wr)
+          ks_ctrl_reg <= {31'h0, wr_data[KS_CTRL_EN]};
+        if (ks_disarm)
+          ks_armed <= 1'b0;
+        else if (ks_init && ks_on)
+          ks_armed <= 1'b1;
+        if (ks_flush)
+          ks_quiet <= 2'd3;
+        else if (ks_quiet != 0)
+          ks_quiet <= ks_quiet - 2'd1;
+        if (comp_state != FILL)
+          ks_stale <= 1'b0;
+        else if (ks_flush)
+          ks_stale <= 1'b1;
+
+        ks_rd <= ks_rd_next;
+        if (ks_flush || (ks_init && !ks_keep))
+        begin
+          ks_count <= 16'h0;
+          ks_wr <= ks_rd_next;
+          ks_ctr <= ks_init ? iv_block : ks_step ? ctr_block + 1 : ctr_block;
+        end
+        else
+        begin
+          ks_count <= ks_count + ks_push - ks_pop;
+          if (ks_push)
+            ks_wr <= ks_next(ks_wr);
+          // Kept at ctr_block plus the fill level
+          if (ks_push || (ks_step && !ks_hit))
+            ks_ctr <= ks_ctr + 1;
+        end
+      end
+    end
+
+    // The buffer reads ahead of ks_rd so that ks_head is a register, and
+    // forwards a block written to the entry it reads that clock
+    generate
+      if (C_KS_DEPTH > 0) begin : ks_buffer
+        reg [127:0] mem [0:C_KS_DEPTH-1];
+        reg [127:0] q, fwd;
+        reg         fwd_sel;
+
+        always @( posedge S_AXI_ACLK )
+        begin
+          if (ks_push)
+            mem[ks_wr] <= cipher_out;
+          q <= mem[ks_rd_next];
+          fwd <= cipher_out;
+          fwd_sel <= ks_push && (ks_wr == ks_rd_next);
+        end
+
+        assign ks_head = fwd_sel ? fwd : q;
+      end
+      else begin : no_ks_buffer
+        assign ks_head = 128'h0;
+      end
+    endgenerate
+
+    // Data bank ownership
+    always @( posedge S_AXI_ACLK )
+    begin
+      if ( S_AXI_ARESETN == 1'b0 || !banks )
+      begin
+        in_full <= 2'b00;
+        out_valid <= 2'b00;
+        in_wr <= 1'b0;
+        in_rd <= 1'b0;
+        out_wr <= 1'b0;
+        out_rd <= 1'b0;
+      end
+      else
+      begin
+        if (auto_start)
+        begin
+          in_full[in_wr] <= 1'b1;
+          in_wr <= ~in_wr;
+        end
+        if (bank_busy && op_last)
+        begin
+          in_full[in_rd] <= 1'b0;
+          in_rd <= ~in_rd;
+          out_valid[out_wr] <= 1'b1;
+          out_wr <= ~out_wr;
+        end
+        if (auto_retire && out_valid[out_rd])
+        begin
+          out_valid[out_rd] <= 1'b0;
+          out_rd <= ~out_rd;
+        end
+      end
+    end
     
     always @( posedge S_AXI_ACLK )
     begin
@@ -449,33 +1255,145 @@
         ciphertext_reg1 <= 32'h0;
         ciphertext_reg2 <= 32'h0;
         ciphertext_reg3 <= 32'h0;
+        ciphertext1_reg0 <= 32'h0;
+        ciphertext1_reg1 <= 32'h0;
+        ciphertext1_reg2 <= 32'h0;
+        ciphertext1_reg3 <= 32'h0;
+        bank_op <= 1'b0;
+        tag_reg0 <= 32'h0;
+        tag_reg1 <= 32'h0;
+        tag_reg2 <= 32'h0;
+        tag_reg3 <= 32'h0;
+        aad_len_reg <= 32'h0;
+        text_len_reg <= 32'h0;
+        ctr_block <= 128'h0;
+        ghash_h <= 128'h0;
+        ghash_y <= 128'h0;
+        cmac_k1 <= 128'h0;
+        ek_j0 <= 128'h0;
+        op_step <= 2'd0;
         comp_state <= IDLE;
       end
       else
       begin
+        // Software may set the length counters, e.g. to resume a message
+        if (wr_en && wr_index == 6'h1B)
+          aad_len_reg <= wr_data;
+        if (wr_en && wr_index == 6'h1C)
+          text_len_reg <= wr_data;
+        // ... and the context, through CTX_DATA
+        if (ctx_wr && comp_state != BUSY)
+        begin
+          ghash_y <= byte_reverse(ctx_next[127:0]);
+          ctr_block <= byte_reverse(ctx_next[255:128]);
+        end
+
         case (comp_state)
           IDLE:
           begin
-            // Wait for the master to command a start
-            if (ENABLE) 
+            // Wait for the master to command a start, or for a full data bank
+            if (ENABLE || bank_ready) 
             begin
               comp_state <= BUSY;
+              bank_op <= !ENABLE;
+              op_step <= 2'd0;
               done_reg <= 32'h0;    // Status register `Done`
-              ciphertext_reg0 <= 32'h0;    // Result registers
-              ciphertext_reg1 <= 32'h0;
-              ciphertext_reg2 <= 32'h0;
-              ciphertext_reg3 <= 32'h0;
+              write_result(128'h0);    // Result registers
             end
+            // or precompute CTR keystream meanwhile
+            else if (ks_fill)
+              comp_state <= FILL;
           end
     
           BUSY:
+          if (!core_wait)
           begin
+            if (op_step == 0)
+            begin
+              case (mode)
+                MODE_ECB:
+                  if (op == OP_BLOCK)
+                    write_result(data_order(cipher_out));
+                MODE_XTS:
+                  case (op)
+                    OP_BLOCK:
+                    begin
+                      write_result(data_order(cipher_out ^ ctr_block));
+                      ctr_block <= xts_mul_alpha(ctr_block);
+                      text_len_reg <= text_len_reg + 16;
+                    end
+                    OP_INIT:
+                      ctr_block <= cipher_out;
+                    default: ;
+                  endcase
+                MODE_CMAC:
+                  case (op)
+                    OP_INIT:
+                    begin
+                      cmac_k1 <= cmac_dbl(cipher_out);
+                      ghash_y <= iv_block;
+                      {tag_reg3, tag_reg2, tag_reg1, tag_reg0} <= byte_reverse(iv_block);
+                      text_len_reg <= 32'h0;
+                    end
+                    OP_BLOCK, OP_FINAL:
+                    begin
+                      ghash_y <= cipher_out;
+                      {tag_reg3, tag_reg2, tag_reg1, tag_reg0} <= byte_reverse(cipher_out);
+                      text_len_reg <= text_len_reg + ((op == OP_FINAL) ? mac_bytes : 5'd16);
+                    end
+                    default: ;
+                  endcase
+                MODE_CTR, MODE_GCM:
+                  case (op)
+                    OP_BLOCK:
+                    begin
+                      write_result(data_order(ctr_out));
+                      // CTR counts over the whole block, GCM over the low word
+                      ctr_block <= (mode == MODE_CTR) ? ctr_block + 1 : {ctr_block[127:32], ctr_block[31:0] + 32'd1};
+                      text_len_reg <= text_len_reg + nbytes;
+                    end
+                    OP_AAD:
+                      if (mode == MODE_GCM)
+                        aad_len_reg <= aad_len_reg + nbytes;
+                    OP_INIT:
+                      if (mode == MODE_CTR)
+                        ctr_block <= iv_block;
+	                      else
+                        ghash_h <= cipher_out;
+                    default: ;
+                  endcase
+                default: ;
+              endcase
+            end
+
+            if (mode == MODE_GCM && op == OP_INIT && op_step == 2)
+            begin
+              ek_j0 <= cipher_out;
+              ctr_block <= {iv_block[127:32], iv_block[31:0] + 32'd1};
+              ghash_y <= 128'h0;
+              aad_len_reg <= 32'h0;
+              text_len_reg <= 32'h0;
+            end
+
+            if (gcm_hash_op && mul_done)
+            begin
+              ghash_y <= mul_z;
+              if (op == OP_FINAL)
+                {tag_reg3, tag_reg2, tag_reg1, tag_reg0} <= byte_reverse(ek_j0 ^ mul_z);
+            end
+
+            // Back to step 0 after the last cycle: the core input register
+            // loads the next operation's first input while the engine is idle
+            if (op_last)
+              op_step <= 2'd0;
+            else if (op_step != 2'd3)
+              op_step <= op_step + 1;
+            if (op_last)
+            begin
               done_reg <= 32'h1;    // Status register `Done`
-              ciphertext_reg0 <= CIPHERTEXT[0*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH];    // Result registers
-              ciphertext_reg1 <= CIPHERTEXT[1*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH];
-              ciphertext_reg2 <= CIPHERTEXT[2*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH];
-              ciphertext_reg3 <= CIPHERTEXT[3*C_S_AXI_DATA_WIDTH+:C_S_AXI_DATA_WIDTH];
-              comp_state <= FINISHED;
+              // A bank's result waits in its result bank instead
+              comp_state <= bank_op ? IDLE : FINISHED;
+            end
           end
     
           FINISHED:
@@ -486,15 +1404,278 @@
             end
           end
     
+          FILL:
+          begin
+            // The keystream buffer takes the block
+            if (CORE_READY)
+              comp_state <= IDLE;
+          end
+    
           default:
             comp_state <= IDLE;
     
         endcase
         // Continuously update the status register for the master to read
-        comp_state_reg <= comp_state; 
+        comp_state_reg <= (comp_state == FILL) ? IDLE : comp_state; 
       end
     end
 
+    // Performance counters
+    // Writing PERF_CTRL (0x18) with bit 0 set copies the live counters into the
+    // snapshot registers so that both halves of each 64-bit value are coherent.
+    // Bit 1 clears the live counters; with both bits set the snapshot captures
+    // the values from before the clear. The register itself reads back as zero.
+    localparam PERF_CTRL_SNAPSHOT = 0;
+    localparam PERF_CTRL_CLEAR    = 1;
+
+    wire perf_ctrl_wr = wr_en && (wr_index == 6'h18);
+
+    always @( posedge S_AXI_ACLK )
+    begin
+      if ( S_AXI_ARESETN == 1'b0 )
+      begin
+        perf_total_cycles <= 64'h0;
+        perf_busy_cycles <= 64'h0;
+        perf_blocks <= 64'h0;
+        perf_axi_wr_beats <= 64'h0;
+        perf_axi_rd_beats <= 64'h0;
+        perf_finished_wait <= 64'h0;
+        perf_total_cycles_snap <= 64'h0;
+        perf_busy_cycles_snap <= 64'h0;
+        perf_blocks_snap <= 64'h0;
+        perf_axi_wr_beats_snap <= 64'h0;
+        perf_axi_rd_beats_snap <= 64'h0;
+        perf_finished_wait_snap <= 64'h0;
+      end
+      else
+      begin
+        if (perf_ctrl_wr && wr_data[PERF_CTRL_SNAPSHOT])
+        begin
+          perf_total_cycles_snap <= perf_total_cycles;
+          perf_busy_cycles_snap <= perf_busy_cycles;
+          perf_blocks_snap <= perf_blocks;
+          perf_axi_wr_beats_snap <= perf_axi_wr_beats;
+          perf_axi_rd_beats_snap <= perf_axi_rd_beats;
+          perf_finished_wait_snap <= perf_finished_wait;
+        end
+
+        if (perf_ctrl_wr && wr_data[PERF_CTRL_CLEAR])
+        begin
+          perf_total_cycles <= 64'h0;
+          perf_busy_cycles <= 64'h0;
+          perf_blocks <= 64'h0;
+          perf_axi_wr_beats <= 64'h0;
+          perf_axi_rd_beats <= 64'h0;
+          perf_finished_wait <= 64'h0;
+        end
+        else
+        begin
+          perf_total_cycles <= perf_total_cycles + 1;
+          if (comp_state == BUSY)
+          begin
+            perf_busy_cycles <= perf_busy_cycles + 1;
+            if (op_last && (op == OP_BLOCK || op == OP_AAD))
+              perf_blocks <= perf_blocks + 1;
+          end
+          if (S_AXI_WVALID && S_AXI_WREADY)
+            perf_axi_wr_beats <= perf_axi_wr_beats + 1;
+          if (S_AXI_RVALID && S_AXI_RREADY)
+            perf_axi_rd_beats <= perf_axi_rd_beats + 1;
+          // Cycles the result sits in FINISHED until software drops enable_reg
+          if (comp_state == FINISHED)
+            perf_finished_wait <= perf_finished_wait + 1;
+        end
+      end
+    end
+
+    // Descriptor ring
+    // Jobs are posted as 64-byte descriptors in a ring in system memory, laid
+    // out as described in AES_ring.v; the engine fetches them through M_AXI
+    // and runs them one after another without software register accesses.
+    //   RING_BASE   (0x34) ring address, 64-byte aligned
+    //   RING_SIZE   (0x35) [3:0] log2 of the number of entries
+    //   RING_TAIL   (0x36) index after the last posted descriptor: the doorbell
+    //   RING_HEAD   (0x37) index after the last completed descriptor
+    //   RING_CTRL   (0x38) bit 0 RUN
+    //   RING_STATUS (0x39) bit 0 busy, bit 1 stopped by a bus error
+    // Indices count up freely; entry i is at RING_BASE + 64 * (i mod size).
+    // The ring is empty when HEAD equals TAIL and may hold size descriptors.
+    // Clearing RUN lets the job in progress finish, then resets HEAD and TAIL
+    // to zero and clears the error. While the engine has a job in progress it
+    // owns the core: software must not write the other registers, and the
+    // engine leaves enable, MODE, the key slot and the key, IV and data
+    // registers as its last job set them.
+    localparam RING_CTRL_RUN = 0;
+
+    wire ring_wr = wr_en;
+    wire ring_run = ring_ctrl_reg[RING_CTRL_RUN];
+
+    always @( posedge S_AXI_ACLK )
+    begin
+      if ( S_AXI_ARESETN == 1'b0 )
+      begin
+        ring_base_reg <= 32'h0;
+        ring_size_reg <= 32'h0;
+        ring_tail_reg <= 32'h0;
+        ring_ctrl_reg <= 32'h0;
+      end
+      else
+      begin
+        if (ring_wr && wr_index == 6'h34)
+          ring_base_reg <= {wr_data[31:6], 6'h0};
+        if (ring_wr && wr_index == 6'h35)
+          ring_size_reg <= {28'h0, wr_data[3:0]};
+        if (ring_wr && wr_index == 6'h36)
+          ring_tail_reg <= wr_data;
+        else if (!ring_run && !ring_busy)
+          ring_tail_reg <= 32'h0;
+        if (ring_wr && wr_index == 6'h38)
+          ring_ctrl_reg <= {31'h0, wr_data[RING_CTRL_RUN]};
+      end
+    end
+
+    // Completion interrupt
+    // IRQ is raised for the descriptor ring and coalesced: once IRQ_COUNT
+    // descriptors have completed, or IRQ_TIME cycles after the first of them
+    // completed, whichever comes first. The ring stopping on a bus error
+    // raises it at once.
+    //   IRQ_CTRL   (0x3A) bit 0 enable; clearing it discards the count
+    //   IRQ_COUNT  (0x3B) [15:0] completions per interrupt, 0 counts as 1
+    //   IRQ_TIME   (0x3C) cycles from the first completion, 0 for no limit
+    //   IRQ_STATUS (0x3D) bit 0 pending, write 1 to clear
+    // IRQ is the pending bit while enabled, as a level. Completions while an
+    // interrupt is pending count towards the next one. A driver that polls
+    // HEAD under load clears enable and sets it again before it sleeps.
+    localparam IRQ_CTRL_EN = 0;
+
+    wire irq_en = irq_ctrl_reg[IRQ_CTRL_EN];
+    wire ring_done = ring_head == ring_head_q + 1;
+    wire [15:0] irq_events_next = irq_events + ring_done;
+    wire [15:0] irq_threshold = irq_count_reg[15:0] ? irq_count_reg[15:0] : 16'd1;
+    wire irq_fire = irq_en && ((irq_events_next != 0 && irq_events_next >= irq_threshold) ||
+                               (irq_events != 0 && irq_time_reg != 0 && irq_timer == irq_time_reg - 1) ||
+                               (ring_error && !ring_error_q));
+
+    always @( posedge S_AXI_ACLK )
+    begin
+      if ( S_AXI_ARESETN == 1'b0 )
+      begin
+        irq_ctrl_reg <= 32'h0;
+        irq_count_reg <= 32'h0;
+        irq_time_reg <= 32'h0;
+        irq_pending <= 1'b0;
+        irq_events <= 16'h0;
+        irq_timer <= 32'h0;
+        ring_head_q <= 32'h0;
+        ring_error_q <= 1'b0;
+      end
+      else
+      begin
+        ring_head_q <= ring_head;
+        ring_error_q <= ring_error;
+        if (ring_wr && wr_index == 6'h3A)
+          irq_ctrl_reg <= {31'h0, wr_data[IRQ_CTRL_EN]};
+        if (ring_wr && wr_index == 6'h3B)
+          irq_count_reg <= {16'h0, wr_data[15:0]};
+        if (ring_wr && wr_index == 6'h3C)
+          irq_time_reg <= wr_data;
+        if (!irq_en || irq_fire)
+        begin
+          irq_events <= 16'h0;
+          irq_timer <= 32'h0;
+        end
+        else
+        begin
+          irq_events <= irq_events_next;
+          if (irq_events != 0)
+            irq_timer <= irq_timer + 1;
+        end
+        if (irq_fire)
+          irq_pending <= 1'b1;
+        else if (ring_wr && wr_index == 6'h3D && wr_data[0])
+          irq_pending <= 1'b0;
+      end
+    end
+
+    assign IRQ = irq_pending && irq_en;
+
+    generate
+      if (C_RING) begin : ring
+        AES_ring #(.ADDR_W(C_M_AXI_ADDR_WIDTH)
+                  ) ring_engine
+                  (
+                  .clk(S_AXI_ACLK),
+                  .resetn(S_AXI_ARESETN),
+                  .run(ring_run),
+                  .base(ring_base_reg),
+                  .size_log2(ring_size_reg[3:0]),
+                  .tail(ring_tail_reg),
+                  .head(ring_head),
+                  .busy(ring_busy),
+                  .error(ring_error),
+                  .reg_wr(ring_reg_wr),
+                  .reg_index(ring_reg_index),
+                  .reg_data(ring_reg_data),
+                  .core_idle(comp_state == IDLE || comp_state == FILL),
+                  .core_finished(comp_state == FINISHED),
+                  .result({ciphertext_reg3, ciphertext_reg2, ciphertext_reg1, ciphertext_reg0}),
+                  .tag({tag_reg3, tag_reg2, tag_reg1, tag_reg0}),
+                  .m_araddr(M_AXI_ARADDR),
+                  .m_arlen(M_AXI_ARLEN),
+                  .m_arvalid(M_AXI_ARVALID),
+                  .m_arready(M_AXI_ARREADY),
+                  .m_rdata(M_AXI_RDATA),
+                  .m_rresp(M_AXI_RRESP),
+                  .m_rlast(M_AXI_RLAST),
+                  .m_rvalid(M_AXI_RVALID),
+                  .m_rready(M_AXI_RREADY),
+                  .m_awaddr(M_AXI_AWADDR),
+                  .m_awlen(M_AXI_AWLEN),
+                  .m_awvalid(M_AXI_AWVALID),
+                  .m_awready(M_AXI_AWREADY),
+                  .m_wdata(M_AXI_WDATA),
+                  .m_wstrb(M_AXI_WSTRB),
+                  .m_wlast(M_AXI_WLAST),
+                  .m_wvalid(M_AXI_WVALID),
+                  .m_wready(M_AXI_WREADY),
+                  .m_bresp(M_AXI_BRESP),
+                  .m_bvalid(M_AXI_BVALID),
+                  .m_bready(M_AXI_BREADY)
+                  );
+      end
+      else begin : no_ring
+        assign ring_busy = 1'b0;
+        assign ring_error = 1'b0;
+        assign ring_head = 32'h0;
+        assign ring_reg_wr = 1'b0;
+        assign ring_reg_index = 0;
+        assign ring_reg_data = 0;
+        assign M_AXI_ARADDR = 0;
+        assign M_AXI_ARLEN = 0;
+        assign M_AXI_ARVALID = 1'b0;
+        assign M_AXI_RREADY = 1'b0;
+        assign M_AXI_AWADDR = 0;
+        assign M_AXI_AWLEN = 0;
+        assign M_AXI_AWVALID = 1'b0;
+        assign M_AXI_WDATA = 0;
+        assign M_AXI_WSTRB = 0;
+        assign M_AXI_WLAST = 1'b0;
+        assign M_AXI_WVALID = 1'b0;
+        assign M_AXI_BREADY = 1'b0;
+      end
+    endgenerate
+
+    // Word-sized incrementing bursts, normal non-secure data accesses,
+    // bufferable and modifiable
+    assign M_AXI_ARSIZE  = 3'b010;
+    assign M_AXI_ARBURST = 2'b01;
+    assign M_AXI_ARCACHE = 4'b0011;
+    assign M_AXI_ARPROT  = 3'b000;
+    assign M_AXI_AWSIZE  = 3'b010;
+    assign M_AXI_AWBURST = 2'b01;
+    assign M_AXI_AWCACHE = 4'b0011;
+    assign M_AXI_AWPROT  = 3'b000;
+
 	// User logic ends
 
 	endmodule
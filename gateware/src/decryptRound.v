@@ -0,0 +1,16 @@
+module decryptRound(in,key,out);
+// One round of the inverse cipher (FIPS-197 5.3), the steps of encryptRound
+// inverted and applied in reverse order.
+input [127:0] in;
+output [127:0] out;
+input [127:0] key;
+wire [127:0] afterShiftRows;
+wire [127:0] afterSubBytes;
+wire [127:0] afterAddroundKey;
+
+invShiftRows r(in,afterShiftRows);
+invSubBytes s(afterShiftRows,afterSubBytes);
+addRoundKey b(afterSubBytes,afterAddroundKey,key);
+invMixColumns m(afterAddroundKey,out);
+		
+endmodule
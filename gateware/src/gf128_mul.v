@@ -0,0 +1,66 @@
+module gf128_mul #(parameter DIGIT=32)(clk, resetn, start, x, h, busy, done, z);
+// GF(2^128) multiplier for GHASH, z = x * h with the GCM bit order (bit 127 of
+// a vector is bit 0 of the field element). Digit-serial: DIGIT bits of x are
+// consumed per clock, so a product takes 128/DIGIT clocks after start and is
+// flagged by a one-clock done pulse. z holds the product until the next start.
+input clk;
+input resetn;
+input start;
+input [127:0] x;
+input [127:0] h;
+output reg busy;
+output reg done;
+output reg [127:0] z;
+
+// Reduction polynomial x^128 + x^7 + x^2 + x + 1 in the GCM bit order
+localparam [127:0] R = {8'hE1, 120'h0};
+
+reg [127:0] xr;
+reg [127:0] v;
+reg [7:0] count;
+reg [127:0] z_next;
+reg [127:0] v_next;
+reg [127:0] x_next;
+integer j;
+
+always @(*) begin
+	z_next = z;
+	v_next = v;
+	x_next = xr;
+	for (j = 0; j < DIGIT; j = j + 1) begin
+		if (x_next[127])
+			z_next = z_next ^ v_next;
+		v_next = v_next[0] ? ((v_next >> 1) ^ R) : (v_next >> 1);
+		x_next = x_next << 1;
+	end
+end
+
+always @(posedge clk) begin
+	if (resetn == 1'b0) begin
+		busy <= 1'b0;
+		done <= 1'b0;
+		z <= 128'h0;
+	end
+	else begin
+		done <= 1'b0;
+		if (start) begin
+			xr <= x;
+			v <= h;
+			z <= 128'h0;
+			count <= 128 / DIGIT;
+			busy <= 1'b1;
+		end
+		else if (busy) begin
+			xr <= x_next;
+			v <= v_next;
+			z <= z_next;
+			count <= count - 1;
+			if (count == 1) begin
+				busy <= 1'b0;
+				done <= 1'b1;
+			end
+		end
+	end
+end
+
+endmodule
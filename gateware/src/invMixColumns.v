@@ -0,0 +1,67 @@
+module invMixColumns(state_in,state_out);
+
+input [127:0] state_in;
+output[127:0] state_out;
+
+
+function [7:0] mb2; //multiply by 2
+	input [7:0] x;
+	begin 
+			if(x[7] == 1) mb2 = ((x << 1) ^ 8'h1b);
+			else mb2 = x << 1; 
+	end 	
+endfunction
+
+/* 
+	The inverse matrix uses {09}, {0b}, {0d} and {0e}, built from doublings:
+		x*9  = x*8 ^ x
+		x*11 = x*8 ^ x*2 ^ x
+		x*13 = x*8 ^ x*4 ^ x
+		x*14 = x*8 ^ x*4 ^ x*2
+*/
+function [7:0] mb9;
+	input [7:0] x;
+	begin 
+			mb9 = mb2(mb2(mb2(x))) ^ x;
+	end 
+endfunction
+
+function [7:0] mb11;
+	input [7:0] x;
+	begin 
+			mb11 = mb2(mb2(mb2(x))) ^ mb2(x) ^ x;
+	end 
+endfunction
+
+function [7:0] mb13;
+	input [7:0] x;
+	begin 
+			mb13 = mb2(mb2(mb2(x))) ^ mb2(mb2(x)) ^ x;
+	end 
+endfunction
+
+function [7:0] mb14;
+	input [7:0] x;
+	begin 
+			mb14 = mb2(mb2(mb2(x))) ^ mb2(mb2(x)) ^ mb2(x);
+	end 
+endfunction
+
+
+
+
+genvar i;
+
+generate 
+for(i=0;i< 4;i=i+1) begin : inv_m_col
+
+	assign state_out[(i*32 + 24)+:8]= mb14(state_in[(i*32 + 24)+:8]) ^ mb11(state_in[(i*32 + 16)+:8]) ^ mb13(state_in[(i*32 + 8)+:8]) ^ mb9(state_in[i*32+:8]);
+	assign state_out[(i*32 + 16)+:8]= mb9(state_in[(i*32 + 24)+:8]) ^ mb14(state_in[(i*32 + 16)+:8]) ^ mb11(state_in[(i*32 + 8)+:8]) ^ mb13(state_in[i*32+:8]);
+	assign state_out[(i*32 + 8)+:8]= mb13(state_in[(i*32 + 24)+:8]) ^ mb9(state_in[(i*32 + 16)+:8]) ^ mb14(state_in[(i*32 + 8)+:8]) ^ mb11(state_in[i*32+:8]);
+	assign state_out[i*32+:8]= mb11(state_in[(i*32 + 24)+:8]) ^ mb13(state_in[(i*32 + 16)+:8]) ^ mb9(state_in[(i*32 + 8)+:8]) ^ mb14(state_in[i*32+:8]);
+
+end
+
+endgenerate
+
+endmodule
@@ -0,0 +1,23 @@
+module keyTable #(parameter SLOTS=32, parameter W=256)(clk, we, waddr, wdata, wchoice, raddr, rdata, rchoice);
+// Key slot table: a key as the key registers hold it and its key size, one
+// entry per slot, expanded when the slot is used. Written and read synchronously so that it maps onto block
+// RAM; rdata follows raddr one clock later. Slot indices are 6 bits, so SLOTS
+// may be at most 64.
+input clk;
+input we;
+input [5:0] waddr;
+input [W-1:0] wdata;
+input [1:0] wchoice;
+input [5:0] raddr;
+output reg [W-1:0] rdata;
+output reg [1:0] rchoice;
+
+reg [W+1:0] mem [0:SLOTS-1];
+
+always @(posedge clk) begin
+	if (we)
+		mem[waddr] <= {wchoice, wdata};
+	{rchoice, rdata} <= mem[raddr];
+end
+
+endmodule
@@ -0,0 +1,37 @@
+module synth_core #(parameter KIND=0, parameter NR=10)(clk, in, keys, out);
+// Synthesis harness for one of AES.v's unrolled datapaths on its own, with
+// registers on both sides so that place and route can time it:
+//   KIND 0  AES_EncryptRounds, NR rounds
+//   KIND 1  AES_DecryptRounds, NR rounds
+//   KIND 2  keyExpansion of a key for NR rounds; `in` is unused
+// Not used by the IP.
+localparam KEY_W = KIND == 2 ? 32 * (NR - 6) : 128 * (NR + 1);
+localparam OUT_W = KIND == 2 ? 128 * (NR + 1) : 128;
+input clk;
+input [127:0] in;
+input [KEY_W-1:0] keys;
+output reg [OUT_W-1:0] out;
+
+reg [127:0] in_r;
+reg [KEY_W-1:0] keys_r;
+wire [OUT_W-1:0] result;
+
+always @(posedge clk) begin
+	in_r <= in;
+	keys_r <= keys;
+	out <= result;
+end
+
+generate
+	if (KIND == 0) begin : enc
+		AES_EncryptRounds #(.Nr(NR)) rounds (in_r, keys_r, result);
+	end
+	else if (KIND == 1) begin : dec
+		AES_DecryptRounds #(.Nr(NR)) rounds (in_r, keys_r, result);
+	end
+	else begin : kexp
+		keyExpansion #(NR - 6, NR) ke (keys_r, result);
+	end
+endgenerate
+
+endmodule
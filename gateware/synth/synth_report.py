@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+"""Synthesize each configuration in configs.txt with Yosys for ECP5, place and
+route it out of context with nextpnr-ecp5, and tabulate LUTs, FFs, block RAM,
+Fmax and the throughput they imply.
+
+usage: synth_report.py [--check BASELINE] [--save BASELINE] [options]
+
+--check compares the results with a saved report and fails when a
+configuration no longer builds, or its LUTs or FFs grow or its Fmax drops by
+more than --tolerance percent. Without nextpnr-ecp5 the Fmax columns are
+left empty and only area is compared.
+"""
+import argparse
+import glob
+import json
+import os
+import shutil
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def read_configs(path):
+    configs = []
+    with open(path) as f:
+        for line in f:
+            words = line.split('#', 1)[0].split()
+            if not words:
+                continue
+            params = dict(w.split('=', 1) for w in words[3:])
+            configs.append({'name': words[0], 'top': words[1],
+                            'cycles': int(words[2]), 'params': params})
+    return configs
+
+
+def run(cmd, log, timeout):
+    with open(log, 'w') as f:
+        try:
+            return subprocess.run(cmd, stdout=f, stderr=subprocess.STDOUT,
+                                  timeout=timeout).returncode == 0
+        except subprocess.TimeoutExpired:
+            f.write('\ntimed out after %d s\n' % timeout)
+            return False
+
+
+def cell_counts(stat_path):
+    with open(stat_path) as f:
+        stat = json.load(f)
+    if 'design' in stat:
+        return stat['design'].get('num_cells_by_type', {})
+    counts = {}
+    for module in stat.get('modules', {}).values():
+        for cell, n in module.get('num_cells_by_type', {}).items():
+            counts[cell] = counts.get(cell, 0) + n
+    return counts
+
+
+def synth(cfg, args, sources):
+    base = os.path.join(args.out, cfg['name'])
+    script = base + '.ys'
+    with open(script, 'w') as f:
+        f.write('read_verilog %s\n' % ' '.join(sources))
+        for key, value in cfg['params'].items():
+            f.write('chparam -set %s %s %s\n' % (key, value, cfg['top']))
+        f.write('synth_ecp5 -top %s -json %s.json\n' % (cfg['top'], base))
+        f.write('tee -q -o %s.stat.json stat -json\n' % base)
+    result = {'cycles': cfg['cycles'], 'lut': None, 'ff': None, 'bram': None,
+              'fmax': None}
+    if not run([args.yosys, '-q', '-s', script], base + '.yosys.log',
+               args.timeout):
+        result['error'] = 'synthesis failed, see %s.yosys.log' % base
+        return result
+    cells = cell_counts(base + '.stat.json')
+    # A CCU2C carry cell takes two LUT4 positions
+    result['lut'] = cells.get('LUT4', 0) + 2 * cells.get('CCU2C', 0)
+    result['ff'] = cells.get('TRELLIS_FF', 0)
+    result['bram'] = cells.get('DP16KD', 0) + cells.get('PDPW16KD', 0)
+    if not args.nextpnr:
+        return result
+    if not run([args.nextpnr, '--' + args.device, '--package', args.package,
+                '--json', base + '.json', '--out-of-context',
+                '--freq', str(args.freq), '--timing-allow-fail',
+                '--report', base + '.pnr.json', '--quiet'],
+               base + '.nextpnr.log', args.timeout):
+        result['pnr'] = 'place and route failed, see %s.nextpnr.log' % base
+        return result
+    with open(base + '.pnr.json') as f:
+        fmax = json.load(f).get('fmax', {})
+    # The slowest clock bounds the configuration
+    achieved = [c['achieved'] for c in fmax.values() if 'achieved' in c]
+    result['fmax'] = min(achieved) if achieved else None
+    return result
+
+
+def throughput(r):
+    """MB/s and MB/s per thousand LUTs at Fmax"""
+    if r.get('fmax') is None:
+        return None, None
+    mbps = r['fmax'] * 16 / r['cycles']
+    return mbps, (mbps * 1000 / r['lut'] if r.get('lut') else None)
+
+
+def table(configs, results):
+    def fmt(v, spec):
+        return '-' if v is None else format(v, spec)
+
+    lines = ['| config | LUT4 | FF | BRAM | Fmax MHz | MB/s | MB/s per kLUT |',
+             '|---|---:|---:|---:|---:|---:|---:|']
+    for cfg in configs:
+        r = results[cfg['name']]
+        mbps, per_klut = throughput(r)
+        lines.append('| %s | %s | %s | %s | %s | %s | %s |' % (
+            cfg['name'], fmt(r['lut'], 'd'), fmt(r['ff'], 'd'),
+            fmt(r['bram'], 'd'), fmt(r['fmax'], '.1f'), fmt(mbps, '.0f'),
+            fmt(per_klut, '.1f')))
+    notes = ['%s: %s' % (c['name'], results[c['name']].get('error') or
+                         results[c['name']].get('pnr'))
+             for c in configs
+             if 'error' in results[c['name']] or 'pnr' in results[c['name']]]
+    return '\n'.join(lines + [''] + notes)
+
+
+def check(results, baseline_path, tolerance):
+    with open(baseline_path) as f:
+        baseline = json.load(f)
+    grow, shrink = 1 + tolerance / 100, 1 - tolerance / 100
+    # A configuration without a baseline would never be checked
+    failures = ['%s: not in the baseline; save one with make synth-baseline'
+                % name for name in sorted(results) if name not in baseline]
+    for name, old in sorted(baseline.items()):
+        new = results.get(name)
+        # Synthesis failures are reported on their own
+        if new is None or 'error' in new:
+            continue
+        if old.get('fmax') is not None and 'pnr' in new:
+            failures.append('%s: %s' % (name, new['pnr']))
+        elif old.get('fmax') is not None and new.get('fmax') is None:
+            failures.append('%s: no Fmax to compare' % name)
+        for key in ('lut', 'ff', 'bram'):
+            if old.get(key) is not None and new.get(key) is not None and \
+                    new[key] > old[key] * grow + 0.5:
+                failures.append('%s: %s %d -> %d' % (name, key, old[key],
+                                                     new[key]))
+        if old.get('fmax') is not None and new.get('fmax') is not None and \
+                new['fmax'] < old['fmax'] * shrink:
+            failures.append('%s: Fmax %.1f -> %.1f MHz' % (name, old['fmax'],
+                                                          new['fmax']))
+    return failures
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    ap.add_argument('--configs', default=os.path.join(HERE, 'configs.txt'))
+    ap.add_argument('--src', default=os.path.join(HERE, '..', 'src'))
+    ap.add_argument('--out', default=os.path.join(HERE, 'build'))
+    ap.add_argument('--only', nargs='*', help='configurations to run')
+    ap.add_argument('--yosys', default='yosys')
+    ap.add_argument('--nextpnr', default='nextpnr-ecp5')
+    ap.add_argument('--device', default='85k', help='nextpnr-ecp5 part')
+    ap.add_argument('--package', default='CABGA756')
+    ap.add_argument('--freq', type=float, default=50,
+                    help='clock constraint, MHz')
+    ap.add_argument('--timeout', type=int, default=3600,
+                    help='seconds per tool run')
+    ap.add_argument('--check', metavar='BASELINE')
+    ap.add_argument('--save', metavar='BASELINE')
+    ap.add_argument('--tolerance', type=float, default=5, help='percent')
+    args = ap.parse_args()
+
+    # Without a baseline a check would pass whatever the results
+    if args.check and not os.path.exists(args.check):
+        sys.exit('ERROR: no baseline %s; save one with make synth-baseline'
+                 % args.check)
+    if not shutil.which(args.yosys):
+        sys.exit('ERROR: %s not found' % args.yosys)
+    if not shutil.which(args.nextpnr):
+        print('WARNING: %s not found, reporting area only' % args.nextpnr)
+        args.nextpnr = None
+    os.makedirs(args.out, exist_ok=True)
+    sources = sorted(glob.glob(os.path.join(args.src, '*.v')))
+    sources.append(os.path.join(HERE, 'synth_core.v'))
+    configs = [c for c in read_configs(args.configs)
+               if not args.only or c['name'] in args.only]
+
+    results = {}
+    for cfg in configs:
+        print('synthesizing %s ...' % cfg['name'], flush=True)
+        results[cfg['name']] = synth(cfg, args, sources)
+    report = table(configs, results)
+    print(report)
+    with open(os.path.join(args.out, 'report.md'), 'w') as f:
+        f.write(report + '\n')
+    with open(os.path.join(args.out, 'report.json'), 'w') as f:
+        json.dump(results, f, indent=1, sort_keys=True)
+    if args.save:
+        with open(args.save, 'w') as f:
+            json.dump(results, f, indent=1, sort_keys=True)
+            f.write('\n')
+
+    failed = ['%s: %s' % (n, r['error']) for n, r in sorted(results.items())
+              if 'error' in r]
+    if args.check:
+        failed += check(results, args.check, args.tolerance)
+    for line in failed:
+        print('REGRESSION: %s' % line)
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
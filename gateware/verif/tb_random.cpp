@@ -0,0 +1,530 @@
+// Randomized high-volume regression for the AES IP on its AXI4-Lite port,
+// built by `make sim-random` with Verilator (--threads, -O3). Batches of ECB
+// blocks with random keys, key sizes, directions, key slots and doorbell or
+// data bank mode are checked against aes_soft.c while every AXI channel stalls
+// at random: valid held back on AW, W and AR, ready on B and R. Responses
+// must also stay stable while they are stalled, and arrive at all.
+//
+// usage: VAES [+blocks=N] [+seed=N] [+stall=PERCENT] [+core_period_ps=N]
+// s00_axi_aclk runs at 100 MHz; +core_period_ps clocks core_clk for a build
+// with -GC_CORE_CLK_ASYNC=1. Ends with blocks simulated per second.
+// A build with -GC_S00_AXI_BURST=1 gets single-beat AXI4 bursts, each word
+// on the byte lanes of its address as in AES_tb.v, whatever the bus width.
+
+#include "VAES.h"
+#include "verilated.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <random>
+#include <type_traits>
+
+extern "C" {
+#include "aes_soft.h"
+}
+
+namespace {
+
+const uint64_t ACLK_PS = 10000;
+const uint64_t RESET_CYCLES = 10;
+const uint64_t HANG_CYCLES = 100000; // without a handshake while work is queued
+const int MAX_BATCH = 64;            // blocks between key or mode changes
+const size_t QUEUE_LOW = 256;        // operations queued ahead of the channels
+// 32-bit words on s00_axi_wdata/rdata: 1 for AXI4-Lite, 2 or 4 with bursts
+const unsigned LANES = sizeof(VAES::s00_axi_wdata) / 4;
+
+// Registers and bits, as in aes_driver.h; BYTE_ORDER is ORDER, <endian.h>
+// having the name
+const uint8_t ENABLE = 0x00, KEY_CHOICE = 0x04, PLAINTEXT = 0x08, KEY = 0x18,
+              KEY_SLOT = 0x38, KEY_SLOT_CTRL = 0x3C, KEY_SLOTS = 0x40,
+              MODE = 0x44, CIPHERTEXT = 0x50, CAPS = 0x64, ORDER = 0x7C;
+const uint32_t ENABLE_AUTO = 2, ENABLE_BANKS = 4, KEY_SLOT_EN = 0x100,
+               KEY_SLOT_STORE = 1, MODE_DECRYPT = 8, CAPS_DECRYPT = 1 << 16,
+               ORDER_LE = 1;
+
+struct Op {
+    bool write;
+    uint8_t addr;
+    uint32_t data; // written, or expected when check is set
+    bool check;
+    bool retire;   // the read of ciphertext_reg3 that completes a block
+};
+
+struct Stats {
+    uint64_t cycles = 0, blocks = 0, batches = 0, errors = 0;
+};
+
+// The word on the byte lanes of addr, of a data port of any width: an
+// integer up to 64 bits, a VlWide above
+unsigned lane(uint8_t addr) { return (addr >> 2) % LANES; }
+
+inline uint32_t get_lane(uint32_t port, unsigned) { return port; }
+inline uint32_t get_lane(uint64_t port, unsigned i) {
+    return (uint32_t)(port >> (32 * i));
+}
+template <std::size_t N> uint32_t get_lane(const VlWide<N> &port, unsigned i) {
+    return port[i];
+}
+
+inline void set_lane(uint32_t &port, unsigned, uint32_t data) { port = data; }
+inline void set_lane(uint64_t &port, unsigned i, uint32_t data) {
+    port = (uint64_t)data << (32 * i);
+}
+template <std::size_t N>
+void set_lane(VlWide<N> &port, unsigned i, uint32_t data) {
+    for (std::size_t k = 0; k < N; k++)
+        port[k] = k == i ? data : 0;
+}
+
+// Every word of a read beat
+typedef std::array<uint32_t, LANES> Beat;
+typedef std::remove_reference<decltype(VAES::s00_axi_rdata)>::type RData;
+
+Beat get_beat(const RData &port) {
+    Beat beat;
+
+    for (unsigned i = 0; i < LANES; i++)
+        beat[i] = get_lane(port, i);
+    return beat;
+}
+
+// AXI master running queued register accesses, with random stalls
+class Master {
+  public:
+    Master(VAES *top, std::mt19937_64 &rng, unsigned stall)
+        : top_(top), rng_(rng), stall_(stall) {}
+
+    std::deque<Op> queue; // in program order, not yet on a channel
+    Stats stats;
+
+    bool idle() const {
+        return queue.empty() && !writes_busy() && !reads_busy();
+    }
+    uint32_t last_read() const { return last_read_; }
+
+    // Before a rising edge of s00_axi_aclk, with the DUT's outputs settled:
+    // note the handshakes the edge completes and check the responses
+    void sample() {
+        aw_hs_ = top_->s00_axi_awvalid && top_->s00_axi_awready;
+        w_hs_ = top_->s00_axi_wvalid && top_->s00_axi_wready;
+        b_hs_ = top_->s00_axi_bvalid && top_->s00_axi_bready;
+        ar_hs_ = top_->s00_axi_arvalid && top_->s00_axi_arready;
+        r_hs_ = top_->s00_axi_rvalid && top_->s00_axi_rready;
+
+        if (b_held_ && (!top_->s00_axi_bvalid || top_->s00_axi_bresp != bresp_))
+            error("bvalid or bresp changed while stalled");
+        if (r_held_ && (!top_->s00_axi_rvalid ||
+                        get_beat(top_->s00_axi_rdata) != rdata_ ||
+                        top_->s00_axi_rresp != rresp_))
+            error("rvalid, rdata or rresp changed while stalled");
+        if (top_->s00_axi_bvalid && b_ready_ == 0)
+            error("bvalid without a write to answer");
+        if (top_->s00_axi_rvalid && r_q_.empty())
+            error("rvalid without a read to answer");
+        b_held_ = top_->s00_axi_bvalid && !top_->s00_axi_bready;
+        r_held_ = top_->s00_axi_rvalid && !top_->s00_axi_rready;
+        bresp_ = top_->s00_axi_bresp;
+        rdata_ = get_beat(top_->s00_axi_rdata);
+        rresp_ = top_->s00_axi_rresp;
+
+        if (b_hs_ && b_ready_ && top_->s00_axi_bresp != 0)
+            error("write to 0x%02x answered %u", b_q_.front().addr,
+                  top_->s00_axi_bresp);
+        if (r_hs_ && !r_q_.empty()) {
+            const Op &op = r_q_.front();
+            uint32_t data = get_lane(top_->s00_axi_rdata, lane(op.addr));
+
+            if (top_->s00_axi_rresp != 0)
+                error("read of 0x%02x answered %u", op.addr,
+                      top_->s00_axi_rresp);
+            else if (op.check && data != op.data)
+                error("read of 0x%02x gave %08x, expected %08x", op.addr,
+                      data, op.data);
+            last_read_ = data;
+        }
+    }
+
+    // After the rising edge: retire what it took and drive the next beats
+    void update() {
+        bool progress = aw_hs_ || w_hs_ || b_hs_ || ar_hs_ || r_hs_;
+
+        stats.cycles++;
+        if (aw_hs_) {
+            aw_q_.pop_front();
+            top_->s00_axi_awvalid = 0;
+        }
+        if (w_hs_) {
+            w_q_.pop_front();
+            top_->s00_axi_wvalid = 0;
+        }
+        if (b_hs_ && b_ready_)
+            b_q_.pop_front();
+        if (ar_hs_) {
+            r_q_.push_back(ar_q_.front());
+            ar_q_.pop_front();
+            top_->s00_axi_arvalid = 0;
+        }
+        if (r_hs_ && !r_q_.empty()) {
+            stats.blocks += r_q_.front().retire;
+            r_q_.pop_front();
+        }
+        // Writes whose address and data have both been taken, on the same
+        // clock or not, are the ones the slave may answer
+        b_ready_ = b_q_.size() - std::max(aw_q_.size(), w_q_.size());
+
+        // Writes and reads do not overtake each other: a change of direction
+        // waits for everything in flight
+        while (!queue.empty()) {
+            const Op &op = queue.front();
+
+            if (op.write ? reads_busy() : writes_busy())
+                break;
+            if (op.write) {
+                aw_q_.push_back(op);
+                w_q_.push_back(op);
+                b_q_.push_back(op);
+            }
+            else {
+                ar_q_.push_back(op);
+            }
+            queue.pop_front();
+        }
+
+        if (!top_->s00_axi_awvalid && !aw_q_.empty() && go()) {
+            top_->s00_axi_awaddr = aw_q_.front().addr;
+            top_->s00_axi_awvalid = 1;
+        }
+        if (!top_->s00_axi_wvalid && !w_q_.empty() && go()) {
+            set_lane(top_->s00_axi_wdata, lane(w_q_.front().addr),
+                     w_q_.front().data);
+            top_->s00_axi_wstrb = 0xf << (4 * lane(w_q_.front().addr));
+            top_->s00_axi_wvalid = 1;
+        }
+        if (!top_->s00_axi_arvalid && !ar_q_.empty() && go()) {
+            top_->s00_axi_araddr = ar_q_.front().addr;
+            top_->s00_axi_arvalid = 1;
+        }
+        top_->s00_axi_bready = go();
+        top_->s00_axi_rready = go();
+
+        quiet_ = progress || idle() ? 0 : quiet_ + 1;
+        if (quiet_ == HANG_CYCLES)
+            error("no handshake for %llu cycles", (unsigned long long)quiet_);
+    }
+
+    void error(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+  private:
+    bool writes_busy() const { return !b_q_.empty(); }
+    bool reads_busy() const { return !ar_q_.empty() || !r_q_.empty(); }
+
+    // A beat is offered, or a response taken, unless this clock stalls it
+    bool go() { return rng_() % 100 >= stall_; }
+
+    VAES *top_;
+    std::mt19937_64 &rng_;
+    unsigned stall_;
+    // aw_q_ and w_q_ hold the beats still to send, b_q_ every write not yet
+    // answered and r_q_ the reads whose address has been taken, in order
+    std::deque<Op> aw_q_, w_q_, b_q_, ar_q_, r_q_;
+    size_t b_ready_ = 0;
+    bool aw_hs_ = false, w_hs_ = false, b_hs_ = false, ar_hs_ = false,
+         r_hs_ = false;
+    bool b_held_ = false, r_held_ = false;
+    uint8_t bresp_ = 0, rresp_ = 0;
+    Beat rdata_ = {};
+    uint32_t last_read_ = 0;
+    uint64_t quiet_ = 0;
+};
+
+void Master::error(const char *fmt, ...) {
+    va_list ap;
+
+    if (stats.errors++ >= 10)
+        return;
+    std::printf("ERROR at cycle %llu: ", (unsigned long long)stats.cycles);
+    va_start(ap, fmt);
+    std::vprintf(fmt, ap);
+    va_end(ap);
+    std::printf("\n");
+}
+
+// Queues batches of blocks as register accesses, with the results expected
+// from the reference model
+class Traffic {
+  public:
+    Traffic(Master &m, std::mt19937_64 &rng, uint32_t caps, uint32_t nslots)
+        : m_(m), rng_(rng), decrypt_(caps & CAPS_DECRYPT),
+          nslots_(std::min<uint32_t>(nslots, 64)) {}
+
+    // One batch of up to max_blocks blocks; returns how many
+    int batch(uint64_t max_blocks) {
+        int choice = rng_() % 3;
+        bool decrypt = decrypt_ && rng_() % 2;
+        bool banks = rng_() % 4 != 0;
+        int n = 1 + rng_() % MAX_BATCH;
+        uint8_t key[32];
+
+        if (rng_() % 8 == 0)
+            n = 1;
+        n = (int)std::min<uint64_t>(n, max_blocks);
+        if (nslots_ && rng_() % 3 == 0) {
+            // Through a key slot, stored now or by an earlier batch, with
+            // the key registers and size clobbered so that only the slot
+            // can give the right result
+            uint32_t s = rng_() % nslots_;
+
+            if (!stored_[s] || rng_() % 2) {
+                random_bytes(slot_key_[s], 32);
+                slot_choice_[s] = choice;
+                load_key(slot_key_[s], choice);
+                write(KEY_SLOT, s);
+                write(KEY_SLOT_CTRL, KEY_SLOT_STORE);
+                stored_[s] = true;
+            }
+            std::memcpy(key, slot_key_[s], 32);
+            choice = slot_choice_[s];
+            random_bytes(garbage_, 32);
+            load_key(garbage_, rng_() % 3);
+            write(KEY_SLOT, KEY_SLOT_EN | s);
+        }
+        else {
+            random_bytes(key, 32);
+            load_key(key, choice);
+            write(KEY_SLOT, 0);
+        }
+        aes_soft_set_key(&ref_, key, 16 + 8 * choice);
+
+        // The whole batch's expected results in one call
+        random_bytes(in_[0], 16 * n);
+        if (decrypt)
+            aes_soft_decrypt(&ref_, in_[0], want_[0], n);
+        else
+            aes_soft_encrypt(&ref_, in_[0], want_[0], n);
+
+        write(MODE, decrypt ? MODE_DECRYPT : 0);
+        write(ENABLE, banks ? ENABLE_AUTO | ENABLE_BANKS : ENABLE_AUTO);
+        // With banks the next block is loaded before the last result is read
+        for (int i = 0; i < n; i++) {
+            send_block(in_[i]);
+            if (!banks)
+                read_result(want_[i]);
+            else if (i > 0)
+                read_result(want_[i - 1]);
+        }
+        if (banks)
+            read_result(want_[n - 1]);
+        write(ENABLE, 0);
+        m_.stats.batches++;
+        return n;
+    }
+
+  private:
+    static uint32_t word(const uint8_t *b) {
+        return b[0] | b[1] << 8 | b[2] << 16 | (uint32_t)b[3] << 24;
+    }
+
+    void write(uint8_t addr, uint32_t data) {
+        m_.queue.push_back({true, addr, data, false, false});
+    }
+
+    void random_bytes(uint8_t *p, int n) {
+        for (int i = 0; i < n; i++)
+            p[i] = (uint8_t)rng_();
+    }
+
+    // All eight key registers, unused ones included
+    void load_key(const uint8_t *key, int choice) {
+        for (int i = 0; i < 8; i++)
+            write(KEY + 4 * i, word(key + 4 * i));
+        write(KEY_CHOICE, choice);
+    }
+
+    // The first three words in any order, then the doorbell
+    void send_block(const uint8_t *in) {
+        int order[3] = {0, 1, 2};
+
+        std::shuffle(order, order + 3, rng_);
+        for (int i : order)
+            write(PLAINTEXT + 4 * i, word(in + 4 * i));
+        write(PLAINTEXT + 12, word(in + 12));
+    }
+
+    // Likewise, ciphertext_reg3 last to retire the block
+    void read_result(const uint8_t *want) {
+        int order[3] = {0, 1, 2};
+
+        std::shuffle(order, order + 3, rng_);
+        for (int i : order)
+            m_.queue.push_back({false, (uint8_t)(CIPHERTEXT + 4 * i),
+                                word(want + 4 * i), true, false});
+        m_.queue.push_back({false, CIPHERTEXT + 12, word(want + 12), true,
+                            true});
+    }
+
+    Master &m_;
+    std::mt19937_64 &rng_;
+    bool decrypt_;
+    uint32_t nslots_;
+    struct aes_soft_key ref_;
+    bool stored_[64] = {};
+    uint8_t slot_key_[64][32];
+    int slot_choice_[64];
+    uint8_t garbage_[32];
+    uint8_t in_[MAX_BATCH][16];
+    uint8_t want_[MAX_BATCH][16];
+};
+
+uint64_t plusarg(VerilatedContext *ctx, const char *name, uint64_t dflt) {
+    const char *match = ctx->commandArgsPlusMatch(name);
+
+    // The match is the whole argument, "+name=value", for a name of "name="
+    if (!match || !*match)
+        return dflt;
+    return std::strtoull(match + 1 + std::strlen(name), nullptr, 0);
+}
+
+// Both clocks, and the master on the rising edges of s00_axi_aclk
+class Bench {
+  public:
+    Bench(VerilatedContext *ctx, VAES *top, Master &m, uint64_t core_ps)
+        : ctx_(ctx), top_(top), m_(m), core_ps_(core_ps),
+          next_core_(core_ps / 2) {}
+
+    // Hold s00_axi_aresetn low for RESET_CYCLES. The AXI4 signals, which
+    // AXI4-Lite builds ignore, describe one 32-bit INCR beat for good.
+    void reset() {
+        top_->s00_axi_awlen = 0;
+        top_->s00_axi_awsize = 2;
+        top_->s00_axi_awburst = 1;
+        top_->s00_axi_wlast = 1;
+        top_->s00_axi_arlen = 0;
+        top_->s00_axi_arsize = 2;
+        top_->s00_axi_arburst = 1;
+        top_->s00_axi_aresetn = 0;
+        top_->eval();
+        for (uint64_t i = 0; i < RESET_CYCLES; i++)
+            step(false);
+        top_->s00_axi_aresetn = 1;
+        top_->eval();
+    }
+
+    void cycle() { step(true); }
+
+    // Run the queued accesses to completion
+    void drain() {
+        while (!m_.idle() && m_.stats.errors == 0)
+            cycle();
+    }
+
+  private:
+    // One period of s00_axi_aclk and the core_clk edges within it
+    void step(bool master) {
+        uint64_t end = next_aclk_ + ACLK_PS;
+
+        while (next_aclk_ < end) {
+            bool aclk = next_aclk_ <= next_core_;
+            bool core = next_core_ <= next_aclk_;
+            bool rising = aclk && !top_->s00_axi_aclk;
+
+            if (rising && master)
+                m_.sample();
+            ctx_->time(aclk ? next_aclk_ : next_core_);
+            if (aclk) {
+                top_->s00_axi_aclk = !top_->s00_axi_aclk;
+                next_aclk_ += ACLK_PS / 2;
+            }
+            if (core) {
+                top_->core_clk = !top_->core_clk;
+                next_core_ += core_ps_ / 2;
+            }
+            top_->eval();
+            if (rising && master) {
+                m_.update();
+                top_->eval();
+            }
+        }
+    }
+
+    VerilatedContext *ctx_;
+    VAES *top_;
+    Master &m_;
+    uint64_t core_ps_;
+    uint64_t next_aclk_ = ACLK_PS / 2, next_core_;
+};
+
+}
+
+int main(int argc, char **argv) {
+    auto ctx = std::make_unique<VerilatedContext>();
+
+    ctx->commandArgs(argc, argv);
+    uint64_t blocks = plusarg(ctx.get(), "blocks=", 1000000);
+    uint64_t seed = plusarg(ctx.get(), "seed=", 1);
+    unsigned stall = std::min<unsigned>(plusarg(ctx.get(), "stall=", 25), 90);
+    uint64_t core_ps = std::max<uint64_t>(
+        plusarg(ctx.get(), "core_period_ps=", ACLK_PS), 2);
+
+    auto top = std::make_unique<VAES>(ctx.get());
+    std::mt19937_64 rng(seed);
+    Master m(top.get(), rng, stall);
+    Bench bench(ctx.get(), top.get(), m, core_ps);
+
+    std::printf("--- AES random traffic: %llu blocks, seed %llu, %u%% stalls, %u-bit bus ---\n",
+                (unsigned long long)blocks, (unsigned long long)seed, stall,
+                32 * LANES);
+    bench.reset();
+
+    // Key and data words little-endian, as the driver selects them
+    m.queue.push_back({true, ORDER, ORDER_LE, false, false});
+
+    // What this build of the IP offers
+    m.queue.push_back({false, CAPS, 0, false, false});
+    bench.drain();
+    uint32_t caps = m.last_read();
+    m.queue.push_back({false, KEY_SLOTS, 0, false, false});
+    bench.drain();
+    uint32_t nslots = m.last_read();
+    std::printf("caps=%08x key slots=%u\n", caps, nslots);
+
+    Traffic traffic(m, rng, caps, nslots);
+    uint64_t queued = 0, cycles0 = m.stats.cycles;
+    auto t0 = std::chrono::steady_clock::now();
+
+    while (m.stats.errors == 0 && (queued < blocks || !m.idle())) {
+        while (queued < blocks && m.queue.size() < QUEUE_LOW)
+            queued += traffic.batch(blocks - queued);
+        bench.cycle();
+    }
+
+    double secs = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - t0).count();
+    uint64_t cycles = m.stats.cycles - cycles0;
+
+    top->final();
+    std::printf("%llu blocks in %llu batches, %llu cycles, %.1f cycles/block\n",
+                (unsigned long long)m.stats.blocks,
+                (unsigned long long)m.stats.batches,
+                (unsigned long long)cycles,
+                m.stats.blocks ? (double)cycles / m.stats.blocks : 0.0);
+    std::printf("simulated %.0f blocks/s, %.0f cycles/s (%.1f s)\n",
+                secs > 0 ? m.stats.blocks / secs : 0.0,
+                secs > 0 ? cycles / secs : 0.0, secs);
+    if (m.stats.errors == 0 && m.stats.blocks == blocks)
+        std::printf("Random traffic PASS blocks=%llu\n",
+                    (unsigned long long)m.stats.blocks);
+    else
+        std::printf("Random traffic FAIL errors=%llu blocks=%llu\n",
+                    (unsigned long long)m.stats.errors,
+                    (unsigned long long)m.stats.blocks);
+    return m.stats.errors != 0 || m.stats.blocks != blocks;
+}
@@ -0,0 +1,217 @@
+/*
+ * Buffers from the handle's DMA buffer pool against copying and pinning.
+ *
+ * One client submits back-to-back ECB requests of each size from one buffer
+ * into another: heap buffers copied through the driver's bounce buffer,
+ * page-aligned heap buffers pinned for every request, and buffers from
+ * aes_buf_alloc(), which the ring runs from as they are. Every result is
+ * checked against the reference AES. Reports modelled throughput, the CPU
+ * time per request and the bytes copied per request. A second table times
+ * aes_buf_alloc() and aes_buf_free() against malloc() and free() with
+ * threads sharing a handle, in wall-clock nanoseconds per pair.
+ *
+ * usage: bench_bufpool [max_bytes] [allocs_per_thread]
+ */
+#define _DEFAULT_SOURCE
+#include "aes_lib.h"
+#include "aes_ref.h"
+#include "aes_sim.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MIN_BYTES 4096
+#define MAX_BYTES (1024 * 1024)
+#define TOTAL_BYTES (4 * 1024 * 1024) // per size and policy
+#define MAX_THREADS 8
+#define HELD 8 // buffers each allocating thread keeps
+
+enum { POLICY_COPY, POLICY_PIN, POLICY_POOL };
+
+struct policy {
+  const char *name;
+  unsigned int zero_copy_min;
+};
+
+struct alloc_arg {
+  struct aes_dev *dev; // NULL for malloc() and free()
+  int id;
+  int allocs;
+  int errors;
+};
+
+static double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Allocate and free buffers of 4 to 64 KiB, HELD at a time */
+static void *alloc_loop(void *p) {
+  struct alloc_arg *arg = p;
+  unsigned int seed = 0x9e3779b9u * (arg->id + 1);
+  uint8_t *held[HELD] = {NULL};
+
+  for (int n = 0; n < arg->allocs; n++) {
+    int k = n % HELD;
+    size_t len = 4096 << rand_r(&seed) % 5;
+
+    if (arg->dev) {
+      aes_buf_free(arg->dev, held[k]);
+      held[k] = aes_buf_alloc(arg->dev, len);
+    } else {
+      free(held[k]);
+      held[k] = malloc(len);
+    }
+    if (!held[k]) {
+      arg->errors++;
+      break;
+    }
+    held[k][0] = (uint8_t)n;
+  }
+  for (int k = 0; k < HELD; k++) {
+    if (arg->dev)
+      aes_buf_free(arg->dev, held[k]);
+    else
+      free(held[k]);
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  static const struct policy policies[] = {
+      {"copy", UINT_MAX}, {"pin", AES_BLOCK_LEN}, {"pool", 0}};
+  static const char *const alloc_names[] = {"malloc", "aes_buf"};
+  size_t max_bytes = argc > 1 ? strtoul(argv[1], NULL, 0) : MAX_BYTES;
+  int allocs = argc > 2 ? atoi(argv[2]) : 100000;
+  uint8_t key[32], ref[AES_BLOCK_LEN];
+  struct aes_ref_key ref_key;
+  uint8_t *raw, *pt;
+  int failed = 0;
+
+  if (max_bytes < MIN_BYTES || max_bytes > MAX_BYTES) {
+    fprintf(stderr, "max_bytes must be from %d to %d\n", MIN_BYTES,
+            MAX_BYTES);
+    return 1;
+  }
+  if (allocs < 1)
+    allocs = 1;
+  for (int i = 0; i < 32; i++)
+    key[i] = (uint8_t)(i * 3 + 1);
+  aes_ref_set_key(&ref_key, key, 32);
+
+  raw = malloc(2 * max_bytes + 4096);
+  pt = malloc(max_bytes);
+  if (!raw || !pt)
+    return 1;
+  for (size_t i = 0; i < max_bytes; i++)
+    pt[i] = (uint8_t)(i * 13 + 5);
+
+  printf("%-10s %-7s %-9s %-7s %-14s %-14s %-12s\n", "bytes", "policy",
+         "requests", "errors", "modeled_MB/s", "cpu_us/req", "copied/req");
+  for (size_t bytes = MIN_BYTES; bytes <= max_bytes; bytes *= 16) {
+    int requests = TOTAL_BYTES / bytes;
+
+    for (int p = POLICY_COPY; p <= POLICY_POOL; p++) {
+      struct aes_sim_config config = {
+          .key_slots = AES_SIM_KEY_SLOTS_DEFAULT,
+          .zero_copy_min = policies[p].zero_copy_min};
+      struct aes_sim *sim = aes_sim_create_config(&config);
+      struct aes_dev *dev = sim ? aes_open_sim(sim) : NULL;
+      uint8_t *src = NULL, *dst = NULL;
+      struct aes_sim_stats st;
+      int errors = 0;
+      double secs;
+
+      if (!dev) {
+        fprintf(stderr, "ERROR: Unable to open the simulated device\n");
+        return 1;
+      }
+      if (p == POLICY_POOL) {
+        src = aes_buf_alloc(dev, bytes);
+        dst = aes_buf_alloc(dev, bytes);
+      } else {
+        /* Page-aligned, as large user buffers usually are */
+        src = (uint8_t *)(((uintptr_t)raw + 4095) & ~(uintptr_t)4095);
+        dst = src + max_bytes;
+      }
+      for (int n = 0; n < requests && src && dst; n++) {
+        memcpy(src, pt, bytes);
+        if (aes_encrypt(dev, AES_KEY_CHOICE_256, key, 32, src, dst, bytes) !=
+            AES_SUCCESS) {
+          errors++;
+          continue;
+        }
+        for (size_t i = 0; i < bytes; i += AES_BLOCK_LEN) {
+          aes_ref_encrypt_block(&ref_key, pt + i, ref);
+          if (memcmp(ref, dst + i, AES_BLOCK_LEN)) {
+            errors++;
+            break;
+          }
+        }
+      }
+      if (!src || !dst)
+        errors++;
+      aes_sim_get_stats(sim, &st);
+      if (p == POLICY_POOL) {
+        errors += st.pool_jobs != (uint64_t)requests;
+        aes_buf_free(dev, src);
+        aes_buf_free(dev, dst);
+      }
+      aes_close(dev);
+      aes_sim_destroy(sim);
+
+      secs = st.modeled_ns * 1e-9;
+      printf("%-10zu %-7s %-9d %-7d %-14.2f %-14.2f %-12.0f\n", bytes,
+             policies[p].name, requests, errors,
+             secs ? (double)requests * bytes / secs / 1e6 : 0.0,
+             st.cpu_ns / 1e3 / requests, (double)st.bytes_copied / requests);
+      failed |= errors != 0;
+    }
+  }
+
+  printf("%-8s %-8s %-9s %-7s %-10s\n", "threads", "alloc", "allocs",
+         "errors", "ns/pair");
+  for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+    for (int a = 0; a <= 1; a++) {
+      struct aes_sim *sim = aes_sim_create();
+      struct aes_dev *dev = sim ? aes_open_sim(sim) : NULL;
+      struct alloc_arg args[MAX_THREADS];
+      pthread_t tids[MAX_THREADS];
+      int errors = 0;
+      double t0, t1;
+
+      if (!dev) {
+        fprintf(stderr, "ERROR: Unable to open the simulated device\n");
+        return 1;
+      }
+      /* Set the arena up before the clock starts */
+      aes_buf_free(dev, aes_buf_alloc(dev, 1));
+      t0 = now_ns();
+      for (int i = 0; i < threads; i++) {
+        args[i] = (struct alloc_arg){
+            .dev = a ? dev : NULL, .id = i, .allocs = allocs};
+        pthread_create(&tids[i], NULL, alloc_loop, &args[i]);
+      }
+      for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        errors += args[i].errors;
+      }
+      t1 = now_ns();
+      aes_close(dev);
+      aes_sim_destroy(sim);
+
+      printf("%-8d %-8s %-9d %-7d %-10.1f\n", threads, alloc_names[a],
+             threads * allocs, errors, (t1 - t0) / allocs);
+      failed |= errors != 0;
+    }
+  }
+  free(raw);
+  free(pt);
+  return failed;
+}
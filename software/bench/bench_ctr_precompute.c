@@ -0,0 +1,125 @@
+/*
+ * CTR keystream precomputation against computing each block on demand.
+ *
+ * One client sends a CTR stream as bursts of small messages on one key,
+ * each message taking up the counter where the last one left it, with the
+ * device idle for gap_us between messages. The simulated device runs with
+ * the keystream buffer (C_KS_DEPTH = 16) and without it, through the
+ * registers and through the descriptor ring, with the unrolled core and
+ * with a core taking 12 cycles a pass, as an iterative core or one on its
+ * own clock would. Every result is checked against the reference AES.
+ * Reports the mean and 99th percentile modelled latency of a message, gap
+ * excluded, and the share of blocks served from the buffer.
+ *
+ * usage: bench_ctr_precompute [messages_per_run] [gap_us]
+ */
+#define _DEFAULT_SOURCE
+#include "aes_lib.h"
+#include "aes_ref.h"
+#include "aes_sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KS_DEPTH 16
+#define MAX_MSG 256
+
+static uint8_t key[32];
+static struct aes_ref_key ref_key;
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* The counter block after `blocks` more, big-endian over all 16 bytes */
+static void ctr_add(uint8_t ctr[16], unsigned int blocks) {
+  for (int i = 15; i >= 0 && blocks; i--) {
+    blocks += ctr[i];
+    ctr[i] = (uint8_t)blocks;
+    blocks >>= 8;
+  }
+}
+
+int main(int argc, char **argv) {
+  static const unsigned int core_cycles[] = {1, 12};
+  static const int msg_sizes[] = {16, 64, 256};
+  static const char *const path_names[] = {"regs", "ring"};
+  int total = argc > 1 ? atoi(argv[1]) : 2048;
+  uint64_t gap_ns = (argc > 2 ? strtoull(argv[2], NULL, 0) : 5) * 1000;
+  uint8_t in[MAX_MSG], out[MAX_MSG], ref[MAX_MSG];
+  uint64_t *lat;
+  int failed = 0;
+
+  if (total < 1)
+    total = 1;
+  lat = malloc(total * sizeof(*lat));
+  if (!lat)
+    return 1;
+  for (int i = 0; i < 32; i++)
+    key[i] = (uint8_t)(i * 7 + 1);
+  aes_ref_set_key(&ref_key, key, 32);
+
+  printf("%-6s %-6s %-5s %-6s %-7s %-7s %-10s %-10s %-9s\n", "cycles",
+         "bytes", "path", "ks", "msgs", "errors", "mean_ns", "p99_ns",
+         "hits/blk");
+  for (size_t c = 0; c < sizeof(core_cycles) / sizeof(core_cycles[0]); c++) {
+    for (size_t m = 0; m < sizeof(msg_sizes) / sizeof(msg_sizes[0]); m++) {
+      for (int ring = 0; ring <= 1; ring++) {
+        for (int ks = 0; ks <= KS_DEPTH; ks += KS_DEPTH) {
+          int len = msg_sizes[m], errors = 0;
+          struct aes_sim_config config = {
+              .key_slots = AES_SIM_KEY_SLOTS_DEFAULT,
+              .no_ring = !ring,
+              .core_cycles = core_cycles[c],
+              .ks_depth = ks};
+          struct aes_sim *sim = aes_sim_create_config(&config);
+          struct aes_dev *dev = sim ? aes_open_sim(sim) : NULL;
+          struct aes_sim_stats before, after;
+          unsigned int seed = 0x9e3779b9u;
+          uint8_t ctr[16] = {0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
+                             0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xf0};
+          struct aes_job job;
+          double mean = 0;
+
+          if (!dev) {
+            fprintf(stderr, "ERROR: Unable to open the simulated device\n");
+            return 1;
+          }
+          aes_sim_get_stats(sim, &before);
+          for (int n = 0; n < total; n++) {
+            for (int i = 0; i < len; i++)
+              in[i] = (uint8_t)rand_r(&seed);
+            aes_sim_idle(sim, gap_ns);
+            aes_job_init(&job, AES_KEY_CHOICE_256, key, 32, in, out, len);
+            aes_job_set_ctr(&job, ctr);
+            if (aes_submit_job(dev, &job) != AES_SUCCESS)
+              errors++;
+            aes_sim_get_stats(sim, &after);
+            lat[n] = after.modeled_ns - before.modeled_ns - gap_ns;
+            before = after;
+            aes_ref_ctr(&ref_key, ctr, in, ref, len);
+            errors += memcmp(ref, out, len) != 0;
+            ctr_add(ctr, (len + AES_BLOCK_LEN - 1) / AES_BLOCK_LEN);
+          }
+          aes_close(dev);
+          aes_sim_destroy(sim);
+
+          for (int n = 0; n < total; n++)
+            mean += lat[n];
+          qsort(lat, total, sizeof(*lat), cmp_u64);
+          printf("%-6u %-6d %-5s %-6d %-7d %-7d %-10.0f %-10llu %-9.3f\n",
+                 core_cycles[c], len, path_names[ring], ks, total, errors,
+                 mean / total,
+                 (unsigned long long)lat[(size_t)total * 99 / 100],
+                 after.blocks ? (double)after.ks_hits / after.blocks : 0.0);
+          failed |= errors != 0;
+        }
+      }
+    }
+  }
+  free(lat);
+  return failed;
+}
@@ -0,0 +1,130 @@
+/*
+ * Scaling benchmark for the device pool.
+ *
+ * A fixed set of client threads share one pool of 1..8 simulated instances
+ * and submit jobs of 1..16 blocks over a set of keys. Every result is checked
+ * against the reference AES. The instances run in parallel, so the modelled
+ * time for a run is that of the busiest instance; the speedup column is
+ * relative to the single-instance run and should track the instance count.
+ *
+ * usage: bench_pool [total_jobs]
+ */
+#define _DEFAULT_SOURCE
+#include "aes_lib.h"
+#include "aes_ref.h"
+#include "aes_sim.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_THREADS 32
+#define NUM_KEYS 16
+#define MAX_JOB_BLOCKS 16
+
+static uint8_t keys[NUM_KEYS][32];
+static struct aes_ref_key ref_keys[NUM_KEYS];
+
+struct client_arg {
+  struct aes_pool *pool;
+  int id;
+  int jobs;
+  int errors;
+  uint64_t bytes;
+};
+
+static void *client(void *p) {
+  struct client_arg *arg = p;
+  uint8_t in[MAX_JOB_BLOCKS * AES_BLOCK_LEN], out[sizeof(in)], ref[16];
+  unsigned int seed = 0x9e3779b9u * (arg->id + 1);
+
+  for (int n = 0; n < arg->jobs; n++) {
+    /* Clients move through the key set in runs, like sessions */
+    int k = (arg->id + n / 8) % NUM_KEYS;
+    int len = AES_BLOCK_LEN * (1 + rand_r(&seed) % MAX_JOB_BLOCKS);
+
+    for (int i = 0; i < len; i++)
+      in[i] = (uint8_t)rand_r(&seed);
+    if (aes_pool_encrypt(arg->pool, AES_KEY_CHOICE_256, keys[k], 32, in, out,
+                         len) != AES_SUCCESS) {
+      arg->errors++;
+      continue;
+    }
+    for (int i = 0; i < len; i += AES_BLOCK_LEN) {
+      aes_ref_encrypt_block(&ref_keys[k], in + i, ref);
+      if (memcmp(ref, out + i, AES_BLOCK_LEN)) {
+        arg->errors++;
+        break;
+      }
+    }
+    arg->bytes += len;
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  static const int instance_counts[] = {1, 2, 4, 8};
+  int total_jobs = argc > 1 ? atoi(argv[1]) : 16384;
+  double base_mbps = 0;
+  int failed = 0;
+
+  for (int k = 0; k < NUM_KEYS; k++) {
+    for (int i = 0; i < 32; i++)
+      keys[k][i] = (uint8_t)(k * 32 + i);
+    aes_ref_set_key(&ref_keys[k], keys[k], 32);
+  }
+
+  printf("%-10s %-8s %-7s %-14s %-8s %-10s\n", "instances", "jobs", "errors",
+         "modeled_MB/s", "speedup", "key_loads");
+  for (size_t c = 0; c < sizeof(instance_counts) / sizeof(instance_counts[0]);
+       c++) {
+    int n = instance_counts[c];
+    struct aes_sim *sims[8];
+    struct aes_pool *pool;
+    pthread_t tids[NUM_THREADS];
+    struct client_arg args[NUM_THREADS];
+    uint64_t bytes = 0, key_loads = 0, max_ns = 0;
+    int errors = 0, jobs = 0;
+    double mbps;
+
+    for (int i = 0; i < n; i++)
+      sims[i] = aes_sim_create();
+    pool = aes_pool_open_sim(sims, n);
+    if (!pool) {
+      fprintf(stderr, "ERROR: Could not build a pool of %d\n", n);
+      return 1;
+    }
+
+    for (int i = 0; i < NUM_THREADS; i++) {
+      args[i] = (struct client_arg){
+          .pool = pool, .id = i, .jobs = total_jobs / NUM_THREADS};
+      pthread_create(&tids[i], NULL, client, &args[i]);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+      pthread_join(tids[i], NULL);
+      errors += args[i].errors;
+      bytes += args[i].bytes;
+      jobs += args[i].jobs;
+    }
+    aes_pool_close(pool);
+
+    for (int i = 0; i < n; i++) {
+      struct aes_sim_stats st;
+
+      aes_sim_get_stats(sims[i], &st);
+      aes_sim_destroy(sims[i]);
+      key_loads += st.key_loads;
+      if (st.modeled_ns > max_ns)
+        max_ns = st.modeled_ns;
+    }
+
+    mbps = max_ns ? bytes * 1e3 / max_ns : 0.0;
+    if (!base_mbps)
+      base_mbps = mbps;
+    printf("%-10d %-8d %-7d %-14.2f %-8.2f %-10llu\n", n, jobs, errors, mbps,
+           base_mbps ? mbps / base_mbps : 0.0, (unsigned long long)key_loads);
+    failed |= errors != 0;
+  }
+  return failed;
+}
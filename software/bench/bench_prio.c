@@ -0,0 +1,221 @@
+/*
+ * Latency of small high-priority jobs under a saturating bulk load.
+ *
+ * Bulk threads each open a handle on one simulated device and keep DEPTH
+ * ECB jobs of bulk_bytes on its submission queue, so the device always has
+ * bulk work, while the main thread submits small CTR jobs one at a time on
+ * a client of its own. The device runs first as a plain round robin, then
+ * with the small jobs' client in AES_PRIO_HIGH, then with long jobs split
+ * into chunks of 4, 16 and 64 KiB as well, and finally with earliest
+ * deadline first. Every result is checked against the reference AES.
+ * Reports the mean and 99th percentile modelled latency of the small jobs,
+ * from submission to completion, and the bulk throughput.
+ *
+ * usage: bench_prio [small_jobs] [bulk_bytes]
+ */
+#define _DEFAULT_SOURCE
+#include "aes_lib.h"
+#include "aes_ref.h"
+#include "aes_sim.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BULK_THREADS 2
+#define DEPTH 4
+#define SMALL_BYTES 256
+
+static uint8_t bulk_key[32], small_key[16];
+static struct aes_ref_key bulk_ref_key, small_ref_key;
+static int bulk_bytes;
+
+struct policy {
+  const char *name;
+  unsigned int chunk_size; // UINT_MAX for whole jobs
+  int high;                // the small thread's handle in AES_PRIO_HIGH
+  int edf;
+};
+
+struct bulk_arg {
+  struct aes_sim *sim;
+  pthread_barrier_t *primed;
+  int id;
+  int *stop;
+  int jobs;
+  int errors;
+};
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* Queue a fresh bulk job in slot s */
+static int bulk_submit(struct aes_dev *dev, uint8_t *in, uint8_t *out, int s,
+                       unsigned int *seed) {
+  struct aes_job job;
+
+  for (int i = 0; i < bulk_bytes; i++)
+    in[i] = (uint8_t)rand_r(seed);
+  aes_job_init(&job, AES_KEY_CHOICE_256, bulk_key, 32, in, out, bulk_bytes);
+  return aes_submit(dev, &job, s);
+}
+
+static void *bulk(void *p) {
+  struct bulk_arg *arg = p;
+  struct aes_dev *dev = aes_open_sim(arg->sim);
+  uint8_t *in = malloc(2 * DEPTH * (size_t)bulk_bytes);
+  unsigned int seed = 0x9e3779b9u * (arg->id + 1);
+  uint8_t ref[AES_BLOCK_LEN], *src, *dst;
+  struct aes_uring_cqe cqe;
+  int inflight = 0, s;
+
+  if (!dev || !in || aes_queue_init(dev, DEPTH) != AES_SUCCESS)
+    arg->errors++;
+  for (s = 0; !arg->errors && s < DEPTH; s++, inflight++)
+    if (bulk_submit(dev, in + 2 * s * bulk_bytes, in + (2 * s + 1) * bulk_bytes,
+                    s, &seed) != AES_SUCCESS)
+      arg->errors++;
+  if (!arg->errors && aes_reap(dev, &cqe, 0, 0) < 0)
+    arg->errors++;
+  pthread_barrier_wait(arg->primed);
+
+  while (!arg->errors && inflight) {
+    if (aes_reap(dev, &cqe, 1, 1) != 1) {
+      arg->errors++;
+      break;
+    }
+    inflight--;
+    s = (int)cqe.user_data;
+    src = in + 2 * s * bulk_bytes;
+    dst = src + bulk_bytes;
+    arg->errors += cqe.res != 0;
+    for (int i = 0; !cqe.res && i < bulk_bytes; i += AES_BLOCK_LEN) {
+      aes_ref_encrypt_block(&bulk_ref_key, src + i, ref);
+      if (memcmp(ref, dst + i, AES_BLOCK_LEN)) {
+        arg->errors++;
+        break;
+      }
+    }
+    arg->jobs++;
+    if (__atomic_load_n(arg->stop, __ATOMIC_RELAXED))
+      continue;
+    if (bulk_submit(dev, src, dst, s, &seed) != AES_SUCCESS)
+      arg->errors++;
+    else
+      inflight++;
+  }
+  aes_close(dev);
+  free(in);
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  static const struct policy policies[] = {
+      {"rr", UINT_MAX, 0, 0},    {"prio", UINT_MAX, 1, 0},
+      {"prio", 4 * 1024, 1, 0},  {"prio", 16 * 1024, 1, 0},
+      {"prio", 64 * 1024, 1, 0}, {"edf", 16 * 1024, 1, 1}};
+  int total = argc > 1 ? atoi(argv[1]) : 100;
+  uint8_t in[SMALL_BYTES], out[SMALL_BYTES], ref[SMALL_BYTES], iv[16];
+  uint64_t *lat;
+  int failed = 0;
+
+  bulk_bytes = argc > 2 ? atoi(argv[2]) : 256 * 1024;
+  if (bulk_bytes < AES_BLOCK_LEN || bulk_bytes > AES_JOB_MAX_LEN ||
+      bulk_bytes % AES_BLOCK_LEN) {
+    fprintf(stderr, "bulk_bytes must be a multiple of 16 up to %d\n",
+            AES_JOB_MAX_LEN);
+    return 1;
+  }
+  if (total < 1)
+    total = 1;
+  lat = malloc(total * sizeof(*lat));
+  if (!lat)
+    return 1;
+  for (int i = 0; i < 32; i++)
+    bulk_key[i] = (uint8_t)i;
+  for (int i = 0; i < 16; i++)
+    small_key[i] = (uint8_t)(0xa5 ^ i);
+  aes_ref_set_key(&bulk_ref_key, bulk_key, 32);
+  aes_ref_set_key(&small_ref_key, small_key, 16);
+
+  printf("%-6s %-7s %-7s %-7s %-10s %-10s %-10s %-13s\n", "policy", "chunk",
+         "small", "errors", "mean_us", "p99_us", "bulk_jobs", "bulk_MB/s");
+  for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+    struct aes_sim_config config = {.key_slots = AES_SIM_KEY_SLOTS_DEFAULT,
+                                    .chunk_size = policies[p].chunk_size,
+                                    .sched_edf = policies[p].edf};
+    struct aes_sim *sim = aes_sim_create_config(&config);
+    struct aes_sim_client *client = sim ? aes_sim_open(sim) : NULL;
+    pthread_t tids[BULK_THREADS];
+    struct bulk_arg args[BULK_THREADS];
+    pthread_barrier_t primed;
+    int stop = 0;
+    unsigned int seed = 0x7f4a7c15u;
+    struct aes_sim_stats st;
+    int errors = 0, bulk_jobs = 0;
+    struct aes_job job;
+    double mean = 0, secs;
+    size_t n;
+
+    if (!client) {
+      fprintf(stderr, "ERROR: Unable to open the simulated device\n");
+      return 1;
+    }
+    if (policies[p].high && aes_sim_set_prio(client, AES_PRIO_HIGH, 0))
+      errors++;
+    pthread_barrier_init(&primed, NULL, BULK_THREADS + 1);
+    for (int i = 0; i < BULK_THREADS; i++) {
+      args[i] = (struct bulk_arg){
+          .sim = sim, .primed = &primed, .id = i, .stop = &stop};
+      pthread_create(&tids[i], NULL, bulk, &args[i]);
+    }
+    /* The small jobs start once the bulk queues are full */
+    pthread_barrier_wait(&primed);
+    for (int k = 0; k < total; k++) {
+      for (int i = 0; i < SMALL_BYTES; i++)
+        in[i] = (uint8_t)rand_r(&seed);
+      for (int i = 0; i < 16; i++)
+        iv[i] = (uint8_t)rand_r(&seed);
+      aes_job_init(&job, AES_KEY_CHOICE_128, small_key, 16, in, out,
+                   SMALL_BYTES);
+      aes_job_set_ctr(&job, iv);
+      if (aes_sim_submit(client, &job))
+        errors++;
+      aes_ref_ctr(&small_ref_key, iv, in, ref, SMALL_BYTES);
+      errors += memcmp(ref, out, SMALL_BYTES) != 0;
+    }
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < BULK_THREADS; i++) {
+      pthread_join(tids[i], NULL);
+      errors += args[i].errors;
+      bulk_jobs += args[i].jobs;
+    }
+    pthread_barrier_destroy(&primed);
+    aes_sim_get_stats(sim, &st);
+    n = aes_sim_get_latencies(client, lat, total);
+    aes_sim_release(client);
+    aes_sim_destroy(sim);
+
+    if (n < (size_t)total)
+      errors++;
+    for (size_t i = 0; i < n; i++)
+      mean += lat[i];
+    qsort(lat, n, sizeof(*lat), cmp_u64);
+    secs = st.modeled_ns * 1e-9;
+    printf("%-6s %-7u %-7d %-7d %-10.1f %-10.1f %-10d %-13.2f\n",
+           policies[p].name,
+           policies[p].chunk_size == UINT_MAX ? 0
+                                              : policies[p].chunk_size / 1024,
+           total, errors, n ? mean / n / 1000 : 0.0,
+           n ? lat[n * 99 / 100] / 1000.0 : 0.0, bulk_jobs,
+           secs ? (double)bulk_jobs * bulk_bytes / secs / 1e6 : 0.0);
+    failed |= errors != 0;
+  }
+  free(lat);
+  return failed;
+}
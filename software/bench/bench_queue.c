@@ -0,0 +1,125 @@
+/*
+ * Multi-threaded stress test and benchmark for the request queue.
+ *
+ * Each client thread opens its own handle on one simulated device (as each
+ * process would open /dev/aes) and submits jobs of 1..16 blocks, drawing its
+ * key from a small shared set so that key batching has something to do.
+ * Every result is checked against the reference AES. Reports wall-clock
+ * throughput of the queue and the modelled device throughput.
+ *
+ * usage: bench_queue [total_jobs]
+ */
+#define _DEFAULT_SOURCE
+#include "aes_lib.h"
+#include "aes_ref.h"
+#include "aes_sim.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_KEYS 4
+#define MAX_JOB_BLOCKS 16
+
+static uint8_t keys[NUM_KEYS][32];
+static struct aes_ref_key ref_keys[NUM_KEYS];
+
+struct client_arg {
+  struct aes_sim *sim;
+  int id;
+  int jobs;
+  int errors;
+  uint64_t bytes;
+};
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *client(void *p) {
+  struct client_arg *arg = p;
+  struct aes_dev *dev = aes_open_sim(arg->sim);
+  uint8_t in[MAX_JOB_BLOCKS * AES_BLOCK_LEN], out[sizeof(in)], ref[16];
+  unsigned int seed = 0x9e3779b9u * (arg->id + 1);
+
+  if (!dev) {
+    arg->errors = arg->jobs;
+    return NULL;
+  }
+  for (int n = 0; n < arg->jobs; n++) {
+    /* Clients move through the key set in runs, like sessions */
+    int k = (arg->id + n / 8) % NUM_KEYS;
+    int len = AES_BLOCK_LEN * (1 + rand_r(&seed) % MAX_JOB_BLOCKS);
+
+    for (int i = 0; i < len; i++)
+      in[i] = (uint8_t)rand_r(&seed);
+    if (aes_encrypt(dev, AES_KEY_CHOICE_256, keys[k], 32, in, out, len) !=
+        AES_SUCCESS) {
+      arg->errors++;
+      continue;
+    }
+    for (int i = 0; i < len; i += AES_BLOCK_LEN) {
+      aes_ref_encrypt_block(&ref_keys[k], in + i, ref);
+      if (memcmp(ref, out + i, AES_BLOCK_LEN)) {
+        arg->errors++;
+        break;
+      }
+    }
+    arg->bytes += len;
+  }
+  aes_close(dev);
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  static const int thread_counts[] = {1, 2, 4, 8, 16, 32, 64};
+  int total_jobs = argc > 1 ? atoi(argv[1]) : 16384;
+  int failed = 0;
+
+  for (int k = 0; k < NUM_KEYS; k++) {
+    for (int i = 0; i < 32; i++)
+      keys[k][i] = (uint8_t)(k * 32 + i);
+    aes_ref_set_key(&ref_keys[k], keys[k], 32);
+  }
+
+  printf("%-8s %-8s %-7s %-12s %-12s %-14s %-10s\n", "threads", "jobs",
+         "errors", "wall_MB/s", "wall_kjob/s", "modeled_MB/s", "key_loads");
+  for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]);
+       t++) {
+    int nthreads = thread_counts[t];
+    struct aes_sim *sim = aes_sim_create();
+    pthread_t tids[64];
+    struct client_arg args[64];
+    struct aes_sim_stats st;
+    uint64_t bytes = 0;
+    int errors = 0, jobs = 0;
+    double t0, wall;
+
+    t0 = now_sec();
+    for (int i = 0; i < nthreads; i++) {
+      args[i] = (struct client_arg){
+          .sim = sim, .id = i, .jobs = total_jobs / nthreads};
+      pthread_create(&tids[i], NULL, client, &args[i]);
+    }
+    for (int i = 0; i < nthreads; i++) {
+      pthread_join(tids[i], NULL);
+      errors += args[i].errors;
+      bytes += args[i].bytes;
+      jobs += args[i].jobs;
+    }
+    wall = now_sec() - t0;
+    aes_sim_get_stats(sim, &st);
+    aes_sim_destroy(sim);
+
+    printf("%-8d %-8d %-7d %-12.2f %-12.1f %-14.2f %-10llu\n", nthreads, jobs,
+           errors, bytes / wall / 1e6, jobs / wall / 1e3,
+           st.modeled_ns ? bytes * 1e3 / st.modeled_ns : 0.0,
+           (unsigned long long)st.key_loads);
+    failed |= errors != 0;
+  }
+  return failed;
+}
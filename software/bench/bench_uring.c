@@ -0,0 +1,100 @@
+/*
+ * Submission and completion queues against one system call per job.
+ *
+ * One client encrypts small ECB messages back to back on a simulated
+ * device, either with aes_encrypt(), one AES_IOC_CRYPT per message, or by
+ * queuing a batch with aes_submit() and collecting it with one aes_reap().
+ * Every result is checked against the reference AES. Reports modelled
+ * messages per second, system calls per message and the share of the
+ * modelled time the driver kept a CPU busy.
+ *
+ * usage: bench_uring [messages_per_run]
+ */
+#include "aes_lib.h"
+#include "aes_ref.h"
+#include "aes_sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_BATCH 256
+#define MAX_MSG 256
+
+static uint8_t in[MAX_BATCH][MAX_MSG], out[MAX_BATCH][MAX_MSG];
+
+int main(int argc, char **argv) {
+  static const int msg_sizes[] = {16, 64, 256};
+  static const int batches[] = {0, 1, 8, 64, 256}; // 0: aes_encrypt()
+  int total = argc > 1 ? atoi(argv[1]) : 8192;
+  struct aes_uring_cqe cqes[MAX_BATCH];
+  struct aes_ref_key ref_key;
+  uint8_t key[32], ref[AES_BLOCK_LEN];
+  int failed = 0;
+
+  for (int i = 0; i < 32; i++)
+    key[i] = (uint8_t)i;
+  aes_ref_set_key(&ref_key, key, 32);
+  for (int i = 0; i < MAX_BATCH; i++)
+    for (int j = 0; j < MAX_MSG; j++)
+      in[i][j] = (uint8_t)(i * 31 + j);
+
+  printf("%-6s %-7s %-9s %-7s %-12s %-11s %-7s\n", "bytes", "batch", "msgs",
+         "errors", "modeled_M/s", "calls/msg", "cpu_%");
+  for (size_t m = 0; m < sizeof(msg_sizes) / sizeof(msg_sizes[0]); m++) {
+    for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+      int len = msg_sizes[m], batch = batches[b], errors = 0, msgs = 0;
+      struct aes_sim *sim = aes_sim_create();
+      struct aes_dev *dev = aes_open_sim(sim);
+      struct aes_sim_stats st;
+      struct aes_job job;
+      char label[8] = "sync";
+      double secs;
+
+      if (batch)
+        snprintf(label, sizeof(label), "%d", batch);
+      if (!dev || (batch && aes_queue_init(dev, batch) != AES_SUCCESS)) {
+        fprintf(stderr, "ERROR: Unable to open the simulated device\n");
+        return 1;
+      }
+      while (msgs < total) {
+        int n = batch ? batch : 1;
+
+        for (int i = 0; i < n; i++) {
+          aes_job_init(&job, AES_KEY_CHOICE_256, key, 32, in[i], out[i], len);
+          if ((batch ? aes_submit(dev, &job, i) : aes_submit_job(dev, &job)) !=
+              AES_SUCCESS)
+            errors++;
+        }
+        if (batch) {
+          int got = aes_reap(dev, cqes, n, n);
+
+          for (int i = 0; i < got; i++)
+            errors += cqes[i].res != 0;
+          errors += got < n ? n - got : 0;
+        }
+        for (int i = 0; i < n; i++) {
+          for (int j = 0; j < len; j += AES_BLOCK_LEN) {
+            aes_ref_encrypt_block(&ref_key, in[i] + j, ref);
+            if (memcmp(ref, out[i] + j, AES_BLOCK_LEN)) {
+              errors++;
+              break;
+            }
+          }
+        }
+        msgs += n;
+      }
+      aes_sim_get_stats(sim, &st);
+      aes_close(dev);
+      aes_sim_destroy(sim);
+
+      secs = st.modeled_ns * 1e-9;
+      printf("%-6d %-7s %-9d %-7d %-12.3f %-11.4f %-7.1f\n", len,
+             label, msgs, errors,
+             secs ? msgs / secs / 1e6 : 0.0, (double)st.syscalls / msgs,
+             st.modeled_ns ? 100.0 * st.cpu_ns / st.modeled_ns : 0.0);
+      failed |= errors != 0;
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,154 @@
+/*
+ * Sector throughput of XTS on the simulated device, in the style of fio
+ * against an aes-xts-plain64 volume.
+ *
+ * Client threads (numjobs) issue I/Os of io_size bytes at sequential or
+ * random sector offsets of a 1 GiB volume; a write encrypts the I/O and a
+ * read decrypts it. Each I/O is one job whose data units are the volume's
+ * sectors, with the plain64 tweak of the first sector. Every result is
+ * checked against the reference XTS. Reports modelled IOPS and throughput
+ * and the key loads and key slot hits the tweak key switches cost.
+ *
+ * usage: bench_xts [ios_per_run]
+ */
+#define _DEFAULT_SOURCE
+#include "aes_lib.h"
+#include "aes_ref.h"
+#include "aes_sim.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_THREADS 4
+#define VOLUME_BYTES (1ull << 30)
+#define MAX_IO 4096
+
+static uint8_t key[32], key2[32];
+static struct aes_ref_key ref_key, ref_key2;
+
+struct run {
+  const char *name;
+  int random;
+  int write;
+  unsigned int sector;
+  unsigned int io_size;
+};
+
+struct client_arg {
+  struct aes_sim *sim;
+  const struct run *run;
+  int id;
+  int ios;
+  int errors;
+};
+
+static void plain64(uint8_t iv[16], uint64_t sector) {
+  memset(iv, 0, 16);
+  for (int i = 0; i < 8; i++)
+    iv[i] = (uint8_t)(sector >> (8 * i));
+}
+
+static void *client(void *p) {
+  struct client_arg *arg = p;
+  const struct run *run = arg->run;
+  struct aes_dev *dev = aes_open_sim(arg->sim);
+  uint64_t sectors = VOLUME_BYTES / run->sector;
+  uint64_t per_io = run->io_size / run->sector;
+  uint64_t next = (uint64_t)arg->id * arg->ios * per_io;
+  uint8_t in[MAX_IO], out[MAX_IO], ref[MAX_IO], iv[16];
+  unsigned int seed = 0x9e3779b9u * (arg->id + 1);
+  struct aes_job job;
+
+  if (!dev) {
+    arg->errors = arg->ios;
+    return NULL;
+  }
+  for (int n = 0; n < arg->ios; n++) {
+    uint64_t sector;
+
+    if (run->random) {
+      sector = ((uint64_t)rand_r(&seed) << 16 ^ rand_r(&seed)) %
+               (sectors / per_io) * per_io;
+    } else {
+      sector = next % sectors;
+      next += per_io;
+    }
+    for (unsigned int i = 0; i < run->io_size; i++)
+      in[i] = (uint8_t)rand_r(&seed);
+
+    plain64(iv, sector);
+    if (aes_job_init(&job, AES_KEY_CHOICE_256, key, 32, in, out,
+                     run->io_size) != AES_SUCCESS ||
+        aes_job_set_xts(&job, key2, iv, run->sector, !run->write) !=
+            AES_SUCCESS ||
+        aes_submit_job(dev, &job) != AES_SUCCESS) {
+      arg->errors++;
+      continue;
+    }
+    for (uint64_t s = 0; s < per_io; s++) {
+      plain64(iv, sector + s);
+      aes_ref_xts(&ref_key, &ref_key2, iv, in + s * run->sector,
+                  ref + s * run->sector, run->sector, !run->write);
+    }
+    if (memcmp(ref, out, run->io_size))
+      arg->errors++;
+  }
+  aes_close(dev);
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  static const struct run runs[] = {
+      {"seqwrite", 0, 1, 512, 512},    {"seqread", 0, 0, 512, 512},
+      {"randwrite", 1, 1, 512, 512},   {"randread", 1, 0, 512, 512},
+      {"seqwrite", 0, 1, 512, 4096},   {"seqread", 0, 0, 512, 4096},
+      {"randwrite", 1, 1, 512, 4096},  {"randread", 1, 0, 512, 4096},
+      {"seqwrite", 0, 1, 4096, 4096},  {"seqread", 0, 0, 4096, 4096},
+      {"randwrite", 1, 1, 4096, 4096}, {"randread", 1, 0, 4096, 4096},
+  };
+  int ios = argc > 1 ? atoi(argv[1]) : 1024;
+  int failed = 0;
+
+  for (int i = 0; i < 32; i++) {
+    key[i] = (uint8_t)i;
+    key2[i] = (uint8_t)(0xa5 ^ i);
+  }
+  aes_ref_set_key(&ref_key, key, 32);
+  aes_ref_set_key(&ref_key2, key2, 32);
+
+  printf("%-10s %-7s %-7s %-7s %-7s %-12s %-14s %-10s %-10s\n", "rw",
+         "sector", "bs", "ios", "errors", "modeled_iops", "modeled_MB/s",
+         "key_loads", "slot_hits");
+  for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); r++) {
+    struct aes_sim *sim = aes_sim_create();
+    pthread_t tids[NUM_THREADS];
+    struct client_arg args[NUM_THREADS];
+    struct aes_sim_stats st;
+    int errors = 0, done = 0;
+
+    for (int i = 0; i < NUM_THREADS; i++) {
+      args[i] = (struct client_arg){
+          .sim = sim, .run = &runs[r], .id = i, .ios = ios / NUM_THREADS};
+      pthread_create(&tids[i], NULL, client, &args[i]);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+      pthread_join(tids[i], NULL);
+      errors += args[i].errors;
+      done += args[i].ios;
+    }
+    aes_sim_get_stats(sim, &st);
+    aes_sim_destroy(sim);
+
+    printf("%-10s %-7u %-7u %-7d %-7d %-12.0f %-14.2f %-10llu %-10llu\n",
+           runs[r].name, runs[r].sector, runs[r].io_size, done, errors,
+           st.modeled_ns ? done * 1e9 / st.modeled_ns : 0.0,
+           st.modeled_ns ? (double)done * runs[r].io_size * 1e3 / st.modeled_ns
+                         : 0.0,
+           (unsigned long long)st.key_loads,
+           (unsigned long long)st.key_slot_hits);
+    failed |= errors != 0;
+  }
+  return failed;
+}
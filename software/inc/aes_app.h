@@ -9,6 +9,9 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "aes_lib.h"
+#include "aes_soft.h"
+
 /* This path is based on the `compatible` string in your driver. */
 #define SYSFS_PATH_TEMPLATE "/sys/bus/platform/devices/*.AES_v1.0"
 
@@ -20,10 +23,6 @@
 
 #define NUM_KEY_REG 8
 
-/* success/failure macros */
-#define AES_SUCCESS 0
-#define AES_FAILURE 1
-
 /* Function Prototypes */
 void print_hex(const char *label, const uint8_t *data, int len);
 int get_key_len_from_choice(int key_choice, int *out_key_len);
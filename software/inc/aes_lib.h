@@ -0,0 +1,92 @@
+#ifndef AES_LIB_H
+#define AES_LIB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aes_ioctl.h"
+
+/* Character device created by the driver for whole-job requests; it spreads
+ * jobs across all instances. Each instance also has its own /dev/aes<id>. */
+#define AES_CHARDEV_PATH "/dev/aes"
+#define AES_CHARDEV_GLOB "/dev/aes[0-9]*"
+
+/* Most instances a user-space pool will drive */
+#define AES_POOL_MAX 16
+
+/* aes_buf_alloc() carves buffers from an arena of this many bytes per
+ * handle: the driver's DMA buffer pool, which ECB and CTR jobs on the ring
+ * run from without pinning or copying, or else hugepages. Larger buffers,
+ * and any once the arena is used up, come from the heap. */
+#define AES_BUF_ARENA_SIZE (16 * 1024 * 1024)
+
+/* success/failure macros */
+#define AES_SUCCESS 0
+#define AES_FAILURE 1
+
+struct aes_sim;
+
+/* A handle on the device: an open file on the character device, a client of
+ * a simulated device, or the CPU, which runs only ECB and CTR jobs. A handle
+ * may be shared between threads, but its jobs queue behind each other;
+ * threads that want a fair share of the device open a handle each. */
+struct aes_dev;
+
+/* A set of device handles, one per instance, that jobs are distributed over:
+ * least-loaded first, but a key stays on the instance it was last sent to
+ * while that instance is not much busier. Safe to share between threads. */
+struct aes_pool;
+
+/* Function Prototypes */
+struct aes_dev *aes_open(const char *path);
+struct aes_dev *aes_open_sim(struct aes_sim *sim);
+struct aes_dev *aes_open_cpu(void);
+void aes_close(struct aes_dev *dev);
+int aes_job_init(struct aes_job *job, int key_choice, const uint8_t *key,
+                 int key_len, const uint8_t *in, uint8_t *out, size_t len);
+void aes_job_set_ctr(struct aes_job *job, const uint8_t iv[16]);
+int aes_job_set_gcm(struct aes_job *job, const uint8_t iv[AES_GCM_IV_LEN],
+                    const uint8_t *aad, size_t aad_len, uint8_t *tag,
+                    int decrypt);
+int aes_job_set_xts(struct aes_job *job, const uint8_t *key2,
+                    const uint8_t iv[16], size_t data_unit, int decrypt);
+void aes_job_set_cmac(struct aes_job *job, const uint8_t *chain, uint8_t *tag,
+                      int more);
+int aes_submit_job(struct aes_dev *dev, const struct aes_job *job);
+int aes_queue_init(struct aes_dev *dev, unsigned int entries);
+int aes_submit(struct aes_dev *dev, const struct aes_job *job,
+               uint64_t user_data);
+int aes_reap(struct aes_dev *dev, struct aes_uring_cqe *cqes, int max,
+             int min_complete);
+int aes_fd(const struct aes_dev *dev);
+int aes_key_init(struct aes_key *entry, int key_choice, const uint8_t *key,
+                 int key_len);
+int aes_batch(struct aes_dev *dev, const struct aes_key *keys, int nkeys,
+              struct aes_msg *msgs, int count);
+int aes_set_prio(struct aes_dev *dev, uint32_t prio, uint32_t deadline_us);
+void *aes_buf_alloc(struct aes_dev *dev, size_t len);
+void aes_buf_free(struct aes_dev *dev, void *buf);
+int aes_encrypt(struct aes_dev *dev, int key_choice, const uint8_t *key,
+                int key_len, const uint8_t *in, uint8_t *out, size_t len);
+int aes_decrypt(struct aes_dev *dev, int key_choice, const uint8_t *key,
+                int key_len, const uint8_t *in, uint8_t *out, size_t len);
+int aes_cmac(struct aes_dev *dev, int key_choice, const uint8_t *key,
+             int key_len, const uint8_t *in, size_t len, uint8_t *tag);
+int aes_gcm_encrypt(struct aes_dev *dev, int key_choice, const uint8_t *key,
+                    int key_len, const uint8_t *iv, const uint8_t *aad,
+                    size_t aad_len, const uint8_t *in, uint8_t *out,
+                    size_t len, uint8_t *tag);
+int aes_gcm_decrypt(struct aes_dev *dev, int key_choice, const uint8_t *key,
+                    int key_len, const uint8_t *iv, const uint8_t *aad,
+                    size_t aad_len, const uint8_t *in, uint8_t *out,
+                    size_t len, const uint8_t *tag);
+struct aes_pool *aes_pool_open(void);
+struct aes_pool *aes_pool_open_sim(struct aes_sim **sims, int n);
+void aes_pool_close(struct aes_pool *pool);
+int aes_pool_size(const struct aes_pool *pool);
+int aes_pool_submit_job(struct aes_pool *pool, const struct aes_job *job);
+int aes_pool_encrypt(struct aes_pool *pool, int key_choice, const uint8_t *key,
+                     int key_len, const uint8_t *in, uint8_t *out,
+                     size_t len);
+
+#endif // AES_LIB_H
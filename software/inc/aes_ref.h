@@ -0,0 +1,36 @@
+#ifndef AES_REF_H
+#define AES_REF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Plain table-based AES (FIPS-197) used as the reference for the simulated
+ * device and for checking results. Not constant time. */
+
+#define AES_REF_MAX_ROUNDS 14
+
+struct aes_ref_key {
+  int rounds;
+  uint8_t rk[16 * (AES_REF_MAX_ROUNDS + 1)]; // expanded round keys
+};
+
+/* Function Prototypes */
+int aes_ref_set_key(struct aes_ref_key *k, const uint8_t *key, int key_len);
+void aes_ref_encrypt_block(const struct aes_ref_key *k, const uint8_t in[16],
+                           uint8_t out[16]);
+void aes_ref_decrypt_block(const struct aes_ref_key *k, const uint8_t in[16],
+                           uint8_t out[16]);
+void aes_ref_gf128_mul(const uint8_t x[16], const uint8_t h[16],
+                       uint8_t out[16]);
+void aes_ref_ctr(const struct aes_ref_key *k, const uint8_t iv[16],
+                 const uint8_t *in, uint8_t *out, size_t len);
+void aes_ref_gcm(const struct aes_ref_key *k, const uint8_t iv[12],
+                 const uint8_t *aad, size_t aad_len, const uint8_t *in,
+                 uint8_t *out, size_t len, int decrypt, uint8_t tag[16]);
+void aes_ref_cmac(const struct aes_ref_key *k, const uint8_t *in, size_t len,
+                  uint8_t tag[16]);
+void aes_ref_xts(const struct aes_ref_key *k1, const struct aes_ref_key *k2,
+                 const uint8_t iv[16], const uint8_t *in, uint8_t *out,
+                 size_t len, int decrypt);
+
+#endif // AES_REF_H
@@ -0,0 +1,130 @@
+#ifndef AES_SIM_H
+#define AES_SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aes_ioctl.h"
+
+/*
+ * Simulated AES device: a register-level model of the AES IP together with
+ * the driver's request queue, so the user library, tests and benchmarks can
+ * run without hardware. Each client corresponds to one open file handle on
+ * the character device and aes_sim_submit() behaves like AES_IOC_CRYPT;
+ * aes_sim_uring_setup() and aes_sim_uring_enter() stand in for the
+ * submission and completion queues, aes_sim_batch() for AES_IOC_BATCH and
+ * aes_sim_set_prio() for AES_IOC_SET_PRIO and aes_sim_buf_setup() for the
+ * buffer pool.
+ *
+ * Device time is modelled rather than measured: every register access and
+ * core cycle advances a per-device clock by the costs below.
+ */
+
+/* Cost model: AXI-Lite through a Zynq GP port and the 100 MHz core */
+#define AES_SIM_CLK_NS 10
+#define AES_SIM_AXI_WRITE_NS 40
+#define AES_SIM_AXI_READ_NS 120
+/* The AXI4 burst slave (AES_burst.v): a burst to a data window is one GP
+ * port transaction, after which the front end writes a register a clock and
+ * reads one every four */
+#define AES_SIM_BURST_WRITE_NS_PER_WORD 10
+#define AES_SIM_BURST_READ_NS_PER_WORD 40
+/* The ring engine's AXI4 master through a Zynq HP port: first beat of a read
+ * burst, and last beat of a write to its response */
+#define AES_SIM_DMA_READ_NS 150
+#define AES_SIM_DMA_WRITE_NS 80
+/* A completion interrupt: entry, the handler and waking the queue worker,
+ * all of it CPU time. While the worker sleeps on the interrupt the CPU is
+ * free; while it polls, or moves data through the registers, it is not. */
+#define AES_SIM_IRQ_NS 3000
+/* The driver's own data movement, CPU time too: copying a request into the
+ * bounce buffer and the result back out, or pinning and mapping the user's
+ * pages for zero copy, per buffer and per page */
+#define AES_SIM_COPY_NS_PER_KB 1000
+/* Entering and leaving the kernel for an ioctl(), CPU time as well */
+#define AES_SIM_SYSCALL_NS 1000
+#define AES_SIM_PIN_NS 1000
+#define AES_SIM_PIN_NS_PER_PAGE 250
+
+#define AES_SIM_MAX_CLIENTS 256
+
+/* Synthesis parameters of the modelled gateware */
+#define AES_SIM_KEY_SLOTS_DEFAULT 32 // C_NUM_KEY_SLOTS in AES.v
+#define AES_SIM_KEY_SLOTS_MAX 64
+
+struct aes_sim_config {
+  int key_slots;   // 0 models gateware without a key table
+  int no_doorbell; // models gateware without doorbell mode (ENABLE_AUTO)
+  int no_banks;    // models gateware without data banks (ENABLE_BANKS)
+  int no_ring;     // models gateware without the descriptor ring
+  int no_irq;      // models gateware without the completion interrupt: the
+                   // ring is always polled
+  /* Driver tunables, as in sysfs; 0 selects the driver's default */
+  unsigned int irq_coalesce_count; // ring completions per interrupt
+  unsigned int irq_coalesce_usecs; // longest wait after the first of them
+  unsigned int irq_poll_threshold; // batches of this many jobs poll HEAD
+  unsigned int zero_copy_min;      // requests of this many bytes or more run
+                                   // from the caller's buffers; UINT_MAX
+                                   // copies all
+  unsigned int chunk_size;         // bytes a long job runs before the queue
+                                   // is looked at again; UINT_MAX runs
+                                   // whole jobs
+  int sched_edf;                   // earliest deadline first
+  unsigned int core_cycles; // cycles per cipher pass; 0 models the unrolled
+                            // core's single cycle
+  unsigned int burst_width; // beat of the AXI4 burst slave with the data
+                            // windows, 64 or 128; 0 models AXI4-Lite
+  unsigned int ks_depth;    // blocks in the CTR keystream buffer
+                            // (C_KS_DEPTH), enabled as the driver leaves
+                            // it; 0 models gateware without
+};
+
+struct aes_sim;
+struct aes_sim_client;
+
+struct aes_sim_stats {
+  uint64_t jobs;
+  uint64_t blocks;        // data and additional data blocks
+  uint64_t key_loads;     // keys written to the key registers
+  uint64_t key_slot_hits; // key switches served from a key slot
+  uint64_t reg_writes;           // AXI write beats
+  uint64_t reg_reads;            // AXI read beats
+  uint64_t busy_cycles;          // core cycles in BUSY
+  uint64_t ks_hits;              // CTR blocks served from precomputed
+                                 // keystream
+  uint64_t finished_wait_cycles; // core cycles in FINISHED
+  uint64_t modeled_ns;           // device time consumed so far
+  uint64_t irqs;                 // completion interrupts taken
+  uint64_t cpu_ns;               // of modeled_ns, time the driver kept a CPU
+                                 // busy
+  uint64_t bytes_copied;         // to and from bounce buffers
+  uint64_t zero_copy_jobs;       // jobs run from the caller's buffers
+  uint64_t pool_jobs;            // of them, jobs run from a buffer pool
+  uint64_t chunks;               // chunks of long jobs run before their last
+  uint64_t syscalls;             // AES_IOC_CRYPT, AES_IOC_URING_ENTER and
+                                 // AES_IOC_BATCH equivalents, as of the
+                                 // call
+};
+
+/* Function Prototypes */
+struct aes_sim *aes_sim_create(void);
+struct aes_sim *aes_sim_create_config(const struct aes_sim_config *config);
+void aes_sim_destroy(struct aes_sim *sim);
+struct aes_sim_client *aes_sim_open(struct aes_sim *sim);
+void aes_sim_release(struct aes_sim_client *client);
+int aes_sim_submit(struct aes_sim_client *client, const struct aes_job *job);
+int aes_sim_uring_setup(struct aes_sim_client *client,
+                        struct aes_uring_params *params, void **mem);
+int aes_sim_uring_enter(struct aes_sim_client *client,
+                        const struct aes_uring_enter *enter);
+int aes_sim_buf_setup(struct aes_sim_client *client, size_t size,
+                      void **mem);
+int aes_sim_batch(struct aes_sim_client *client, const struct aes_batch *batch);
+void aes_sim_get_stats(struct aes_sim *sim, struct aes_sim_stats *stats);
+void aes_sim_idle(struct aes_sim *sim, uint64_t ns);
+int aes_sim_set_prio(struct aes_sim_client *client, uint32_t prio,
+                     uint32_t deadline_us);
+size_t aes_sim_get_latencies(struct aes_sim_client *client, uint64_t *ns,
+                             size_t max);
+
+#endif // AES_SIM_H
@@ -0,0 +1,33 @@
+#ifndef AES_SOFT_H
+#define AES_SOFT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Constant-time bitsliced AES (FIPS-197) on the CPU: no table lookups and
+ * no branches on the key or the data. Blocks go through a kernel several at
+ * a time, 4 to 16 by vector width, chosen at run time: AVX2 or SSE2 on x86,
+ * NEON on ARM, else plain 64-bit words. The CPU fallback of the library,
+ * and a golden model fast enough to check long runs of the device or RTL;
+ * aes_ref.h stays the readable one. */
+
+#define AES_SOFT_MAX_ROUNDS 14
+#define AES_SOFT_MAX_BLOCKS 16 // blocks per kernel call, of any kernel
+
+struct aes_soft_key {
+  int rounds;
+  uint64_t sk[8 * (AES_SOFT_MAX_ROUNDS + 1)]; // bitsliced round keys
+};
+
+/* Function Prototypes */
+int aes_soft_set_key(struct aes_soft_key *k, const uint8_t *key, int key_len);
+void aes_soft_encrypt(const struct aes_soft_key *k, const uint8_t *in,
+                      uint8_t *out, size_t blocks);
+void aes_soft_decrypt(const struct aes_soft_key *k, const uint8_t *in,
+                      uint8_t *out, size_t blocks);
+void aes_soft_ctr(const struct aes_soft_key *k, const uint8_t iv[16],
+                  const uint8_t *in, uint8_t *out, size_t len);
+const char *aes_soft_impl(void);
+int aes_soft_set_impl(const char *name);
+
+#endif // AES_SOFT_H
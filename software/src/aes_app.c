@@ -12,10 +12,14 @@ int find_sysfs_path(void) {
   glob_t glob_result;
   if (glob(SYSFS_PATH_TEMPLATE, 0, NULL, &glob_result) == 0 &&
       glob_result.gl_pathc > 0) {
+    /* Every instance is listed; the register-level fallback drives the first
+     * one, while jobs through /dev/aes are spread across all of them */
+    for (size_t i = 0; i < glob_result.gl_pathc; i++)
+      printf("INFO: Found AES device %zu at: %s\n", i,
+             glob_result.gl_pathv[i]);
     strncpy(sysfs_device_path, glob_result.gl_pathv[0],
             sizeof(sysfs_device_path) - 1);
     globfree(&glob_result);
-    printf("INFO: Found AES device at: %s\n", sysfs_device_path);
     return AES_SUCCESS;
   }
   fprintf(stderr, "Unable to find AES device sysfs path matching '%s'.\n",
@@ -107,6 +111,36 @@ int start_encryption(int key_choice, const uint8_t *key, int key_len,
                      const uint8_t *plaintext, int data_len) {
   uint8_t final_ciphertext[MAX_DATA_LEN] = {0};
   int num_blocks = data_len / BLOCK_SIZE;
+  const char *target = AES_CHARDEV_PATH;
+  struct aes_dev *dev;
+
+  /* Prefer the character device: the driver runs the whole request as one
+   * job, so concurrent clients cannot interleave their register writes.
+   * Without any device, encrypt on the CPU. */
+  dev = aes_open(AES_CHARDEV_PATH);
+  if (!dev && !sysfs_device_path[0]) {
+    dev = aes_open_cpu();
+    target = "the CPU";
+  }
+  if (dev) {
+    int ret;
+
+    if (data_len <= 0 || data_len > MAX_DATA_LEN) {
+      fprintf(stderr, "ERROR: Invalid data length %d\n", data_len);
+      aes_close(dev);
+      return AES_FAILURE;
+    }
+    printf("[start_encryption] Submitting %d block(s) to %s\n", num_blocks,
+           target);
+    ret = aes_encrypt(dev, key_choice, key, key_len, plaintext,
+                      final_ciphertext, data_len);
+    aes_close(dev);
+    if (ret != AES_SUCCESS)
+      return AES_FAILURE;
+    printf("\n[start_encryption] Encryption Completed Successfully\n");
+    print_hex("Final Ciphertext:", final_ciphertext, data_len);
+    return AES_SUCCESS;
+  }
 
   /* Reset all key registers to zero and then load the new key */
   printf("[start_encryption] Resetting key registers and loading new key...\n");
@@ -217,9 +251,9 @@ void print_hex(const char *label, const uint8_t *data, int len) {
 }
 
 int main(void) {
-  if (find_sysfs_path() != AES_SUCCESS) {
-    return EXIT_FAILURE;
-  }
+  if (find_sysfs_path() != AES_SUCCESS)
+    printf("INFO: No AES device, encrypting on the CPU (%s)\n",
+           aes_soft_impl());
   int key_choice, key_len, data_len;
   uint8_t key[32] = {0};
   uint8_t plaintext[MAX_DATA_LEN] = {0};
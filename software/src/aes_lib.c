@@ -0,0 +1,1038 @@
+#define _DEFAULT_SOURCE
+#include "aes_lib.h"
+#include "aes_sim.h"
+#include "aes_soft.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+struct aes_dev {
+  int fd;                      // character device, or -1
+  struct aes_sim_client *sim;  // simulated device client, or NULL
+  int cpu;                     // jobs run on the CPU, through aes_soft
+  /* Submission and completion queues, after aes_queue_init() */
+  void *map;
+  size_t map_len; // 0 when the simulated device owns the memory
+  uint32_t entries;
+  struct aes_uring_hdr *hdr;
+  struct aes_uring_sqe *sqes;
+  struct aes_uring_cqe *cqes;
+  struct aes_buf_arena *bufs; // after the first aes_buf_alloc()
+  int bufs_failed;            // no arena could be set up, under aes_buf_lock
+};
+
+/* Buffer arena: blocks of power-of-two pages up to the whole arena */
+#define AES_BUF_PAGE 4096
+#define AES_BUF_CLASSES 13 // AES_BUF_PAGE << 12 == AES_BUF_ARENA_SIZE
+
+/* Freed blocks go on a lock-free list per size class and are handed out
+ * again before the arena is carved any further */
+struct aes_buf_arena {
+  uint8_t *base;
+  size_t size;
+  size_t map_len; // 0 when the simulated device owns the memory
+  size_t brk;     // bytes carved so far
+  /* Per class, a tag against ABA in the high half and the first free
+   * block's page + 1 in the low one */
+  uint64_t head[AES_BUF_CLASSES];
+  uint32_t *next; // per free block's first page: the next one's page + 1
+  uint8_t *cls;   // per block's first page: its class
+};
+
+static pthread_mutex_t aes_buf_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Key hash buckets remembering the instance a key was last sent to */
+#define AES_POOL_AFFINITY_BUCKETS 64
+/* Extra queued blocks a key's home instance may carry before the key moves */
+#define AES_POOL_AFFINITY_SLACK 32
+/* Idle handles kept per instance for reuse */
+#define AES_POOL_IDLE_MAX 64
+
+/* One instance of a pool. Each job borrows a handle of its own, so that
+ * concurrent jobs queue as separate clients and the driver can batch them
+ * by key instead of running one handle's jobs strictly in order. */
+struct aes_pool_inst {
+  char path[64];          // character device, or empty
+  struct aes_sim *sim;    // simulated device, or NULL
+  unsigned long load;     // blocks submitted and not yet returned
+  int nidle;
+  struct aes_dev *idle[AES_POOL_IDLE_MAX];
+};
+
+struct aes_pool {
+  pthread_mutex_t lock;
+  int n;
+  struct aes_pool_inst inst[AES_POOL_MAX];
+  int affinity[AES_POOL_AFFINITY_BUCKETS];
+};
+
+/**
+ *  @brief: Open the AES character device
+    @param: path
+    @result: Handle, or NULL if the device is not present
+*/
+struct aes_dev *aes_open(const char *path) {
+  struct aes_dev *dev;
+  int fd = open(path, O_RDWR | O_CLOEXEC);
+
+  if (fd < 0)
+    return NULL;
+  dev = calloc(1, sizeof(*dev));
+  if (!dev) {
+    close(fd);
+    return NULL;
+  }
+  dev->fd = fd;
+  return dev;
+}
+
+/**
+ *  @brief: Open a handle on a simulated device
+    @param: sim
+    @result: Handle, or NULL on failure
+*/
+struct aes_dev *aes_open_sim(struct aes_sim *sim) {
+  struct aes_dev *dev = calloc(1, sizeof(*dev));
+
+  if (!dev)
+    return NULL;
+  dev->fd = -1;
+  dev->sim = aes_sim_open(sim);
+  if (!dev->sim) {
+    free(dev);
+    return NULL;
+  }
+  return dev;
+}
+
+/**
+ *  @brief: Open a handle that runs ECB and CTR jobs on the CPU with the
+    constant-time software AES, for hosts without the device
+    @param: None
+    @result: Handle, or NULL on failure
+*/
+struct aes_dev *aes_open_cpu(void) {
+  struct aes_dev *dev = calloc(1, sizeof(*dev));
+
+  if (!dev)
+    return NULL;
+  dev->fd = -1;
+  dev->cpu = 1;
+  return dev;
+}
+
+/**
+ *  @brief: Close a handle
+    @param: dev
+    @result: None
+*/
+void aes_close(struct aes_dev *dev) {
+  if (!dev)
+    return;
+  if (dev->map_len)
+    munmap(dev->map, dev->map_len);
+  if (dev->bufs) {
+    if (dev->bufs->map_len)
+      munmap(dev->bufs->base, dev->bufs->map_len);
+    free(dev->bufs->next);
+    free(dev->bufs->cls);
+    free(dev->bufs);
+  }
+  if (dev->fd >= 0)
+    close(dev->fd);
+  aes_sim_release(dev->sim);
+  free(dev);
+}
+
+/**
+ *  @brief: Fill in an ECB job descriptor, splitting the key into register
+    words. aes_job_set_ctr(), aes_job_set_gcm(), aes_job_set_xts() and
+    aes_job_set_cmac() switch it to another mode.
+    @param: job
+    @param: key_choice
+    @param: key
+    @param: key_len (bytes, must match key_choice)
+    @param: in
+    @param: out
+    @param: len (bytes, multiple of AES_BLOCK_LEN in ECB)
+    @result: Fail or success
+*/
+int aes_job_init(struct aes_job *job, int key_choice, const uint8_t *key,
+                 int key_len, const uint8_t *in, uint8_t *out, size_t len) {
+  if (key_choice < AES_KEY_CHOICE_128 || key_choice > AES_KEY_CHOICE_256 ||
+      key_len != 16 + 8 * key_choice) {
+    fprintf(stderr, "ERROR: Key length %d does not match key choice %d\n",
+            key_len, key_choice);
+    return AES_FAILURE;
+  }
+  if (len > AES_JOB_MAX_LEN) {
+    fprintf(stderr, "ERROR: Invalid job length %zu\n", len);
+    return AES_FAILURE;
+  }
+
+  memset(job, 0, sizeof(*job));
+  job->key_choice = key_choice;
+  job->len = len;
+  memcpy(job->key, key, key_len);
+  job->src = (uintptr_t)in;
+  job->dst = (uintptr_t)out;
+  return AES_SUCCESS;
+}
+
+/**
+ *  @brief: Switch a job to CTR mode
+    @param: job
+    @param: iv (initial counter block, incremented as a 128-bit big-endian
+            number)
+    @result: None
+*/
+void aes_job_set_ctr(struct aes_job *job, const uint8_t iv[16]) {
+  job->mode = AES_MODE_CTR;
+  memcpy(job->iv, iv, sizeof(job->iv));
+}
+
+/**
+ *  @brief: Switch a job to GCM
+    @param: job
+    @param: iv (AES_GCM_IV_LEN bytes)
+    @param: aad
+    @param: aad_len
+    @param: tag (AES_GCM_TAG_LEN bytes, written on encryption and checked
+            on decryption)
+    @param: decrypt
+    @result: Fail or success
+*/
+int aes_job_set_gcm(struct aes_job *job, const uint8_t iv[AES_GCM_IV_LEN],
+                    const uint8_t *aad, size_t aad_len, uint8_t *tag,
+                    int decrypt) {
+  if (aad_len > AES_JOB_MAX_LEN) {
+    fprintf(stderr, "ERROR: Invalid additional data length %zu\n", aad_len);
+    return AES_FAILURE;
+  }
+  job->mode = AES_MODE_GCM;
+  job->flags = decrypt ? AES_JOB_DECRYPT : 0;
+  memset(job->iv, 0, sizeof(job->iv));
+  memcpy(job->iv, iv, AES_GCM_IV_LEN);
+  job->aad = (uintptr_t)aad;
+  job->aad_len = aad_len;
+  job->tag = (uintptr_t)tag;
+  return AES_SUCCESS;
+}
+
+/**
+ *  @brief: Switch a job to XTS
+    @param: job
+    @param: key2 (tweak key, the same length as the data key)
+    @param: iv (tweak of the first data unit, a 128-bit little-endian number
+            such as a plain64 sector number)
+    @param: data_unit (bytes per data unit, a multiple of AES_BLOCK_LEN, or 0
+            for a single unit of the job's length)
+    @param: decrypt
+    @result: Fail or success
+*/
+int aes_job_set_xts(struct aes_job *job, const uint8_t *key2,
+                    const uint8_t iv[16], size_t data_unit, int decrypt) {
+  if (data_unit % AES_BLOCK_LEN || data_unit > AES_JOB_MAX_LEN) {
+    fprintf(stderr, "ERROR: Invalid data unit %zu\n", data_unit);
+    return AES_FAILURE;
+  }
+  job->mode = AES_MODE_XTS;
+  job->flags = decrypt ? AES_JOB_DECRYPT : 0;
+  memset(job->key2, 0, sizeof(job->key2));
+  memcpy(job->key2, key2, 16 + 8 * job->key_choice);
+  memcpy(job->iv, iv, sizeof(job->iv));
+  job->data_unit = data_unit;
+  return AES_SUCCESS;
+}
+
+/**
+ *  @brief: Switch a job to CMAC. The output buffer is not used.
+    @param: job
+    @param: chain (chaining value returned by the previous part of the
+            message, or NULL for a new message)
+    @param: tag (AES_CMAC_TAG_LEN bytes: the MAC, or with `more` the chaining
+            value for the next part)
+    @param: more (the message continues; len must be whole blocks)
+    @result: None
+*/
+void aes_job_set_cmac(struct aes_job *job, const uint8_t *chain, uint8_t *tag,
+                      int more) {
+  job->mode = AES_MODE_CMAC;
+  job->flags = more ? AES_JOB_MORE : 0;
+  memset(job->iv, 0, sizeof(job->iv));
+  if (chain)
+    memcpy(job->iv, chain, sizeof(job->iv));
+  job->dst = 0;
+  job->tag = (uintptr_t)tag;
+}
+
+/* Lengths each mode accepts, as checked by the driver */
+static int aes_job_check(const struct aes_job *job) {
+  switch (job->mode) {
+  case AES_MODE_ECB:
+    if (job->len && !(job->len % AES_BLOCK_LEN))
+      return AES_SUCCESS;
+    break;
+  case AES_MODE_XTS:
+    if (job->len && !(job->len % AES_BLOCK_LEN) &&
+        (!job->data_unit || !(job->len % job->data_unit)))
+      return AES_SUCCESS;
+    break;
+  case AES_MODE_CTR:
+    if (job->len)
+      return AES_SUCCESS;
+    break;
+  case AES_MODE_CMAC:
+    if (!(job->flags & AES_JOB_MORE) || !(job->len % AES_BLOCK_LEN))
+      return AES_SUCCESS;
+    break;
+  default:
+    return AES_SUCCESS;
+  }
+  fprintf(stderr, "ERROR: Invalid job length %u\n", job->len);
+  return AES_FAILURE;
+}
+
+/* A job on a CPU handle: ECB and CTR through aes_soft */
+static int aes_cpu_submit(const struct aes_job *job) {
+  const uint8_t *src = (const uint8_t *)(uintptr_t)job->src;
+  uint8_t *dst = (uint8_t *)(uintptr_t)job->dst;
+  struct aes_soft_key k;
+
+  if ((job->mode != AES_MODE_ECB && job->mode != AES_MODE_CTR) ||
+      (job->mode == AES_MODE_CTR && job->flags))
+    return -EOPNOTSUPP;
+  if (job->key_choice > AES_KEY_CHOICE_256 ||
+      aes_soft_set_key(&k, (const uint8_t *)job->key,
+                       16 + 8 * job->key_choice))
+    return -EINVAL;
+  if (job->mode == AES_MODE_CTR)
+    aes_soft_ctr(&k, job->iv, src, dst, job->len);
+  else if (job->flags & AES_JOB_DECRYPT)
+    aes_soft_decrypt(&k, src, dst, job->len / AES_BLOCK_LEN);
+  else
+    aes_soft_encrypt(&k, src, dst, job->len / AES_BLOCK_LEN);
+  memset(&k, 0, sizeof(k));
+  return 0;
+}
+
+/**
+ *  @brief: Run one job to completion. The driver executes the whole job
+    without interleaving other clients' register accesses.
+    @param: dev
+    @param: job
+    @result: Fail or success
+*/
+int aes_submit_job(struct aes_dev *dev, const struct aes_job *job) {
+  int ret;
+
+  if (aes_job_check(job) != AES_SUCCESS)
+    return AES_FAILURE;
+  if (dev->sim)
+    ret = aes_sim_submit(dev->sim, job);
+  else if (dev->cpu)
+    ret = aes_cpu_submit(job);
+  else
+    ret = ioctl(dev->fd, AES_IOC_CRYPT, job) ? -errno : 0;
+
+  if (ret) {
+    fprintf(stderr, "ERROR: AES job failed: %s\n", strerror(-ret));
+    return AES_FAILURE;
+  }
+  return AES_SUCCESS;
+}
+
+/**
+ *  @brief: Create the handle's submission and completion queues for
+    aes_submit() and aes_reap(). Only per-instance handles have them.
+    @param: dev
+    @param: entries (jobs in flight, a power of two up to
+            AES_URING_MAX_ENTRIES)
+    @result: Fail or success
+*/
+int aes_queue_init(struct aes_dev *dev, unsigned int entries) {
+  struct aes_uring_params params = {.entries = entries};
+  int ret;
+
+  if (dev->map) {
+    fprintf(stderr, "ERROR: Queues already set up\n");
+    return AES_FAILURE;
+  }
+  if (dev->sim) {
+    ret = aes_sim_uring_setup(dev->sim, &params, &dev->map);
+  } else if (dev->cpu) {
+    ret = -EOPNOTSUPP;
+  } else {
+    ret = ioctl(dev->fd, AES_IOC_URING_SETUP, &params) ? -errno : 0;
+    if (!ret) {
+      dev->map = mmap(NULL, params.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      dev->fd, 0);
+      if (dev->map == MAP_FAILED) {
+        dev->map = NULL;
+        ret = -errno;
+      } else {
+        dev->map_len = params.size;
+      }
+    }
+  }
+  if (ret) {
+    fprintf(stderr, "ERROR: Unable to set up queues: %s\n", strerror(-ret));
+    return AES_FAILURE;
+  }
+  dev->entries = params.entries;
+  dev->hdr = dev->map;
+  dev->sqes = (struct aes_uring_sqe *)((char *)dev->map + params.sq_off);
+  dev->cqes = (struct aes_uring_cqe *)((char *)dev->map + params.cq_off);
+  return AES_SUCCESS;
+}
+
+/* Hand published jobs to the driver and wait for min_complete completions,
+ * in one system call */
+static int aes_queue_enter(struct aes_dev *dev, uint32_t to_submit,
+                           uint32_t min_complete) {
+  struct aes_uring_enter enter = {.to_submit = to_submit,
+                                  .min_complete = min_complete};
+  int ret;
+
+  if (dev->sim)
+    ret = aes_sim_uring_enter(dev->sim, &enter);
+  else
+    ret = ioctl(dev->fd, AES_IOC_URING_ENTER, &enter) < 0 ? -errno : 0;
+  if (ret < 0 && ret != -EINTR) {
+    fprintf(stderr, "ERROR: AES queue failed: %s\n", strerror(-ret));
+    return AES_FAILURE;
+  }
+  return AES_SUCCESS;
+}
+
+/**
+ *  @brief: Queue a job without waiting for it. Jobs reach the driver in
+    batches, on the next aes_reap() or when the submission queue fills; the
+    buffers must stay valid until the job is reaped.
+    @param: dev (set up with aes_queue_init())
+    @param: job
+    @param: user_data (returned with the job's completion)
+    @result: Fail or success. Fails while the driver holds as many jobs as
+             the queues have entries: reap some and retry.
+*/
+int aes_submit(struct aes_dev *dev, const struct aes_job *job,
+               uint64_t user_data) {
+  uint32_t tail, head;
+
+  if (!dev->map || aes_job_check(job) != AES_SUCCESS)
+    return AES_FAILURE;
+  tail = dev->hdr->sq_tail;
+  head = __atomic_load_n(&dev->hdr->sq_head, __ATOMIC_ACQUIRE);
+  if (tail - head == dev->entries) {
+    if (aes_queue_enter(dev, tail - head, 0) != AES_SUCCESS)
+      return AES_FAILURE;
+    head = __atomic_load_n(&dev->hdr->sq_head, __ATOMIC_ACQUIRE);
+    if (tail - head == dev->entries)
+      return AES_FAILURE;
+  }
+  dev->sqes[tail % dev->entries].job = *job;
+  dev->sqes[tail % dev->entries].user_data = user_data;
+  __atomic_store_n(&dev->hdr->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  return AES_SUCCESS;
+}
+
+/**
+ *  @brief: Collect completions. Queued jobs are handed to the driver first,
+    and the call waits in the same system call when fewer than min_complete
+    completions are ready. Each completion's res is 0 or a negative errno.
+    @param: dev (set up with aes_queue_init())
+    @param: cqes (output)
+    @param: max (size of cqes)
+    @param: min_complete (completions to wait for; waits no longer once
+            every queued job has completed)
+    @result: Completions returned, or -1 on failure
+*/
+int aes_reap(struct aes_dev *dev, struct aes_uring_cqe *cqes, int max,
+             int min_complete) {
+  uint32_t head, tail, pending;
+  int n = 0;
+
+  if (!dev->map || max < 0 || min_complete < 0)
+    return -1;
+  if ((uint32_t)min_complete > dev->entries)
+    min_complete = dev->entries;
+  head = dev->hdr->cq_head;
+  tail = __atomic_load_n(&dev->hdr->cq_tail, __ATOMIC_ACQUIRE);
+  pending = dev->hdr->sq_tail -
+            __atomic_load_n(&dev->hdr->sq_head, __ATOMIC_ACQUIRE);
+  if (pending || tail - head < (uint32_t)min_complete) {
+    if (aes_queue_enter(dev, pending, min_complete) != AES_SUCCESS)
+      return -1;
+    tail = __atomic_load_n(&dev->hdr->cq_tail, __ATOMIC_ACQUIRE);
+  }
+  for (; n < max && head != tail; n++, head++)
+    cqes[n] = dev->cqes[head % dev->entries];
+  __atomic_store_n(&dev->hdr->cq_head, head, __ATOMIC_RELEASE);
+  return n;
+}
+
+/**
+ *  @brief: File descriptor to poll() for completions: readable when
+    aes_reap() has something to return. -1 for a simulated device.
+    @param: dev
+    @result: File descriptor
+*/
+int aes_fd(const struct aes_dev *dev) { return dev->fd; }
+
+/**
+ *  @brief: Fill in an entry of a batch's key table, splitting the key into
+    register words
+    @param: entry
+    @param: key_choice
+    @param: key
+    @param: key_len (bytes, must match key_choice)
+    @result: Fail or success
+*/
+int aes_key_init(struct aes_key *entry, int key_choice, const uint8_t *key,
+                 int key_len) {
+  if (key_choice < AES_KEY_CHOICE_128 || key_choice > AES_KEY_CHOICE_256 ||
+      key_len != 16 + 8 * key_choice) {
+    fprintf(stderr, "ERROR: Key length %d does not match key choice %d\n",
+            key_len, key_choice);
+    return AES_FAILURE;
+  }
+  memset(entry, 0, sizeof(*entry));
+  entry->key_choice = key_choice;
+  memcpy(entry->key, key, key_len);
+  return AES_SUCCESS;
+}
+
+/**
+ *  @brief: Run a batch of small ECB and CTR messages in one system call.
+    The driver groups the messages by key and runs each group as few jobs
+    as it can. Only per-instance handles take batches.
+    @param: dev
+    @param: keys (the table each message's key indexes)
+    @param: nkeys (up to AES_BATCH_MAX_KEYS)
+    @param: msgs (each message's status is written back)
+    @param: count (up to AES_BATCH_MAX_MSGS, with AES_BATCH_MAX_LEN bytes in
+            all)
+    @result: Fail or success: fails when any message failed
+*/
+int aes_batch(struct aes_dev *dev, const struct aes_key *keys, int nkeys,
+              struct aes_msg *msgs, int count) {
+  struct aes_batch batch = {.keys = (uintptr_t)keys,
+                            .msgs = (uintptr_t)msgs,
+                            .nkeys = nkeys,
+                            .count = count};
+  int ret;
+
+  if (nkeys <= 0 || count <= 0)
+    return AES_FAILURE;
+  if (dev->sim)
+    ret = aes_sim_batch(dev->sim, &batch);
+  else if (dev->cpu)
+    ret = -EOPNOTSUPP;
+  else
+    ret = ioctl(dev->fd, AES_IOC_BATCH, &batch) ? -errno : 0;
+  if (ret) {
+    fprintf(stderr, "ERROR: AES batch failed: %s\n", strerror(-ret));
+    return AES_FAILURE;
+  }
+  for (int i = 0; i < count; i++)
+    if (msgs[i].status)
+      return AES_FAILURE;
+  return AES_SUCCESS;
+}
+
+/**
+ *  @brief: Set the scheduling class of the handle's later jobs. A job can
+    also ask for AES_PRIO_HIGH on its own with AES_JOB_PRIO_HIGH.
+    @param: dev
+    @param: prio (AES_PRIO_HIGH or AES_PRIO_NORMAL)
+    @param: deadline_us (with the driver's sched_edf: each job is due this
+            long after submission; 0 for the class default)
+    @result: Fail or success
+*/
+int aes_set_prio(struct aes_dev *dev, uint32_t prio, uint32_t deadline_us) {
+  struct aes_prio p = {.prio = prio, .deadline_us = deadline_us};
+  int ret;
+
+  if (dev->sim)
+    ret = aes_sim_set_prio(dev->sim, prio, deadline_us);
+  else if (dev->cpu)
+    ret = -EOPNOTSUPP;
+  else
+    ret = ioctl(dev->fd, AES_IOC_SET_PRIO, &p) ? -errno : 0;
+  if (ret) {
+    fprintf(stderr, "ERROR: AES priority failed: %s\n", strerror(-ret));
+    return AES_FAILURE;
+  }
+  return AES_SUCCESS;
+}
+
+/* Map the handle's arena: its DMA buffer pool, or failing that hugepages,
+ * so a buffer pinned for zero copy spans few contiguous stretches of
+ * physical memory and so takes few descriptors and IOTLB entries */
+static struct aes_buf_arena *aes_buf_arena_create(struct aes_dev *dev) {
+  struct aes_buf_params params = {.size = AES_BUF_ARENA_SIZE};
+  size_t pages = AES_BUF_ARENA_SIZE / AES_BUF_PAGE;
+  struct aes_buf_arena *a = calloc(1, sizeof(*a));
+  void *mem = NULL;
+
+  if (!a)
+    return NULL;
+  a->next = calloc(pages, sizeof(*a->next));
+  a->cls = calloc(pages, sizeof(*a->cls));
+  if (!a->next || !a->cls)
+    goto fail;
+  a->size = AES_BUF_ARENA_SIZE;
+
+  if (dev->sim) {
+    if (aes_sim_buf_setup(dev->sim, a->size, &mem))
+      mem = NULL;
+  } else if (!dev->cpu && !ioctl(dev->fd, AES_IOC_BUF_SETUP, &params)) {
+    mem = mmap(NULL, a->size, PROT_READ | PROT_WRITE, MAP_SHARED, dev->fd,
+               AES_BUF_MMAP_OFFSET);
+    if (mem == MAP_FAILED)
+      mem = NULL;
+    else
+      a->map_len = a->size;
+  }
+  if (!mem) {
+    mem = mmap(NULL, a->size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1,
+               0);
+    if (mem == MAP_FAILED) {
+      mem = mmap(NULL, a->size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (mem == MAP_FAILED)
+        goto fail;
+      madvise(mem, a->size, MADV_HUGEPAGE);
+    }
+    a->map_len = a->size;
+  }
+  a->base = mem;
+  return a;
+
+fail:
+  free(a->next);
+  free(a->cls);
+  free(a);
+  return NULL;
+}
+
+/* The handle's arena, set up on first use; NULL to use the heap */
+static struct aes_buf_arena *aes_buf_arena(struct aes_dev *dev) {
+  struct aes_buf_arena *a = __atomic_load_n(&dev->bufs, __ATOMIC_ACQUIRE);
+
+  if (a)
+    return a;
+  pthread_mutex_lock(&aes_buf_lock);
+  a = dev->bufs;
+  if (!a && !dev->bufs_failed) {
+    a = aes_buf_arena_create(dev);
+    dev->bufs_failed = !a;
+    __atomic_store_n(&dev->bufs, a, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&aes_buf_lock);
+  return a;
+}
+
+/* Take a block of class c off its free list */
+static void *aes_buf_pop(struct aes_buf_arena *a, int c) {
+  uint64_t head = __atomic_load_n(&a->head[c], __ATOMIC_ACQUIRE), next;
+  uint32_t page;
+
+  do {
+    page = (uint32_t)head;
+    if (!page)
+      return NULL;
+    next = ((head >> 32) + 1) << 32 |
+           __atomic_load_n(&a->next[page - 1], __ATOMIC_RELAXED);
+  } while (!__atomic_compare_exchange_n(&a->head[c], &head, next, 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+  return a->base + (size_t)(page - 1) * AES_BUF_PAGE;
+}
+
+/* Put the block starting at page back on its class's free list */
+static void aes_buf_push(struct aes_buf_arena *a, uint32_t page) {
+  int c = a->cls[page];
+  uint64_t head = __atomic_load_n(&a->head[c], __ATOMIC_RELAXED), next;
+
+  do {
+    __atomic_store_n(&a->next[page], (uint32_t)head, __ATOMIC_RELAXED);
+    next = ((head >> 32) + 1) << 32 | (page + 1);
+  } while (!__atomic_compare_exchange_n(&a->head[c], &head, next, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* Carve a fresh block of class c from the end of the arena */
+static void *aes_buf_carve(struct aes_buf_arena *a, int c) {
+  size_t len = (size_t)AES_BUF_PAGE << c;
+  size_t brk = __atomic_load_n(&a->brk, __ATOMIC_RELAXED);
+
+  do {
+    if (len > a->size - brk)
+      return NULL;
+  } while (!__atomic_compare_exchange_n(&a->brk, &brk, brk + len, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  a->cls[brk / AES_BUF_PAGE] = (uint8_t)c;
+  return a->base + brk;
+}
+
+/**
+ *  @brief: Allocate a page-aligned buffer for jobs on the handle, from its
+    arena when it fits (see AES_BUF_ARENA_SIZE). An ECB or CTR job with src
+    and dst both in the driver's DMA buffer pool runs on the ring without
+    pinning or copying, at any length. Safe to call from several threads.
+    @param: dev
+    @param: len (bytes)
+    @result: Buffer, or NULL on failure
+*/
+void *aes_buf_alloc(struct aes_dev *dev, size_t len) {
+  struct aes_buf_arena *a = aes_buf_arena(dev);
+  void *buf = NULL;
+  int c = 0;
+
+  if (a && len <= a->size) {
+    while ((size_t)AES_BUF_PAGE << c < len)
+      c++;
+    buf = aes_buf_pop(a, c);
+    if (!buf)
+      buf = aes_buf_carve(a, c);
+  }
+  if (!buf && posix_memalign(&buf, AES_BUF_PAGE, len ? len : 1))
+    buf = NULL;
+  return buf;
+}
+
+/**
+ *  @brief: Free a buffer from aes_buf_alloc() on the same handle, for the
+    next allocation of its size class
+    @param: dev
+    @param: buf (may be NULL)
+    @result: None
+*/
+void aes_buf_free(struct aes_dev *dev, void *buf) {
+  struct aes_buf_arena *a = __atomic_load_n(&dev->bufs, __ATOMIC_ACQUIRE);
+  uintptr_t off = (uintptr_t)buf - (uintptr_t)(a ? a->base : NULL);
+
+  if (a && buf && off < a->size)
+    aes_buf_push(a, off / AES_BUF_PAGE);
+  else
+    free(buf);
+}
+
+/**
+ *  @brief: Encrypt a buffer in one job
+    @param: dev
+    @param: key_choice
+    @param: key
+    @param: key_len
+    @param: in
+    @param: out
+    @param: len
+    @result: Fail or success
+*/
+int aes_encrypt(struct aes_dev *dev, int key_choice, const uint8_t *key,
+                int key_len, const uint8_t *in, uint8_t *out, size_t len) {
+  struct aes_job job;
+
+  if (aes_job_init(&job, key_choice, key, key_len, in, out, len) !=
+      AES_SUCCESS)
+    return AES_FAILURE;
+  return aes_submit_job(dev, &job);
+}
+
+/**
+ *  @brief: Decrypt a buffer in one job with the inverse cipher
+    @param: dev
+    @param: key_choice
+    @param: key
+    @param: key_len
+    @param: in
+    @param: out
+    @param: len
+    @result: Fail or success
+*/
+int aes_decrypt(struct aes_dev *dev, int key_choice, const uint8_t *key,
+                int key_len, const uint8_t *in, uint8_t *out, size_t len) {
+  struct aes_job job;
+
+  if (aes_job_init(&job, key_choice, key, key_len, in, out, len) !=
+      AES_SUCCESS)
+    return AES_FAILURE;
+  job.flags = AES_JOB_DECRYPT;
+  return aes_submit_job(dev, &job);
+}
+
+/**
+ *  @brief: Compute the AES-CMAC of a buffer in one job
+    @param: dev
+    @param: key_choice
+    @param: key
+    @param: key_len
+    @param: in
+    @param: len (bytes, may be zero)
+    @param: tag (AES_CMAC_TAG_LEN bytes, output)
+    @result: Fail or success
+*/
+int aes_cmac(struct aes_dev *dev, int key_choice, const uint8_t *key,
+             int key_len, const uint8_t *in, size_t len, uint8_t *tag) {
+  struct aes_job job;
+
+  if (aes_job_init(&job, key_choice, key, key_len, in, NULL, len) !=
+      AES_SUCCESS)
+    return AES_FAILURE;
+  aes_job_set_cmac(&job, NULL, tag, 0);
+  return aes_submit_job(dev, &job);
+}
+
+/**
+ *  @brief: Encrypt and authenticate a buffer with GCM in one job
+    @param: dev
+    @param: key_choice
+    @param: key
+    @param: key_len
+    @param: iv (AES_GCM_IV_LEN bytes)
+    @param: aad
+    @param: aad_len
+    @param: in
+    @param: out
+    @param: len
+    @param: tag (AES_GCM_TAG_LEN bytes, output)
+    @result: Fail or success
+*/
+int aes_gcm_encrypt(struct aes_dev *dev, int key_choice, const uint8_t *key,
+                    int key_len, const uint8_t *iv, const uint8_t *aad,
+                    size_t aad_len, const uint8_t *in, uint8_t *out,
+                    size_t len, uint8_t *tag) {
+  struct aes_job job;
+
+  if (aes_job_init(&job, key_choice, key, key_len, in, out, len) !=
+          AES_SUCCESS ||
+      aes_job_set_gcm(&job, iv, aad, aad_len, tag, 0) != AES_SUCCESS)
+    return AES_FAILURE;
+  return aes_submit_job(dev, &job);
+}
+
+/**
+ *  @brief: Check and decrypt a buffer with GCM in one job
+    @param: dev
+    @param: key_choice
+    @param: key
+    @param: key_len
+    @param: iv (AES_GCM_IV_LEN bytes)
+    @param: aad
+    @param: aad_len
+    @param: in
+    @param: out (not written if the tag does not match)
+    @param: len
+    @param: tag (AES_GCM_TAG_LEN bytes, expected)
+    @result: Fail, including a tag mismatch, or success
+*/
+int aes_gcm_decrypt(struct aes_dev *dev, int key_choice, const uint8_t *key,
+                    int key_len, const uint8_t *iv, const uint8_t *aad,
+                    size_t aad_len, const uint8_t *in, uint8_t *out,
+                    size_t len, const uint8_t *tag) {
+  struct aes_job job;
+
+  if (aes_job_init(&job, key_choice, key, key_len, in, out, len) !=
+          AES_SUCCESS ||
+      aes_job_set_gcm(&job, iv, aad, aad_len, (uint8_t *)tag, 1) !=
+          AES_SUCCESS)
+    return AES_FAILURE;
+  return aes_submit_job(dev, &job);
+}
+
+/*--------------------------------------------------------- DEVICE POOL
+ * ---------------------------------------------------------*/
+
+static struct aes_pool *aes_pool_alloc(void) {
+  struct aes_pool *pool = calloc(1, sizeof(*pool));
+
+  if (!pool)
+    return NULL;
+  pthread_mutex_init(&pool->lock, NULL);
+  for (int i = 0; i < AES_POOL_AFFINITY_BUCKETS; i++)
+    pool->affinity[i] = -1;
+  return pool;
+}
+
+static struct aes_dev *aes_pool_inst_open(struct aes_pool_inst *inst) {
+  return inst->sim ? aes_open_sim(inst->sim) : aes_open(inst->path);
+}
+
+/**
+ *  @brief: Open every AES instance's character device as one pool
+    @param: None
+    @result: Pool, or NULL if no instance is present
+*/
+struct aes_pool *aes_pool_open(void) {
+  struct aes_pool *pool;
+  glob_t glob_result;
+
+  if (glob(AES_CHARDEV_GLOB, 0, NULL, &glob_result) != 0)
+    return NULL;
+  pool = aes_pool_alloc();
+  for (size_t i = 0; pool && i < glob_result.gl_pathc && pool->n < AES_POOL_MAX;
+       i++) {
+    struct aes_pool_inst *inst = &pool->inst[pool->n];
+
+    /* Keep one handle open per instance, which also checks it is usable */
+    snprintf(inst->path, sizeof(inst->path), "%s", glob_result.gl_pathv[i]);
+    inst->idle[0] = aes_open(inst->path);
+    if (inst->idle[0]) {
+      inst->nidle = 1;
+      pool->n++;
+    }
+  }
+  globfree(&glob_result);
+  if (pool && !pool->n) {
+    aes_pool_close(pool);
+    return NULL;
+  }
+  return pool;
+}
+
+/**
+ *  @brief: Build a pool over simulated devices
+    @param: sims
+    @param: n (at most AES_POOL_MAX)
+    @result: Pool, or NULL on failure
+*/
+struct aes_pool *aes_pool_open_sim(struct aes_sim **sims, int n) {
+  struct aes_pool *pool;
+
+  if (n <= 0 || n > AES_POOL_MAX)
+    return NULL;
+  pool = aes_pool_alloc();
+  if (!pool)
+    return NULL;
+  for (; pool->n < n; pool->n++)
+    pool->inst[pool->n].sim = sims[pool->n];
+  return pool;
+}
+
+/**
+ *  @brief: Close every handle in the pool. No jobs may be in flight.
+    @param: pool
+    @result: None
+*/
+void aes_pool_close(struct aes_pool *pool) {
+  if (!pool)
+    return;
+  for (int i = 0; i < pool->n; i++)
+    while (pool->inst[i].nidle)
+      aes_close(pool->inst[i].idle[--pool->inst[i].nidle]);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
+}
+
+/**
+ *  @brief: Number of instances in the pool
+    @param: pool
+    @result: Instance count
+*/
+int aes_pool_size(const struct aes_pool *pool) { return pool->n; }
+
+/* Device operations a job takes, roughly */
+static unsigned long aes_job_blocks(const struct aes_job *job) {
+  return (job->aad_len + job->len + AES_BLOCK_LEN - 1) / AES_BLOCK_LEN;
+}
+
+/* FNV-1a over the key words and key size */
+static unsigned int aes_pool_key_bucket(const struct aes_job *job) {
+  const uint8_t *p = (const uint8_t *)job->key;
+  uint32_t h = 2166136261u ^ job->key_choice;
+
+  for (size_t i = 0; i < sizeof(job->key); i++)
+    h = (h ^ p[i]) * 16777619u;
+  return h % AES_POOL_AFFINITY_BUCKETS;
+}
+
+/* Same policy as the driver's AES_pool_get(): least loaded, unless the key's
+ * home instance is within AES_POOL_AFFINITY_SLACK blocks of it. Returns the
+ * instance with the job's load taken and an idle handle, if any, in *dev. */
+static int aes_pool_get(struct aes_pool *pool, const struct aes_job *job,
+                        struct aes_dev **dev) {
+  unsigned int bucket = aes_pool_key_bucket(job);
+  struct aes_pool_inst *inst;
+  int least = 0, home;
+
+  pthread_mutex_lock(&pool->lock);
+  for (int i = 1; i < pool->n; i++)
+    if (pool->inst[i].load < pool->inst[least].load)
+      least = i;
+  home = pool->affinity[bucket];
+  if (home >= 0 &&
+      pool->inst[home].load <= pool->inst[least].load + AES_POOL_AFFINITY_SLACK)
+    least = home;
+  pool->affinity[bucket] = least;
+  inst = &pool->inst[least];
+  inst->load += aes_job_blocks(job);
+  *dev = inst->nidle ? inst->idle[--inst->nidle] : NULL;
+  pthread_mutex_unlock(&pool->lock);
+  return least;
+}
+
+static void aes_pool_put(struct aes_pool *pool, int i,
+                         const struct aes_job *job, struct aes_dev *dev) {
+  struct aes_pool_inst *inst = &pool->inst[i];
+
+  pthread_mutex_lock(&pool->lock);
+  inst->load -= aes_job_blocks(job);
+  if (dev && inst->nidle < AES_POOL_IDLE_MAX) {
+    inst->idle[inst->nidle++] = dev;
+    dev = NULL;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  aes_close(dev);
+}
+
+/**
+ *  @brief: Run one job on the instance picked for it
+    @param: pool
+    @param: job
+    @result: Fail or success
+*/
+int aes_pool_submit_job(struct aes_pool *pool, const struct aes_job *job) {
+  struct aes_dev *dev;
+  int i = aes_pool_get(pool, job, &dev);
+  int ret = AES_FAILURE;
+
+  if (!dev)
+    dev = aes_pool_inst_open(&pool->inst[i]);
+  if (dev)
+    ret = aes_submit_job(dev, job);
+  else
+    fprintf(stderr, "ERROR: Could not open a handle on AES instance %d\n", i);
+  aes_pool_put(pool, i, job, dev);
+  return ret;
+}
+
+/**
+ *  @brief: Encrypt a buffer in one job on the pool
+    @param: pool
+    @param: key_choice
+    @param: key
+    @param: key_len
+    @param: in
+    @param: out
+    @param: len
+    @result: Fail or success
+*/
+int aes_pool_encrypt(struct aes_pool *pool, int key_choice, const uint8_t *key,
+                     int key_len, const uint8_t *in, uint8_t *out,
+                     size_t len) {
+  struct aes_job job;
+
+  if (aes_job_init(&job, key_choice, key, key_len, in, out, len) !=
+      AES_SUCCESS)
+    return AES_FAILURE;
+  return aes_pool_submit_job(pool, &job);
+}
@@ -0,0 +1,1195 @@
+/*
+ * OpenSSL 3 provider "aesaccel": AES-128/192/256 in ECB, CBC, CTR and GCM on
+ * the AES device through the user library, so that applications linked
+ * against OpenSSL use the device without source changes.
+ *
+ * The device is picked by the "device" entry of the provider's configuration
+ * section, or by AES_PROVIDER_DEVICE, which takes precedence:
+ *   unset     every instance found by aes_pool_open()
+ *   sim[:N]   a pool of N (default 1) simulated devices
+ *   none      no device, everything runs on the default provider
+ * Work the device cannot take runs on the default provider, loaded into a
+ * library context of the provider's own: all of it without a device, a
+ * request while AES_PROVIDER_MAX_INFLIGHT jobs (default 4 per instance) are
+ * already on the device, a job the device rejects, CBC encryption, which is
+ * serial, and TLS 1.2 GCM records (the TLS1_AAD and TLS1_IV_FIXED params),
+ * which hand their whole context over to the default provider's GCM.
+ *
+ * GCM runs its counter blocks on the device and GHASH on the CPU, so that a
+ * message may arrive over any number of updates.
+ */
+#define _DEFAULT_SOURCE
+#include "aes_lib.h"
+#include "aes_sim.h"
+
+#include <openssl/core_dispatch.h>
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/params.h>
+#include <openssl/provider.h>
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROV_NAME "aesaccel"
+#define PROV_VERSION "1.0.0"
+/* Jobs each instance may have in flight before requests run in software */
+#define PROV_INFLIGHT_PER_INST 4
+/* prov_device_job(): no device, or it is busy; the job was not tried */
+#define PROV_NOT_TRIED 2
+/* Longest GCM IV, as the default provider takes */
+#define PROV_GCM_IV_MAX 128
+
+enum prov_mode { PROV_ECB, PROV_CBC, PROV_CTR, PROV_GCM, PROV_NMODES };
+
+static const char *const prov_sw_names[PROV_NMODES][3] = {
+    {"AES-128-ECB", "AES-192-ECB", "AES-256-ECB"},
+    {"AES-128-CBC", "AES-192-CBC", "AES-256-CBC"},
+    {"AES-128-CTR", "AES-192-CTR", "AES-256-CTR"},
+    {"AES-128-GCM", "AES-192-GCM", "AES-256-GCM"},
+};
+
+struct prov_ctx {
+  const OSSL_CORE_HANDLE *handle;
+  OSSL_LIB_CTX *libctx;   // holds the default provider for fallback
+  OSSL_PROVIDER *deflt;
+  EVP_CIPHER *sw[PROV_NMODES][3];
+  struct aes_sim *sims[AES_POOL_MAX];
+  int nsims;
+  struct aes_pool *pool;  // NULL: no device
+  int max_inflight;
+  int inflight;           // jobs on the device, atomic
+  int no_decrypt;         // the device has no inverse cipher
+};
+
+struct prov_gcm {
+  uint64_t htable[16][2]; // multiples of H for 4-bit GHASH
+  uint8_t j0[16];
+  uint8_t ekj0[16];       // E(K, J0), masks the tag
+  uint8_t y[16];          // GHASH accumulator
+  size_t ypos;            // bytes of the current GHASH block absorbed
+  uint64_t aad_len, ct_len;
+  size_t ivlen;
+  uint8_t iv[PROV_GCM_IV_MAX];
+  uint8_t tag[16];
+  size_t taglen;
+  int started;            // key and IV set, counter running
+  int ct;                 // ciphertext has begun, no more AAD
+  int tag_set;            // decryption: expected tag given
+};
+
+struct prov_cipher {
+  struct prov_ctx *prov;
+  enum prov_mode mode;
+  int kidx;               // 0, 1, 2 for 128, 192, 256-bit keys
+  int enc;
+  int key_set, iv_set;
+  uint8_t key[32];
+  uint8_t iv[16];         // CBC: chaining value. CTR, GCM: next counter
+  uint8_t buf[16];        // ECB, CBC: partial block. CTR, GCM: keystream
+  size_t bufsz;           // ECB, CBC: bytes in buf
+  unsigned int num;       // CTR, GCM: keystream bytes of buf used
+  unsigned int pad;
+  EVP_CIPHER_CTX *sw;     // software ECB, CBC or CTR for fallback
+  int sw_enc;             // direction sw was keyed for, or -1
+  int sw_chained;         // CBC encryption: sw holds the chaining value
+  EVP_CIPHER_CTX *delegate; // whole operation on the default provider
+  struct prov_gcm gcm;
+};
+
+/*------------------------------------------------------------ DEVICE
+ * ---------------------------------------------------------*/
+
+/* Run a job on the device unless the device is missing or busy */
+static int prov_device_job(struct prov_ctx *prov, const struct aes_job *job) {
+  int ret;
+
+  if (!prov->pool)
+    return PROV_NOT_TRIED;
+  if (__atomic_add_fetch(&prov->inflight, 1, __ATOMIC_RELAXED) >
+      prov->max_inflight) {
+    __atomic_sub_fetch(&prov->inflight, 1, __ATOMIC_RELAXED);
+    return PROV_NOT_TRIED;
+  }
+  ret = aes_pool_submit_job(prov->pool, job);
+  __atomic_sub_fetch(&prov->inflight, 1, __ATOMIC_RELAXED);
+  return ret;
+}
+
+/* Key the software cipher for a direction */
+static int prov_sw_key(struct prov_cipher *c, int enc) {
+  const EVP_CIPHER *cipher;
+
+  if (c->sw_enc == enc)
+    return 1;
+  if (c->mode == PROV_CTR || c->mode == PROV_GCM)
+    cipher = c->prov->sw[PROV_CTR][c->kidx];
+  else if (c->mode == PROV_CBC && enc)
+    cipher = c->prov->sw[PROV_CBC][c->kidx];
+  else
+    cipher = c->prov->sw[PROV_ECB][c->kidx];
+  if (!EVP_CipherInit_ex2(c->sw, cipher, c->key, NULL, enc, NULL) ||
+      !EVP_CIPHER_CTX_set_padding(c->sw, 0))
+    return 0;
+  c->sw_enc = enc;
+  return 1;
+}
+
+/* Software pass over whole blocks or, in CTR, any length from a counter */
+static int prov_sw_run(struct prov_cipher *c, int enc, const uint8_t *iv,
+                       const uint8_t *in, uint8_t *out, size_t len) {
+  int outl;
+
+  if (!prov_sw_key(c, enc) ||
+      (iv && !EVP_CipherInit_ex2(c->sw, NULL, NULL, iv, enc, NULL)))
+    return 0;
+  while (len) {
+    int n = len > INT_MAX / 2 ? INT_MAX / 2 / 16 * 16 : (int)len;
+
+    if (!EVP_CipherUpdate(c->sw, out, &outl, in, n))
+      return 0;
+    in += n;
+    out += n;
+    len -= n;
+  }
+  return 1;
+}
+
+static int prov_key_choice(const struct prov_cipher *c) {
+  return AES_KEY_CHOICE_128 + c->kidx;
+}
+
+/* Whole blocks in ECB */
+static int prov_ecb(struct prov_cipher *c, int enc, const uint8_t *in,
+                    uint8_t *out, size_t len) {
+  struct aes_job job;
+
+  while (len) {
+    size_t n = len > AES_JOB_MAX_LEN ? AES_JOB_MAX_LEN : len;
+    int ret = PROV_NOT_TRIED;
+
+    if (enc || !c->prov->no_decrypt) {
+      aes_job_init(&job, prov_key_choice(c), c->key, 16 + 8 * c->kidx, in, out,
+                   n);
+      job.flags = enc ? 0 : AES_JOB_DECRYPT;
+      ret = prov_device_job(c->prov, &job);
+      /* Without the inverse cipher, stop asking */
+      if (ret == AES_FAILURE && !enc)
+        c->prov->no_decrypt = 1;
+    }
+    if (ret != AES_SUCCESS && !prov_sw_run(c, enc, NULL, in, out, n))
+      return 0;
+    in += n;
+    out += n;
+    len -= n;
+  }
+  return 1;
+}
+
+/* Add blocks to the last `width` bytes of a big-endian counter */
+static void prov_ctr_add(uint8_t ctr[16], uint64_t blocks, int width) {
+  for (int i = 15; i >= 16 - width && blocks; i--) {
+    blocks += ctr[i];
+    ctr[i] = (uint8_t)blocks;
+    blocks >>= 8;
+  }
+}
+
+/* CTR from a 128-bit big-endian counter, which is left unchanged */
+static int prov_ctr(struct prov_cipher *c, const uint8_t ctr[16],
+                    const uint8_t *in, uint8_t *out, size_t len) {
+  uint8_t cb[16];
+  struct aes_job job;
+
+  memcpy(cb, ctr, sizeof(cb));
+  while (len) {
+    size_t n = len > AES_JOB_MAX_LEN ? AES_JOB_MAX_LEN : len;
+
+    aes_job_init(&job, prov_key_choice(c), c->key, 16 + 8 * c->kidx, in, out,
+                 n);
+    aes_job_set_ctr(&job, cb);
+    if (prov_device_job(c->prov, &job) != AES_SUCCESS &&
+        !prov_sw_run(c, 1, cb, in, out, n))
+      return 0;
+    prov_ctr_add(cb, n / AES_BLOCK_LEN, 16);
+    in += n;
+    out += n;
+    len -= n;
+  }
+  return 1;
+}
+
+/* Stream through c->iv: 128-bit counter in CTR, 32-bit in GCM */
+static int prov_ctr_stream(struct prov_cipher *c, const uint8_t *in,
+                           uint8_t *out, size_t len) {
+  int width = c->mode == PROV_GCM ? 4 : 16;
+
+  while (c->num && len) {
+    *out++ = *in++ ^ c->buf[c->num];
+    c->num = (c->num + 1) % AES_BLOCK_LEN;
+    len--;
+  }
+  while (len >= AES_BLOCK_LEN) {
+    uint64_t blocks = len / AES_BLOCK_LEN;
+
+    if (width == 4) {
+      uint64_t to_wrap = 0x100000000ull - ((uint64_t)c->iv[12] << 24 |
+                                           c->iv[13] << 16 | c->iv[14] << 8 |
+                                           c->iv[15]);
+
+      if (blocks > to_wrap)
+        blocks = to_wrap;
+    }
+    if (!prov_ctr(c, c->iv, in, out, blocks * AES_BLOCK_LEN))
+      return 0;
+    prov_ctr_add(c->iv, blocks, width);
+    in += blocks * AES_BLOCK_LEN;
+    out += blocks * AES_BLOCK_LEN;
+    len -= blocks * AES_BLOCK_LEN;
+  }
+  if (len) {
+    memset(c->buf, 0, sizeof(c->buf));
+    if (!prov_ctr(c, c->iv, c->buf, c->buf, AES_BLOCK_LEN))
+      return 0;
+    prov_ctr_add(c->iv, 1, width);
+    for (c->num = 0; c->num < len; c->num++)
+      out[c->num] = in[c->num] ^ c->buf[c->num];
+  }
+  return 1;
+}
+
+/*-------------------------------------------------------------- GHASH
+ * ---------------------------------------------------------*/
+
+static uint64_t prov_load64(const uint8_t *p) {
+  uint64_t v = 0;
+
+  for (int i = 0; i < 8; i++)
+    v = v << 8 | p[i];
+  return v;
+}
+
+static void prov_store64(uint8_t *p, uint64_t v) {
+  for (int i = 7; i >= 0; i--, v >>= 8)
+    p[i] = (uint8_t)v;
+}
+
+/* Shoup's 4-bit tables: htable[i] = i * H, bits taken high to low */
+static void prov_ghash_init(struct prov_gcm *g, const uint8_t h[16]) {
+  uint64_t hi = prov_load64(h), lo = prov_load64(h + 8);
+
+  memset(g->htable, 0, sizeof(g->htable));
+  for (int i = 8; i > 0; i >>= 1) {
+    g->htable[i][0] = hi;
+    g->htable[i][1] = lo;
+    uint64_t t = 0xe100000000000000ull & (0 - (lo & 1));
+    lo = hi << 63 | lo >> 1;
+    hi = hi >> 1 ^ t;
+  }
+  for (int i = 2; i < 16; i <<= 1)
+    for (int j = 1; j < i; j++) {
+      g->htable[i + j][0] = g->htable[i][0] ^ g->htable[j][0];
+      g->htable[i + j][1] = g->htable[i][1] ^ g->htable[j][1];
+    }
+}
+
+/* y = y * H */
+static void prov_ghash_mul(struct prov_gcm *g) {
+  static const uint64_t rem_4bit[16] = {
+      0x0000, 0x1C20, 0x3840, 0x2460, 0x7080, 0x6CA0, 0x48C0, 0x54E0,
+      0xE100, 0xFD20, 0xD940, 0xC560, 0x9180, 0x8DA0, 0xA9C0, 0xB5E0};
+  uint64_t hi = 0, lo = 0;
+
+  for (int i = 15; i >= 0; i--) {
+    for (int nib = 0; nib < 2; nib++) {
+      int n = nib ? g->y[i] >> 4 : g->y[i] & 0xf;
+
+      if (i != 15 || nib) {
+        uint64_t rem = lo & 0xf;
+
+        lo = hi << 60 | lo >> 4;
+        hi = hi >> 4 ^ rem_4bit[rem] << 48;
+      }
+      hi ^= g->htable[n][0];
+      lo ^= g->htable[n][1];
+    }
+  }
+  prov_store64(g->y, hi);
+  prov_store64(g->y + 8, lo);
+}
+
+static void prov_ghash(struct prov_gcm *g, const uint8_t *p, size_t len) {
+  while (len) {
+    if (!g->ypos && len >= AES_BLOCK_LEN) {
+      for (; len >= AES_BLOCK_LEN; p += AES_BLOCK_LEN, len -= AES_BLOCK_LEN) {
+        for (int i = 0; i < AES_BLOCK_LEN; i++)
+          g->y[i] ^= p[i];
+        prov_ghash_mul(g);
+      }
+      continue;
+    }
+    g->y[g->ypos++] ^= *p++;
+    len--;
+    if (g->ypos == AES_BLOCK_LEN) {
+      prov_ghash_mul(g);
+      g->ypos = 0;
+    }
+  }
+}
+
+/* Pad the data hashed so far to a whole block */
+static void prov_ghash_flush(struct prov_gcm *g) {
+  if (g->ypos) {
+    prov_ghash_mul(g);
+    g->ypos = 0;
+  }
+}
+
+/* Hash subkey for a new key */
+static int prov_gcm_key(struct prov_cipher *c) {
+  uint8_t h[16] = {0}, zero[16] = {0};
+
+  if (!prov_ctr(c, zero, h, h, AES_BLOCK_LEN))
+    return 0;
+  prov_ghash_init(&c->gcm, h);
+  return 1;
+}
+
+/* Start a message: J0 from the IV, E(K, J0), counter at J0 + 1 */
+static int prov_gcm_start(struct prov_cipher *c) {
+  struct prov_gcm *g = &c->gcm;
+
+  memset(g->y, 0, sizeof(g->y));
+  g->ypos = 0;
+  if (g->ivlen == AES_GCM_IV_LEN) {
+    memcpy(g->j0, g->iv, AES_GCM_IV_LEN);
+    memset(g->j0 + AES_GCM_IV_LEN, 0, 4);
+    g->j0[15] = 1;
+  } else {
+    uint8_t lens[16] = {0};
+
+    prov_store64(lens + 8, (uint64_t)g->ivlen * 8);
+    prov_ghash(g, g->iv, g->ivlen);
+    prov_ghash_flush(g);
+    prov_ghash(g, lens, sizeof(lens));
+    memcpy(g->j0, g->y, sizeof(g->j0));
+    memset(g->y, 0, sizeof(g->y));
+  }
+  memset(g->ekj0, 0, sizeof(g->ekj0));
+  if (!prov_ctr(c, g->j0, g->ekj0, g->ekj0, AES_BLOCK_LEN))
+    return 0;
+  memcpy(c->iv, g->j0, sizeof(c->iv));
+  prov_ctr_add(c->iv, 1, 4);
+  c->num = 0;
+  g->aad_len = g->ct_len = 0;
+  g->ct = 0;
+  g->started = 1;
+  return 1;
+}
+
+/* AAD when out is NULL, otherwise text */
+static int prov_gcm_update(struct prov_cipher *c, uint8_t *out,
+                           const uint8_t *in, size_t len) {
+  struct prov_gcm *g = &c->gcm;
+
+  if (!g->started)
+    return 0;
+  if (!out) {
+    if (g->ct)
+      return 0;
+    prov_ghash(g, in, len);
+    g->aad_len += len;
+    return 1;
+  }
+  if (!g->ct) {
+    prov_ghash_flush(g);
+    g->ct = 1;
+  }
+  if (g->ct_len + len < g->ct_len || g->ct_len + len > (1ull << 36) - 32)
+    return 0;
+  g->ct_len += len;
+  if (!c->enc)
+    prov_ghash(g, in, len);
+  if (!prov_ctr_stream(c, in, out, len))
+    return 0;
+  if (c->enc)
+    prov_ghash(g, out, len);
+  return 1;
+}
+
+static int prov_gcm_final(struct prov_cipher *c) {
+  struct prov_gcm *g = &c->gcm;
+  uint8_t lens[16];
+
+  if (!g->started || (!c->enc && !g->tag_set))
+    return 0;
+  prov_ghash_flush(g);
+  prov_store64(lens, g->aad_len * 8);
+  prov_store64(lens + 8, g->ct_len * 8);
+  prov_ghash(g, lens, sizeof(lens));
+  for (int i = 0; i < AES_BLOCK_LEN; i++)
+    g->y[i] ^= g->ekj0[i];
+  g->started = 0;
+  g->tag_set = 0;
+  if (c->enc) {
+    memcpy(g->tag, g->y, sizeof(g->tag));
+    return 1;
+  }
+  return CRYPTO_memcmp(g->tag, g->y, g->taglen) == 0;
+}
+
+/*------------------------------------------------------- BLOCK MODES
+ * ---------------------------------------------------------*/
+
+/* Whole blocks of ECB or CBC */
+static int prov_blocks(struct prov_cipher *c, const uint8_t *in, uint8_t *out,
+                       size_t len) {
+  uint8_t next_iv[16], *tmp;
+
+  if (!len)
+    return 1;
+  if (c->mode == PROV_ECB)
+    return prov_ecb(c, c->enc, in, out, len);
+  if (c->enc) {
+    /* Each block chains on the last, so there is nothing to overlap */
+    if (!prov_sw_run(c, 1, c->sw_chained ? NULL : c->iv, in, out, len))
+      return 0;
+    memcpy(c->iv, out + len - AES_BLOCK_LEN, AES_BLOCK_LEN);
+    c->sw_chained = 1;
+    return 1;
+  }
+  /* Decryption: ECB on the device, then XOR with the previous ciphertext */
+  memcpy(next_iv, in + len - AES_BLOCK_LEN, AES_BLOCK_LEN);
+  tmp = out + len > in && in + len > out ? malloc(len) : out;
+  if (!tmp || !prov_ecb(c, 0, in, tmp, len)) {
+    if (tmp != out)
+      free(tmp);
+    return 0;
+  }
+  for (size_t i = 0; i < len; i++)
+    tmp[i] ^= i < AES_BLOCK_LEN ? c->iv[i] : in[i - AES_BLOCK_LEN];
+  if (tmp != out) {
+    memcpy(out, tmp, len);
+    free(tmp);
+  }
+  memcpy(c->iv, next_iv, AES_BLOCK_LEN);
+  return 1;
+}
+
+/* Buffered update of ECB or CBC; a decryption with padding holds back the
+ * last whole block for final */
+static int prov_block_update(struct prov_cipher *c, uint8_t *out, size_t *outl,
+                             size_t outsize, const uint8_t *in, size_t inl) {
+  size_t total = c->bufsz + inl, whole, done = 0;
+  int hold = !c->enc && c->pad;
+
+  whole = total / AES_BLOCK_LEN * AES_BLOCK_LEN;
+  if (hold && whole && whole == total)
+    whole -= AES_BLOCK_LEN;
+  if (outsize < whole)
+    return 0;
+  if (c->bufsz && whole) {
+    size_t n = AES_BLOCK_LEN - c->bufsz;
+
+    memcpy(c->buf + c->bufsz, in, n);
+    if (!prov_blocks(c, c->buf, out, AES_BLOCK_LEN))
+      return 0;
+    in += n;
+    inl -= n;
+    c->bufsz = 0;
+    done = AES_BLOCK_LEN;
+  }
+  if (!prov_blocks(c, in, out + done, whole - done))
+    return 0;
+  in += whole - done;
+  inl -= whole - done;
+  memcpy(c->buf + c->bufsz, in, inl);
+  c->bufsz += inl;
+  *outl = whole;
+  return 1;
+}
+
+static int prov_block_final(struct prov_cipher *c, uint8_t *out, size_t *outl,
+                            size_t outsize) {
+  size_t n;
+
+  *outl = 0;
+  if (!c->pad) {
+    if (c->bufsz)
+      return 0;
+    return 1;
+  }
+  if (c->enc) {
+    memset(c->buf + c->bufsz, (int)(AES_BLOCK_LEN - c->bufsz),
+           AES_BLOCK_LEN - c->bufsz);
+    if (outsize < AES_BLOCK_LEN || !prov_blocks(c, c->buf, out, AES_BLOCK_LEN))
+      return 0;
+    c->bufsz = 0;
+    *outl = AES_BLOCK_LEN;
+    return 1;
+  }
+  if (c->bufsz != AES_BLOCK_LEN || !prov_blocks(c, c->buf, c->buf,
+                                                AES_BLOCK_LEN))
+    return 0;
+  c->bufsz = 0;
+  n = c->buf[AES_BLOCK_LEN - 1];
+  if (n == 0 || n > AES_BLOCK_LEN)
+    return 0;
+  for (size_t i = AES_BLOCK_LEN - n; i < AES_BLOCK_LEN; i++)
+    if (c->buf[i] != n)
+      return 0;
+  if (outsize < AES_BLOCK_LEN - n)
+    return 0;
+  memcpy(out, c->buf, AES_BLOCK_LEN - n);
+  *outl = AES_BLOCK_LEN - n;
+  return 1;
+}
+
+/*--------------------------------------------------------- DELEGATION
+ * ---------------------------------------------------------*/
+
+/* Hand the operation to the default provider's cipher of the same name */
+static int prov_delegate(struct prov_cipher *c) {
+  if (c->delegate)
+    return 1;
+  c->delegate = EVP_CIPHER_CTX_new();
+  if (!c->delegate ||
+      !EVP_CipherInit_ex2(c->delegate, c->prov->sw[c->mode][c->kidx],
+                          c->key_set ? c->key : NULL, NULL, c->enc, NULL)) {
+    EVP_CIPHER_CTX_free(c->delegate);
+    c->delegate = NULL;
+    return 0;
+  }
+  if (c->mode == PROV_GCM) {
+    OSSL_PARAM p[2] = {OSSL_PARAM_END, OSSL_PARAM_END};
+
+    p[0] = OSSL_PARAM_construct_size_t(OSSL_CIPHER_PARAM_AEAD_IVLEN,
+                                       &c->gcm.ivlen);
+    if (!EVP_CIPHER_CTX_set_params(c->delegate, p) ||
+        (c->iv_set && !EVP_CipherInit_ex2(c->delegate, NULL, NULL, c->gcm.iv,
+                                          c->enc, NULL)))
+      return 0;
+  } else if (c->iv_set &&
+             !EVP_CipherInit_ex2(c->delegate, NULL, NULL, c->iv, c->enc,
+                                 NULL)) {
+    return 0;
+  }
+  return 1;
+}
+
+/* Output length of a delegated call, read after the call has set it */
+static int prov_delegate_out(int ret, const int *outl, size_t *outlp) {
+  if (!ret || *outl < 0)
+    return 0;
+  *outlp = *outl;
+  return 1;
+}
+
+/*------------------------------------------------------ CIPHER OBJECT
+ * ---------------------------------------------------------*/
+
+static struct prov_cipher *prov_newctx(void *provctx, enum prov_mode mode,
+                                       int kidx) {
+  struct prov_cipher *c = calloc(1, sizeof(*c));
+
+  if (!c)
+    return NULL;
+  c->prov = provctx;
+  c->mode = mode;
+  c->kidx = kidx;
+  c->pad = 1;
+  c->sw_enc = -1;
+  c->gcm.ivlen = AES_GCM_IV_LEN;
+  c->gcm.taglen = AES_GCM_TAG_LEN;
+  c->sw = EVP_CIPHER_CTX_new();
+  if (!c->sw) {
+    free(c);
+    return NULL;
+  }
+  return c;
+}
+
+static void prov_freectx(void *vctx) {
+  struct prov_cipher *c = vctx;
+
+  if (!c)
+    return;
+  EVP_CIPHER_CTX_free(c->sw);
+  EVP_CIPHER_CTX_free(c->delegate);
+  OPENSSL_cleanse(c, sizeof(*c));
+  free(c);
+}
+
+/* EVP_CIPHER_CTX_dup() is OpenSSL 3.1 and later */
+static EVP_CIPHER_CTX *prov_ctx_copy(const EVP_CIPHER_CTX *src) {
+  EVP_CIPHER_CTX *dst = EVP_CIPHER_CTX_new();
+
+  if (dst && !EVP_CIPHER_CTX_copy(dst, src)) {
+    EVP_CIPHER_CTX_free(dst);
+    return NULL;
+  }
+  return dst;
+}
+
+static void *prov_dupctx(void *vctx) {
+  struct prov_cipher *c = vctx, *d = malloc(sizeof(*d));
+
+  if (!d)
+    return NULL;
+  *d = *c;
+  d->sw = prov_ctx_copy(c->sw);
+  d->delegate = c->delegate ? prov_ctx_copy(c->delegate) : NULL;
+  if (!d->sw || (c->delegate && !d->delegate)) {
+    prov_freectx(d);
+    return NULL;
+  }
+  return d;
+}
+
+static size_t prov_ivlen(const struct prov_cipher *c) {
+  if (c->mode == PROV_ECB)
+    return 0;
+  return c->mode == PROV_GCM ? c->gcm.ivlen : AES_BLOCK_LEN;
+}
+
+static int prov_set_ctx_params(void *vctx, const OSSL_PARAM params[]);
+
+static int prov_init(struct prov_cipher *c, const unsigned char *key,
+                     size_t keylen, const unsigned char *iv, size_t ivlen,
+                     const OSSL_PARAM params[], int enc) {
+  /* Without a device the default provider does it all */
+  if (!c->prov->pool && !prov_delegate(c))
+    return 0;
+  if (c->delegate)
+    return EVP_CipherInit_ex2(c->delegate, NULL, key, iv, enc, params);
+  if (c->enc != enc)
+    c->sw_enc = -1;
+  c->sw_chained = 0;
+  c->enc = enc;
+  c->bufsz = 0;
+  c->num = 0;
+  c->gcm.started = 0;
+  if (!prov_set_ctx_params(c, params))
+    return 0;
+  if (c->delegate)
+    return EVP_CipherInit_ex2(c->delegate, NULL, key, iv, enc, NULL);
+  if (iv && c->mode != PROV_ECB) {
+    if (ivlen != prov_ivlen(c) || ivlen > sizeof(c->gcm.iv))
+      return 0;
+    memcpy(c->mode == PROV_GCM ? c->gcm.iv : c->iv, iv, ivlen);
+    c->iv_set = 1;
+  }
+  if (key) {
+    if (keylen != (size_t)(16 + 8 * c->kidx))
+      return 0;
+    memcpy(c->key, key, keylen);
+    c->key_set = 1;
+    c->sw_enc = -1;
+    c->sw_chained = 0;
+    if (c->mode == PROV_GCM && !prov_gcm_key(c))
+      return 0;
+  }
+  if (c->mode == PROV_GCM && c->key_set && c->iv_set)
+    return prov_gcm_start(c);
+  return 1;
+}
+
+static int prov_encrypt_init(void *vctx, const unsigned char *key,
+                             size_t keylen, const unsigned char *iv,
+                             size_t ivlen, const OSSL_PARAM params[]) {
+  return prov_init(vctx, key, keylen, iv, ivlen, params, 1);
+}
+
+static int prov_decrypt_init(void *vctx, const unsigned char *key,
+                             size_t keylen, const unsigned char *iv,
+                             size_t ivlen, const OSSL_PARAM params[]) {
+  return prov_init(vctx, key, keylen, iv, ivlen, params, 0);
+}
+
+static int prov_update(void *vctx, unsigned char *out, size_t *outl,
+                       size_t outsize, const unsigned char *in, size_t inl) {
+  struct prov_cipher *c = vctx;
+  int n = 0;
+
+  if (c->delegate)
+    return prov_delegate_out(
+        inl <= INT_MAX &&
+            EVP_CipherUpdate(c->delegate, out, &n, in, (int)inl),
+        &n, outl);
+  if (!c->key_set || (c->mode != PROV_ECB && !c->iv_set))
+    return 0;
+  switch (c->mode) {
+  case PROV_ECB:
+  case PROV_CBC:
+    return prov_block_update(c, out, outl, outsize, in, inl);
+  case PROV_CTR:
+    if (outsize < inl || !prov_ctr_stream(c, in, out, inl))
+      return 0;
+    break;
+  default:
+    if ((out && outsize < inl) || !prov_gcm_update(c, out, in, inl))
+      return 0;
+    break;
+  }
+  *outl = inl;
+  return 1;
+}
+
+static int prov_final(void *vctx, unsigned char *out, size_t *outl,
+                      size_t outsize) {
+  struct prov_cipher *c = vctx;
+  int n = 0;
+
+  if (c->delegate)
+    return prov_delegate_out(EVP_CipherFinal_ex(c->delegate, out, &n), &n,
+                             outl);
+  if (!c->key_set)
+    return 0;
+  if (c->mode == PROV_ECB || c->mode == PROV_CBC)
+    return prov_block_final(c, out, outl, outsize);
+  *outl = 0;
+  return c->mode == PROV_GCM ? prov_gcm_final(c) : 1;
+}
+
+/* One-shot call: whole blocks only in ECB and CBC, final when in is NULL */
+static int prov_cipher(void *vctx, unsigned char *out, size_t *outl,
+                       size_t outsize, const unsigned char *in, size_t inl) {
+  struct prov_cipher *c = vctx;
+
+  if (c->delegate) {
+    int n;
+
+    if (inl > INT_MAX)
+      return 0;
+    n = EVP_Cipher(c->delegate, out, in, (unsigned int)inl);
+    return prov_delegate_out(n >= 0, &n, outl);
+  }
+  if (c->mode == PROV_ECB || c->mode == PROV_CBC) {
+    if (!c->key_set || inl % AES_BLOCK_LEN || outsize < inl ||
+        !prov_blocks(c, in, out, inl))
+      return 0;
+    *outl = inl;
+    return 1;
+  }
+  if (!in)
+    return prov_final(c, out, outl, outsize);
+  return prov_update(c, out, outl, outsize, in, inl);
+}
+
+/*-------------------------------------------------------------- PARAMS
+ * ---------------------------------------------------------*/
+
+static int prov_get_params(OSSL_PARAM params[], unsigned int mode,
+                           size_t keylen, size_t blocksize, size_t ivlen,
+                           int aead) {
+  OSSL_PARAM *p;
+
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_MODE)) &&
+      !OSSL_PARAM_set_uint(p, mode))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_KEYLEN)) &&
+      !OSSL_PARAM_set_size_t(p, keylen))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_BLOCK_SIZE)) &&
+      !OSSL_PARAM_set_size_t(p, blocksize))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_IVLEN)) &&
+      !OSSL_PARAM_set_size_t(p, ivlen))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_AEAD)) &&
+      !OSSL_PARAM_set_int(p, aead))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_CUSTOM_IV)) &&
+      !OSSL_PARAM_set_int(p, aead))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_CTS)) &&
+      !OSSL_PARAM_set_int(p, 0))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_TLS1_MULTIBLOCK)) &&
+      !OSSL_PARAM_set_int(p, 0))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_HAS_RAND_KEY)) &&
+      !OSSL_PARAM_set_int(p, 0))
+    return 0;
+  return 1;
+}
+
+static const OSSL_PARAM prov_gettable_params_table[] = {
+    OSSL_PARAM_uint(OSSL_CIPHER_PARAM_MODE, NULL),
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, NULL),
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_IVLEN, NULL),
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_BLOCK_SIZE, NULL),
+    OSSL_PARAM_int(OSSL_CIPHER_PARAM_AEAD, NULL),
+    OSSL_PARAM_int(OSSL_CIPHER_PARAM_CUSTOM_IV, NULL),
+    OSSL_PARAM_int(OSSL_CIPHER_PARAM_CTS, NULL),
+    OSSL_PARAM_int(OSSL_CIPHER_PARAM_TLS1_MULTIBLOCK, NULL),
+    OSSL_PARAM_int(OSSL_CIPHER_PARAM_HAS_RAND_KEY, NULL),
+    OSSL_PARAM_END};
+
+static const OSSL_PARAM *prov_gettable_params(void *provctx) {
+  (void)provctx;
+  return prov_gettable_params_table;
+}
+
+static int prov_get_ctx_params(void *vctx, OSSL_PARAM params[]) {
+  struct prov_cipher *c = vctx;
+  OSSL_PARAM *p;
+  const uint8_t *iv = c->mode == PROV_GCM ? c->gcm.iv : c->iv;
+
+  if (c->delegate)
+    return EVP_CIPHER_CTX_get_params(c->delegate, params);
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_KEYLEN)) &&
+      !OSSL_PARAM_set_size_t(p, 16 + 8 * c->kidx))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_IVLEN)) &&
+      !OSSL_PARAM_set_size_t(p, prov_ivlen(c)))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_PADDING)) &&
+      !OSSL_PARAM_set_uint(p, c->pad))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_NUM)) &&
+      !OSSL_PARAM_set_uint(p, c->num))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_IV)) &&
+      !OSSL_PARAM_set_octet_string(p, iv, prov_ivlen(c)))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_UPDATED_IV)) &&
+      !OSSL_PARAM_set_octet_string(p, iv, prov_ivlen(c)))
+    return 0;
+  if (c->mode != PROV_GCM)
+    return 1;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_AEAD_TAGLEN)) &&
+      !OSSL_PARAM_set_size_t(p, c->gcm.taglen))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_AEAD_TAG))) {
+    if (!c->enc || c->gcm.started || p->data_size == 0 ||
+        p->data_size > AES_GCM_TAG_LEN ||
+        !OSSL_PARAM_set_octet_string(p, c->gcm.tag, p->data_size))
+      return 0;
+  }
+  return 1;
+}
+
+static int prov_set_ctx_params(void *vctx, const OSSL_PARAM params[]) {
+  struct prov_cipher *c = vctx;
+  const OSSL_PARAM *p;
+  unsigned int u;
+  size_t sz;
+
+  if (!params)
+    return 1;
+  if (c->mode == PROV_GCM &&
+      (OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_AEAD_TLS1_AAD) ||
+       OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_AEAD_TLS1_IV_FIXED)) &&
+      !prov_delegate(c))
+    return 0;
+  if (c->delegate)
+    return EVP_CIPHER_CTX_set_params(c->delegate, params);
+  if ((p = OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_PADDING))) {
+    if (!OSSL_PARAM_get_uint(p, &u))
+      return 0;
+    c->pad = u != 0;
+  }
+  if ((p = OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_NUM))) {
+    if (!OSSL_PARAM_get_uint(p, &u) || u >= AES_BLOCK_LEN)
+      return 0;
+    c->num = u;
+  }
+  if ((p = OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_KEYLEN))) {
+    if (!OSSL_PARAM_get_size_t(p, &sz) || sz != (size_t)(16 + 8 * c->kidx))
+      return 0;
+  }
+  if (c->mode != PROV_GCM)
+    return 1;
+  if ((p = OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_AEAD_IVLEN))) {
+    if (!OSSL_PARAM_get_size_t(p, &sz) || sz == 0 || sz > sizeof(c->gcm.iv))
+      return 0;
+    c->gcm.ivlen = sz;
+  }
+  if ((p = OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_AEAD_TAG))) {
+    void *tag = c->gcm.tag;
+
+    if (p->data_type != OSSL_PARAM_OCTET_STRING || p->data_size == 0 ||
+        p->data_size > AES_GCM_TAG_LEN)
+      return 0;
+    if (p->data) {
+      if (c->enc || !OSSL_PARAM_get_octet_string(p, &tag, sizeof(c->gcm.tag),
+                                                 &sz))
+        return 0;
+      c->gcm.tag_set = 1;
+    }
+    c->gcm.taglen = p->data_size;
+  }
+  return 1;
+}
+
+static const OSSL_PARAM prov_gettable_ctx_table[] = {
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, NULL),
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_IVLEN, NULL),
+    OSSL_PARAM_uint(OSSL_CIPHER_PARAM_PADDING, NULL),
+    OSSL_PARAM_uint(OSSL_CIPHER_PARAM_NUM, NULL),
+    OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_IV, NULL, 0),
+    OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_UPDATED_IV, NULL, 0),
+    OSSL_PARAM_END};
+
+static const OSSL_PARAM prov_gettable_gcm_ctx_table[] = {
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, NULL),
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_IVLEN, NULL),
+    OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_IV, NULL, 0),
+    OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_UPDATED_IV, NULL, 0),
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_AEAD_TAGLEN, NULL),
+    OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_AEAD_TAG, NULL, 0),
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_AEAD_TLS1_AAD_PAD, NULL),
+    OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_AEAD_TLS1_GET_IV_GEN, NULL, 0),
+    OSSL_PARAM_END};
+
+static const OSSL_PARAM prov_settable_ctx_table[] = {
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, NULL),
+    OSSL_PARAM_uint(OSSL_CIPHER_PARAM_PADDING, NULL),
+    OSSL_PARAM_uint(OSSL_CIPHER_PARAM_NUM, NULL),
+    OSSL_PARAM_END};
+
+static const OSSL_PARAM prov_settable_gcm_ctx_table[] = {
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, NULL),
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_AEAD_IVLEN, NULL),
+    OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_AEAD_TAG, NULL, 0),
+    OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_AEAD_TLS1_AAD, NULL, 0),
+    OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_AEAD_TLS1_IV_FIXED, NULL, 0),
+    OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_AEAD_TLS1_SET_IV_INV, NULL, 0),
+    OSSL_PARAM_END};
+
+static const OSSL_PARAM *prov_gettable_ctx_params(void *cctx, void *provctx) {
+  (void)cctx;
+  (void)provctx;
+  return prov_gettable_ctx_table;
+}
+
+static const OSSL_PARAM *prov_gettable_gcm_ctx_params(void *cctx,
+                                                      void *provctx) {
+  (void)cctx;
+  (void)provctx;
+  return prov_gettable_gcm_ctx_table;
+}
+
+static const OSSL_PARAM *prov_settable_ctx_params(void *cctx, void *provctx) {
+  (void)cctx;
+  (void)provctx;
+  return prov_settable_ctx_table;
+}
+
+static const OSSL_PARAM *prov_settable_gcm_ctx_params(void *cctx,
+                                                      void *provctx) {
+  (void)cctx;
+  (void)provctx;
+  return prov_settable_gcm_ctx_table;
+}
+
+/*---------------------------------------------------------- ALGORITHMS
+ * ---------------------------------------------------------*/
+
+/* newctx, get_params and the dispatch table of one cipher */
+#define PROV_CIPHER(bits, lc, uc, evp_mode, blocksize, ivlen, aead, tables)   \
+  static void *prov_aes_##bits##_##lc##_newctx(void *provctx) {               \
+    return prov_newctx(provctx, PROV_##uc, (bits - 128) / 64);                 \
+  }                                                                            \
+  static int prov_aes_##bits##_##lc##_get_params(OSSL_PARAM params[]) {       \
+    return prov_get_params(params, evp_mode, bits / 8, blocksize, ivlen,       \
+                           aead);                                              \
+  }                                                                            \
+  static const OSSL_DISPATCH prov_aes_##bits##_##lc##_functions[] = {          \
+      {OSSL_FUNC_CIPHER_NEWCTX, (void (*)(void))prov_aes_##bits##_##lc##_newctx}, \
+      {OSSL_FUNC_CIPHER_FREECTX, (void (*)(void))prov_freectx},                \
+      {OSSL_FUNC_CIPHER_DUPCTX, (void (*)(void))prov_dupctx},                  \
+      {OSSL_FUNC_CIPHER_ENCRYPT_INIT, (void (*)(void))prov_encrypt_init},      \
+      {OSSL_FUNC_CIPHER_DECRYPT_INIT, (void (*)(void))prov_decrypt_init},      \
+      {OSSL_FUNC_CIPHER_UPDATE, (void (*)(void))prov_update},                  \
+      {OSSL_FUNC_CIPHER_FINAL, (void (*)(void))prov_final},                    \
+      {OSSL_FUNC_CIPHER_CIPHER, (void (*)(void))prov_cipher},                  \
+      {OSSL_FUNC_CIPHER_GET_PARAMS,                                            \
+       (void (*)(void))prov_aes_##bits##_##lc##_get_params},                   \
+      {OSSL_FUNC_CIPHER_GETTABLE_PARAMS, (void (*)(void))prov_gettable_params}, \
+      {OSSL_FUNC_CIPHER_GET_CTX_PARAMS, (void (*)(void))prov_get_ctx_params},  \
+      {OSSL_FUNC_CIPHER_SET_CTX_PARAMS, (void (*)(void))prov_set_ctx_params},  \
+      {OSSL_FUNC_CIPHER_GETTABLE_CTX_PARAMS,                                   \
+       (void (*)(void))prov_gettable_##tables##ctx_params},                    \
+      {OSSL_FUNC_CIPHER_SETTABLE_CTX_PARAMS,                                   \
+       (void (*)(void))prov_settable_##tables##ctx_params},                    \
+      {0, NULL}};
+
+PROV_CIPHER(128, ecb, ECB, EVP_CIPH_ECB_MODE, 16, 0, 0, )
+PROV_CIPHER(192, ecb, ECB, EVP_CIPH_ECB_MODE, 16, 0, 0, )
+PROV_CIPHER(256, ecb, ECB, EVP_CIPH_ECB_MODE, 16, 0, 0, )
+PROV_CIPHER(128, cbc, CBC, EVP_CIPH_CBC_MODE, 16, 16, 0, )
+PROV_CIPHER(192, cbc, CBC, EVP_CIPH_CBC_MODE, 16, 16, 0, )
+PROV_CIPHER(256, cbc, CBC, EVP_CIPH_CBC_MODE, 16, 16, 0, )
+PROV_CIPHER(128, ctr, CTR, EVP_CIPH_CTR_MODE, 1, 16, 0, )
+PROV_CIPHER(192, ctr, CTR, EVP_CIPH_CTR_MODE, 1, 16, 0, )
+PROV_CIPHER(256, ctr, CTR, EVP_CIPH_CTR_MODE, 1, 16, 0, )
+PROV_CIPHER(128, gcm, GCM, EVP_CIPH_GCM_MODE, 1, 12, 1, gcm_)
+PROV_CIPHER(192, gcm, GCM, EVP_CIPH_GCM_MODE, 1, 12, 1, gcm_)
+PROV_CIPHER(256, gcm, GCM, EVP_CIPH_GCM_MODE, 1, 12, 1, gcm_)
+
+/* Names as the default provider registers them */
+static const OSSL_ALGORITHM prov_ciphers[] = {
+    {"AES-128-ECB:2.16.840.1.101.3.4.1.1", "provider=" PROV_NAME,
+     prov_aes_128_ecb_functions, NULL},
+    {"AES-192-ECB:2.16.840.1.101.3.4.1.21", "provider=" PROV_NAME,
+     prov_aes_192_ecb_functions, NULL},
+    {"AES-256-ECB:2.16.840.1.101.3.4.1.41", "provider=" PROV_NAME,
+     prov_aes_256_ecb_functions, NULL},
+    {"AES-128-CBC:AES128:2.16.840.1.101.3.4.1.2", "provider=" PROV_NAME,
+     prov_aes_128_cbc_functions, NULL},
+    {"AES-192-CBC:AES192:2.16.840.1.101.3.4.1.22", "provider=" PROV_NAME,
+     prov_aes_192_cbc_functions, NULL},
+    {"AES-256-CBC:AES256:2.16.840.1.101.3.4.1.42", "provider=" PROV_NAME,
+     prov_aes_256_cbc_functions, NULL},
+    {"AES-128-CTR", "provider=" PROV_NAME, prov_aes_128_ctr_functions, NULL},
+    {"AES-192-CTR", "provider=" PROV_NAME, prov_aes_192_ctr_functions, NULL},
+    {"AES-256-CTR", "provider=" PROV_NAME, prov_aes_256_ctr_functions, NULL},
+    {"AES-128-GCM:id-aes128-GCM:2.16.840.1.101.3.4.1.6", "provider=" PROV_NAME,
+     prov_aes_128_gcm_functions, NULL},
+    {"AES-192-GCM:id-aes192-GCM:2.16.840.1.101.3.4.1.26", "provider=" PROV_NAME,
+     prov_aes_192_gcm_functions, NULL},
+    {"AES-256-GCM:id-aes256-GCM:2.16.840.1.101.3.4.1.46", "provider=" PROV_NAME,
+     prov_aes_256_gcm_functions, NULL},
+    {NULL, NULL, NULL, NULL}};
+
+/*------------------------------------------------------------ PROVIDER
+ * ---------------------------------------------------------*/
+
+static const OSSL_ALGORITHM *prov_query(void *provctx, int operation_id,
+                                        int *no_cache) {
+  (void)provctx;
+  *no_cache = 0;
+  return operation_id == OSSL_OP_CIPHER ? prov_ciphers : NULL;
+}
+
+static const OSSL_PARAM prov_param_types[] = {
+    OSSL_PARAM_DEFN(OSSL_PROV_PARAM_NAME, OSSL_PARAM_UTF8_PTR, NULL, 0),
+    OSSL_PARAM_DEFN(OSSL_PROV_PARAM_VERSION, OSSL_PARAM_UTF8_PTR, NULL, 0),
+    OSSL_PARAM_DEFN(OSSL_PROV_PARAM_BUILDINFO, OSSL_PARAM_UTF8_PTR, NULL, 0),
+    OSSL_PARAM_DEFN(OSSL_PROV_PARAM_STATUS, OSSL_PARAM_INTEGER, NULL, 0),
+    OSSL_PARAM_END};
+
+static const OSSL_PARAM *prov_gettable_provider_params(void *provctx) {
+  (void)provctx;
+  return prov_param_types;
+}
+
+static int prov_get_provider_params(void *provctx, OSSL_PARAM params[]) {
+  OSSL_PARAM *p;
+
+  (void)provctx;
+  if ((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_NAME)) &&
+      !OSSL_PARAM_set_utf8_ptr(p, "AES device provider"))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_VERSION)) &&
+      !OSSL_PARAM_set_utf8_ptr(p, PROV_VERSION))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_BUILDINFO)) &&
+      !OSSL_PARAM_set_utf8_ptr(p, PROV_VERSION))
+    return 0;
+  if ((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_STATUS)) &&
+      !OSSL_PARAM_set_int(p, 1))
+    return 0;
+  return 1;
+}
+
+static void prov_teardown(void *provctx) {
+  struct prov_ctx *prov = provctx;
+
+  aes_pool_close(prov->pool);
+  for (int i = 0; i < prov->nsims; i++)
+    aes_sim_destroy(prov->sims[i]);
+  for (int m = 0; m < PROV_NMODES; m++)
+    for (int k = 0; k < 3; k++)
+      EVP_CIPHER_free(prov->sw[m][k]);
+  OSSL_PROVIDER_unload(prov->deflt);
+  OSSL_LIB_CTX_free(prov->libctx);
+  free(prov);
+}
+
+static const OSSL_DISPATCH prov_dispatch[] = {
+    {OSSL_FUNC_PROVIDER_TEARDOWN, (void (*)(void))prov_teardown},
+    {OSSL_FUNC_PROVIDER_GETTABLE_PARAMS,
+     (void (*)(void))prov_gettable_provider_params},
+    {OSSL_FUNC_PROVIDER_GET_PARAMS, (void (*)(void))prov_get_provider_params},
+    {OSSL_FUNC_PROVIDER_QUERY_OPERATION, (void (*)(void))prov_query},
+    {0, NULL}};
+
+/* The "device" entry of the provider's configuration section */
+static const char *prov_config_device(const OSSL_CORE_HANDLE *handle,
+                                      const OSSL_DISPATCH *in) {
+  OSSL_FUNC_core_get_params_fn *get_params = NULL;
+  const char *device = NULL;
+  OSSL_PARAM p[2] = {OSSL_PARAM_END, OSSL_PARAM_END};
+
+  for (; in->function_id; in++)
+    if (in->function_id == OSSL_FUNC_CORE_GET_PARAMS)
+      get_params = OSSL_FUNC_core_get_params(in);
+  if (!get_params)
+    return NULL;
+  p[0] = OSSL_PARAM_construct_utf8_ptr("device", (char **)&device, 0);
+  if (!get_params(handle, p))
+    return NULL;
+  return device;
+}
+
+/* Open the device named by the configuration or AES_PROVIDER_DEVICE */
+static void prov_open_device(struct prov_ctx *prov, const char *device) {
+  const char *env = getenv("AES_PROVIDER_DEVICE");
+
+  if (env)
+    device = env;
+  if (device && !strcmp(device, "none"))
+    return;
+  if (device && !strncmp(device, "sim", 3)) {
+    int n = device[3] == ':' ? atoi(device + 4) : 1;
+
+    if (n < 1 || n > AES_POOL_MAX)
+      n = 1;
+    for (; prov->nsims < n; prov->nsims++)
+      if (!(prov->sims[prov->nsims] = aes_sim_create()))
+        return;
+    prov->pool = aes_pool_open_sim(prov->sims, prov->nsims);
+  } else {
+    prov->pool = aes_pool_open();
+  }
+  if (!prov->pool)
+    return;
+  env = getenv("AES_PROVIDER_MAX_INFLIGHT");
+  prov->max_inflight = env ? atoi(env) : 0;
+  if (prov->max_inflight <= 0)
+    prov->max_inflight = PROV_INFLIGHT_PER_INST * aes_pool_size(prov->pool);
+}
+
+int OSSL_provider_init(const OSSL_CORE_HANDLE *handle, const OSSL_DISPATCH *in,
+                       const OSSL_DISPATCH **out, void **provctx) {
+  struct prov_ctx *prov = calloc(1, sizeof(*prov));
+
+  if (!prov)
+    return 0;
+  prov->handle = handle;
+  prov->libctx = OSSL_LIB_CTX_new();
+  prov->deflt = prov->libctx ? OSSL_PROVIDER_load(prov->libctx, "default")
+                             : NULL;
+  for (int m = 0; prov->deflt && m < PROV_NMODES; m++)
+    for (int k = 0; k < 3; k++)
+      prov->sw[m][k] = EVP_CIPHER_fetch(prov->libctx, prov_sw_names[m][k],
+                                        NULL);
+  for (int m = 0; m < PROV_NMODES; m++)
+    for (int k = 0; k < 3; k++)
+      if (!prov->sw[m][k]) {
+        fprintf(stderr, "ERROR: Default provider AES unavailable\n");
+        prov_teardown(prov);
+        return 0;
+      }
+  prov_open_device(prov, prov_config_device(handle, in));
+  *out = prov_dispatch;
+  *provctx = prov;
+  return 1;
+}
@@ -0,0 +1,342 @@
+#include "aes_ref.h"
+
+#include <string.h>
+
+static const uint8_t sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b,
+    0xfe, 0xd7, 0xab, 0x76, 0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0,
+    0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0, 0xb7, 0xfd, 0x93, 0x26,
+    0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2,
+    0xeb, 0x27, 0xb2, 0x75, 0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0,
+    0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84, 0x53, 0xd1, 0x00, 0xed,
+    0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f,
+    0x50, 0x3c, 0x9f, 0xa8, 0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5,
+    0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2, 0xcd, 0x0c, 0x13, 0xec,
+    0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14,
+    0xde, 0x5e, 0x0b, 0xdb, 0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c,
+    0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79, 0xe7, 0xc8, 0x37, 0x6d,
+    0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f,
+    0x4b, 0xbd, 0x8b, 0x8a, 0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e,
+    0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e, 0xe1, 0xf8, 0x98, 0x11,
+    0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f,
+    0xb0, 0x54, 0xbb, 0x16};
+
+static const uint8_t inv_sbox[256] = {
+    0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e,
+    0x81, 0xf3, 0xd7, 0xfb, 0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87,
+    0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb, 0x54, 0x7b, 0x94, 0x32,
+    0xa6, 0xc2, 0x23, 0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
+    0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49,
+    0x6d, 0x8b, 0xd1, 0x25, 0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16,
+    0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92, 0x6c, 0x70, 0x48, 0x50,
+    0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
+    0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a, 0xf7, 0xe4, 0x58, 0x05,
+    0xb8, 0xb3, 0x45, 0x06, 0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02,
+    0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b, 0x3a, 0x91, 0x11, 0x41,
+    0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
+    0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8,
+    0x1c, 0x75, 0xdf, 0x6e, 0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89,
+    0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b, 0xfc, 0x56, 0x3e, 0x4b,
+    0xc6, 0xd2, 0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
+    0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59,
+    0x27, 0x80, 0xec, 0x5f, 0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d,
+    0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef, 0xa0, 0xe0, 0x3b, 0x4d,
+    0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
+    0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63,
+    0x55, 0x21, 0x0c, 0x7d};
+
+/* multiply by 2 in GF(2^8) */
+static uint8_t xtime(uint8_t x) {
+  return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1b : 0x00));
+}
+
+/**
+ *  @brief: Expand a 128/192/256-bit key into the round key schedule
+    @param: k
+    @param: key
+    @param: key_len (bytes)
+    @result: 0 on success, -1 for an unsupported key length
+*/
+int aes_ref_set_key(struct aes_ref_key *k, const uint8_t *key, int key_len) {
+  int nk = key_len / 4;
+  int words;
+  uint8_t rcon = 0x01;
+
+  if (key_len != 16 && key_len != 24 && key_len != 32)
+    return -1;
+
+  k->rounds = nk + 6;
+  words = 4 * (k->rounds + 1);
+  memcpy(k->rk, key, key_len);
+
+  for (int i = nk; i < words; i++) {
+    uint8_t t[4];
+    memcpy(t, &k->rk[4 * (i - 1)], 4);
+    if (i % nk == 0) {
+      uint8_t t0 = t[0];
+      t[0] = sbox[t[1]] ^ rcon;
+      t[1] = sbox[t[2]];
+      t[2] = sbox[t[3]];
+      t[3] = sbox[t0];
+      rcon = xtime(rcon);
+    } else if (nk > 6 && i % nk == 4) {
+      for (int j = 0; j < 4; j++)
+        t[j] = sbox[t[j]];
+    }
+    for (int j = 0; j < 4; j++)
+      k->rk[4 * i + j] = k->rk[4 * (i - nk) + j] ^ t[j];
+  }
+  return 0;
+}
+
+/**
+ *  @brief: Encrypt a single 16-byte block
+    @param: k
+    @param: in
+    @param: out (may alias in)
+    @result: None
+*/
+void aes_ref_encrypt_block(const struct aes_ref_key *k, const uint8_t in[16],
+                           uint8_t out[16]) {
+  uint8_t s[16], t[16];
+
+  for (int i = 0; i < 16; i++)
+    s[i] = in[i] ^ k->rk[i];
+
+  for (int round = 1; round <= k->rounds; round++) {
+    /* SubBytes and ShiftRows; the state is column-major, s[4*c + r] */
+    for (int c = 0; c < 4; c++)
+      for (int r = 0; r < 4; r++)
+        t[4 * c + r] = sbox[s[4 * ((c + r) % 4) + r]];
+
+    /* MixColumns, skipped in the final round */
+    if (round != k->rounds) {
+      for (int c = 0; c < 4; c++) {
+        uint8_t *col = &t[4 * c];
+        uint8_t all = col[0] ^ col[1] ^ col[2] ^ col[3];
+        uint8_t c0 = col[0];
+        col[0] ^= all ^ xtime(col[0] ^ col[1]);
+        col[1] ^= all ^ xtime(col[1] ^ col[2]);
+        col[2] ^= all ^ xtime(col[2] ^ col[3]);
+        col[3] ^= all ^ xtime(col[3] ^ c0);
+      }
+    }
+
+    for (int i = 0; i < 16; i++)
+      s[i] = t[i] ^ k->rk[16 * round + i];
+  }
+  memcpy(out, s, 16);
+}
+
+/* multiply in GF(2^8) */
+static uint8_t gmul(uint8_t a, uint8_t b) {
+  uint8_t p = 0;
+
+  for (; b; b >>= 1, a = xtime(a))
+    if (b & 1)
+      p ^= a;
+  return p;
+}
+
+/**
+ *  @brief: Decrypt a single 16-byte block with the inverse cipher
+    @param: k
+    @param: in
+    @param: out (may alias in)
+    @result: None
+*/
+void aes_ref_decrypt_block(const struct aes_ref_key *k, const uint8_t in[16],
+                           uint8_t out[16]) {
+  uint8_t s[16], t[16];
+
+  for (int i = 0; i < 16; i++)
+    s[i] = in[i] ^ k->rk[16 * k->rounds + i];
+
+  for (int round = k->rounds - 1; round >= 0; round--) {
+    /* InvShiftRows and InvSubBytes */
+    for (int c = 0; c < 4; c++)
+      for (int r = 0; r < 4; r++)
+        t[4 * c + r] = inv_sbox[s[4 * ((c + 4 - r) % 4) + r]];
+
+    for (int i = 0; i < 16; i++)
+      t[i] ^= k->rk[16 * round + i];
+
+    /* InvMixColumns, skipped after the last round key */
+    if (round) {
+      for (int c = 0; c < 4; c++) {
+        uint8_t *col = &t[4 * c], a[4];
+
+        memcpy(a, col, 4);
+        for (int r = 0; r < 4; r++)
+          col[r] = gmul(a[r], 14) ^ gmul(a[(r + 1) % 4], 11) ^
+                   gmul(a[(r + 2) % 4], 13) ^ gmul(a[(r + 3) % 4], 9);
+      }
+    }
+    memcpy(s, t, 16);
+  }
+  memcpy(out, s, 16);
+}
+
+/* GF(2^128) product in the GCM bit order (SP 800-38D, algorithm 1) */
+void aes_ref_gf128_mul(const uint8_t x[16], const uint8_t h[16],
+                       uint8_t out[16]) {
+  uint8_t z[16] = {0}, v[16];
+
+  memcpy(v, h, 16);
+  for (int i = 0; i < 128; i++) {
+    int lsb = v[15] & 1;
+
+    if (x[i / 8] & (0x80 >> (i % 8)))
+      for (int j = 0; j < 16; j++)
+        z[j] ^= v[j];
+    for (int j = 15; j > 0; j--)
+      v[j] = (uint8_t)((v[j] >> 1) | (v[j - 1] << 7));
+    v[0] >>= 1;
+    if (lsb)
+      v[0] ^= 0xe1;
+  }
+  memcpy(out, z, 16);
+}
+
+/* Increment the last `width` bytes of a counter block, big endian */
+static void ctr_inc(uint8_t ctr[16], int width) {
+  for (int i = 15; i >= 16 - width; i--)
+    if (++ctr[i])
+      break;
+}
+
+static void ctr_xor(const struct aes_ref_key *k, uint8_t ctr[16], int width,
+                    const uint8_t *in, uint8_t *out, size_t len) {
+  uint8_t ks[16];
+
+  for (size_t off = 0; off < len; off += 16) {
+    size_t n = len - off < 16 ? len - off : 16;
+
+    aes_ref_encrypt_block(k, ctr, ks);
+    ctr_inc(ctr, width);
+    for (size_t i = 0; i < n; i++)
+      out[off + i] = in[off + i] ^ ks[i];
+  }
+}
+
+/* CTR mode with a 128-bit big-endian counter, as in the Linux ctr(aes) */
+void aes_ref_ctr(const struct aes_ref_key *k, const uint8_t iv[16],
+                 const uint8_t *in, uint8_t *out, size_t len) {
+  uint8_t ctr[16];
+
+  memcpy(ctr, iv, 16);
+  ctr_xor(k, ctr, 16, in, out, len);
+}
+
+static void ghash(const uint8_t h[16], uint8_t y[16], const uint8_t *data,
+                  size_t len) {
+  for (size_t off = 0; off < len; off += 16) {
+    size_t n = len - off < 16 ? len - off : 16;
+
+    for (size_t i = 0; i < n; i++)
+      y[i] ^= data[off + i];
+    aes_ref_gf128_mul(y, h, y);
+  }
+}
+
+/* GCM with a 96-bit IV and a 128-bit tag. On decryption the tag is computed
+ * over the ciphertext in `in`; the caller compares it. */
+void aes_ref_gcm(const struct aes_ref_key *k, const uint8_t iv[12],
+                 const uint8_t *aad, size_t aad_len, const uint8_t *in,
+                 uint8_t *out, size_t len, int decrypt, uint8_t tag[16]) {
+  uint8_t h[16] = {0}, j0[16], ctr[16], y[16] = {0}, lens[16];
+  uint64_t abits = (uint64_t)aad_len * 8, cbits = (uint64_t)len * 8;
+
+  aes_ref_encrypt_block(k, h, h);
+  memcpy(j0, iv, 12);
+  j0[12] = j0[13] = j0[14] = 0;
+  j0[15] = 1;
+  memcpy(ctr, j0, 16);
+  ctr_inc(ctr, 4);
+
+  ghash(h, y, aad, aad_len);
+  if (decrypt)
+    ghash(h, y, in, len);
+  ctr_xor(k, ctr, 4, in, out, len);
+  if (!decrypt)
+    ghash(h, y, out, len);
+
+  for (int i = 0; i < 8; i++) {
+    lens[i] = (uint8_t)(abits >> (56 - 8 * i));
+    lens[8 + i] = (uint8_t)(cbits >> (56 - 8 * i));
+  }
+  ghash(h, y, lens, 16);
+  aes_ref_encrypt_block(k, j0, j0);
+  for (int i = 0; i < 16; i++)
+    tag[i] = y[i] ^ j0[i];
+}
+
+/* XTS with a 128-bit tweak, no ciphertext stealing (IEEE 1619). `len` is a
+ * multiple of 16 and covers one data unit. */
+void aes_ref_xts(const struct aes_ref_key *k1, const struct aes_ref_key *k2,
+                 const uint8_t iv[16], const uint8_t *in, uint8_t *out,
+                 size_t len, int decrypt) {
+  uint8_t t[16], x[16];
+
+  aes_ref_encrypt_block(k2, iv, t);
+  for (size_t off = 0; off + 16 <= len; off += 16) {
+    int carry = t[15] >> 7;
+
+    for (int i = 0; i < 16; i++)
+      x[i] = in[off + i] ^ t[i];
+    if (decrypt)
+      aes_ref_decrypt_block(k1, x, x);
+    else
+      aes_ref_encrypt_block(k1, x, x);
+    for (int i = 0; i < 16; i++)
+      out[off + i] = x[i] ^ t[i];
+
+    /* Multiply the tweak by alpha, little-endian */
+    for (int i = 15; i > 0; i--)
+      t[i] = (uint8_t)((t[i] << 1) | (t[i - 1] >> 7));
+    t[0] = (uint8_t)((t[0] << 1) ^ (carry ? 0x87 : 0));
+  }
+}
+
+/* Double in GF(2^128), big endian (RFC 4493 subkey generation) */
+static void cmac_dbl(uint8_t x[16]) {
+  int carry = x[0] >> 7;
+
+  for (int i = 0; i < 15; i++)
+    x[i] = (uint8_t)((x[i] << 1) | (x[i + 1] >> 7));
+  x[15] = (uint8_t)((x[15] << 1) ^ (carry ? 0x87 : 0));
+}
+
+/* AES-CMAC (RFC 4493) of `len` bytes, any length including zero */
+void aes_ref_cmac(const struct aes_ref_key *k, const uint8_t *in, size_t len,
+                  uint8_t tag[16]) {
+  uint8_t sub[16] = {0}, x[16] = {0};
+  size_t last = len ? (len - 1) / 16 * 16 : 0;
+
+  aes_ref_encrypt_block(k, sub, sub);
+  cmac_dbl(sub);
+  for (size_t off = 0; off < last; off += 16) {
+    for (int i = 0; i < 16; i++)
+      x[i] ^= in[off + i];
+    aes_ref_encrypt_block(k, x, x);
+  }
+
+  /* Complete last block with K1, padded with K2 */
+  if (len && len - last == 16) {
+    for (int i = 0; i < 16; i++)
+      x[i] ^= in[last + i];
+  } else {
+    for (size_t i = 0; i < len - last; i++)
+      x[i] ^= in[last + i];
+    x[len - last] ^= 0x80;
+    cmac_dbl(sub);
+  }
+  for (int i = 0; i < 16; i++)
+    x[i] ^= sub[i];
+  aes_ref_encrypt_block(k, x, tag);
+}
@@ -0,0 +1,2692 @@
+#define _DEFAULT_SOURCE
+#include "aes_sim.h"
+#include "aes_ref.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Register word indices, as decoded by AES_slave_lite_v1_0_S00_AXI.v */
+#define REG_ENABLE 0x00
+#define REG_KEY_CHOICE 0x01
+#define REG_PLAINTEXT0 0x02
+#define REG_KEY0 0x06
+#define REG_KEY_SLOT 0x0E
+#define REG_KEY_SLOT_CTRL 0x0F
+#define REG_KEY_SLOTS 0x10
+#define REG_MODE 0x11
+#define REG_DONE 0x12
+#define REG_COMP_STATE 0x13
+#define REG_CIPHERTEXT0 0x14
+#define REG_CIPHERTEXT3 0x17
+#define REG_CAPS 0x19
+#define REG_AAD_LEN 0x1B
+#define REG_TEXT_LEN 0x1C
+#define REG_KS_CTRL 0x1D
+#define REG_KS_STATUS 0x1E
+#define REG_BYTE_ORDER 0x1F
+#define REG_IV0 0x2C
+#define REG_TAG0 0x30
+#define REG_RING_TAIL 0x36
+#define REG_RING_HEAD 0x37
+#define REG_RING_STATUS 0x39
+#define REG_IRQ_CTRL 0x3A
+#define REG_IRQ_COUNT 0x3B
+#define REG_IRQ_TIME 0x3C
+#define REG_IRQ_STATUS 0x3D
+#define REG_CTX_INDEX 0x3E
+#define REG_CTX_DATA 0x3F
+#define NUM_REGS 64
+
+#define KEY_SLOT_MASK 0x3f
+#define KEY_SLOT_EN (1u << 8)
+#define KEY_SLOT_STORE 1
+
+/* MODE register: [2:0] mode, [3] decrypt, [5:4] operation, [12:8] bytes */
+#define MODE_DECRYPT (1u << 3)
+#define MODE_OP_SHIFT 4
+#define MODE_BYTES_SHIFT 8
+#define OP_BLOCK 0
+#define OP_AAD 1
+#define OP_INIT 2
+#define OP_FINAL 3
+#define CAPS_DECRYPT (1u << 16)
+#define CAPS_DOORBELL (1u << 17)
+#define CAPS_BANKS (1u << 18)
+#define CAPS_RING (1u << 19)
+#define CAPS_IRQ (1u << 20)
+#define CAPS_WINDOW (1u << 21)
+#define CAPS_KS (1u << 22)
+#define CAPS_CTX (1u << 23)
+#define CAPS_BYTE_ORDER (1u << 24)
+#define BYTE_ORDER_LE 1
+#define CTX_WORDS 8
+#define KS_CTRL_EN 1
+#define KS_CTRL_FLUSH 2
+/* Clocks after a flush before the keystream buffer fills again */
+#define KS_QUIET_CYCLES 3
+#define ENABLE_AUTO (1u << 1)
+#define ENABLE_BANKS (1u << 2)
+
+/* BUSY cycles: one cipher pass, two and a clock for GCM INIT (E(0), then
+ * E(J0) once the core's input register holds J0), and one plus the four
+ * digit steps of the GHASH multiplier plus its done pulse for GCM operations
+ * that hash. A cipher pass is hw_core_cycles long. */
+#define GCM_HASH_EXTRA_CYCLES 5
+
+#define STATE_IDLE 0
+#define STATE_BUSY 1
+#define STATE_FINISHED 2
+
+/* Ring descriptor CTRL and STATUS, as in AES_ring.v */
+#define RING_DESC_MORE (1u << 4)
+#define RING_DESC_KEY_PTR (1u << 5)
+#define RING_DESC_KEY_CHOICE_SHIFT 6
+#define RING_DESC_KEY_SLOT_SHIFT 8
+#define RING_DESC_DONE (1u << 31)
+#define RING_ERR_DESC 1
+
+#define IRQ_COUNT_MASK 0xffff
+#define IRQ_NEVER UINT64_MAX
+
+/* Same policy constants as AES_KEY_BATCH_MAX, AES_RING_ENTRIES, AES_CLK_MHZ
+ * and the AES_IRQ_* tunable defaults in the driver */
+#define SIM_KEY_BATCH_MAX 8
+#define SIM_RING_ENTRIES 64
+#define SIM_CLK_MHZ 100
+#define SIM_IRQ_COALESCE_COUNT 16
+#define SIM_IRQ_COALESCE_USECS 20
+#define SIM_IRQ_POLL_THRESHOLD 4
+#define SIM_ZERO_COPY_MIN 4096
+#define SIM_BUF_POOL_MAX (64 * 1024 * 1024)
+#define SIM_PAGE_SIZE 4096
+#define SIM_KMALLOC_MAX (4u << 20) // larger bounce buffers are vmalloc()ed
+#define SIM_CHUNK_SIZE (16 * 1024)
+#define SIM_DEADLINE_HIGH_US 1000
+#define SIM_DEADLINE_NORMAL_US 100000
+
+/* A ring descriptor in the modelled memory: the driver's struct
+ * AES_ring_desc with host pointers for bus addresses */
+struct sim_ring_desc {
+  uint32_t ctrl;
+  const uint32_t *key;
+  const uint8_t *aad;
+  const uint8_t *src;
+  uint8_t *dst;
+  uint32_t aad_len;
+  uint32_t len;
+  uint8_t iv[16];
+  uint32_t status;
+  uint8_t tag[16];
+};
+
+struct aes_sim_job {
+  struct aes_sim_job *next;
+  const struct aes_job *desc;
+  struct aes_sim_client *client;
+  /* Submission queue jobs: their own copy of the SQ entry */
+  int uring;
+  struct aes_job req;
+  uint64_t user_data;
+  uint8_t *buf; // additional data then text, the text processed in place;
+                // NULL for a zero-copy job
+  size_t buf_len;
+  uint64_t host_ns; // copying or pinning in the submitting thread
+  int pooled;       // zero copy from the client's buffer pool
+  uint8_t tag[AES_GCM_TAG_LEN]; // GCM: computed, or expected on decryption.
+                                // CMAC: the MAC or chaining value
+  int status;
+  unsigned int ring_descs; // descriptors on the ring and not yet reaped
+  int ring_posted;         // all of the job's descriptors have been posted
+  uint32_t prio;      // AES_PRIO_*, set on submission
+  uint64_t deadline;  // EDF: device time when due
+  uint64_t submit_ns; // device time when queued, for the latency samples
+  uint32_t offset;    // bytes of text run by earlier chunks
+  uint8_t ctx[4 * CTX_WORDS]; // GCM: engine context between chunks
+  int done;
+  pthread_cond_t done_cv;
+};
+
+/* Mirrors the driver's struct AES_uring; the done list and running are
+ * under the device lock */
+struct sim_uring {
+  void *mem;
+  uint32_t entries;
+  struct aes_uring_hdr *hdr;
+  struct aes_uring_sqe *sqes;
+  struct aes_uring_cqe *cqes;
+  uint32_t sq_head, cq_tail;
+  unsigned int inflight;
+  struct aes_sim_job *done_head, *done_tail;
+  unsigned int running;
+  pthread_cond_t cv;
+};
+
+struct aes_sim_client {
+  struct aes_sim *sim;
+  int slot;
+  struct aes_sim_job *head[AES_PRIO_CLASSES], *tail[AES_PRIO_CLASSES];
+  uint32_t prio, deadline_us; // as AES_IOC_SET_PRIO sets them, under lock
+  /* Submission to completion device time of each job, under lock */
+  uint64_t *lat;
+  size_t lat_count, lat_cap;
+  struct sim_uring *uring;
+  /* Mirrors the driver's struct AES_bufpool; the caller's view of the pool
+   * is the allocation itself */
+  uint8_t *bufs;
+  size_t bufs_size;
+};
+
+struct aes_sim {
+  pthread_mutex_t lock;
+  pthread_cond_t work_cv;
+  pthread_t worker;
+  int stop;
+  struct aes_sim_client *clients[AES_SIM_MAX_CLIENTS];
+  int rr[AES_PRIO_CLASSES]; // next slot in round robin order, per class
+  unsigned int chunk_size;   // scheduling tunables, read by the worker
+  int sched_edf;
+  uint64_t now_ns; // device time at the worker's last pickup or completion,
+                   // under lock
+
+  /* Hardware model, only touched by the worker thread */
+  uint32_t regs[NUM_REGS];
+  int comp_state;
+  uint64_t finish_ns; // when the operation in BUSY reaches FINISHED
+  unsigned int busy_cycles; // BUSY cycles of the operation in progress
+  int counts_block;         // the operation in progress moves a data block
+  uint8_t hw_ctr[16], hw_h[16], hw_y[16], hw_ek_j0[16]; // FIPS byte order
+                                                        // (hw_ctr: XTS tweak,
+                                                        // hw_y: CMAC chain)
+  uint8_t hw_cmac_k1[16];
+  struct aes_ref_key hw_key;
+  int hw_key_dirty;
+  int hw_num_key_slots;
+  int hw_doorbell; // gateware has ENABLE_AUTO
+  int hw_banks;    // gateware has data banks (ENABLE_BANKS)
+  unsigned int hw_core_cycles; // cycles per cipher pass
+  unsigned int hw_burst_width; // AXI4 burst slave beat, 0 for AXI4-Lite
+  /* Data banks: software fills bank_in[in_wr] and reads bank_out[out_rd]
+   * while the engine takes bank_in[in_rd] and fills bank_out[out_wr] */
+  uint32_t bank_in[2][4], bank_out[2][4];
+  uint32_t bank_result[4]; // result of the bank operation in progress
+  int in_full[2], out_valid[2];
+  int in_wr, in_rd, out_wr, out_rd;
+  int bank_op; // the operation in progress came from a data bank
+  struct aes_ref_key hw_key_slots[AES_SIM_KEY_SLOTS_MAX]; // expanded keys
+  int hw_ring; // gateware has the descriptor ring
+  /* Descriptors the engine has been handed run back to back; HEAD counts
+   * those whose completion time has passed */
+  uint32_t hw_ring_tail;
+  uint64_t hw_ring_free_ns; // when the engine finishes the last one
+  uint64_t ring_done_ns[SIM_RING_ENTRIES];
+  struct sim_ring_desc ring_desc[SIM_RING_ENTRIES]; // memory
+  int hw_irq; // gateware has the completion interrupt
+  uint32_t hw_irq_from; // first descriptor counted towards the next IRQ
+  uint64_t hw_irq_first_ns; // its completion, once its slot has been reused
+  /* CTR keystream buffer: only its fill level is kept, the results being
+   * computed as each block is taken. It fills from ks_idle_ns while the FSM
+   * is IDLE. */
+  unsigned int hw_ks_depth; // C_KS_DEPTH, 0 without the buffer
+  unsigned int ks_count;
+  int ks_armed;        // CTR INIT has loaded the counter the buffer follows
+  uint64_t ks_idle_ns; // start of the next FILL, if IDLE and not full
+
+  /* Driver state, only touched by the worker thread */
+  int key_valid;
+  uint32_t key_choice;
+  uint32_t key[8];
+  unsigned int key_batch;
+  uint32_t mode; // last value written to MODE
+  int doorbell_on; // ENABLE_AUTO is set
+  /* Mirrors the driver's descriptor ring */
+  uint32_t ring_keys[SIM_RING_ENTRIES][8];
+  struct aes_sim_job *ring_jobs[SIM_RING_ENTRIES];
+  uint32_t ring_head, ring_tail;
+  uint64_t ring_key_clock;
+  /* Mirrors the driver's completion interrupt handling */
+  int ring_polling; // IRQ_CTRL is off
+  uint32_t irq_count; // last value written to IRQ_COUNT
+  unsigned int irq_coalesce_count, irq_coalesce_usecs, irq_poll_threshold;
+  unsigned int zero_copy_min; // read by the submitting threads
+  size_t buf_pool_bytes;      // of the clients' pools, under lock
+  uint64_t sleep_ns; // device time the worker slept on the interrupt
+  uint64_t idle_ns;  // device time to pass before the next job, under lock
+  /* Mirrors the driver's key slot LRU */
+  struct {
+    int valid;
+    uint32_t key_choice;
+    uint32_t key[8];
+    uint64_t last_used;
+  } key_slots[AES_SIM_KEY_SLOTS_MAX];
+  uint64_t key_slot_clock;
+
+  struct aes_sim_stats hw_stats; // worker copy
+  struct aes_sim_stats stats;    // published under lock after each job
+  uint64_t syscalls;             // counted under lock by the callers
+};
+
+/*--------------------------------------------------------- HARDWARE MODEL
+ * ---------------------------------------------------------*/
+
+static void hw_start_op(struct aes_sim *sim, uint64_t now);
+
+/* The FSM takes FILL from IDLE while these hold */
+static int hw_ks_filling(const struct aes_sim *sim) {
+  return sim->hw_ks_depth && (sim->regs[REG_KS_CTRL] & KS_CTRL_EN) &&
+         sim->ks_armed && (sim->regs[REG_MODE] & 7) == AES_MODE_CTR &&
+         sim->ks_count < sim->hw_ks_depth && sim->comp_state == STATE_IDLE;
+}
+
+/* IDLE and FILL alternate: a buffered block every pass plus a clock */
+static uint64_t hw_ks_fill_ns(const struct aes_sim *sim) {
+  return (1 + (uint64_t)sim->hw_core_cycles) * AES_SIM_CLK_NS;
+}
+
+/* The blocks buffered in IDLE up to now */
+static void hw_ks_fill(struct aes_sim *sim, uint64_t now) {
+  uint64_t n;
+
+  if (!hw_ks_filling(sim) || now <= sim->ks_idle_ns)
+    return;
+  n = (now - sim->ks_idle_ns) / hw_ks_fill_ns(sim);
+  if (n >= sim->hw_ks_depth - sim->ks_count) {
+    sim->ks_count = sim->hw_ks_depth;
+    sim->ks_idle_ns = now;
+    return;
+  }
+  sim->ks_count += n;
+  sim->ks_idle_ns += n * hw_ks_fill_ns(sim);
+}
+
+/* Empties the buffer, dropping a block under way; filling resumes after
+ * KS_QUIET_CYCLES */
+static void hw_ks_flush(struct aes_sim *sim) {
+  hw_ks_fill(sim, sim->hw_stats.modeled_ns);
+  sim->ks_count = 0;
+  sim->ks_idle_ns =
+      sim->hw_stats.modeled_ns + KS_QUIET_CYCLES * AES_SIM_CLK_NS;
+}
+
+/* A register write that changes what the keystream depends on */
+static void hw_ks_write(struct aes_sim *sim, unsigned int reg, uint32_t val) {
+  int disarm = (reg == REG_MODE && (val & 7) != AES_MODE_CTR) ||
+               (reg == REG_KS_CTRL && !(val & KS_CTRL_EN)) ||
+               reg == REG_CTX_DATA;
+
+  if (disarm || (reg == REG_KS_CTRL && (val & KS_CTRL_FLUSH)) ||
+      ((reg == REG_KEY_CHOICE || (reg >= REG_KEY0 && reg <= REG_KEY_SLOT) ||
+        reg == REG_BYTE_ORDER) &&
+       val != sim->regs[reg]) ||
+      (reg == REG_KEY_SLOT_CTRL && (val & KEY_SLOT_STORE)))
+    hw_ks_flush(sim);
+  if (disarm)
+    sim->ks_armed = 0;
+  if (reg == REG_KS_CTRL)
+    sim->regs[REG_KS_CTRL] = val & KS_CTRL_EN;
+}
+
+static int hw_banks_on(const struct aes_sim *sim) {
+  return sim->hw_banks && (sim->regs[REG_ENABLE] & ENABLE_AUTO) &&
+         (sim->regs[REG_ENABLE] & ENABLE_BANKS);
+}
+
+/* Clearing ENABLE_BANKS empties both banks */
+static void hw_bank_reset(struct aes_sim *sim) {
+  memset(sim->in_full, 0, sizeof(sim->in_full));
+  memset(sim->out_valid, 0, sizeof(sim->out_valid));
+  sim->in_wr = sim->in_rd = sim->out_wr = sim->out_rd = 0;
+}
+
+/* IDLE takes the next full data bank once its result bank is free */
+static void hw_bank_start(struct aes_sim *sim, uint64_t now) {
+  if (sim->comp_state == STATE_IDLE && hw_banks_on(sim) &&
+      sim->in_full[sim->in_rd] && !sim->out_valid[sim->out_wr]) {
+    sim->bank_op = 1;
+    hw_start_op(sim, now);
+  }
+}
+
+static void hw_advance(struct aes_sim *sim) {
+  while (sim->comp_state == STATE_BUSY &&
+         sim->hw_stats.modeled_ns >= sim->finish_ns) {
+    sim->hw_stats.busy_cycles += sim->busy_cycles;
+    sim->hw_stats.blocks += sim->counts_block;
+    if (!sim->bank_op) {
+      sim->comp_state = STATE_FINISHED;
+      sim->regs[REG_DONE] = 1;
+      break;
+    }
+    /* A bank's result goes to its result bank and the FSM returns to IDLE,
+     * where it may take the other bank straight away */
+    sim->bank_op = 0;
+    sim->comp_state = STATE_IDLE;
+    sim->ks_idle_ns = sim->finish_ns;
+    if (hw_banks_on(sim)) {
+      memcpy(sim->bank_out[sim->out_wr], sim->bank_result,
+             sizeof(sim->bank_result));
+      sim->out_valid[sim->out_wr] = 1;
+      sim->out_wr ^= 1;
+      sim->in_full[sim->in_rd] = 0;
+      sim->in_rd ^= 1;
+      hw_bank_start(sim, sim->finish_ns);
+    }
+  }
+  sim->regs[REG_COMP_STATE] = sim->comp_state;
+}
+
+static int hw_le_words(const struct aes_sim *sim) {
+  return sim->regs[REG_BYTE_ORDER] & BYTE_ORDER_LE;
+}
+
+/* Register word `w` of `words` to bytes: a little-endian word, or with
+ * BYTE_ORDER clear word nw-1-w big-endian, the original packing of nw words
+ * in FIPS order from the top byte of the highest */
+static void hw_get_word(const struct aes_sim *sim, const uint32_t *words,
+                        int nw, int w, uint8_t out[4]) {
+  uint32_t v = hw_le_words(sim) ? words[w] : words[nw - 1 - w];
+
+  if (hw_le_words(sim))
+    memcpy(out, &v, 4);
+  else
+    for (int i = 0; i < 4; i++)
+      out[i] = (uint8_t)(v >> (24 - 8 * i));
+}
+
+static void hw_put_word(const struct aes_sim *sim, uint32_t *words, int nw,
+                        int w, const uint8_t in[4]) {
+  if (hw_le_words(sim))
+    memcpy(&words[w], in, 4);
+  else
+    words[nw - 1 - w] = (uint32_t)in[0] << 24 | (uint32_t)in[1] << 16 |
+                        (uint32_t)in[2] << 8 | in[3];
+}
+
+/* Expansion of the key registers, cached until they are written */
+static const struct aes_ref_key *hw_expanded_key(struct aes_sim *sim) {
+  uint8_t key[32] = {0};
+  int choice = sim->regs[REG_KEY_CHOICE] & 3;
+
+  if (sim->hw_key_dirty) {
+    for (int i = 0; i < (choice == 3 ? 0 : 4 + 2 * choice); i++)
+      hw_get_word(sim, &sim->regs[REG_KEY0], 4 + 2 * choice, i, key + 4 * i);
+    sim->hw_key.rounds = 0;
+    if (choice != 3)
+      aes_ref_set_key(&sim->hw_key, key, 16 + 8 * choice);
+    sim->hw_key_dirty = 0;
+  }
+  return &sim->hw_key;
+}
+
+static void hw_encrypt(const struct aes_ref_key *key, const uint8_t in[16],
+                       uint8_t out[16]) {
+  if (key->rounds)
+    aes_ref_encrypt_block(key, in, out);
+  else
+    memset(out, 0, 16);
+}
+
+static void hw_decrypt(const struct aes_ref_key *key, const uint8_t in[16],
+                       uint8_t out[16]) {
+  if (key->rounds)
+    aes_ref_decrypt_block(key, in, out);
+  else
+    memset(out, 0, 16);
+}
+
+/* Multiply an XTS tweak by alpha, the tweak read as a little-endian number */
+static void hw_xts_mul_alpha(uint8_t t[16]) {
+  int carry = t[15] >> 7;
+
+  for (int i = 15; i > 0; i--)
+    t[i] = (uint8_t)((t[i] << 1) | (t[i - 1] >> 7));
+  t[0] = (uint8_t)((t[0] << 1) ^ (carry ? 0x87 : 0));
+}
+
+/* Double in GF(2^128), big endian, as for the CMAC subkeys */
+static void hw_cmac_dbl(uint8_t x[16]) {
+  int carry = x[0] >> 7;
+
+  for (int i = 0; i < 15; i++)
+    x[i] = (uint8_t)((x[i] << 1) | (x[i + 1] >> 7));
+  x[15] = (uint8_t)((x[15] << 1) ^ (carry ? 0x87 : 0));
+}
+
+/* Increment the last `width` bytes of a counter block, big endian */
+static void hw_ctr_inc(uint8_t ctr[16], int width) {
+  for (int i = 15; i >= 16 - width; i--)
+    if (++ctr[i])
+      break;
+}
+
+static void hw_ghash(struct aes_sim *sim, const uint8_t x[16]) {
+  for (int i = 0; i < 16; i++)
+    sim->hw_y[i] ^= x[i];
+  aes_ref_gf128_mul(sim->hw_y, sim->hw_h, sim->hw_y);
+}
+
+/* The result is computed up front and becomes visible when BUSY ends. `now`
+ * is when IDLE saw the start. */
+static void hw_start_op(struct aes_sim *sim, uint64_t now) {
+  const uint32_t *words =
+      sim->bank_op ? sim->bank_in[sim->in_rd] : &sim->regs[REG_PLAINTEXT0];
+  unsigned int core = sim->hw_core_cycles;
+  const struct aes_ref_key *key;
+  uint8_t data[16], iv[16], ks[16], out[16] = {0};
+  uint32_t slot = sim->regs[REG_KEY_SLOT], mode = sim->regs[REG_MODE];
+  unsigned int op = (mode >> MODE_OP_SHIFT) & 3;
+  unsigned int n = (mode >> MODE_BYTES_SHIFT) & 0x1f;
+
+  if ((slot & KEY_SLOT_EN) &&
+      (int)(slot & KEY_SLOT_MASK) < sim->hw_num_key_slots)
+    key = &sim->hw_key_slots[slot & KEY_SLOT_MASK];
+  else
+    key = hw_expanded_key(sim);
+  if (!n || n > 16)
+    n = 16;
+  /* A FILL under way when the operation arrives runs to the end first */
+  hw_ks_fill(sim, now);
+  if (hw_ks_filling(sim) && now >= sim->ks_idle_ns + AES_SIM_CLK_NS) {
+    now = sim->ks_idle_ns + hw_ks_fill_ns(sim);
+    sim->ks_count++;
+  }
+
+  for (int i = 0; i < 4; i++) {
+    hw_get_word(sim, words, 4, i, data + 4 * i);
+    memcpy(iv + 4 * i, &sim->regs[REG_IV0 + i], 4);
+  }
+  memset(data + n, 0, 16 - n);
+
+  sim->busy_cycles = core;
+  sim->counts_block = op == OP_BLOCK || op == OP_AAD;
+  switch (mode & 7) {
+  case AES_MODE_ECB:
+    if (op == OP_BLOCK && (mode & MODE_DECRYPT))
+      hw_decrypt(key, data, out);
+    else if (op == OP_BLOCK)
+      hw_encrypt(key, data, out);
+    break;
+  case AES_MODE_XTS:
+    /* INIT encrypts IV with the key selected then, normally the tweak key */
+    if (op == OP_INIT)
+      hw_encrypt(key, iv, sim->hw_ctr);
+    if (op != OP_BLOCK)
+      break;
+    for (int i = 0; i < 16; i++)
+      ks[i] = data[i] ^ sim->hw_ctr[i];
+    if (mode & MODE_DECRYPT)
+      hw_decrypt(key, ks, out);
+    else
+      hw_encrypt(key, ks, out);
+    for (int i = 0; i < 16; i++)
+      out[i] ^= sim->hw_ctr[i];
+    hw_xts_mul_alpha(sim->hw_ctr);
+    sim->regs[REG_TEXT_LEN] += 16;
+    break;
+  case AES_MODE_CMAC: {
+    /* FINAL reads the byte count literally: 16 complete, 0-15 padded */
+    unsigned int last = (mode >> MODE_BYTES_SHIFT) & 0x1f;
+
+    if (last > 16)
+      last = 16;
+    switch (op) {
+    case OP_INIT:
+      memset(sim->hw_cmac_k1, 0, 16);
+      hw_encrypt(key, sim->hw_cmac_k1, sim->hw_cmac_k1);
+      hw_cmac_dbl(sim->hw_cmac_k1);
+      memcpy(sim->hw_y, iv, 16);
+      sim->regs[REG_TEXT_LEN] = 0;
+      break;
+    case OP_BLOCK:
+      for (int i = 0; i < 16; i++)
+        sim->hw_y[i] ^= data[i];
+      hw_encrypt(key, sim->hw_y, sim->hw_y);
+      sim->regs[REG_TEXT_LEN] += 16;
+      break;
+    case OP_FINAL:
+      for (int i = 0; i < 4; i++)
+        memcpy(ks + 4 * i, &words[i], 4);
+      memset(ks + last, 0, 16 - last);
+      memcpy(iv, sim->hw_cmac_k1, 16);
+      if (last < 16) {
+        ks[last] = 0x80;
+        hw_cmac_dbl(iv);
+      }
+      for (int i = 0; i < 16; i++)
+        sim->hw_y[i] ^= ks[i] ^ iv[i];
+      hw_encrypt(key, sim->hw_y, sim->hw_y);
+      sim->regs[REG_TEXT_LEN] += last;
+      break;
+    default:
+      break;
+    }
+    /* TAG holds the chaining value, and the MAC after FINAL */
+    for (int i = 0; i < 4; i++)
+      memcpy(&sim->regs[REG_TAG0 + i], sim->hw_y + 4 * i, 4);
+    break;
+  }
+  case AES_MODE_CTR:
+    if (op == OP_INIT) {
+      /* The buffer stays when the IV continues the counter */
+      if (!sim->ks_armed || memcmp(iv, sim->hw_ctr, 16))
+        sim->ks_count = 0;
+      if (sim->regs[REG_KS_CTRL] & KS_CTRL_EN)
+        sim->ks_armed = 1;
+      memcpy(sim->hw_ctr, iv, 16);
+    }
+    if (op != OP_BLOCK)
+      break;
+    if (sim->ks_count) {
+      /* Buffered keystream, XORed in the first BUSY cycle */
+      sim->ks_count--;
+      sim->busy_cycles = 1;
+      sim->hw_stats.ks_hits++;
+    }
+    hw_encrypt(key, sim->hw_ctr, ks);
+    hw_ctr_inc(sim->hw_ctr, 16);
+    for (unsigned int i = 0; i < n; i++)
+      out[i] = data[i] ^ ks[i];
+    sim->regs[REG_TEXT_LEN] += n;
+    break;
+  case AES_MODE_GCM:
+    sim->busy_cycles = op == OP_INIT ? 2 * core + 1 : core + GCM_HASH_EXTRA_CYCLES;
+    switch (op) {
+    case OP_INIT:
+      memset(sim->hw_h, 0, 16);
+      hw_encrypt(key, sim->hw_h, sim->hw_h);
+      hw_encrypt(key, iv, sim->hw_ek_j0);
+      memcpy(sim->hw_ctr, iv, 16);
+      hw_ctr_inc(sim->hw_ctr, 4);
+      memset(sim->hw_y, 0, 16);
+      sim->regs[REG_AAD_LEN] = 0;
+      sim->regs[REG_TEXT_LEN] = 0;
+      break;
+    case OP_AAD:
+      hw_ghash(sim, data);
+      sim->regs[REG_AAD_LEN] += n;
+      break;
+    case OP_BLOCK:
+      hw_encrypt(key, sim->hw_ctr, ks);
+      hw_ctr_inc(sim->hw_ctr, 4);
+      for (unsigned int i = 0; i < n; i++)
+        out[i] = data[i] ^ ks[i];
+      hw_ghash(sim, (mode & MODE_DECRYPT) ? data : out);
+      sim->regs[REG_TEXT_LEN] += n;
+      break;
+    case OP_FINAL: {
+      uint64_t abits = (uint64_t)sim->regs[REG_AAD_LEN] * 8;
+      uint64_t tbits = (uint64_t)sim->regs[REG_TEXT_LEN] * 8;
+      uint8_t lens[16];
+
+      for (int i = 0; i < 8; i++) {
+        lens[i] = (uint8_t)(abits >> (56 - 8 * i));
+        lens[8 + i] = (uint8_t)(tbits >> (56 - 8 * i));
+      }
+      hw_ghash(sim, lens);
+      for (int i = 0; i < 16; i++)
+        ks[i] = sim->hw_ek_j0[i] ^ sim->hw_y[i];
+      for (int i = 0; i < 4; i++)
+        memcpy(&sim->regs[REG_TAG0 + i], ks + 4 * i, 4);
+      break;
+    }
+    }
+    break;
+  default:
+    break;
+  }
+  for (int i = 0; i < 4; i++)
+    hw_put_word(sim,
+                sim->bank_op ? sim->bank_result : &sim->regs[REG_CIPHERTEXT0],
+                4, i, out + 4 * i);
+
+  sim->regs[REG_DONE] = 0;
+  sim->comp_state = STATE_BUSY;
+  /* IDLE samples enable on the next edge, BUSY retires on the last cycle */
+  sim->finish_ns = now + (1 + sim->busy_cycles) * AES_SIM_CLK_NS;
+}
+
+/* The FSM reacting to a new value of enable */
+static void hw_enable(struct aes_sim *sim, uint32_t val) {
+  if ((val & 1) && sim->comp_state == STATE_IDLE) {
+    sim->bank_op = 0;
+    hw_start_op(sim, sim->hw_stats.modeled_ns);
+  } else if (!(val & 1) && sim->comp_state == STATE_FINISHED) {
+    /* Time the result sat in FINISHED waiting for software */
+    sim->hw_stats.finished_wait_cycles +=
+        (sim->hw_stats.modeled_ns - sim->finish_ns) / AES_SIM_CLK_NS;
+    sim->comp_state = STATE_IDLE;
+    sim->ks_idle_ns = sim->hw_stats.modeled_ns;
+  }
+}
+
+static void hw_ring_kick(struct aes_sim *sim, uint32_t tail);
+
+/* HEAD: the descriptors whose completion time has passed */
+static uint32_t hw_ring_head(struct aes_sim *sim) {
+  while (sim->regs[REG_RING_HEAD] != sim->hw_ring_tail &&
+         sim->ring_done_ns[sim->regs[REG_RING_HEAD] % SIM_RING_ENTRIES] <=
+             sim->hw_stats.modeled_ns)
+    sim->regs[REG_RING_HEAD]++;
+  return sim->regs[REG_RING_HEAD];
+}
+
+/* Completion time of descriptor i, counted towards the next IRQ. The
+ * gateware counts completions rather than ring slots, so the count can
+ * outlive a slot the ring has since reused: every such descriptor completed
+ * before the kick that reused it, and is taken to have completed with the
+ * first one counted. */
+static uint64_t hw_irq_done_ns(const struct aes_sim *sim, uint32_t i) {
+  if (sim->hw_ring_tail - i > SIM_RING_ENTRIES)
+    return sim->hw_irq_first_ns;
+  return sim->ring_done_ns[i % SIM_RING_ENTRIES];
+}
+
+/* When IRQ next fires as the coalescing logic counts: at the IRQ_COUNT-th
+ * completion from hw_irq_from, or IRQ_TIME cycles after the first */
+static uint64_t hw_irq_fire_ns(const struct aes_sim *sim) {
+  uint32_t from = sim->hw_irq_from;
+  uint32_t count = sim->regs[REG_IRQ_COUNT] & IRQ_COUNT_MASK;
+  uint64_t fire = IRQ_NEVER, first;
+
+  if (!(sim->regs[REG_IRQ_CTRL] & 1) || from == sim->hw_ring_tail)
+    return IRQ_NEVER;
+  if (!count)
+    count = 1;
+  if (sim->hw_ring_tail - from >= count)
+    fire = hw_irq_done_ns(sim, from + count - 1);
+  first = hw_irq_done_ns(sim, from);
+  if (sim->regs[REG_IRQ_TIME] &&
+      first + (uint64_t)sim->regs[REG_IRQ_TIME] * AES_SIM_CLK_NS < fire)
+    fire = first + (uint64_t)sim->regs[REG_IRQ_TIME] * AES_SIM_CLK_NS;
+  return fire;
+}
+
+/* Latch the interrupts that have fired by now; the completions up to each
+ * one are used up by it */
+static void hw_irq_advance(struct aes_sim *sim) {
+  uint64_t fire;
+
+  while ((fire = hw_irq_fire_ns(sim)) <= sim->hw_stats.modeled_ns) {
+    sim->regs[REG_IRQ_STATUS] = 1;
+    while (sim->hw_irq_from != sim->hw_ring_tail &&
+           hw_irq_done_ns(sim, sim->hw_irq_from) <= fire)
+      sim->hw_irq_from++;
+  }
+}
+
+/* The coalescing registers, on the AXI-Lite path only */
+static void hw_irq_write(struct aes_sim *sim, unsigned int reg, uint32_t val) {
+  hw_irq_advance(sim);
+  if (reg == REG_IRQ_CTRL) {
+    /* Enabling starts the count afresh */
+    if ((val & 1) && !(sim->regs[REG_IRQ_CTRL] & 1))
+      sim->hw_irq_from = hw_ring_head(sim);
+    sim->regs[REG_IRQ_CTRL] = val & 1;
+  } else if (reg == REG_IRQ_COUNT) {
+    sim->regs[REG_IRQ_COUNT] = val & IRQ_COUNT_MASK;
+  } else if (reg == REG_IRQ_TIME) {
+    sim->regs[REG_IRQ_TIME] = val;
+  } else if (val & 1) {
+    sim->regs[REG_IRQ_STATUS] = 0;
+  }
+}
+
+/* The context window: word CTX_INDEX of the running hash (TAG layout) then
+ * the counter block (IV layout), CTX_INDEX moving on with each access */
+static uint8_t *hw_ctx_word(struct aes_sim *sim) {
+  unsigned int i = sim->regs[REG_CTX_INDEX];
+
+  sim->regs[REG_CTX_INDEX] = (i + 1) % CTX_WORDS;
+  return i < 4 ? sim->hw_y + 4 * i : sim->hw_ctr + 4 * (i - 4);
+}
+
+static uint32_t hw_ctx_read(struct aes_sim *sim) {
+  uint32_t val;
+
+  memcpy(&val, hw_ctx_word(sim), 4);
+  return val;
+}
+
+/* Ignored while the engine is BUSY, as the gateware does */
+static void hw_ctx_write(struct aes_sim *sim, uint32_t val) {
+  uint8_t *word = hw_ctx_word(sim);
+
+  if (sim->comp_state != STATE_BUSY)
+    memcpy(word, &val, 4);
+}
+
+/* A register write taking effect, from the AXI-Lite slave or the ring */
+static void hw_reg_write(struct aes_sim *sim, unsigned int reg, uint32_t val) {
+  hw_advance(sim);
+  if (sim->hw_ks_depth)
+    hw_ks_write(sim, reg, val);
+
+  if (hw_banks_on(sim) && reg >= REG_PLAINTEXT0 && reg <= REG_PLAINTEXT0 + 3)
+    sim->bank_in[sim->in_wr][reg - REG_PLAINTEXT0] = val;
+  else if (reg <= REG_KEY0 + 7 || reg == REG_KEY_SLOT || reg == REG_MODE ||
+           reg == REG_AAD_LEN || reg == REG_TEXT_LEN ||
+           (reg >= REG_IV0 && reg <= REG_IV0 + 3))
+    sim->regs[reg] = val;
+  if (reg == REG_BYTE_ORDER)
+    sim->regs[REG_BYTE_ORDER] = val & BYTE_ORDER_LE;
+  if (reg == REG_KEY_CHOICE || (reg >= REG_KEY0 && reg <= REG_KEY0 + 7) ||
+      reg == REG_BYTE_ORDER)
+    sim->hw_key_dirty = 1;
+  if (reg == REG_CTX_INDEX)
+    sim->regs[REG_CTX_INDEX] = val % CTX_WORDS;
+  if (reg == REG_CTX_DATA)
+    hw_ctx_write(sim, val);
+  if (reg == REG_KEY_SLOT_CTRL && (val & KEY_SLOT_STORE) &&
+      (int)(sim->regs[REG_KEY_SLOT] & KEY_SLOT_MASK) < sim->hw_num_key_slots)
+    sim->hw_key_slots[sim->regs[REG_KEY_SLOT] & KEY_SLOT_MASK] =
+        *hw_expanded_key(sim);
+
+  if (reg == REG_ENABLE) {
+    if (!hw_banks_on(sim))
+      hw_bank_reset(sim);
+    hw_enable(sim, val);
+  }
+  /* The doorbell: the last plaintext word sets enable, or with banks hands
+   * the bank to the engine */
+  if (reg == REG_PLAINTEXT0 + 3 && hw_banks_on(sim)) {
+    sim->in_full[sim->in_wr] = 1;
+    sim->in_wr ^= 1;
+    hw_bank_start(sim, sim->hw_stats.modeled_ns);
+  } else if (reg == REG_PLAINTEXT0 + 3 && sim->hw_doorbell &&
+             (sim->regs[REG_ENABLE] & ENABLE_AUTO)) {
+    sim->regs[REG_ENABLE] |= 1;
+    hw_enable(sim, sim->regs[REG_ENABLE]);
+  }
+  sim->regs[REG_COMP_STATE] = sim->comp_state;
+}
+
+static void hw_write(struct aes_sim *sim, unsigned int reg, uint32_t val) {
+  sim->hw_stats.modeled_ns += AES_SIM_AXI_WRITE_NS;
+  sim->hw_stats.reg_writes++;
+  if (reg == REG_RING_TAIL && sim->hw_ring)
+    hw_ring_kick(sim, val);
+  else if (reg >= REG_IRQ_CTRL && reg <= REG_IRQ_STATUS && sim->hw_irq)
+    hw_irq_write(sim, reg, val);
+  else
+    hw_reg_write(sim, reg, val);
+}
+
+/* A register read taking effect, from AXI-Lite or a burst */
+static uint32_t hw_reg_read(struct aes_sim *sim, unsigned int reg) {
+  int banks = hw_banks_on(sim);
+  int doorbell = !banks && sim->hw_doorbell &&
+                 (sim->regs[REG_ENABLE] & ENABLE_AUTO);
+  int result = reg >= REG_CIPHERTEXT0 && reg <= REG_CIPHERTEXT3;
+  uint32_t val;
+
+  if (reg == REG_RING_HEAD)
+    return hw_ring_head(sim);
+  if (reg == REG_IRQ_STATUS)
+    hw_irq_advance(sim);
+  if (reg == REG_KS_STATUS) {
+    hw_advance(sim);
+    hw_ks_fill(sim, sim->hw_stats.modeled_ns);
+    return sim->hw_ks_depth << 16 | sim->ks_count;
+  }
+  if (reg == REG_CTX_DATA) {
+    hw_advance(sim);
+    return hw_ctx_read(sim);
+  }
+  /* With banks a result read is held until the oldest result is in its
+   * bank, and reading the last word frees the bank */
+  if (banks && result) {
+    while (!sim->out_valid[sim->out_rd] && sim->comp_state == STATE_BUSY) {
+      if (sim->hw_stats.modeled_ns < sim->finish_ns)
+        sim->hw_stats.modeled_ns = sim->finish_ns;
+      hw_advance(sim);
+    }
+    hw_advance(sim);
+    val = sim->bank_out[sim->out_rd][reg - REG_CIPHERTEXT0];
+    if (reg == REG_CIPHERTEXT3 && sim->out_valid[sim->out_rd]) {
+      sim->out_valid[sim->out_rd] = 0;
+      sim->out_rd ^= 1;
+      hw_bank_start(sim, sim->hw_stats.modeled_ns);
+      sim->regs[REG_COMP_STATE] = sim->comp_state;
+    }
+    return val;
+  }
+  /* Doorbell mode holds a result read until the operation has finished */
+  if (doorbell && result && sim->comp_state == STATE_BUSY &&
+      sim->hw_stats.modeled_ns < sim->finish_ns)
+    sim->hw_stats.modeled_ns = sim->finish_ns;
+  hw_advance(sim);
+  val = reg < NUM_REGS ? sim->regs[reg] : 0;
+
+  /* ... and reading the last result word drops enable */
+  if (doorbell && reg == REG_CIPHERTEXT3) {
+    sim->regs[REG_ENABLE] &= ~1u;
+    hw_enable(sim, sim->regs[REG_ENABLE]);
+    sim->regs[REG_COMP_STATE] = sim->comp_state;
+  }
+  return val;
+}
+
+static uint32_t hw_read(struct aes_sim *sim, unsigned int reg) {
+  sim->hw_stats.modeled_ns += AES_SIM_AXI_READ_NS;
+  sim->hw_stats.reg_reads++;
+  return hw_reg_read(sim, reg);
+}
+
+/* A burst through a data window of the AXI4 slave: one transaction of as
+ * many beats as the words need, each word then taking effect in turn */
+static unsigned int hw_burst_beats(const struct aes_sim *sim, unsigned int n) {
+  return (32 * n + sim->hw_burst_width - 1) / sim->hw_burst_width;
+}
+
+static void hw_write_burst(struct aes_sim *sim, unsigned int reg,
+                           const uint32_t *val, unsigned int n) {
+  sim->hw_stats.modeled_ns += AES_SIM_AXI_WRITE_NS;
+  sim->hw_stats.reg_writes += hw_burst_beats(sim, n);
+  for (unsigned int i = 0; i < n; i++) {
+    sim->hw_stats.modeled_ns += AES_SIM_BURST_WRITE_NS_PER_WORD;
+    hw_reg_write(sim, reg + i, val[i]);
+  }
+}
+
+static void hw_read_burst(struct aes_sim *sim, unsigned int reg, uint32_t *val,
+                          unsigned int n) {
+  sim->hw_stats.modeled_ns += AES_SIM_AXI_READ_NS;
+  sim->hw_stats.reg_reads += hw_burst_beats(sim, n);
+  for (unsigned int i = 0; i < n; i++) {
+    sim->hw_stats.modeled_ns += AES_SIM_BURST_READ_NS_PER_WORD;
+    val[i] = hw_reg_read(sim, reg + i);
+  }
+}
+
+/* The ring engine writes a register in a clock, with no AXI-Lite cost */
+static void hw_ring_reg(struct aes_sim *sim, unsigned int reg, uint32_t val) {
+  sim->hw_stats.modeled_ns += AES_SIM_CLK_NS;
+  hw_reg_write(sim, reg, val);
+}
+
+/* One operation as AES_ring.v runs it: fetch the n bytes of `in` into the
+ * data registers, MODE, enable, wait for FINISHED, drop enable and store n
+ * bytes of the result to `out` */
+static void hw_ring_op(struct aes_sim *sim, uint32_t ctrl, unsigned int op,
+                       unsigned int bytes, const uint8_t *in, uint8_t *out,
+                       unsigned int n) {
+  unsigned int words = (n + 3) / 4;
+  uint8_t block[16] = {0};
+  uint32_t val;
+
+  if (in) {
+    sim->hw_stats.modeled_ns += AES_SIM_DMA_READ_NS;
+    memcpy(block, in, n);
+    for (unsigned int i = 0; i < words; i++) {
+      memcpy(&val, block + 4 * i, 4);
+      hw_ring_reg(sim, REG_PLAINTEXT0 + i, val);
+    }
+  }
+  hw_ring_reg(sim, REG_MODE,
+              (ctrl & 0xf) | op << MODE_OP_SHIFT | bytes << MODE_BYTES_SHIFT);
+  hw_ring_reg(sim, REG_ENABLE, 1);
+  if (sim->hw_stats.modeled_ns < sim->finish_ns)
+    sim->hw_stats.modeled_ns = sim->finish_ns;
+  hw_advance(sim);
+  memcpy(block, &sim->regs[REG_CIPHERTEXT0], sizeof(block));
+  hw_ring_reg(sim, REG_ENABLE, 0);
+  sim->hw_stats.modeled_ns += AES_SIM_CLK_NS;
+  if (out) {
+    sim->hw_stats.modeled_ns +=
+        AES_SIM_DMA_WRITE_NS + words * AES_SIM_CLK_NS;
+    memcpy(out, block, n);
+  }
+}
+
+/* One descriptor, in the order of AES_ring.v's states */
+static void hw_ring_job(struct aes_sim *sim, struct sim_ring_desc *d) {
+  uint32_t mode = d->ctrl & 7, aad_len = d->aad_len, len = d->len, val;
+  int more = d->ctrl & RING_DESC_MORE;
+  const uint8_t *in;
+  uint8_t *out;
+  unsigned int n;
+
+  sim->hw_stats.modeled_ns += AES_SIM_DMA_READ_NS + 11 * AES_SIM_CLK_NS;
+  d->status = RING_DESC_DONE;
+  if (mode == AES_MODE_XTS || mode > AES_MODE_CMAC) {
+    d->status |= RING_ERR_DESC;
+    sim->hw_stats.modeled_ns += AES_SIM_DMA_WRITE_NS + AES_SIM_CLK_NS;
+    return;
+  }
+  if (d->ctrl & RING_DESC_KEY_PTR) {
+    hw_ring_reg(sim, REG_KEY_SLOT, 0);
+    sim->hw_stats.modeled_ns += AES_SIM_DMA_READ_NS;
+    for (int i = 0; i < 8; i++)
+      hw_ring_reg(sim, REG_KEY0 + i, d->key[i]);
+    hw_ring_reg(sim, REG_KEY_CHOICE, (d->ctrl >> RING_DESC_KEY_CHOICE_SHIFT) & 3);
+  } else {
+    hw_ring_reg(sim, REG_KEY_SLOT,
+                KEY_SLOT_EN | ((d->ctrl >> RING_DESC_KEY_SLOT_SHIFT) &
+                               KEY_SLOT_MASK));
+  }
+  if (mode != AES_MODE_ECB) {
+    for (int i = 0; i < 4; i++) {
+      memcpy(&val, d->iv + 4 * i, 4);
+      hw_ring_reg(sim, REG_IV0 + i, val);
+    }
+    hw_ring_op(sim, d->ctrl, OP_INIT, 0, NULL, NULL, 0);
+  }
+  for (in = d->aad; mode == AES_MODE_GCM && aad_len; in += n, aad_len -= n) {
+    n = aad_len < 16 ? aad_len : 16;
+    hw_ring_op(sim, d->ctrl, OP_AAD, n % 16, in, NULL, n);
+  }
+  /* CMAC keeps its last block for FINAL, and writes nothing back */
+  for (in = d->src, out = d->dst;
+       len && !(mode == AES_MODE_CMAC && !more && len <= 16);
+       in += n, out += n, len -= n) {
+    n = len < 16 ? len : 16;
+    hw_ring_op(sim, d->ctrl, OP_BLOCK, n % 16, in,
+               mode == AES_MODE_CMAC ? NULL : out, n);
+  }
+  if (mode == AES_MODE_GCM)
+    hw_ring_op(sim, d->ctrl, OP_FINAL, 0, NULL, NULL, 0);
+  else if (mode == AES_MODE_CMAC && !more)
+    hw_ring_op(sim, d->ctrl, OP_FINAL, len, len ? in : NULL, NULL, len);
+  if (mode == AES_MODE_GCM || mode == AES_MODE_CMAC) {
+    memcpy(d->tag, &sim->regs[REG_TAG0], sizeof(d->tag));
+    sim->hw_stats.modeled_ns += AES_SIM_DMA_WRITE_NS + 4 * AES_SIM_CLK_NS;
+  }
+  sim->hw_stats.modeled_ns += AES_SIM_DMA_WRITE_NS + AES_SIM_CLK_NS;
+}
+
+/* TAIL written: the engine runs the new descriptors back to back from when
+ * it is next free. The device clock is wound back afterwards, as software
+ * only sees each completion through HEAD. */
+static void hw_ring_kick(struct aes_sim *sim, uint32_t tail) {
+  uint64_t now = sim->hw_stats.modeled_ns;
+
+  hw_irq_advance(sim);
+  if (sim->hw_ring_free_ns > now)
+    sim->hw_stats.modeled_ns = sim->hw_ring_free_ns;
+  for (; sim->hw_ring_tail != tail; sim->hw_ring_tail++) {
+    if (sim->hw_ring_tail - sim->hw_irq_from == SIM_RING_ENTRIES)
+      sim->hw_irq_first_ns =
+          sim->ring_done_ns[sim->hw_irq_from % SIM_RING_ENTRIES];
+    hw_ring_job(sim, &sim->ring_desc[sim->hw_ring_tail % SIM_RING_ENTRIES]);
+    sim->ring_done_ns[sim->hw_ring_tail % SIM_RING_ENTRIES] =
+        sim->hw_stats.modeled_ns;
+  }
+  sim->hw_ring_free_ns = sim->hw_stats.modeled_ns;
+  sim->hw_stats.modeled_ns = now;
+}
+
+/*--------------------------------------------------------- DRIVER MODEL
+ * ---------------------------------------------------------*/
+
+static int sim_key_resident(struct aes_sim *sim, uint32_t key_choice,
+                            const uint32_t *key) {
+  return sim->key_valid && sim->key_choice == key_choice &&
+         !memcmp(sim->key, key, sizeof(sim->key));
+}
+
+/* Mirrors AES_pick_edf(): the client whose first job of some class is due
+ * first, ties going to the earlier one in round robin order */
+static struct aes_sim_client *sim_pick_edf(struct aes_sim *sim, int *prio,
+                                           int *slot) {
+  struct aes_sim_client *client, *pick = NULL;
+  uint64_t due = UINT64_MAX;
+
+  for (int p = 0; p < AES_PRIO_CLASSES; p++) {
+    for (int i = 0; i < AES_SIM_MAX_CLIENTS; i++) {
+      int s = (sim->rr[p] + i) % AES_SIM_MAX_CLIENTS;
+
+      client = sim->clients[s];
+      if (client && client->head[p] && client->head[p]->deadline < due) {
+        pick = client;
+        due = client->head[p]->deadline;
+        *prio = p;
+        *slot = s;
+      }
+    }
+  }
+  return pick;
+}
+
+/* Mirrors AES_dequeue_job(): the high class while it has jobs, or the job
+ * due first under EDF; within a class round robin over clients, preferring
+ * a job on the resident key for at most SIM_KEY_BATCH_MAX jobs in a row */
+static struct aes_sim_job *sim_dequeue(struct aes_sim *sim) {
+  struct aes_sim_client *pick = NULL;
+  struct aes_sim_job *job;
+  int i, slot = 0, prio = 0, found = 0;
+
+  if (sim->sched_edf) {
+    pick = sim_pick_edf(sim, &prio, &slot);
+    found = pick != NULL;
+  } else {
+    for (prio = 0; prio < AES_PRIO_CLASSES && !found; prio++)
+      for (i = 0; i < AES_SIM_MAX_CLIENTS && !found; i++)
+        found = sim->clients[i] && sim->clients[i]->head[prio];
+    prio--;
+  }
+  if (found && !pick && sim->key_batch < SIM_KEY_BATCH_MAX) {
+    for (i = 0; i < AES_SIM_MAX_CLIENTS && !pick; i++) {
+      slot = (sim->rr[prio] + i) % AES_SIM_MAX_CLIENTS;
+      if (sim->clients[slot] && sim->clients[slot]->head[prio] &&
+          sim_key_resident(sim,
+                           sim->clients[slot]->head[prio]->desc->key_choice,
+                           sim->clients[slot]->head[prio]->desc->key))
+        pick = sim->clients[slot];
+    }
+  }
+  if (found && !pick) {
+    for (i = 0; i < AES_SIM_MAX_CLIENTS && !pick; i++) {
+      slot = (sim->rr[prio] + i) % AES_SIM_MAX_CLIENTS;
+      if (sim->clients[slot] && sim->clients[slot]->head[prio])
+        pick = sim->clients[slot];
+    }
+    sim->key_batch = 0;
+  }
+  if (!pick)
+    return NULL;
+
+  job = pick->head[prio];
+  pick->head[prio] = job->next;
+  if (!pick->head[prio])
+    pick->tail[prio] = NULL;
+  sim->rr[prio] = (slot + 1) % AES_SIM_MAX_CLIENTS;
+  return job;
+}
+
+/* Mirrors AES_requeue_job(): back to the head of its client's queue, with
+ * the lock held */
+static void sim_requeue(struct aes_sim_job *job) {
+  struct aes_sim_client *client = job->client;
+
+  job->next = client->head[job->prio];
+  client->head[job->prio] = job;
+  if (!client->tail[job->prio])
+    client->tail[job->prio] = job;
+}
+
+/* Mirrors AES_job_chunk() */
+static uint32_t sim_job_chunk(const struct aes_sim *sim,
+                              const struct aes_sim_job *job) {
+  const struct aes_job *desc = job->desc;
+  uint32_t left = desc->len - job->offset, chunk = sim->chunk_size;
+
+  if (!chunk || left <= chunk ||
+      (desc->mode == AES_MODE_GCM && !(sim->regs[REG_CAPS] & CAPS_CTX)) ||
+      (desc->mode == AES_MODE_XTS && !desc->data_unit))
+    return left;
+  if (desc->mode == AES_MODE_XTS) {
+    chunk -= chunk % desc->data_unit;
+    if (!chunk)
+      chunk = desc->data_unit;
+  }
+  return chunk < left ? chunk : left;
+}
+
+/* Mirrors AES_key_slot_lookup(): the slot holding the key, or the first free
+ * slot, or the least recently used one */
+static int sim_key_slot_lookup(struct aes_sim *sim, uint32_t key_choice,
+                               const uint32_t *key, int *hit) {
+  int victim = 0, free_found = 0;
+
+  for (int i = 0; i < sim->hw_num_key_slots; i++) {
+    if (!sim->key_slots[i].valid) {
+      if (!free_found)
+        victim = i;
+      free_found = 1;
+      continue;
+    }
+    if (sim->key_slots[i].key_choice == key_choice &&
+        !memcmp(sim->key_slots[i].key, key, sizeof(sim->key))) {
+      *hit = 1;
+      return i;
+    }
+    if (!free_found &&
+        sim->key_slots[i].last_used < sim->key_slots[victim].last_used)
+      victim = i;
+  }
+  *hit = 0;
+  return victim;
+}
+
+/* Mirrors AES_write_key_regs(): a burst to the key window when there is one */
+static void sim_write_key_regs(struct aes_sim *sim, uint32_t key_choice,
+                               const uint32_t *key) {
+  if (sim->regs[REG_CAPS] & CAPS_WINDOW)
+    hw_write_burst(sim, REG_KEY0, key, 8);
+  else
+    for (int i = 0; i < 8; i++)
+      hw_write(sim, REG_KEY0 + i, key[i]);
+  hw_write(sim, REG_KEY_CHOICE, key_choice);
+}
+
+/* Mirrors AES_load_key() */
+static void sim_load_key(struct aes_sim *sim, uint32_t key_choice,
+                         const uint32_t *key) {
+  int idx, hit;
+
+  if (sim_key_resident(sim, key_choice, key)) {
+    sim->key_batch++;
+    return;
+  }
+  if (!sim->hw_num_key_slots) {
+    sim_write_key_regs(sim, key_choice, key);
+    sim->hw_stats.key_loads++;
+  } else {
+    idx = sim_key_slot_lookup(sim, key_choice, key, &hit);
+    if (!hit)
+      sim_write_key_regs(sim, key_choice, key);
+    hw_write(sim, REG_KEY_SLOT, idx | KEY_SLOT_EN);
+    if (!hit) {
+      hw_write(sim, REG_KEY_SLOT_CTRL, KEY_SLOT_STORE);
+      sim->key_slots[idx].key_choice = key_choice;
+      memcpy(sim->key_slots[idx].key, key, sizeof(sim->key));
+      sim->key_slots[idx].valid = 1;
+      sim->hw_stats.key_loads++;
+    } else {
+      sim->hw_stats.key_slot_hits++;
+    }
+    sim->key_slots[idx].last_used = ++sim->key_slot_clock;
+  }
+  memcpy(sim->key, key, sizeof(sim->key));
+  sim->key_choice = key_choice;
+  sim->key_valid = 1;
+  sim->key_batch = 1;
+}
+
+/* Mirrors AES_set_mode(): MODE is only written when it changes */
+static void sim_set_mode(struct aes_sim *sim, uint32_t mode) {
+  if (sim->mode != mode) {
+    hw_write(sim, REG_MODE, mode);
+    sim->mode = mode;
+  }
+}
+
+/* Mirrors AES_set_doorbell() */
+static void sim_set_doorbell(struct aes_sim *sim, int on) {
+  uint32_t val =
+      ENABLE_AUTO | ((sim->regs[REG_CAPS] & CAPS_BANKS) ? ENABLE_BANKS : 0);
+
+  if (sim->doorbell_on != on) {
+    hw_write(sim, REG_ENABLE, on ? val : 0);
+    sim->doorbell_on = on;
+  }
+}
+
+/* Mirrors AES_doorbell_load(): all four data words, the last one starting
+ * the operation or handing the bank to the engine, in one burst to the data
+ * window when there is one */
+static void sim_doorbell_load(struct aes_sim *sim, const uint8_t *in,
+                              unsigned int n) {
+  uint8_t block[16] = {0};
+  uint32_t val, words[4];
+
+  memcpy(block, in, n);
+  if (sim->regs[REG_CAPS] & CAPS_WINDOW) {
+    memcpy(words, block, sizeof(words));
+    hw_write_burst(sim, REG_PLAINTEXT0, words, 4);
+    return;
+  }
+  for (int i = 0; i < 4; i++) {
+    memcpy(&val, block + 4 * i, 4);
+    hw_write(sim, REG_PLAINTEXT0 + i, val);
+  }
+}
+
+/* Mirrors AES_doorbell_retire(): read the oldest result, or without `out`
+ * only its last word */
+static void sim_doorbell_retire(struct aes_sim *sim, uint8_t *out,
+                                unsigned int n) {
+  uint8_t block[16];
+  uint32_t val, words[4];
+
+  if (!out) {
+    hw_read(sim, REG_CIPHERTEXT3);
+    return;
+  }
+  if (sim->regs[REG_CAPS] & CAPS_WINDOW) {
+    hw_read_burst(sim, REG_CIPHERTEXT0, words, 4);
+    memcpy(out, words, n);
+    return;
+  }
+  for (int i = 0; i < 4; i++) {
+    val = hw_read(sim, REG_CIPHERTEXT0 + i);
+    memcpy(block + 4 * i, &val, 4);
+  }
+  memcpy(out, block, n);
+}
+
+/* Mirrors AES_run_op(): write the first n bytes of `in` if given, run one
+ * operation and read the first n bytes of the result into `out` if given.
+ * Only the data words covering n bytes are transferred, except in doorbell
+ * mode where all four go each way and the data words start and retire the
+ * operation. */
+static int sim_run_op(struct aes_sim *sim, const uint8_t *in, uint8_t *out,
+                      unsigned int n) {
+  unsigned int words = (n + 3) / 4;
+  uint8_t block[16] = {0};
+  uint32_t val, idle;
+  int polls = 0;
+
+  if ((sim->regs[REG_CAPS] & CAPS_DOORBELL) && in) {
+    sim_set_doorbell(sim, 1);
+    sim_doorbell_load(sim, in, n);
+    sim_doorbell_retire(sim, out, n);
+    return 0;
+  }
+  idle = sim->doorbell_on
+             ? ENABLE_AUTO |
+                   ((sim->regs[REG_CAPS] & CAPS_BANKS) ? ENABLE_BANKS : 0)
+             : 0;
+
+  if (in) {
+    memcpy(block, in, n);
+    for (unsigned int i = 0; i < words; i++) {
+      memcpy(&val, block + 4 * i, 4);
+      hw_write(sim, REG_PLAINTEXT0 + i, val);
+    }
+  }
+
+  hw_write(sim, REG_ENABLE, idle | 1);
+  while (hw_read(sim, REG_COMP_STATE) != STATE_FINISHED) {
+    if (++polls > 1000) {
+      hw_write(sim, REG_ENABLE, idle);
+      return -ETIMEDOUT;
+    }
+  }
+  if (out) {
+    for (unsigned int i = 0; i < words; i++) {
+      val = hw_read(sim, REG_CIPHERTEXT0 + i);
+      memcpy(block + 4 * i, &val, 4);
+    }
+    memcpy(out, block, n);
+  }
+  hw_write(sim, REG_ENABLE, idle);
+  return 0;
+}
+
+static void sim_write_iv(struct aes_sim *sim, const uint8_t iv[16]) {
+  uint32_t val, words[4];
+
+  if (sim->regs[REG_CAPS] & CAPS_WINDOW) {
+    memcpy(words, iv, sizeof(words));
+    hw_write_burst(sim, REG_IV0, words, 4);
+    return;
+  }
+  for (int i = 0; i < 4; i++) {
+    memcpy(&val, iv + 4 * i, 4);
+    hw_write(sim, REG_IV0 + i, val);
+  }
+}
+
+/* Mirrors AES_run_banked(): load block i+1 before retiring block i, and
+ * retire the pending block before MODE changes */
+static void sim_run_banked(struct aes_sim *sim, uint32_t mode, uint8_t *buf,
+                           uint32_t len, int read_back) {
+  unsigned int prev_n = 0;
+  uint8_t *prev = NULL;
+
+  sim_set_doorbell(sim, 1);
+  for (uint32_t off = 0; off < len; off += AES_BLOCK_LEN) {
+    unsigned int n = len - off < AES_BLOCK_LEN ? len - off : AES_BLOCK_LEN;
+    uint32_t m = mode | (n % AES_BLOCK_LEN) << MODE_BYTES_SHIFT;
+
+    if (prev && m != sim->mode) {
+      sim_doorbell_retire(sim, read_back ? prev : NULL, prev_n);
+      prev = NULL;
+    }
+    sim_set_mode(sim, m);
+    sim_doorbell_load(sim, buf + off, n);
+    if (prev)
+      sim_doorbell_retire(sim, read_back ? prev : NULL, prev_n);
+    prev = buf + off;
+    prev_n = n;
+  }
+  if (prev)
+    sim_doorbell_retire(sim, read_back ? prev : NULL, prev_n);
+}
+
+/* Mirrors AES_run_stream(): one operation per block of `len` bytes at `buf`,
+ * the last one carrying its byte count in MODE */
+static int sim_run_stream(struct aes_sim *sim, uint32_t mode, uint8_t *buf,
+                          uint32_t len, int read_back) {
+  if (sim->regs[REG_CAPS] & CAPS_BANKS) {
+    sim_run_banked(sim, mode, buf, len, read_back);
+    return 0;
+  }
+  for (uint32_t off = 0; off < len; off += AES_BLOCK_LEN) {
+    unsigned int n = len - off < AES_BLOCK_LEN ? len - off : AES_BLOCK_LEN;
+    int ret;
+
+    sim_set_mode(sim, mode | (n % AES_BLOCK_LEN) << MODE_BYTES_SHIFT);
+    ret = sim_run_op(sim, buf + off, read_back ? buf + off : NULL, n);
+    if (ret)
+      return ret;
+  }
+  return 0;
+}
+
+/* Mirrors AES_ctr_add() */
+static void sim_ctr_add(uint8_t ctr[16], uint32_t blocks) {
+  for (int i = 15; i >= 0 && blocks; i--) {
+    blocks += ctr[i];
+    ctr[i] = (uint8_t)blocks;
+    blocks >>= 8;
+  }
+}
+
+/* Mirrors AES_tweak_add() */
+static void sim_tweak_add(uint8_t tweak[16], uint32_t units) {
+  for (int i = 0; i < 16 && units; i++) {
+    units += tweak[i];
+    tweak[i] = (uint8_t)units;
+    units >>= 8;
+  }
+}
+
+/* Mirrors AES_run_xts(): per data unit of the n bytes from offset, INIT
+ * under the tweak key, then the unit's blocks under the data key */
+static int sim_run_xts(struct aes_sim *sim, const struct aes_job *desc,
+                       uint8_t *text, uint32_t mode, uint32_t offset,
+                       uint32_t n) {
+  uint32_t unit = desc->data_unit ? desc->data_unit : desc->len;
+  uint8_t tweak[16];
+  int ret;
+
+  memcpy(tweak, desc->iv, sizeof(tweak));
+  sim_tweak_add(tweak, offset / unit);
+  for (uint32_t off = offset; off < offset + n; off += unit) {
+    sim_load_key(sim, desc->key_choice, desc->key2);
+    sim_write_iv(sim, tweak);
+    sim_set_mode(sim, mode | OP_INIT << MODE_OP_SHIFT);
+    ret = sim_run_op(sim, NULL, NULL, 0);
+    if (ret)
+      return ret;
+    sim_load_key(sim, desc->key_choice, desc->key);
+    ret = sim_run_stream(sim, mode, text + off, unit, 1);
+    if (ret)
+      return ret;
+    sim_tweak_add(tweak, 1);
+  }
+  return 0;
+}
+
+static void sim_read_tag(struct aes_sim *sim, uint8_t tag[16]) {
+  uint32_t val;
+
+  for (int i = 0; i < 4; i++) {
+    val = hw_read(sim, REG_TAG0 + i);
+    memcpy(tag + 4 * i, &val, 4);
+  }
+}
+
+/* Mirrors AES_read_ctx() */
+static void sim_read_ctx(struct aes_sim *sim, uint8_t ctx[4 * CTX_WORDS]) {
+  uint32_t val;
+
+  hw_write(sim, REG_CTX_INDEX, 0);
+  for (int i = 0; i < CTX_WORDS; i++) {
+    val = hw_read(sim, REG_CTX_DATA);
+    memcpy(ctx + 4 * i, &val, 4);
+  }
+}
+
+/* Mirrors AES_write_ctx() */
+static void sim_write_ctx(struct aes_sim *sim,
+                          const uint8_t ctx[4 * CTX_WORDS]) {
+  uint32_t val;
+
+  hw_write(sim, REG_CTX_INDEX, 0);
+  for (int i = 0; i < CTX_WORDS; i++) {
+    memcpy(&val, ctx + 4 * i, 4);
+    hw_write(sim, REG_CTX_DATA, val);
+  }
+}
+
+/* Mirrors AES_run_gcm(): n bytes of text, the additional data with the first
+ * chunk, the lengths and the tag with the last, the context saved in between
+ * and restored after INIT */
+static int sim_run_gcm(struct aes_sim *sim, struct aes_sim_job *job,
+                       uint32_t mode, uint32_t n) {
+  const struct aes_job *desc = job->desc;
+  uint8_t j0[16], tag[AES_GCM_TAG_LEN];
+  int ret;
+
+  memcpy(j0, desc->iv, AES_GCM_IV_LEN);
+  memset(j0 + AES_GCM_IV_LEN, 0, 16 - AES_GCM_IV_LEN);
+  j0[15] = 1;
+  sim_write_iv(sim, j0);
+  sim_set_mode(sim, mode | OP_INIT << MODE_OP_SHIFT);
+  ret = sim_run_op(sim, NULL, NULL, 0);
+  if (ret)
+    return ret;
+  if (!job->offset) {
+    ret = sim_run_stream(sim, mode | OP_AAD << MODE_OP_SHIFT, job->buf,
+                         desc->aad_len, 0);
+  } else {
+    hw_write(sim, REG_AAD_LEN, desc->aad_len);
+    hw_write(sim, REG_TEXT_LEN, job->offset);
+    sim_write_ctx(sim, job->ctx);
+  }
+  if (!ret)
+    ret = sim_run_stream(sim, mode, job->buf + desc->aad_len + job->offset,
+                         n, 1);
+  if (ret)
+    return ret;
+  if (job->offset + n < desc->len) {
+    sim_read_ctx(sim, job->ctx);
+    return 0;
+  }
+  sim_set_mode(sim, mode | OP_FINAL << MODE_OP_SHIFT);
+  ret = sim_run_op(sim, NULL, NULL, 0);
+  if (ret)
+    return ret;
+  if (desc->flags & AES_JOB_DECRYPT) {
+    sim_read_tag(sim, tag);
+    if (memcmp(tag, job->tag, AES_GCM_TAG_LEN))
+      ret = -EBADMSG;
+  } else {
+    sim_read_tag(sim, job->tag);
+  }
+  return ret;
+}
+
+/* Mirrors AES_run_cmac(): chain every block of the chunk, then FINAL with
+ * the last block's byte count at the end of the message, or read back the
+ * chaining value for the next chunk or job to resume from */
+static int sim_run_cmac(struct aes_sim *sim, struct aes_sim_job *job,
+                        uint32_t mode, uint32_t n) {
+  const struct aes_job *desc = job->desc;
+  int more = (desc->flags & AES_JOB_MORE) || job->offset + n < desc->len;
+  uint8_t *buf = job->buf + job->offset;
+  uint32_t last = 0, chained = n;
+  int ret;
+
+  if (!more) {
+    last = n ? (n - 1) % AES_BLOCK_LEN + 1 : 0;
+    chained = n - last;
+  }
+  sim_write_iv(sim, job->offset ? job->tag : desc->iv);
+  sim_set_mode(sim, mode | OP_INIT << MODE_OP_SHIFT);
+  ret = sim_run_op(sim, NULL, NULL, 0);
+  if (!ret)
+    ret = sim_run_stream(sim, mode, buf, chained, 0);
+  if (!ret && !more) {
+    sim_set_mode(sim, mode | OP_FINAL << MODE_OP_SHIFT |
+                          last << MODE_BYTES_SHIFT);
+    ret = sim_run_op(sim, buf + chained, NULL, last);
+  }
+  if (!ret)
+    sim_read_tag(sim, job->tag);
+  return ret;
+}
+
+/* Mirrors AES_run_job(): n bytes from where the job's earlier chunks
+ * stopped */
+static int sim_run_job(struct aes_sim *sim, struct aes_sim_job *job,
+                       uint32_t n) {
+  const struct aes_job *desc = job->desc;
+  uint32_t mode = desc->mode;
+  uint8_t *text = job->buf + desc->aad_len;
+  uint8_t iv[16];
+  int ret;
+
+  sim_load_key(sim, desc->key_choice, desc->key);
+  if (desc->flags & AES_JOB_DECRYPT)
+    mode |= MODE_DECRYPT;
+
+  switch (desc->mode) {
+  case AES_MODE_CTR:
+    memcpy(iv, desc->iv, sizeof(iv));
+    sim_ctr_add(iv, job->offset / AES_BLOCK_LEN);
+    sim_write_iv(sim, iv);
+    sim_set_mode(sim, mode | OP_INIT << MODE_OP_SHIFT);
+    ret = sim_run_op(sim, NULL, NULL, 0);
+    if (!ret)
+      ret = sim_run_stream(sim, mode, text + job->offset, n, 1);
+    break;
+  case AES_MODE_GCM:
+    ret = sim_run_gcm(sim, job, mode, n);
+    break;
+  case AES_MODE_XTS:
+    ret = sim_run_xts(sim, desc, text, mode, job->offset, n);
+    break;
+  case AES_MODE_CMAC:
+    ret = sim_run_cmac(sim, job, mode, n);
+    break;
+  default:
+    ret = sim_run_stream(sim, mode, text + job->offset, n, 1);
+    break;
+  }
+  if (ret && ret != -EBADMSG)
+    return ret;
+  job->offset += n;
+  if (job->offset == desc->len)
+    sim->hw_stats.jobs++;
+  return ret;
+}
+
+/* Mirrors AES_job_valid() */
+static int sim_job_valid(const struct aes_job *job) {
+  uint32_t flags = job->flags & ~AES_JOB_PRIO_HIGH;
+
+  if (job->key_choice > AES_KEY_CHOICE_256 || job->len > AES_JOB_MAX_LEN ||
+      (job->data_unit && job->mode != AES_MODE_XTS))
+    return 0;
+  switch (job->mode) {
+  case AES_MODE_ECB:
+    return job->len && !(job->len % AES_BLOCK_LEN) && !job->aad_len &&
+           !(flags & ~AES_JOB_DECRYPT);
+  case AES_MODE_CTR:
+    return job->len && !job->aad_len && !flags;
+  case AES_MODE_GCM:
+    return job->aad_len <= AES_JOB_MAX_LEN &&
+           !(flags & ~AES_JOB_DECRYPT);
+  case AES_MODE_XTS:
+    return job->len && !(job->len % AES_BLOCK_LEN) && !job->aad_len &&
+           !(flags & ~AES_JOB_DECRYPT) &&
+           !(job->data_unit % AES_BLOCK_LEN) &&
+           (!job->data_unit || !(job->len % job->data_unit));
+  case AES_MODE_CMAC:
+    return !job->aad_len && !(flags & ~AES_JOB_MORE) &&
+           (!(flags & AES_JOB_MORE) || !(job->len % AES_BLOCK_LEN));
+  default:
+    return 0;
+  }
+}
+
+/* Called with the lock held. A submission queue job goes to its client's
+ * done list, as AES_uring_done() puts it. */
+static void sim_complete(struct aes_sim *sim, struct aes_sim_job *job) {
+  struct aes_sim_client *client = job->client;
+  size_t cap = client->lat_cap;
+  struct sim_uring *u;
+  uint64_t *lat;
+
+  sim->hw_stats.cpu_ns = sim->hw_stats.modeled_ns - sim->sleep_ns;
+  sim->stats = sim->hw_stats;
+  sim->now_ns = sim->hw_stats.modeled_ns;
+  if (client->lat_count == cap) {
+    cap = cap ? 2 * cap : 1024;
+    lat = realloc(client->lat, cap * sizeof(*lat));
+    if (lat) {
+      client->lat = lat;
+      client->lat_cap = cap;
+    }
+  }
+  if (client->lat_count < client->lat_cap)
+    client->lat[client->lat_count++] = sim->now_ns - job->submit_ns;
+  if (job->uring) {
+    u = job->client->uring;
+    if (u->done_tail)
+      u->done_tail->next = job;
+    else
+      u->done_head = job;
+    u->done_tail = job;
+    job->next = NULL;
+    u->running--;
+    pthread_cond_broadcast(&u->cv);
+    return;
+  }
+  job->done = 1;
+  pthread_cond_signal(&job->done_cv);
+}
+
+/* Mirrors AES_ring_eligible(): a bounce buffer kvmalloc() could not take
+ * from the slab is not physically contiguous */
+static int sim_ring_eligible(const struct aes_sim_job *job, uint32_t n) {
+  const struct aes_job *desc = job->desc;
+
+  return desc->mode != AES_MODE_XTS && desc->aad_len + desc->len &&
+         ((desc->mode != AES_MODE_GCM && desc->mode != AES_MODE_CMAC) ||
+          n == desc->len) &&
+         job->buf_len <= SIM_KMALLOC_MAX &&
+         !((uintptr_t)job->buf % AES_BLOCK_LEN) &&
+         !(desc->aad_len % AES_BLOCK_LEN);
+}
+
+/* Mirrors AES_ring_post_desc() */
+static void sim_ring_post_desc(struct aes_sim *sim, struct aes_sim_job *job,
+                               const uint8_t *src, uint8_t *dst, uint32_t n,
+                               const uint8_t iv[16]) {
+  const struct aes_job *desc = job->desc;
+  uint32_t idx = sim->ring_tail % SIM_RING_ENTRIES;
+  struct sim_ring_desc *d = &sim->ring_desc[idx];
+  int slot = 0, hit = 0;
+
+  memset(d, 0, sizeof(*d));
+  d->ctrl = desc->mode;
+  if (desc->flags & AES_JOB_DECRYPT)
+    d->ctrl |= MODE_DECRYPT;
+  if (desc->flags & AES_JOB_MORE)
+    d->ctrl |= RING_DESC_MORE;
+  if (sim->hw_num_key_slots) {
+    slot = sim_key_slot_lookup(sim, desc->key_choice, desc->key, &hit);
+    if (hit) {
+      sim->key_slots[slot].last_used = ++sim->key_slot_clock;
+      sim->hw_stats.key_slot_hits++;
+    } else if (!sim->key_slots[slot].valid ||
+               sim->key_slots[slot].last_used <= sim->ring_key_clock) {
+      sim_load_key(sim, desc->key_choice, desc->key);
+      hit = 1;
+    }
+  }
+  if (hit) {
+    d->ctrl |= (uint32_t)slot << RING_DESC_KEY_SLOT_SHIFT;
+  } else {
+    d->ctrl |= RING_DESC_KEY_PTR |
+               desc->key_choice << RING_DESC_KEY_CHOICE_SHIFT;
+    memcpy(sim->ring_keys[idx], desc->key, sizeof(sim->ring_keys[idx]));
+    sim->hw_stats.key_loads++;
+  }
+  memcpy(d->iv, iv, sizeof(d->iv));
+  d->key = sim->ring_keys[idx];
+  d->aad = src - desc->aad_len;
+  d->src = src;
+  d->dst = dst;
+  d->aad_len = desc->aad_len;
+  d->len = n;
+
+  sim->ring_jobs[idx] = job;
+  sim->ring_tail++;
+  job->ring_descs++;
+}
+
+/* Mirrors AES_ring_post(): n bytes of the job as one descriptor */
+static void sim_ring_post(struct aes_sim *sim, struct aes_sim_job *job,
+                          uint32_t n) {
+  const struct aes_job *desc = job->desc;
+  uint8_t *text = job->buf + desc->aad_len + job->offset;
+  uint8_t iv[16];
+
+  if (!job->offset) {
+    job->status = 0;
+    job->ring_descs = 0;
+  }
+  memcpy(iv, desc->iv, sizeof(iv));
+  if (desc->mode == AES_MODE_GCM) {
+    memset(iv + AES_GCM_IV_LEN, 0, 16 - AES_GCM_IV_LEN);
+    iv[15] = 1;
+  } else if (desc->mode == AES_MODE_CTR) {
+    sim_ctr_add(iv, job->offset / AES_BLOCK_LEN);
+  }
+  job->offset += n;
+  job->ring_posted = job->offset == desc->len;
+  sim_ring_post_desc(sim, job, text, text, n, iv);
+}
+
+/* Mirrors AES_ring_reap(): retire the descriptors before upto in ring order,
+ * completing each job with its last descriptor. Called without the lock. */
+static void sim_ring_reap(struct aes_sim *sim, uint32_t upto) {
+  pthread_mutex_lock(&sim->lock);
+  for (uint32_t i = sim->ring_head; i != upto; i++) {
+    struct sim_ring_desc *d = &sim->ring_desc[i % SIM_RING_ENTRIES];
+    struct aes_sim_job *job = sim->ring_jobs[i % SIM_RING_ENTRIES];
+    const struct aes_job *desc = job->desc;
+
+    if ((d->status & 0xff) && !job->status)
+      job->status = -EIO;
+    if (--job->ring_descs || !job->ring_posted)
+      continue;
+    if (!job->status) {
+      /* AES_crypt() checks a GCM decryption's tag */
+      if (desc->mode == AES_MODE_GCM && (desc->flags & AES_JOB_DECRYPT)) {
+        if (memcmp(d->tag, job->tag, AES_GCM_TAG_LEN))
+          job->status = -EBADMSG;
+      } else {
+        memcpy(job->tag, d->tag, sizeof(job->tag));
+      }
+      sim->hw_stats.jobs++;
+      if (!job->buf)
+        sim->hw_stats.zero_copy_jobs++;
+      if (job->pooled)
+        sim->hw_stats.pool_jobs++;
+    }
+    sim_complete(sim, job);
+  }
+  pthread_mutex_unlock(&sim->lock);
+  sim->ring_head = upto;
+}
+
+/* Mirrors AES_ring_set_polling() */
+static void sim_ring_set_polling(struct aes_sim *sim, int polling) {
+  if (!sim->hw_irq || sim->ring_polling == polling)
+    return;
+  hw_write(sim, REG_IRQ_CTRL, !polling);
+  sim->ring_polling = polling;
+}
+
+/* The worker sleeps until the interrupt is taken, then the handler clears
+ * it. With no interrupt to come it sleeps out the timeout, modelled as
+ * ending when the engine goes idle. */
+static void sim_irq_sleep(struct aes_sim *sim) {
+  uint64_t now = sim->hw_stats.modeled_ns, wake;
+
+  hw_irq_advance(sim);
+  wake = (sim->regs[REG_IRQ_STATUS] & 1) ? now : hw_irq_fire_ns(sim);
+  if (wake == IRQ_NEVER) {
+    wake = sim->hw_ring_free_ns > now ? sim->hw_ring_free_ns : now;
+    sim->sleep_ns += wake - now;
+    sim->hw_stats.modeled_ns = wake;
+    return;
+  }
+  sim->sleep_ns += wake - now;
+  sim->hw_stats.modeled_ns = wake + AES_SIM_IRQ_NS;
+  if (hw_read(sim, REG_IRQ_STATUS) & 1)
+    hw_write(sim, REG_IRQ_STATUS, 1);
+  sim->hw_stats.irqs++;
+}
+
+/* Mirrors AES_ring_wait(): HEAD is polled back to back, or IRQ_COUNT set to
+ * the rest of the batch and the worker sleeps until HEAD moves */
+static uint32_t sim_ring_wait(struct aes_sim *sim, uint32_t tail) {
+  uint32_t head, count;
+
+  if (sim->ring_polling) {
+    while ((head = hw_read(sim, REG_RING_HEAD)) == sim->ring_head)
+      ;
+    return head;
+  }
+  count = tail - sim->ring_head;
+  if (count > sim->irq_coalesce_count)
+    count = sim->irq_coalesce_count;
+  if (count != sim->irq_count) {
+    hw_write(sim, REG_IRQ_COUNT, count);
+    sim->irq_count = count;
+  }
+  while ((head = hw_read(sim, REG_RING_HEAD)) == sim->ring_head) {
+    hw_read(sim, REG_RING_STATUS);
+    sim_irq_sleep(sim);
+  }
+  return head;
+}
+
+/* Mirrors AES_ring_run(): one TAIL write, then the jobs completed in ring
+ * order as HEAD catches up. Called without the lock. */
+static void sim_ring_run(struct aes_sim *sim) {
+  uint32_t tail = sim->ring_tail;
+  unsigned int jobs = 0;
+
+  if (sim->ring_head == tail)
+    return;
+  for (uint32_t i = sim->ring_head; i != tail; i++)
+    jobs += i == sim->ring_head ||
+            sim->ring_jobs[i % SIM_RING_ENTRIES] !=
+                sim->ring_jobs[(i - 1) % SIM_RING_ENTRIES];
+  sim_set_doorbell(sim, 0);
+  sim_ring_set_polling(sim, jobs >= sim->irq_poll_threshold);
+  hw_write(sim, REG_RING_TAIL, tail);
+  while (sim->ring_head != tail)
+    sim_ring_reap(sim, sim_ring_wait(sim, tail));
+  sim->ring_key_clock = sim->key_slot_clock;
+
+  /* The engine leaves the key, MODE and ENABLE as its last job set them */
+  sim->key_valid = 0;
+  sim->mode = ~0u;
+  sim->doorbell_on = 0;
+}
+
+/* Mirrors AES_ring_post_user(), for n bytes of the job. The caller's
+ * buffers stand in for pinned pages that are never physically adjacent, so
+ * a descriptor ends wherever the source or the destination crosses a page;
+ * the buffer pool is contiguous, one descriptor for the lot. */
+static void sim_ring_post_user(struct aes_sim *sim, struct aes_sim_job *job,
+                               uint32_t n) {
+  const struct aes_job *desc = job->desc;
+  const uint8_t *src = (const uint8_t *)(uintptr_t)desc->src;
+  uint8_t *dst = (uint8_t *)(uintptr_t)desc->dst;
+  uint32_t end = job->offset + n, done, src_room, dst_room;
+  uint8_t iv[16];
+
+  if (!job->offset) {
+    job->status = 0;
+    job->ring_descs = 0;
+  }
+  memcpy(iv, desc->iv, sizeof(iv));
+  if (desc->mode == AES_MODE_CTR)
+    sim_ctr_add(iv, job->offset / AES_BLOCK_LEN);
+  job->ring_posted = 0;
+  while ((done = job->offset) < end) {
+    if (sim->ring_tail - sim->ring_head == SIM_RING_ENTRIES)
+      sim_ring_run(sim);
+    if (job->status)
+      break;
+    src_room = SIM_PAGE_SIZE - (uintptr_t)(src + done) % SIM_PAGE_SIZE;
+    dst_room = SIM_PAGE_SIZE - (uintptr_t)(dst + done) % SIM_PAGE_SIZE;
+    n = end - done;
+    if (n > src_room && !job->pooled)
+      n = src_room;
+    if (n > dst_room && !job->pooled)
+      n = dst_room;
+    sim_ring_post_desc(sim, job, src + done, dst + done, n, iv);
+    if (desc->mode == AES_MODE_CTR)
+      sim_ctr_add(iv, n / AES_BLOCK_LEN);
+    job->offset += n;
+  }
+  job->ring_posted = job->status || job->offset == desc->len;
+  if (job->ring_posted && !job->ring_descs) {
+    pthread_mutex_lock(&sim->lock);
+    sim_complete(sim, job);
+    pthread_mutex_unlock(&sim->lock);
+  }
+}
+
+/* Mirrors AES_ring_chunk_done(): run the chunk, then requeue the job or
+ * complete it if the chunk failed. Returns with the lock held. */
+static void sim_ring_chunk_done(struct aes_sim *sim, struct aes_sim_job *job) {
+  sim_ring_run(sim);
+  sim->hw_stats.chunks++;
+  pthread_mutex_lock(&sim->lock);
+  if (!job->status) {
+    sim_requeue(job);
+    return;
+  }
+  job->ring_posted = 1;
+  sim_complete(sim, job);
+}
+
+/* Mirrors AES_queue_work(): batch what the ring can run, and drain the
+ * batch before a job that has to go through the registers. A job runs a
+ * chunk at a time, going back on the queue after each but the last. */
+static void *sim_worker(void *arg) {
+  struct aes_sim *sim = arg;
+  struct aes_sim_job *job;
+  uint64_t idle_ns;
+  uint32_t n;
+
+  pthread_mutex_lock(&sim->lock);
+  while (!sim->stop) {
+    job = sim_dequeue(sim);
+    if (!job && sim->ring_head != sim->ring_tail) {
+      pthread_mutex_unlock(&sim->lock);
+      sim_ring_run(sim);
+      pthread_mutex_lock(&sim->lock);
+      continue;
+    }
+    if (!job) {
+      pthread_cond_wait(&sim->work_cv, &sim->lock);
+      continue;
+    }
+    idle_ns = sim->idle_ns;
+    sim->idle_ns = 0;
+    sim->now_ns = sim->hw_stats.modeled_ns;
+    pthread_mutex_unlock(&sim->lock);
+
+    /* Time with nothing to do, then the submitting thread's copies or
+     * pinning, charged as the worker picks the job up */
+    sim->hw_stats.modeled_ns += idle_ns;
+    if (!job->offset) {
+      sim->hw_stats.modeled_ns += job->host_ns;
+      if (job->buf)
+        sim->hw_stats.bytes_copied += job->buf_len +
+                                      (job->desc->mode == AES_MODE_CMAC
+                                           ? 0
+                                           : job->desc->len);
+    }
+    n = sim_job_chunk(sim, job);
+    if (!job->buf) {
+      sim_ring_post_user(sim, job, n);
+      if (!job->ring_posted) {
+        sim_ring_chunk_done(sim, job);
+        continue;
+      }
+      if (sim->ring_tail - sim->ring_head == SIM_RING_ENTRIES)
+        sim_ring_run(sim);
+      pthread_mutex_lock(&sim->lock);
+      continue;
+    }
+    if (sim->hw_ring && sim_ring_eligible(job, n)) {
+      sim_ring_post(sim, job, n);
+      if (!job->ring_posted) {
+        sim_ring_chunk_done(sim, job);
+        continue;
+      }
+      if (sim->ring_tail - sim->ring_head == SIM_RING_ENTRIES)
+        sim_ring_run(sim);
+      pthread_mutex_lock(&sim->lock);
+      continue;
+    }
+    sim_ring_run(sim);
+    job->status = sim_run_job(sim, job, n);
+    if (job->status && job->status != -EBADMSG)
+      sim->key_valid = 0;
+
+    pthread_mutex_lock(&sim->lock);
+    if (!job->status && job->offset < job->desc->len) {
+      sim->hw_stats.chunks++;
+      sim_requeue(job);
+      continue;
+    }
+    sim_complete(sim, job);
+  }
+  pthread_mutex_unlock(&sim->lock);
+  return NULL;
+}
+
+/*--------------------------------------------------------- API
+ * ---------------------------------------------------------*/
+
+/**
+ *  @brief: Create a simulated device with the default gateware parameters
+    @param: None
+    @result: Device, or NULL on failure
+*/
+struct aes_sim *aes_sim_create(void) {
+  struct aes_sim_config config = {.key_slots = AES_SIM_KEY_SLOTS_DEFAULT};
+
+  return aes_sim_create_config(&config);
+}
+
+/**
+ *  @brief: Create a simulated device and start its queue worker
+    @param: config
+    @result: Device, or NULL on failure
+*/
+struct aes_sim *aes_sim_create_config(const struct aes_sim_config *config) {
+  struct aes_sim *sim;
+
+  if (config->key_slots < 0 || config->key_slots > AES_SIM_KEY_SLOTS_MAX ||
+      config->irq_coalesce_count > IRQ_COUNT_MASK ||
+      config->ks_depth > 0xffff ||
+      (config->burst_width && config->burst_width != 64 &&
+       config->burst_width != 128))
+    return NULL;
+  sim = calloc(1, sizeof(*sim));
+  if (!sim)
+    return NULL;
+  pthread_mutex_init(&sim->lock, NULL);
+  pthread_cond_init(&sim->work_cv, NULL);
+  sim->hw_key_dirty = 1;
+  sim->hw_num_key_slots = config->key_slots;
+  sim->hw_doorbell = !config->no_doorbell;
+  sim->hw_banks = sim->hw_doorbell && !config->no_banks;
+  sim->hw_core_cycles = config->core_cycles ? config->core_cycles : 1;
+  sim->hw_ring = !config->no_ring;
+  sim->hw_burst_width = config->burst_width;
+  sim->regs[REG_KEY_SLOTS] = config->key_slots;
+  sim->regs[REG_CAPS] = (1u << AES_MODE_ECB) | (1u << AES_MODE_CTR) |
+                        (1u << AES_MODE_GCM) | (1u << AES_MODE_XTS) |
+                        (1u << AES_MODE_CMAC) | CAPS_DECRYPT | CAPS_CTX |
+                        CAPS_BYTE_ORDER;
+  /* Little-endian key and data words, as AES_probe() selects them */
+  sim->regs[REG_BYTE_ORDER] = BYTE_ORDER_LE;
+  if (sim->hw_doorbell)
+    sim->regs[REG_CAPS] |= CAPS_DOORBELL;
+  if (sim->hw_banks)
+    sim->regs[REG_CAPS] |= CAPS_BANKS;
+  if (sim->hw_ring)
+    sim->regs[REG_CAPS] |= CAPS_RING;
+  if (sim->hw_burst_width)
+    sim->regs[REG_CAPS] |= CAPS_WINDOW;
+  /* The keystream buffer on, as AES_probe() leaves it */
+  sim->hw_ks_depth = config->ks_depth;
+  if (sim->hw_ks_depth) {
+    sim->regs[REG_CAPS] |= CAPS_KS;
+    sim->regs[REG_KS_CTRL] = KS_CTRL_EN;
+  }
+  /* Tunables and the coalescing registers as AES_irq_init() leaves them */
+  sim->hw_irq = sim->hw_ring && !config->no_irq;
+  sim->ring_polling = 1;
+  sim->irq_coalesce_count = config->irq_coalesce_count
+                                ? config->irq_coalesce_count
+                                : SIM_IRQ_COALESCE_COUNT;
+  sim->irq_coalesce_usecs = config->irq_coalesce_usecs
+                                ? config->irq_coalesce_usecs
+                                : SIM_IRQ_COALESCE_USECS;
+  sim->irq_poll_threshold = config->irq_poll_threshold
+                                ? config->irq_poll_threshold
+                                : SIM_IRQ_POLL_THRESHOLD;
+  sim->zero_copy_min =
+      config->zero_copy_min ? config->zero_copy_min : SIM_ZERO_COPY_MIN;
+  sim->chunk_size = config->chunk_size ? config->chunk_size : SIM_CHUNK_SIZE;
+  sim->sched_edf = config->sched_edf;
+  if (sim->hw_irq) {
+    sim->regs[REG_CAPS] |= CAPS_IRQ;
+    sim->regs[REG_IRQ_COUNT] = sim->irq_count =
+        sim->irq_coalesce_count & IRQ_COUNT_MASK;
+    sim->regs[REG_IRQ_TIME] = sim->irq_coalesce_usecs * SIM_CLK_MHZ;
+  }
+  if (pthread_create(&sim->worker, NULL, sim_worker, sim)) {
+    free(sim);
+    return NULL;
+  }
+  return sim;
+}
+
+/**
+ *  @brief: Stop the worker and free the device. All clients must be released.
+    @param: sim
+    @result: None
+*/
+void aes_sim_destroy(struct aes_sim *sim) {
+  if (!sim)
+    return;
+  pthread_mutex_lock(&sim->lock);
+  sim->stop = 1;
+  pthread_cond_signal(&sim->work_cv);
+  pthread_mutex_unlock(&sim->lock);
+  pthread_join(sim->worker, NULL);
+  pthread_cond_destroy(&sim->work_cv);
+  pthread_mutex_destroy(&sim->lock);
+  free(sim);
+}
+
+/**
+ *  @brief: Open a client handle, the equivalent of open() on the device
+    @param: sim
+    @result: Client, or NULL when all slots are in use
+*/
+struct aes_sim_client *aes_sim_open(struct aes_sim *sim) {
+  struct aes_sim_client *client = calloc(1, sizeof(*client));
+
+  if (!client)
+    return NULL;
+  client->sim = sim;
+  client->prio = AES_PRIO_NORMAL;
+  pthread_mutex_lock(&sim->lock);
+  for (client->slot = 0; client->slot < AES_SIM_MAX_CLIENTS; client->slot++)
+    if (!sim->clients[client->slot])
+      break;
+  if (client->slot == AES_SIM_MAX_CLIENTS) {
+    pthread_mutex_unlock(&sim->lock);
+    free(client);
+    return NULL;
+  }
+  sim->clients[client->slot] = client;
+  pthread_mutex_unlock(&sim->lock);
+  return client;
+}
+
+/**
+ *  @brief: Close a client handle
+    @param: client
+    @result: None
+*/
+void aes_sim_release(struct aes_sim_client *client) {
+  struct aes_sim *sim;
+
+  if (!client)
+    return;
+  sim = client->sim;
+  pthread_mutex_lock(&sim->lock);
+  /* Mirrors AES_uring_free(): wait for queued jobs, drop their results */
+  while (client->uring && client->uring->running)
+    pthread_cond_wait(&client->uring->cv, &sim->lock);
+  sim->clients[client->slot] = NULL;
+  sim->buf_pool_bytes -= client->bufs_size;
+  pthread_mutex_unlock(&sim->lock);
+  free(client->bufs);
+  if (client->uring) {
+    for (struct aes_sim_job *job = client->uring->done_head, *next; job;
+         job = next) {
+      next = job->next;
+      free(job->buf);
+      free(job);
+    }
+    pthread_cond_destroy(&client->uring->cv);
+    free(client->uring->mem);
+    free(client->uring);
+  }
+  free(client->lat);
+  free(client);
+}
+
+/* Mirrors AES_zero_copy_eligible() */
+static int sim_zero_copy_eligible(struct aes_sim *sim,
+                                  const struct aes_job *job) {
+  return sim->hw_ring && job->len >= sim->zero_copy_min &&
+         (job->mode == AES_MODE_ECB || job->mode == AES_MODE_CTR) &&
+         !((job->src | job->dst) % AES_BLOCK_LEN) &&
+         (job->src == job->dst || job->src + job->len <= job->dst ||
+          job->dst + job->len <= job->src);
+}
+
+/* Mirrors AES_pool_eligible() */
+static int sim_pool_eligible(struct aes_sim_client *client,
+                             const struct aes_job *job) {
+  uint64_t base =
+      (uintptr_t)__atomic_load_n(&client->bufs, __ATOMIC_ACQUIRE);
+
+  return base && client->sim->hw_ring && job->len <= client->bufs_size &&
+         (job->mode == AES_MODE_ECB || job->mode == AES_MODE_CTR) &&
+         job->src >= base && job->src - base <= client->bufs_size - job->len &&
+         job->dst >= base && job->dst - base <= client->bufs_size - job->len &&
+         !((job->src | job->dst) % AES_BLOCK_LEN) &&
+         (job->src == job->dst || job->src + job->len <= job->dst ||
+          job->dst + job->len <= job->src);
+}
+
+/* Modelled cost of AES_pin_user() */
+static uint64_t sim_pin_ns(uint64_t addr, uint32_t len) {
+  uint64_t pages = (addr % SIM_PAGE_SIZE + len + SIM_PAGE_SIZE - 1) /
+                   SIM_PAGE_SIZE;
+
+  return AES_SIM_PIN_NS + pages * AES_SIM_PIN_NS_PER_PAGE;
+}
+
+/* Mirrors AES_submit_list(): queue jobs chained through next on their
+ * client, each in its class and due by its deadline, all at once, for the
+ * worker */
+static void sim_job_queue(struct aes_sim_client *client,
+                          struct aes_sim_job *sjob) {
+  struct aes_sim *sim = client->sim;
+  struct aes_sim_job *next;
+  uint32_t p, us;
+
+  pthread_mutex_lock(&sim->lock);
+  for (; sjob; sjob = next) {
+    next = sjob->next;
+    if (sjob->uring)
+      client->uring->running++;
+    p = sjob->desc->flags & AES_JOB_PRIO_HIGH ? AES_PRIO_HIGH : client->prio;
+    us = client->deadline_us ? client->deadline_us
+         : p == AES_PRIO_HIGH ? SIM_DEADLINE_HIGH_US
+                              : SIM_DEADLINE_NORMAL_US;
+    sjob->prio = p;
+    /* Idle time still to be charged passes before the job arrives */
+    sjob->submit_ns = sim->now_ns + sim->idle_ns;
+    sjob->deadline = sjob->submit_ns + (uint64_t)us * 1000;
+    sjob->offset = 0;
+    sjob->next = NULL;
+    if (client->tail[p])
+      client->tail[p]->next = sjob;
+    else
+      client->head[p] = sjob;
+    client->tail[p] = sjob;
+  }
+  pthread_cond_signal(&sim->work_cv);
+  pthread_mutex_unlock(&sim->lock);
+}
+
+/* Mirrors AES_user_job_start(): run from the buffer pool, pin for zero
+ * copy, or copy the input into a bounce buffer, then queue the job. Costs
+ * are charged as host_ns. */
+static int sim_job_start(struct aes_sim_client *client,
+                         struct aes_sim_job *sjob) {
+  struct aes_sim *sim = client->sim;
+  const struct aes_job *job = sjob->desc;
+
+  sjob->client = client;
+  sjob->next = NULL;
+  if (sim_pool_eligible(client, job)) {
+    sjob->pooled = 1;
+  } else if (sim_zero_copy_eligible(sim, job)) {
+    sjob->host_ns += sim_pin_ns(job->src, job->len) +
+                     (job->src == job->dst ? 0 : sim_pin_ns(job->dst, job->len));
+  } else {
+    sjob->buf_len = job->aad_len + job->len;
+    sjob->buf = malloc(sjob->buf_len + 1);
+    if (!sjob->buf)
+      return -ENOMEM;
+    sjob->host_ns +=
+        (sjob->buf_len + (job->mode == AES_MODE_CMAC ? 0 : job->len)) *
+        AES_SIM_COPY_NS_PER_KB / 1024;
+    if (job->aad_len)
+      memcpy(sjob->buf, (const void *)(uintptr_t)job->aad, job->aad_len);
+    if (job->len)
+      memcpy(sjob->buf + job->aad_len, (const void *)(uintptr_t)job->src,
+             job->len);
+    if (job->mode == AES_MODE_GCM && (job->flags & AES_JOB_DECRYPT))
+      memcpy(sjob->tag, (const void *)(uintptr_t)job->tag, AES_GCM_TAG_LEN);
+  }
+  sim_job_queue(client, sjob);
+  return 0;
+}
+
+/* Mirrors AES_user_job_finish(): copy the result back */
+static int sim_job_finish(struct aes_sim_job *sjob) {
+  const struct aes_job *job = sjob->desc;
+  int ret = sjob->status;
+
+  if (sjob->buf && !ret && job->len && job->mode != AES_MODE_CMAC)
+    memcpy((void *)(uintptr_t)job->dst, sjob->buf + job->aad_len, job->len);
+  if (sjob->buf && !ret &&
+      (job->mode == AES_MODE_CMAC ||
+       (job->mode == AES_MODE_GCM && !(job->flags & AES_JOB_DECRYPT))))
+    memcpy((void *)(uintptr_t)job->tag, sjob->tag, AES_GCM_TAG_LEN);
+  free(sjob->buf);
+  sjob->buf = NULL;
+  return ret;
+}
+
+/**
+ *  @brief: Run one job through the queue and wait for it, like AES_IOC_CRYPT
+    @param: client
+    @param: job
+    @result: 0, or a negative errno
+*/
+int aes_sim_submit(struct aes_sim_client *client, const struct aes_job *job) {
+  struct aes_sim *sim = client->sim;
+  struct aes_sim_job sjob = {.desc = job, .host_ns = AES_SIM_SYSCALL_NS};
+  int ret;
+
+  pthread_mutex_lock(&sim->lock);
+  sim->syscalls++;
+  pthread_mutex_unlock(&sim->lock);
+  if (!sim_job_valid(job))
+    return -EINVAL;
+
+  pthread_cond_init(&sjob.done_cv, NULL);
+  ret = sim_job_start(client, &sjob);
+  if (!ret) {
+    pthread_mutex_lock(&sim->lock);
+    while (!sjob.done)
+      pthread_cond_wait(&sjob.done_cv, &sim->lock);
+    pthread_mutex_unlock(&sim->lock);
+    ret = sim_job_finish(&sjob);
+  }
+  pthread_cond_destroy(&sjob.done_cv);
+  return ret;
+}
+
+/**
+ *  @brief: Create the submission and completion queues of a client, like
+    AES_IOC_URING_SETUP followed by mmap()
+    @param: client
+    @param: params (entries and flags in; offsets and size out)
+    @param: mem (the shared memory, freed by aes_sim_release())
+    @result: 0, or a negative errno
+*/
+int aes_sim_uring_setup(struct aes_sim_client *client,
+                        struct aes_uring_params *params, void **mem) {
+  struct sim_uring *u;
+
+  if (!params->entries || params->entries & (params->entries - 1) ||
+      params->entries > AES_URING_MAX_ENTRIES || params->flags)
+    return -EINVAL;
+  if (client->uring)
+    return -EBUSY;
+  params->sq_off = sizeof(struct aes_uring_hdr);
+  params->cq_off =
+      params->sq_off + params->entries * sizeof(struct aes_uring_sqe);
+  params->size = (params->cq_off +
+                  params->entries * sizeof(struct aes_uring_cqe) +
+                  SIM_PAGE_SIZE - 1) / SIM_PAGE_SIZE * SIM_PAGE_SIZE;
+  params->pad = 0;
+
+  u = calloc(1, sizeof(*u));
+  if (!u)
+    return -ENOMEM;
+  u->mem = calloc(1, params->size);
+  if (!u->mem) {
+    free(u);
+    return -ENOMEM;
+  }
+  u->entries = params->entries;
+  u->hdr = u->mem;
+  u->sqes = (struct aes_uring_sqe *)((uint8_t *)u->mem + params->sq_off);
+  u->cqes = (struct aes_uring_cqe *)((uint8_t *)u->mem + params->cq_off);
+  pthread_cond_init(&u->cv, NULL);
+  client->uring = u;
+  *mem = u->mem;
+  return 0;
+}
+
+/**
+ *  @brief: Allocate a client's DMA buffer pool, like AES_IOC_BUF_SETUP
+            followed by mmap()
+    @param: client
+    @param: size (bytes, a multiple of the page size up to AES_BUF_MAX_SIZE)
+    @param: mem (the pool, freed by aes_sim_release())
+    @result: 0, or a negative errno
+*/
+int aes_sim_buf_setup(struct aes_sim_client *client, size_t size,
+                      void **mem) {
+  struct aes_sim *sim = client->sim;
+  void *bufs;
+  int ret = 0;
+
+  if (!size || size % SIM_PAGE_SIZE || size > AES_BUF_MAX_SIZE)
+    return -EINVAL;
+  if (posix_memalign(&bufs, SIM_PAGE_SIZE, size))
+    return -ENOMEM;
+  memset(bufs, 0, size);
+
+  pthread_mutex_lock(&sim->lock);
+  sim->syscalls++;
+  if (client->bufs)
+    ret = -EBUSY;
+  else if (sim->buf_pool_bytes + size > SIM_BUF_POOL_MAX)
+    ret = -ENOSPC;
+  if (!ret) {
+    sim->buf_pool_bytes += size;
+    client->bufs_size = size;
+    __atomic_store_n(&client->bufs, bufs, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&sim->lock);
+  if (ret) {
+    free(bufs);
+    return ret;
+  }
+  *mem = bufs;
+  return 0;
+}
+
+/* Mirrors AES_uring_post() */
+static void sim_uring_post(struct aes_sim_client *client) {
+  struct sim_uring *u = client->uring;
+  struct aes_sim_job *job, *next;
+  struct aes_uring_cqe *cqe;
+
+  pthread_mutex_lock(&client->sim->lock);
+  job = u->done_head;
+  u->done_head = u->done_tail = NULL;
+  pthread_mutex_unlock(&client->sim->lock);
+  if (!job)
+    return;
+
+  for (; job; job = next) {
+    next = job->next;
+    cqe = &u->cqes[u->cq_tail % u->entries];
+    cqe->user_data = job->user_data;
+    cqe->res = sim_job_finish(job);
+    cqe->pad = 0;
+    free(job);
+    u->cq_tail++;
+    u->inflight--;
+  }
+  __atomic_store_n(&u->hdr->cq_tail, u->cq_tail, __ATOMIC_RELEASE);
+}
+
+/**
+ *  @brief: Take published submission queue entries and wait for
+    completions, like AES_IOC_URING_ENTER
+    @param: client
+    @param: enter
+    @result: Entries taken, or a negative errno
+*/
+int aes_sim_uring_enter(struct aes_sim_client *client,
+                        const struct aes_uring_enter *enter) {
+  struct aes_sim *sim = client->sim;
+  struct sim_uring *u = client->uring;
+  struct aes_sim_job *sjob;
+  uint32_t sq_tail, used;
+  int taken = 0, ret = 0, err;
+
+  if (!u)
+    return -ENXIO;
+  if (enter->min_complete > u->entries)
+    return -EINVAL;
+  pthread_mutex_lock(&sim->lock);
+  sim->syscalls++;
+  pthread_mutex_unlock(&sim->lock);
+
+  sim_uring_post(client);
+  sq_tail = __atomic_load_n(&u->hdr->sq_tail, __ATOMIC_ACQUIRE);
+  while ((uint32_t)taken < enter->to_submit && u->sq_head != sq_tail) {
+    used = u->cq_tail - __atomic_load_n(&u->hdr->cq_head, __ATOMIC_RELAXED);
+    if (used > u->entries)
+      used = u->entries;
+    if (u->inflight + used >= u->entries)
+      break;
+    sjob = calloc(1, sizeof(*sjob));
+    if (!sjob) {
+      ret = -ENOMEM;
+      break;
+    }
+    sjob->req = u->sqes[u->sq_head % u->entries].job;
+    sjob->user_data = u->sqes[u->sq_head % u->entries].user_data;
+    sjob->desc = &sjob->req;
+    sjob->uring = 1;
+    sjob->client = client;
+    /* The system call itself, charged to the first job it submits */
+    sjob->host_ns = taken ? 0 : AES_SIM_SYSCALL_NS;
+    u->sq_head++;
+    u->inflight++;
+    taken++;
+    /* Once started the job belongs to the worker until it completes */
+    err = sim_job_valid(&sjob->req) ? sim_job_start(client, sjob) : -EINVAL;
+    if (err) {
+      sjob->status = err;
+      pthread_mutex_lock(&sim->lock);
+      if (u->done_tail)
+        u->done_tail->next = sjob;
+      else
+        u->done_head = sjob;
+      u->done_tail = sjob;
+      pthread_mutex_unlock(&sim->lock);
+    }
+  }
+  __atomic_store_n(&u->hdr->sq_head, u->sq_head, __ATOMIC_RELEASE);
+
+  while (u->cq_tail - __atomic_load_n(&u->hdr->cq_head, __ATOMIC_RELAXED) <
+             enter->min_complete &&
+         u->inflight) {
+    pthread_mutex_lock(&sim->lock);
+    while (!u->done_head)
+      pthread_cond_wait(&u->cv, &sim->lock);
+    pthread_mutex_unlock(&sim->lock);
+    sim_uring_post(client);
+  }
+  return taken ? taken : ret;
+}
+
+/* Mirrors struct AES_batch_run */
+struct sim_batch_run {
+  struct aes_sim_job job;
+  uint32_t first, count;
+};
+
+/* Mirrors AES_batch_msg_check(); the model has every mode */
+static int sim_batch_msg_check(const struct aes_batch *batch,
+                               const struct aes_msg *msg) {
+  const struct aes_key *keys = (const struct aes_key *)(uintptr_t)batch->keys;
+
+  if (msg->key >= batch->nkeys ||
+      keys[msg->key].key_choice > AES_KEY_CHOICE_256 || !msg->len ||
+      msg->len > AES_BATCH_MAX_LEN)
+    return -EINVAL;
+  if (msg->mode == AES_MODE_ECB)
+    return msg->len % AES_BLOCK_LEN || (msg->flags & ~AES_JOB_DECRYPT)
+               ? -EINVAL
+               : 0;
+  return msg->mode == AES_MODE_CTR && !msg->flags ? 0 : -EINVAL;
+}
+
+static int sim_batch_cmp(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* Mirrors AES_batch_joins() */
+static int sim_batch_joins(const struct aes_msg *prev,
+                           const struct aes_msg *msg) {
+  uint8_t iv[16];
+
+  if (msg->key != prev->key || msg->mode != prev->mode ||
+      msg->flags != prev->flags)
+    return 0;
+  if (msg->mode == AES_MODE_ECB)
+    return 1;
+  if (prev->len % AES_BLOCK_LEN)
+    return 0;
+  memcpy(iv, prev->iv, sizeof(iv));
+  sim_ctr_add(iv, prev->len / AES_BLOCK_LEN);
+  return !memcmp(iv, msg->iv, sizeof(iv));
+}
+
+/**
+ *  @brief: Run a batch of small messages, like AES_IOC_BATCH: grouped by
+    key into runs that each go to the device as one job
+    @param: client
+    @param: batch (each message's status is written back)
+    @result: 0, or a negative errno
+*/
+int aes_sim_batch(struct aes_sim_client *client,
+                  const struct aes_batch *batch) {
+  const struct aes_key *keys = (const struct aes_key *)(uintptr_t)batch->keys;
+  struct aes_msg *msgs = (struct aes_msg *)(uintptr_t)batch->msgs;
+  struct sim_batch_run *runs = NULL, *run = NULL;
+  uint32_t i, r, n = 0, nruns = 0, off, len = 0;
+  struct aes_sim *sim = client->sim;
+  uint8_t *buf = NULL;
+  uint64_t *order;
+  struct aes_msg *msg;
+  int ret = 0;
+
+  pthread_mutex_lock(&sim->lock);
+  sim->syscalls++;
+  pthread_mutex_unlock(&sim->lock);
+  if (!batch->nkeys || batch->nkeys > AES_BATCH_MAX_KEYS || !batch->count ||
+      batch->count > AES_BATCH_MAX_MSGS)
+    return -EINVAL;
+
+  order = malloc(batch->count * sizeof(*order));
+  if (!order)
+    return -ENOMEM;
+  for (i = 0; i < batch->count; i++) {
+    msg = &msgs[i];
+    msg->status = sim_batch_msg_check(batch, msg);
+    if (msg->status)
+      continue;
+    len += (msg->len + AES_BLOCK_LEN - 1) / AES_BLOCK_LEN * AES_BLOCK_LEN;
+    order[n++] = (uint64_t)msg->key << 40 | (uint64_t)msg->mode << 36 |
+                 (uint64_t)msg->flags << 32 | i;
+  }
+  if (len > AES_BATCH_MAX_LEN) {
+    ret = -EINVAL;
+    goto out_free;
+  }
+  if (!n)
+    goto out_free;
+  qsort(order, n, sizeof(*order), sim_batch_cmp);
+
+  buf = malloc(len);
+  runs = calloc(n, sizeof(*runs));
+  if (!buf || !runs) {
+    ret = -ENOMEM;
+    goto out_free;
+  }
+  for (i = 0, off = 0; i < n; i++) {
+    msg = &msgs[(uint32_t)order[i]];
+    memcpy(buf + off, (const void *)(uintptr_t)msg->src, msg->len);
+    if (run && sim_batch_joins(&msgs[(uint32_t)order[i - 1]], msg)) {
+      run->count++;
+      run->job.req.len += msg->len;
+    } else {
+      run = &runs[nruns++];
+      run->first = i;
+      run->count = 1;
+      run->job.req.key_choice = keys[msg->key].key_choice;
+      memcpy(run->job.req.key, keys[msg->key].key, sizeof(run->job.req.key));
+      run->job.req.mode = msg->mode;
+      run->job.req.flags = msg->flags;
+      memcpy(run->job.req.iv, msg->iv, sizeof(run->job.req.iv));
+      run->job.req.len = msg->len;
+      run->job.buf = buf + off;
+    }
+    off += (msg->len + AES_BLOCK_LEN - 1) / AES_BLOCK_LEN * AES_BLOCK_LEN;
+  }
+
+  for (r = 0; r < nruns; r++) {
+    struct aes_sim_job *sjob = &runs[r].job;
+
+    sjob->desc = &sjob->req;
+    sjob->client = client;
+    sjob->buf_len = sjob->req.len;
+    /* Copying in and out, and the system call charged to the first run */
+    sjob->host_ns = 2 * sjob->buf_len * AES_SIM_COPY_NS_PER_KB / 1024 +
+                    (r ? 0 : AES_SIM_SYSCALL_NS);
+    pthread_cond_init(&sjob->done_cv, NULL);
+    sjob->next = r + 1 < nruns ? &runs[r + 1].job : NULL;
+  }
+  sim_job_queue(client, &runs[0].job);
+  pthread_mutex_lock(&sim->lock);
+  for (r = 0; r < nruns; r++)
+    while (!runs[r].job.done)
+      pthread_cond_wait(&runs[r].job.done_cv, &sim->lock);
+  pthread_mutex_unlock(&sim->lock);
+
+  for (r = 0; r < nruns; r++) {
+    run = &runs[r];
+    off = run->job.buf - buf;
+    for (i = run->first; i < run->first + run->count; i++) {
+      msg = &msgs[(uint32_t)order[i]];
+      msg->status = run->job.status;
+      if (!msg->status)
+        memcpy((void *)(uintptr_t)msg->dst, buf + off, msg->len);
+      off += (msg->len + AES_BLOCK_LEN - 1) / AES_BLOCK_LEN * AES_BLOCK_LEN;
+    }
+    pthread_cond_destroy(&run->job.done_cv);
+  }
+
+out_free:
+  free(runs);
+  free(buf);
+  free(order);
+  return ret;
+}
+
+/**
+ *  @brief: Read the device statistics as of the last completed job
+    @param: sim
+    @param: stats
+    @result: None
+*/
+void aes_sim_get_stats(struct aes_sim *sim, struct aes_sim_stats *stats) {
+  pthread_mutex_lock(&sim->lock);
+  *stats = sim->stats;
+  stats->syscalls = sim->syscalls;
+  pthread_mutex_unlock(&sim->lock);
+}
+
+/**
+ *  @brief: Let device time pass with no requests, as between bursts of
+            traffic; it is charged when the worker picks up the next job
+    @param: sim
+    @param: ns
+    @result: None
+*/
+void aes_sim_idle(struct aes_sim *sim, uint64_t ns) {
+  pthread_mutex_lock(&sim->lock);
+  sim->idle_ns += ns;
+  pthread_mutex_unlock(&sim->lock);
+}
+
+/**
+ *  @brief: Set the class and deadline of a client's later jobs, like
+            AES_IOC_SET_PRIO
+    @param: client
+    @param: prio (AES_PRIO_*)
+    @param: deadline_us (EDF: relative deadline, 0 for the class default)
+    @result: 0, or a negative errno
+*/
+int aes_sim_set_prio(struct aes_sim_client *client, uint32_t prio,
+                     uint32_t deadline_us) {
+  struct aes_sim *sim = client->sim;
+
+  if (prio >= AES_PRIO_CLASSES)
+    return -EINVAL;
+  pthread_mutex_lock(&sim->lock);
+  sim->syscalls++;
+  client->prio = prio;
+  client->deadline_us = deadline_us;
+  pthread_mutex_unlock(&sim->lock);
+  return 0;
+}
+
+/**
+ *  @brief: Take the device time from submission to completion of the
+            client's jobs completed since the last call, oldest first. A job
+            counts as submitted when the worker last picked up a job or
+            completed one, so one queued while a chunk runs waits for all of
+            it.
+    @param: client
+    @param: ns (filled with up to max samples; the rest are dropped)
+    @param: max
+    @result: Samples written
+*/
+size_t aes_sim_get_latencies(struct aes_sim_client *client, uint64_t *ns,
+                             size_t max) {
+  struct aes_sim *sim = client->sim;
+  size_t n;
+
+  pthread_mutex_lock(&sim->lock);
+  n = client->lat_count < max ? client->lat_count : max;
+  if (n)
+    memcpy(ns, client->lat, n * sizeof(*ns));
+  client->lat_count = 0;
+  pthread_mutex_unlock(&sim->lock);
+  return n;
+}
@@ -0,0 +1,294 @@
+#include "aes_soft.h"
+
+#include <pthread.h>
+#include <string.h>
+
+/* Four blocks as the eight 64-bit words the kernels transpose into bit
+ * planes: each block's little-endian 32-bit words spread two bytes to a
+ * 16-bit group, block i in words i and i + 4 */
+static void soft_load4(uint64_t q[8], const uint8_t *in) {
+  for (int i = 0; i < 4; i++) {
+    uint64_t x[4];
+
+    for (int j = 0; j < 4; j++) {
+      const uint8_t *b = in + 16 * i + 4 * j;
+
+      x[j] = (uint64_t)b[0] | (uint64_t)b[1] << 8 | (uint64_t)b[2] << 16 |
+             (uint64_t)b[3] << 24;
+      x[j] |= x[j] << 16;
+      x[j] &= 0x0000FFFF0000FFFF;
+      x[j] |= x[j] << 8;
+      x[j] &= 0x00FF00FF00FF00FF;
+    }
+    q[i] = x[0] | x[2] << 8;
+    q[i + 4] = x[1] | x[3] << 8;
+  }
+}
+
+static void soft_store4(uint8_t *out, const uint64_t q[8]) {
+  for (int i = 0; i < 4; i++) {
+    uint64_t x[4] = {q[i] & 0x00FF00FF00FF00FF, q[i + 4] & 0x00FF00FF00FF00FF,
+                     q[i] >> 8 & 0x00FF00FF00FF00FF,
+                     q[i + 4] >> 8 & 0x00FF00FF00FF00FF};
+
+    for (int j = 0; j < 4; j++) {
+      uint8_t *b = out + 16 * i + 4 * j;
+
+      x[j] |= x[j] >> 8;
+      x[j] &= 0x0000FFFF0000FFFF;
+      x[j] |= x[j] >> 16;
+      b[0] = (uint8_t)x[j];
+      b[1] = (uint8_t)(x[j] >> 8);
+      b[2] = (uint8_t)(x[j] >> 16);
+      b[3] = (uint8_t)(x[j] >> 24);
+    }
+  }
+}
+
+/* Plain 64-bit words: four blocks, and the key schedule's S-box */
+#define SOFT_LANES 1
+#define SOFT_NAME(x) soft_generic_##x
+#include "aes_soft_kernel.h"
+#undef SOFT_NAME
+#undef SOFT_LANES
+
+#if defined(__x86_64__) || defined(__SSE2__)
+#define SOFT_LANES 2
+#define SOFT_NAME(x) soft_sse2_##x
+#include "aes_soft_kernel.h"
+#undef SOFT_NAME
+#undef SOFT_LANES
+#endif
+
+/* Four lanes, one AVX2 register a word: eight lanes give the S-box more
+ * independent work but spill it out of the sixteen registers, and run slower */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define SOFT_AVX2 1
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define SOFT_LANES 4
+#define SOFT_NAME(x) soft_avx2_##x
+#include "aes_soft_kernel.h"
+#undef SOFT_NAME
+#undef SOFT_LANES
+#pragma GCC pop_options
+
+static int soft_avx2_usable(void) { return __builtin_cpu_supports("avx2"); }
+#endif
+
+#if defined(__ARM_NEON)
+#define SOFT_LANES 2
+#define SOFT_NAME(x) soft_neon_##x
+#include "aes_soft_kernel.h"
+#undef SOFT_NAME
+#undef SOFT_LANES
+#endif
+
+struct soft_kernel {
+  const char *name;
+  int blocks;
+  int (*usable)(void); // NULL when the build target guarantees it
+  void (*encrypt)(const uint64_t *sk, int rounds, const uint8_t *in,
+                  uint8_t *out);
+  void (*decrypt)(const uint64_t *sk, int rounds, const uint8_t *in,
+                  uint8_t *out);
+};
+
+/* Fastest first */
+static const struct soft_kernel soft_kernels[] = {
+#ifdef SOFT_AVX2
+    {"avx2", 16, soft_avx2_usable, soft_avx2_encrypt, soft_avx2_decrypt},
+#endif
+#if defined(__x86_64__) || defined(__SSE2__)
+    {"sse2", 8, NULL, soft_sse2_encrypt, soft_sse2_decrypt},
+#endif
+#if defined(__ARM_NEON)
+    {"neon", 8, NULL, soft_neon_encrypt, soft_neon_decrypt},
+#endif
+    {"generic", 4, NULL, soft_generic_encrypt, soft_generic_decrypt},
+};
+
+static pthread_once_t soft_once = PTHREAD_ONCE_INIT;
+static const struct soft_kernel *soft_cur;
+
+static void soft_init(void) {
+  const struct soft_kernel *k = soft_kernels;
+
+  while (k->usable && !k->usable())
+    k++;
+  __atomic_store_n(&soft_cur, k, __ATOMIC_RELAXED);
+}
+
+static const struct soft_kernel *soft_kernel(void) {
+  pthread_once(&soft_once, soft_init);
+  return __atomic_load_n(&soft_cur, __ATOMIC_RELAXED);
+}
+
+/**
+ *  @brief: Name the kernel in use: "avx2", "sse2", "neon" or "generic"
+    @param: None
+    @result: Kernel name
+*/
+const char *aes_soft_impl(void) { return soft_kernel()->name; }
+
+/**
+ *  @brief: Switch every later call to another kernel, for tests and
+    benchmarks; not to be called while other threads encrypt
+    @param: name (as aes_soft_impl() returns it, or NULL for the fastest)
+    @result: 0 on success, -1 if the kernel is not built or the CPU lacks it
+*/
+int aes_soft_set_impl(const char *name) {
+  size_t n = sizeof(soft_kernels) / sizeof(soft_kernels[0]);
+
+  pthread_once(&soft_once, soft_init);
+  if (!name) {
+    soft_init();
+    return 0;
+  }
+  for (size_t i = 0; i < n; i++) {
+    const struct soft_kernel *k = &soft_kernels[i];
+
+    if (!strcmp(k->name, name) && (!k->usable || k->usable())) {
+      __atomic_store_n(&soft_cur, k, __ATOMIC_RELAXED);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* SubWord of the key schedule, through the bitsliced S-box */
+static uint32_t soft_sub_word(uint32_t x) {
+  uint64_t q[8] = {x};
+
+  soft_generic_ortho(q);
+  soft_generic_sbox(q);
+  soft_generic_ortho(q);
+  return (uint32_t)q[0];
+}
+
+/**
+ *  @brief: Expand a 128/192/256-bit key into bitsliced round keys, in
+    constant time
+    @param: k
+    @param: key
+    @param: key_len (bytes)
+    @result: 0 on success, -1 for an unsupported key length
+*/
+int aes_soft_set_key(struct aes_soft_key *k, const uint8_t *key,
+                     int key_len) {
+  static const uint8_t rcon[10] = {0x01, 0x02, 0x04, 0x08, 0x10,
+                                   0x20, 0x40, 0x80, 0x1b, 0x36};
+  uint32_t w[4 * (AES_SOFT_MAX_ROUNDS + 1)], t;
+  int nk = key_len / 4, words;
+
+  if (key_len != 16 && key_len != 24 && key_len != 32)
+    return -1;
+
+  k->rounds = nk + 6;
+  words = 4 * (k->rounds + 1);
+  for (int i = 0; i < nk; i++)
+    w[i] = (uint32_t)key[4 * i] | (uint32_t)key[4 * i + 1] << 8 |
+           (uint32_t)key[4 * i + 2] << 16 | (uint32_t)key[4 * i + 3] << 24;
+  for (int i = nk; i < words; i++) {
+    t = w[i - 1];
+    if (i % nk == 0)
+      t = soft_sub_word(t << 24 | t >> 8) ^ rcon[i / nk - 1];
+    else if (nk > 6 && i % nk == 4)
+      t = soft_sub_word(t);
+    w[i] = w[i - nk] ^ t;
+  }
+
+  /* Each round key as the bit planes of four copies of itself */
+  for (int r = 0; r <= k->rounds; r++) {
+    uint8_t blocks[64];
+    uint64_t q[8];
+
+    for (int i = 0; i < 16; i++)
+      blocks[i] = (uint8_t)(w[4 * r + i / 4] >> 8 * (i % 4));
+    for (int j = 1; j < 4; j++)
+      memcpy(blocks + 16 * j, blocks, 16);
+    soft_load4(q, blocks);
+    soft_generic_ortho(q);
+    memcpy(&k->sk[8 * r], q, sizeof(q));
+  }
+  return 0;
+}
+
+/* Whole kernel calls straight through, the rest through a buffer */
+static void soft_ecb(const struct aes_soft_key *k, const uint8_t *in,
+                     uint8_t *out, size_t blocks, int decrypt) {
+  const struct soft_kernel *kern = soft_kernel();
+  void (*fn)(const uint64_t *, int, const uint8_t *, uint8_t *) =
+      decrypt ? kern->decrypt : kern->encrypt;
+  size_t n = kern->blocks;
+  uint8_t buf[16 * AES_SOFT_MAX_BLOCKS];
+
+  for (; blocks >= n; blocks -= n, in += 16 * n, out += 16 * n)
+    fn(k->sk, k->rounds, in, out);
+  if (blocks) {
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, in, 16 * blocks);
+    fn(k->sk, k->rounds, buf, buf);
+    memcpy(out, buf, 16 * blocks);
+  }
+}
+
+/**
+ *  @brief: Encrypt blocks in ECB mode
+    @param: k
+    @param: in
+    @param: out (may equal in)
+    @param: blocks
+    @result: None
+*/
+void aes_soft_encrypt(const struct aes_soft_key *k, const uint8_t *in,
+                      uint8_t *out, size_t blocks) {
+  soft_ecb(k, in, out, blocks, 0);
+}
+
+/**
+ *  @brief: Decrypt blocks in ECB mode
+    @param: k
+    @param: in
+    @param: out (may equal in)
+    @param: blocks
+    @result: None
+*/
+void aes_soft_decrypt(const struct aes_soft_key *k, const uint8_t *in,
+                      uint8_t *out, size_t blocks) {
+  soft_ecb(k, in, out, blocks, 1);
+}
+
+/**
+ *  @brief: CTR mode with a 128-bit big-endian counter, as aes_ref_ctr()
+    @param: k
+    @param: iv (initial counter block)
+    @param: in
+    @param: out (may equal in)
+    @param: len (bytes, any)
+    @result: None
+*/
+void aes_soft_ctr(const struct aes_soft_key *k, const uint8_t iv[16],
+                  const uint8_t *in, uint8_t *out, size_t len) {
+  const struct soft_kernel *kern = soft_kernel();
+  size_t chunk = 16 * (size_t)kern->blocks, n;
+  uint8_t ctr[16], ks[16 * AES_SOFT_MAX_BLOCKS];
+
+  memcpy(ctr, iv, 16);
+  for (size_t off = 0; off < len; off += n) {
+    n = len - off < chunk ? len - off : chunk;
+    for (size_t b = 0; b < chunk; b += 16) {
+      unsigned int carry = 1;
+
+      memcpy(ks + b, ctr, 16);
+      for (int i = 15; i >= 0; i--) {
+        carry += ctr[i];
+        ctr[i] = (uint8_t)carry;
+        carry >>= 8;
+      }
+    }
+    kern->encrypt(k->sk, k->rounds, ks, ks);
+    for (size_t i = 0; i < n; i++)
+      out[off + i] = in[off + i] ^ ks[i];
+  }
+}
@@ -0,0 +1,376 @@
+/*
+ * Bitsliced AES rounds, included by aes_soft.c once per kernel with
+ *   SOFT_LANES    64-bit lanes per word, each lane four blocks
+ *   SOFT_NAME(x)  the kernel's name for x
+ *
+ * The state of 4 * SOFT_LANES blocks is eight words, word i holding bit i
+ * of every byte: the S-box is the Boyar-Peralta circuit over the words and
+ * ShiftRows and MixColumns are shifts within a lane, so the rounds are the
+ * same operations for every lane and any vector width. Nothing depends on
+ * the key or the data but the values computed: no table lookups and no
+ * branches.
+ */
+
+#if SOFT_LANES == 1
+typedef uint64_t SOFT_NAME(word);
+#else
+typedef uint64_t SOFT_NAME(word)
+    __attribute__((vector_size(8 * SOFT_LANES), aligned(8)));
+#endif
+#define W SOFT_NAME(word)
+
+static inline void SOFT_NAME(sbox)(W *q) {
+  W x0, x1, x2, x3, x4, x5, x6, x7;
+  W y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11, y12, y13, y14, y15, y16,
+      y17, y18, y19, y20, y21;
+  W z0, z1, z2, z3, z4, z5, z6, z7, z8, z9, z10, z11, z12, z13, z14, z15,
+      z16, z17;
+  W t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12, t13, t14, t15,
+      t16, t17, t18, t19, t20, t21, t22, t23, t24, t25, t26, t27, t28, t29,
+      t30, t31, t32, t33, t34, t35, t36, t37, t38, t39, t40, t41, t42, t43,
+      t44, t45, t46, t47, t48, t49, t50, t51, t52, t53, t54, t55, t56, t57,
+      t58, t59, t60, t61, t62, t63, t64, t65, t66, t67;
+  W s0, s1, s2, s3, s4, s5, s6, s7;
+
+  x0 = q[7];
+  x1 = q[6];
+  x2 = q[5];
+  x3 = q[4];
+  x4 = q[3];
+  x5 = q[2];
+  x6 = q[1];
+  x7 = q[0];
+
+  /* Top linear transformation */
+  y14 = x3 ^ x5;
+  y13 = x0 ^ x6;
+  y9 = x0 ^ x3;
+  y8 = x0 ^ x5;
+  t0 = x1 ^ x2;
+  y1 = t0 ^ x7;
+  y4 = y1 ^ x3;
+  y12 = y13 ^ y14;
+  y2 = y1 ^ x0;
+  y5 = y1 ^ x6;
+  y3 = y5 ^ y8;
+  t1 = x4 ^ y12;
+  y15 = t1 ^ x5;
+  y20 = t1 ^ x1;
+  y6 = y15 ^ x7;
+  y10 = y15 ^ t0;
+  y11 = y20 ^ y9;
+  y7 = x7 ^ y11;
+  y17 = y10 ^ y11;
+  y19 = y10 ^ y8;
+  y16 = t0 ^ y11;
+  y21 = y13 ^ y16;
+  y18 = x0 ^ y16;
+
+  /* Inversion in GF(2^8) */
+  t2 = y12 & y15;
+  t3 = y3 & y6;
+  t4 = t3 ^ t2;
+  t5 = y4 & x7;
+  t6 = t5 ^ t2;
+  t7 = y13 & y16;
+  t8 = y5 & y1;
+  t9 = t8 ^ t7;
+  t10 = y2 & y7;
+  t11 = t10 ^ t7;
+  t12 = y9 & y11;
+  t13 = y14 & y17;
+  t14 = t13 ^ t12;
+  t15 = y8 & y10;
+  t16 = t15 ^ t12;
+  t17 = t4 ^ t14;
+  t18 = t6 ^ t16;
+  t19 = t9 ^ t14;
+  t20 = t11 ^ t16;
+  t21 = t17 ^ y20;
+  t22 = t18 ^ y19;
+  t23 = t19 ^ y21;
+  t24 = t20 ^ y18;
+
+  t25 = t21 ^ t22;
+  t26 = t21 & t23;
+  t27 = t24 ^ t26;
+  t28 = t25 & t27;
+  t29 = t28 ^ t22;
+  t30 = t23 ^ t24;
+  t31 = t22 ^ t26;
+  t32 = t31 & t30;
+  t33 = t32 ^ t24;
+  t34 = t23 ^ t33;
+  t35 = t27 ^ t33;
+  t36 = t24 & t35;
+  t37 = t36 ^ t34;
+  t38 = t27 ^ t36;
+  t39 = t29 & t38;
+  t40 = t25 ^ t39;
+
+  t41 = t40 ^ t37;
+  t42 = t29 ^ t33;
+  t43 = t29 ^ t40;
+  t44 = t33 ^ t37;
+  t45 = t42 ^ t41;
+  z0 = t44 & y15;
+  z1 = t37 & y6;
+  z2 = t33 & x7;
+  z3 = t43 & y16;
+  z4 = t40 & y1;
+  z5 = t29 & y7;
+  z6 = t42 & y11;
+  z7 = t45 & y17;
+  z8 = t41 & y10;
+  z9 = t44 & y12;
+  z10 = t37 & y3;
+  z11 = t33 & y4;
+  z12 = t43 & y13;
+  z13 = t40 & y5;
+  z14 = t29 & y2;
+  z15 = t42 & y9;
+  z16 = t45 & y14;
+  z17 = t41 & y8;
+
+  /* Bottom linear transformation */
+  t46 = z15 ^ z16;
+  t47 = z10 ^ z11;
+  t48 = z5 ^ z13;
+  t49 = z9 ^ z10;
+  t50 = z2 ^ z12;
+  t51 = z2 ^ z5;
+  t52 = z7 ^ z8;
+  t53 = z0 ^ z3;
+  t54 = z6 ^ z7;
+  t55 = z16 ^ z17;
+  t56 = z12 ^ t48;
+  t57 = t50 ^ t53;
+  t58 = z4 ^ t46;
+  t59 = z3 ^ t54;
+  t60 = t46 ^ t57;
+  t61 = z14 ^ t57;
+  t62 = t52 ^ t58;
+  t63 = t49 ^ t58;
+  t64 = z4 ^ t59;
+  t65 = t61 ^ t62;
+  t66 = z1 ^ t63;
+  s0 = t59 ^ t63;
+  s6 = t56 ^ ~t62;
+  s7 = t48 ^ ~t60;
+  t67 = t64 ^ t65;
+  s3 = t53 ^ t66;
+  s4 = t51 ^ t66;
+  s5 = t47 ^ t65;
+  s1 = t64 ^ ~s3;
+  s2 = t55 ^ ~t67;
+
+  q[7] = s0;
+  q[6] = s1;
+  q[5] = s2;
+  q[4] = s3;
+  q[3] = s4;
+  q[2] = s5;
+  q[1] = s6;
+  q[0] = s7;
+}
+
+/* The inverse S-box is the forward one between two inverse affine maps */
+static inline void SOFT_NAME(inv_affine)(W *q) {
+  W q0 = ~q[0], q1 = ~q[1], q2 = q[2], q3 = q[3], q4 = q[4], q5 = ~q[5],
+    q6 = ~q[6], q7 = q[7];
+
+  q[7] = q1 ^ q4 ^ q6;
+  q[6] = q0 ^ q3 ^ q5;
+  q[5] = q7 ^ q2 ^ q4;
+  q[4] = q6 ^ q1 ^ q3;
+  q[3] = q5 ^ q0 ^ q2;
+  q[2] = q4 ^ q7 ^ q1;
+  q[1] = q3 ^ q6 ^ q0;
+  q[0] = q2 ^ q5 ^ q7;
+}
+
+static inline void SOFT_NAME(inv_sbox)(W *q) {
+  SOFT_NAME(inv_affine)(q);
+  SOFT_NAME(sbox)(q);
+  SOFT_NAME(inv_affine)(q);
+}
+
+/* Transpose between the eight words of the loaded blocks and bit planes */
+static inline void SOFT_NAME(ortho)(W *q) {
+#define SOFT_SWAP(cl, ch, s, x, y)                                            \
+  do {                                                                        \
+    W a = (x), b = (y);                                                       \
+    (x) = (a & (uint64_t)(cl)) | ((b & (uint64_t)(cl)) << (s));               \
+    (y) = ((a & (uint64_t)(ch)) >> (s)) | (b & (uint64_t)(ch));               \
+  } while (0)
+#define SOFT_SWAP2(x, y)                                                      \
+  SOFT_SWAP(0x5555555555555555, 0xAAAAAAAAAAAAAAAA, 1, x, y)
+#define SOFT_SWAP4(x, y)                                                      \
+  SOFT_SWAP(0x3333333333333333, 0xCCCCCCCCCCCCCCCC, 2, x, y)
+#define SOFT_SWAP8(x, y)                                                      \
+  SOFT_SWAP(0x0F0F0F0F0F0F0F0F, 0xF0F0F0F0F0F0F0F0, 4, x, y)
+
+  SOFT_SWAP2(q[0], q[1]);
+  SOFT_SWAP2(q[2], q[3]);
+  SOFT_SWAP2(q[4], q[5]);
+  SOFT_SWAP2(q[6], q[7]);
+  SOFT_SWAP4(q[0], q[2]);
+  SOFT_SWAP4(q[1], q[3]);
+  SOFT_SWAP4(q[4], q[6]);
+  SOFT_SWAP4(q[5], q[7]);
+  SOFT_SWAP8(q[0], q[4]);
+  SOFT_SWAP8(q[1], q[5]);
+  SOFT_SWAP8(q[2], q[6]);
+  SOFT_SWAP8(q[3], q[7]);
+
+#undef SOFT_SWAP8
+#undef SOFT_SWAP4
+#undef SOFT_SWAP2
+#undef SOFT_SWAP
+}
+
+static inline void SOFT_NAME(add_round_key)(W *q, const uint64_t *sk) {
+  for (int i = 0; i < 8; i++)
+    q[i] ^= sk[i];
+}
+
+static inline void SOFT_NAME(shift_rows)(W *q) {
+  for (int i = 0; i < 8; i++) {
+    W x = q[i];
+
+    q[i] = (x & 0x000000000000FFFF) | ((x & 0x00000000FFF00000) >> 4) |
+           ((x & 0x00000000000F0000) << 12) |
+           ((x & 0x0000FF0000000000) >> 8) |
+           ((x & 0x000000FF00000000) << 8) |
+           ((x & 0xF000000000000000) >> 12) |
+           ((x & 0x0FFF000000000000) << 4);
+  }
+}
+
+static inline void SOFT_NAME(inv_shift_rows)(W *q) {
+  for (int i = 0; i < 8; i++) {
+    W x = q[i];
+
+    q[i] = (x & 0x000000000000FFFF) | ((x & 0x000000000FFF0000) << 4) |
+           ((x & 0x00000000F0000000) >> 12) |
+           ((x & 0x000000FF00000000) << 8) |
+           ((x & 0x0000FF0000000000) >> 8) |
+           ((x & 0x000F000000000000) << 12) |
+           ((x & 0xFFF0000000000000) >> 4);
+  }
+}
+
+#define SOFT_ROTR32(x) ((x) << 32 | (x) >> 32)
+
+static inline void SOFT_NAME(mix_columns)(W *q) {
+  W r[8], p[8];
+
+  for (int i = 0; i < 8; i++) {
+    p[i] = q[i];
+    r[i] = (p[i] >> 16) | (p[i] << 48);
+  }
+  q[0] = p[7] ^ r[7] ^ r[0] ^ SOFT_ROTR32(p[0] ^ r[0]);
+  q[1] = p[0] ^ r[0] ^ p[7] ^ r[7] ^ r[1] ^ SOFT_ROTR32(p[1] ^ r[1]);
+  q[2] = p[1] ^ r[1] ^ r[2] ^ SOFT_ROTR32(p[2] ^ r[2]);
+  q[3] = p[2] ^ r[2] ^ p[7] ^ r[7] ^ r[3] ^ SOFT_ROTR32(p[3] ^ r[3]);
+  q[4] = p[3] ^ r[3] ^ p[7] ^ r[7] ^ r[4] ^ SOFT_ROTR32(p[4] ^ r[4]);
+  q[5] = p[4] ^ r[4] ^ r[5] ^ SOFT_ROTR32(p[5] ^ r[5]);
+  q[6] = p[5] ^ r[5] ^ r[6] ^ SOFT_ROTR32(p[6] ^ r[6]);
+  q[7] = p[6] ^ r[6] ^ r[7] ^ SOFT_ROTR32(p[7] ^ r[7]);
+}
+
+static inline void SOFT_NAME(inv_mix_columns)(W *q) {
+  W q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3], q4 = q[4], q5 = q[5],
+    q6 = q[6], q7 = q[7];
+  W r0 = (q0 >> 16) | (q0 << 48), r1 = (q1 >> 16) | (q1 << 48),
+    r2 = (q2 >> 16) | (q2 << 48), r3 = (q3 >> 16) | (q3 << 48),
+    r4 = (q4 >> 16) | (q4 << 48), r5 = (q5 >> 16) | (q5 << 48),
+    r6 = (q6 >> 16) | (q6 << 48), r7 = (q7 >> 16) | (q7 << 48);
+
+  q[0] = q5 ^ q6 ^ q7 ^ r0 ^ r5 ^ r7 ^
+         SOFT_ROTR32(q0 ^ q5 ^ q6 ^ r0 ^ r5);
+  q[1] = q0 ^ q5 ^ r0 ^ r1 ^ r5 ^ r6 ^ r7 ^
+         SOFT_ROTR32(q1 ^ q5 ^ q7 ^ r1 ^ r5 ^ r6);
+  q[2] = q0 ^ q1 ^ q6 ^ r1 ^ r2 ^ r6 ^ r7 ^
+         SOFT_ROTR32(q0 ^ q2 ^ q6 ^ r2 ^ r6 ^ r7);
+  q[3] = q0 ^ q1 ^ q2 ^ q5 ^ q6 ^ r0 ^ r2 ^ r3 ^ r5 ^
+         SOFT_ROTR32(q0 ^ q1 ^ q3 ^ q5 ^ q6 ^ q7 ^ r0 ^ r3 ^ r5 ^ r7);
+  q[4] = q1 ^ q2 ^ q3 ^ q5 ^ r1 ^ r3 ^ r4 ^ r5 ^ r6 ^ r7 ^
+         SOFT_ROTR32(q1 ^ q2 ^ q4 ^ q5 ^ q7 ^ r1 ^ r4 ^ r5 ^ r6);
+  q[5] = q2 ^ q3 ^ q4 ^ q6 ^ r2 ^ r4 ^ r5 ^ r6 ^ r7 ^
+         SOFT_ROTR32(q2 ^ q3 ^ q5 ^ q6 ^ r2 ^ r5 ^ r6 ^ r7);
+  q[6] = q3 ^ q4 ^ q5 ^ q7 ^ r3 ^ r5 ^ r6 ^ r7 ^
+         SOFT_ROTR32(q3 ^ q4 ^ q6 ^ q7 ^ r3 ^ r6 ^ r7);
+  q[7] = q4 ^ q5 ^ q6 ^ r4 ^ r6 ^ r7 ^
+         SOFT_ROTR32(q4 ^ q5 ^ q7 ^ r4 ^ r7);
+}
+
+/* Load 4 * SOFT_LANES blocks into bit planes, lane l from blocks 4l..4l+3 */
+static inline void SOFT_NAME(load)(W *q, const uint8_t *in) {
+  uint64_t w[8][SOFT_LANES];
+
+  for (int l = 0; l < SOFT_LANES; l++) {
+    uint64_t x[8];
+
+    soft_load4(x, in + 64 * l);
+    for (int i = 0; i < 8; i++)
+      w[i][l] = x[i];
+  }
+  memcpy(q, w, sizeof(w));
+  SOFT_NAME(ortho)(q);
+}
+
+static inline void SOFT_NAME(store)(W *q, uint8_t *out) {
+  uint64_t w[8][SOFT_LANES];
+
+  SOFT_NAME(ortho)(q);
+  memcpy(w, q, sizeof(w));
+  for (int l = 0; l < SOFT_LANES; l++) {
+    uint64_t x[8];
+
+    for (int i = 0; i < 8; i++)
+      x[i] = w[i][l];
+    soft_store4(out + 64 * l, x);
+  }
+}
+
+/* Encrypt 4 * SOFT_LANES blocks; out may equal in */
+static void SOFT_NAME(encrypt)(const uint64_t *sk, int rounds,
+                               const uint8_t *in, uint8_t *out) {
+  W q[8];
+
+  SOFT_NAME(load)(q, in);
+  SOFT_NAME(add_round_key)(q, sk);
+  for (int r = 1; r < rounds; r++) {
+    SOFT_NAME(sbox)(q);
+    SOFT_NAME(shift_rows)(q);
+    SOFT_NAME(mix_columns)(q);
+    SOFT_NAME(add_round_key)(q, sk + 8 * r);
+  }
+  SOFT_NAME(sbox)(q);
+  SOFT_NAME(shift_rows)(q);
+  SOFT_NAME(add_round_key)(q, sk + 8 * rounds);
+  SOFT_NAME(store)(q, out);
+}
+
+/* Decrypt 4 * SOFT_LANES blocks; out may equal in */
+static void SOFT_NAME(decrypt)(const uint64_t *sk, int rounds,
+                               const uint8_t *in, uint8_t *out) {
+  W q[8];
+
+  SOFT_NAME(load)(q, in);
+  SOFT_NAME(add_round_key)(q, sk + 8 * rounds);
+  for (int r = rounds - 1; r > 0; r--) {
+    SOFT_NAME(inv_shift_rows)(q);
+    SOFT_NAME(inv_sbox)(q);
+    SOFT_NAME(add_round_key)(q, sk + 8 * r);
+    SOFT_NAME(inv_mix_columns)(q);
+  }
+  SOFT_NAME(inv_shift_rows)(q);
+  SOFT_NAME(inv_sbox)(q);
+  SOFT_NAME(add_round_key)(q, sk);
+  SOFT_NAME(store)(q, out);
+}
+
+#undef SOFT_ROTR32
+#undef W
@@ -0,0 +1,267 @@
+#define _DEFAULT_SOURCE
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/params.h>
+#include <openssl/provider.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Tests of the aesaccel OpenSSL provider (aes_prov.c) against the default
+ * provider. usage: test_aes_prov [directory holding aesaccel.so]
+ */
+
+#define MAX_LEN 4096
+
+static const char *const names[] = {
+    "AES-128-ECB", "AES-192-ECB", "AES-256-ECB", "AES-128-CBC",
+    "AES-192-CBC", "AES-256-CBC", "AES-128-CTR", "AES-192-CTR",
+    "AES-256-CTR", "AES-128-GCM", "AES-192-GCM", "AES-256-GCM"};
+#define NCIPHERS (int)(sizeof(names) / sizeof(names[0]))
+
+static const char *prov_dir = ".";
+static OSSL_LIB_CTX *deflt_ctx;
+
+/* A library context with aesaccel loaded on the given device */
+static OSSL_LIB_CTX *load_accel(const char *device, const char *max_inflight) {
+    OSSL_LIB_CTX *ctx = OSSL_LIB_CTX_new();
+
+    setenv("AES_PROVIDER_DEVICE", device, 1);
+    if (max_inflight)
+        setenv("AES_PROVIDER_MAX_INFLIGHT", max_inflight, 1);
+    else
+        unsetenv("AES_PROVIDER_MAX_INFLIGHT");
+    if (!ctx || !OSSL_PROVIDER_set_default_search_path(ctx, prov_dir) ||
+        !OSSL_PROVIDER_load(ctx, "aesaccel")) {
+        OSSL_LIB_CTX_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/* One message in updates of pseudo-random sizes. GCM takes the AAD in two
+ * pieces and writes or checks the tag. Returns the output length or -1. */
+static int run(EVP_CIPHER *cipher, int enc, const unsigned char *key,
+               const unsigned char *iv, int ivlen, const unsigned char *in,
+               unsigned char *out, int len, unsigned char *tag,
+               unsigned int seed) {
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    int gcm = EVP_CIPHER_get_mode(cipher) == EVP_CIPH_GCM_MODE;
+    int total = 0, n, ok;
+    unsigned char aad[37];
+
+    for (int i = 0; i < (int)sizeof(aad); i++)
+        aad[i] = (unsigned char)(i * 7);
+    ok = ctx && EVP_CipherInit_ex2(ctx, cipher, NULL, NULL, enc, NULL);
+    if (ok && gcm)
+        ok = EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, ivlen, NULL);
+    ok = ok && EVP_CipherInit_ex2(ctx, NULL, key, iv, enc, NULL);
+    if (ok && gcm) {
+        ok = EVP_CipherUpdate(ctx, NULL, &n, aad, 5) &&
+             EVP_CipherUpdate(ctx, NULL, &n, aad + 5, sizeof(aad) - 5);
+        if (ok && !enc)
+            ok = EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, 16, tag);
+    }
+    while (ok && len) {
+        int chunk = 1 + rand_r(&seed) % 700;
+
+        if (chunk > len)
+            chunk = len;
+        ok = EVP_CipherUpdate(ctx, out + total, &n, in, chunk);
+        total += n;
+        in += chunk;
+        len -= chunk;
+    }
+    ok = ok && EVP_CipherFinal_ex(ctx, out + total, &n);
+    total += ok ? n : 0;
+    if (ok && gcm && enc)
+        ok = EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, 16, tag);
+    EVP_CIPHER_CTX_free(ctx);
+    return ok ? total : -1;
+}
+
+/* Every cipher and key size, lengths 0 to MAX_LEN, both ways against the
+ * default provider; decryption in place */
+static int check_all(OSSL_LIB_CTX *accel, unsigned int seed) {
+    unsigned char *in = malloc(3 * MAX_LEN + 32), *ref = in + MAX_LEN,
+                  *out = ref + MAX_LEN + 16;
+    unsigned char key[32], iv[64], tag[16], ref_tag[16];
+    int ok = in != NULL;
+
+    for (int i = 0; ok && i < MAX_LEN; i++)
+        in[i] = (unsigned char)rand_r(&seed);
+    for (int c = 0; c < NCIPHERS && ok; c++) {
+        EVP_CIPHER *a = EVP_CIPHER_fetch(accel, names[c], NULL);
+        EVP_CIPHER *d = EVP_CIPHER_fetch(deflt_ctx, names[c], NULL);
+        int gcm = c >= 9;
+
+        ok = a && d;
+        for (int t = 0; t < 24 && ok; t++) {
+            int len = t < 4 ? t * 16 : rand_r(&seed) % MAX_LEN;
+            int ivlen = gcm && t % 3 == 1 ? 8 + t : gcm ? 12 : 16;
+            int n;
+
+            if (c < 3 || (c < 6 && t % 2))
+                len -= len % 16;
+            for (int i = 0; i < 32; i++)
+                key[i] = (unsigned char)rand_r(&seed);
+            for (int i = 0; i < 64; i++)
+                iv[i] = (unsigned char)rand_r(&seed);
+            /* CTR: carry out of the counter's low 64 bits */
+            if (t == 5 && !gcm)
+                memset(iv + 8, 0xff, 8);
+            n = run(d, 1, key, iv, ivlen, in, ref, len, ref_tag, seed);
+            ok = n >= 0 &&
+                 run(a, 1, key, iv, ivlen, in, out, len, tag, seed + 1) == n &&
+                 !memcmp(out, ref, n) && (!gcm || !memcmp(tag, ref_tag, 16));
+            ok = ok &&
+                 run(a, 0, key, iv, ivlen, out, out, n, tag, seed + 2) ==
+                     len &&
+                 !memcmp(out, in, len);
+        }
+        EVP_CIPHER_free(a);
+        EVP_CIPHER_free(d);
+    }
+    free(in);
+    return ok;
+}
+
+struct worker {
+    OSSL_LIB_CTX *accel;
+    unsigned int seed;
+    int ok;
+};
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+
+    w->ok = check_all(w->accel, w->seed);
+    return NULL;
+}
+
+/* A TLS 1.2 record: fixed IV, explicit IV, AAD through TLS1_AAD, whose
+ * length is of the record without its tag when encrypting, with it when not */
+static int tls_record(EVP_CIPHER *cipher, int enc, unsigned char *buf,
+                      int len) {
+    static const unsigned char key[16] = {1, 2, 3};
+    unsigned char fixed[4] = {9, 8, 7, 6}, aad[13] = {0};
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    int n = -1;
+
+    aad[11] = (unsigned char)((len - (enc ? 16 : 0)) >> 8);
+    aad[12] = (unsigned char)(len - (enc ? 16 : 0));
+    if (ctx && EVP_CipherInit_ex2(ctx, cipher, key, NULL, enc, NULL) &&
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IV_FIXED, 4, fixed) > 0 &&
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_TLS1_AAD, 13, aad) == 16)
+        n = EVP_Cipher(ctx, buf, buf, len);
+    EVP_CIPHER_CTX_free(ctx);
+    return n;
+}
+
+int main(int argc, char **argv) {
+    int passed = 0, failed = 0;
+    OSSL_LIB_CTX *sim, *none, *busy;
+    int ok;
+
+    if (argc > 1)
+        prov_dir = argv[1];
+    deflt_ctx = OSSL_LIB_CTX_new();
+    OSSL_PROVIDER_load(deflt_ctx, "default");
+    sim = load_accel("sim", NULL);
+    none = load_accel("none", NULL);
+    busy = load_accel("sim:2", "1");
+
+    // Test 1: The provider loads and offers every cipher
+    ok = sim && none && busy;
+    for (int c = 0; c < NCIPHERS && ok; c++) {
+        EVP_CIPHER *a = EVP_CIPHER_fetch(sim, names[c], "provider=aesaccel");
+
+        ok = a != NULL;
+        EVP_CIPHER_free(a);
+    }
+    if (ok) {
+        printf("Test 1 PASS\n"); passed++;
+    }
+    else {
+        printf("Test 1 FAIL\n"); failed++;
+    }
+
+    // Test 2: Simulated device matches the default provider, all modes
+    if (sim && check_all(sim, 1)) {
+        printf("Test 2 PASS\n"); passed++;
+    }
+    else {
+        printf("Test 2 FAIL\n"); failed++;
+    }
+
+    // Test 3: Without a device everything falls back to the default provider
+    if (none && check_all(none, 2)) {
+        printf("Test 3 PASS\n"); passed++;
+    }
+    else {
+        printf("Test 3 FAIL\n"); failed++;
+    }
+
+    // Test 4: A busy device sends the overflow to the default provider
+    ok = busy != NULL;
+    if (ok) {
+        struct worker w[4];
+        pthread_t th[4];
+
+        for (int i = 0; i < 4; i++) {
+            w[i] = (struct worker){busy, 10 + i, 0};
+            pthread_create(&th[i], NULL, worker_main, &w[i]);
+        }
+        for (int i = 0; i < 4; i++) {
+            pthread_join(th[i], NULL);
+            ok &= w[i].ok;
+        }
+    }
+    if (ok) {
+        printf("Test 4 PASS\n"); passed++;
+    }
+    else {
+        printf("Test 4 FAIL\n"); failed++;
+    }
+
+    // Test 5: GCM tag rejection, and TLS 1.2 records handed over whole
+    ok = sim != NULL;
+    if (ok) {
+        EVP_CIPHER *a = EVP_CIPHER_fetch(sim, "AES-128-GCM", NULL);
+        EVP_CIPHER *d = EVP_CIPHER_fetch(deflt_ctx, "AES-128-GCM", NULL);
+        unsigned char key[16] = {0}, iv[12] = {0}, in[100] = {0}, out[100],
+                      tag[16], rec[124], ref[124];
+
+        ok = a && d &&
+             run(a, 1, key, iv, 12, in, out, sizeof(in), tag, 5) ==
+                 (int)sizeof(in);
+        tag[3] ^= 1;
+        ok = ok && run(a, 0, key, iv, 12, out, out, sizeof(in), tag, 6) < 0;
+        /* Explicit IVs are random, so each side opens the other's record */
+        for (int i = 0; i < (int)sizeof(rec); i++)
+            rec[i] = ref[i] = (unsigned char)i;
+        ok = ok && tls_record(a, 1, rec, sizeof(rec)) == (int)sizeof(rec) &&
+             tls_record(d, 1, ref, sizeof(ref)) == (int)sizeof(ref) &&
+             tls_record(d, 0, rec, sizeof(rec)) == (int)sizeof(rec) &&
+             tls_record(a, 0, ref, sizeof(ref)) == (int)sizeof(ref);
+        for (int i = 8; ok && i < 108; i++)
+            ok = rec[i] == (unsigned char)i && ref[i] == (unsigned char)i;
+        EVP_CIPHER_free(a);
+        EVP_CIPHER_free(d);
+    }
+    if (ok) {
+        printf("Test 5 PASS\n"); passed++;
+    }
+    else {
+        printf("Test 5 FAIL\n"); failed++;
+    }
+
+    OSSL_LIB_CTX_free(sim);
+    OSSL_LIB_CTX_free(none);
+    OSSL_LIB_CTX_free(busy);
+    OSSL_LIB_CTX_free(deflt_ctx);
+    printf("Summary: %d PASS, %d FAIL\n", passed, failed);
+    return failed;
+}